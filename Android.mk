@@ -7,11 +7,19 @@ YOSAL_SRC_FILES += src/base64/cencode.c
 YOSAL_SRC_FILES += src/base64/base64.c
 YOSAL_SRC_FILES += src/core/yalloc.c
 YOSAL_SRC_FILES += src/core/ybuffer.c
+YOSAL_SRC_FILES += src/core/ydtoa.c
+YOSAL_SRC_FILES += src/core/ypool.c
+YOSAL_SRC_FILES += src/core/ythreadpool.c
 YOSAL_SRC_FILES += src/hash/lookup3.c
 YOSAL_SRC_FILES += src/hash/fnv1.c
 YOSAL_SRC_FILES += src/struct/array.c
 YOSAL_SRC_FILES += src/struct/hashmap.c
 YOSAL_SRC_FILES += src/struct/queue.c
+YOSAL_SRC_FILES += src/struct/queue_concurrent.c
+YOSAL_SRC_FILES += src/struct/yring.c
+YOSAL_SRC_FILES += src/struct/yheap.c
+YOSAL_SRC_FILES += src/struct/ytimerwheel.c
+YOSAL_SRC_FILES += src/struct/ysort.c
 YOSAL_SRC_FILES += src/struct/yobject.c
 YOSAL_SRC_FILES += src/digest/digest_md5.c
 YOSAL_SRC_FILES += src/digest/digest_sha1.c
@@ -20,6 +28,11 @@ YOSAL_SRC_FILES += src/io/ychannel.c
 YOSAL_SRC_FILES += src/io/engine/fd.c
 YOSAL_SRC_FILES += src/io/engine/file.c
 YOSAL_SRC_FILES += src/io/engine/javastream.c
+YOSAL_SRC_FILES += src/io/engine/javanio.c
+YOSAL_SRC_FILES += src/io/engine/digest.c
+YOSAL_SRC_FILES += src/io/engine/memory.c
+YOSAL_SRC_FILES += src/io/engine/shared.c
+YOSAL_SRC_FILES += src/io/engine/pipe.c
 YOSAL_SRC_FILES += src/java/jniutils.c
 YOSAL_SRC_FILES += src/system/log.c
 YOSAL_SRC_FILES += src/system/system.c
@@ -54,6 +54,19 @@ YArray_create();
 YArray*
 YArray_createLength(int initlength);
 
+/**
+ * Creates a new YArray whose memory is allocated from an arena. It is
+ * released along with the arena, YArray_release only releasing elements
+ * if an element release function has been set.
+ *
+ * @param arena to allocate memory from, or NULL to use heap
+ * @param initlength number of elements that will be stored in this YArray
+ *
+ * @return newly created YArray
+ */
+YArray*
+YArray_createArena(Yarena *arena, int initlength);
+
 /**
  * Truncate the given YArray to 0. Release all elements held by the given YArray
  * if an element release function has been set using YArray_setElementReleaseFunc
@@ -156,6 +169,49 @@ YArray_length(const YArray *array);
 int
 YArray_setElementReleaseFunc(YArray *array, YArrayElementReleaseFunc releaseElement);
 
+/**
+ * Sort elements of the given YArray, using an introsort. The comparison
+ * function is called like for qsort, with pointers to two elements.
+ *
+ * @param array to be sorted
+ * @param compar comparison function
+ *
+ * @return YOSAL_OK on success
+ * @see Ysort
+ */
+int
+YArray_sort(YArray *array, YsortCompareFunc compar);
+
+/**
+ * Sort elements of the given YArray, using a merge sort split across
+ * workers of a thread pool. Small arrays are sorted by calling thread.
+ *
+ * @param array to be sorted
+ * @param compar comparison function, called from many threads
+ * @param pool of workers sorting array, or NULL
+ *
+ * @return YOSAL_OK on success
+ * @see Ysort_parallel
+ */
+int
+YArray_sortParallel(YArray *array, YsortCompareFunc compar, Ythreadpool *pool);
+
+/**
+ * Find an element in a YArray sorted consistently with the comparison
+ * function. As for bsearch, the comparison function is called with a
+ * pointer to key first, then a pointer to an array element, and key may
+ * be of another type than elements. Both are pointers to pointers, since
+ * elements are.
+ *
+ * @param array to search
+ * @param key element to look for
+ * @param compar comparison function
+ *
+ * @return index of first element equal to key, or -1 if there is none
+ */
+int
+YArray_bsearch(YArray *array, const void *key, YsortCompareFunc compar);
+
 
 #ifdef	__cplusplus
 }
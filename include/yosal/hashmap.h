@@ -66,6 +66,20 @@ struct YhashmapSearchStruct {
 Yhashmap*
 Yhashmap_create(int initialCapacity);
 
+/**
+ * Instantiate a new Yhashmap whose buckets, entries and keys are allocated
+ * from an arena, and released along with it. Values set with
+ * Yhashmap_setvalue are still copied into heap, and released by
+ * Yhashmap_release, which must then be called before releasing arena.
+ *
+ * @param arena to allocate memory from, or NULL to use heap
+ * @param initialCapacity of the Yhashmap
+ *
+ * @return newly created Yhashmap
+ */
+Yhashmap*
+Yhashmap_create_arena(Yarena *arena, int initialCapacity);
+
 /**
  * Destroy an existing Yhashmap and release associated memory
  *
@@ -170,6 +184,18 @@ Yhashmap_capacity(Yhashmap* map);
 size_t
 Yhashmap_collisions(Yhashmap* map);
 
+/**
+ * Estimate memory held by a Yhashmap: map, buckets, entries, keys and
+ * values copied into it. Values only referenced by the map are not
+ * counted.
+ *
+ * @param map to be measured
+ *
+ * @return number of bytes held by map
+ */
+size_t
+Yhashmap_footprint(Yhashmap* map);
+
 /**
  * Obtain refernce to the key of a YhashmapEntry. The caller should not free or modify
  * the obtained key.
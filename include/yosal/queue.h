@@ -26,6 +26,11 @@ typedef struct YqueueRecordStruct YqueueRecord;
  *
  * @brief Portable queue implementation
  *
+ * Values are stored in a circular array, doubled when full, so that
+ * inserting and removing at both ends don't allocate memory most of the
+ * time, and iteration walks contiguous memory. Records returned by the
+ * iterator are slots of this array, only valid until queue is modified.
+ *
  * @{
  */
 
@@ -38,6 +43,18 @@ typedef struct YqueueRecordStruct YqueueRecord;
 Yqueue*
 Yqueue_create();
 
+/**
+ * Create a new Yqueue instance whose memory is allocated from an arena,
+ * and released along with it. Growing the queue leaves its previous array
+ * in the arena, unless it is the most recent allocation.
+ *
+ * @param arena to allocate memory from, or NULL to use heap
+ *
+ * @return newly created Yqueue
+ */
+Yqueue*
+Yqueue_create_arena(Yarena *arena);
+
 /**
  * Release an existing Yqueue.
  *
@@ -54,7 +71,7 @@ Yqueue_release(Yqueue *l);
  * @param l queue to append to
  * @param value to be inserted
  *
- * @return new queue size
+ * @return new queue size, or -1 on error
  */
 int
 Yqueue_push(Yqueue *l, void *value);
@@ -65,7 +82,7 @@ Yqueue_push(Yqueue *l, void *value);
  * @param l queue to prepend to
  * @param value to be inserted
  *
- * @return new queue size
+ * @return new queue size, or -1 on error
  */
 int
 Yqueue_insert(Yqueue *l, void *value);
@@ -80,6 +97,16 @@ Yqueue_insert(Yqueue *l, void *value);
 void*
 Yqueue_pop(Yqueue *l);
 
+/**
+ * Retrieve and remove the last value from a Yqueue.
+ *
+ * @param l queue to pop from
+ *
+ * @return retrieved value
+ */
+void*
+Yqueue_poplast(Yqueue *l);
+
 /**
  * Obtain a reference to the first value of a Yqueue.
  *
@@ -90,6 +117,16 @@ Yqueue_pop(Yqueue *l);
 void*
 Yqueue_fetch(Yqueue *l);
 
+/**
+ * Obtain a reference to the last value of a Yqueue.
+ *
+ * @param l queue to obtain reference from
+ *
+ * @return retrieved value
+ */
+void*
+Yqueue_fetchlast(Yqueue *l);
+
 /**
  * Determine the size of a Yqueue.
  *
@@ -132,15 +169,158 @@ void*
 Yqueue_value(const YqueueRecord *element);
 
 /**
- * Obtain a sorted array from a populated Yqueue.
+ * Obtain a sorted array from a populated Yqueue. Values are sorted by
+ * Ysort, the comparison function being called like for qsort.
  *
  * @param l yqueue to be sorted
- * @param compar comparison function to compare two queue records.
+ * @param compar comparison function to compare two queue records, or
+ *        NULL to keep queue order
  * @see http://www.gnu.org/software/libc/manual/html_node/Array-Sort-Function.html
  */
 void**
 Yqueue_array(Yqueue *l, int(*compar)(const void *, const void *));
 
+/** @} */
+
+/**
+ * Bounded queue shared between threads
+ */
+typedef struct YqueueConcurrentStruct YqueueConcurrent;
+
+/**
+ * @defgroup YqueueConcurrent
+ *
+ * @brief Lock-free bounded queue for multiple producers and consumers
+ *
+ * Values are stored in a ring of fixed capacity, where each slot carries
+ * a sequence number telling producers and consumers whether it is ready
+ * for them, so that pushing and popping only contend on a single atomic
+ * position. Blocking variants only involve a lock when the queue is full
+ * or empty.
+ *
+ * @{
+ */
+
+/**
+ * Create a new concurrent queue.
+ *
+ * @param capacity maximum number of values, rounded up to a power of 2.
+ *        Minimum capacity is 2, a capacity of 1 being rounded up to 2
+ *
+ * @return newly created queue, or NULL on error, or if capacity is not
+ *         positive
+ */
+YqueueConcurrent*
+Yqueue_concurrent_create(int capacity);
+
+/**
+ * Release a concurrent queue. No other thread may use it anymore.
+ *
+ * @param q queue to be released
+ *
+ * @return YOSAL_OK on success
+ */
+int
+Yqueue_concurrent_release(YqueueConcurrent *q);
+
+/**
+ * Insert a value at the end of a concurrent queue, without waiting.
+ *
+ * @param q queue to append to
+ * @param value to be inserted
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR if queue is full or closed
+ */
+int
+Yqueue_concurrent_trypush(YqueueConcurrent *q, void *value);
+
+/**
+ * Retrieve and remove the first value of a concurrent queue, without
+ * waiting.
+ *
+ * @param q queue to pop from
+ * @param[out] valueref retrieved value
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR if queue is empty
+ */
+int
+Yqueue_concurrent_trypop(YqueueConcurrent *q, void **valueref);
+
+/**
+ * Insert values at the end of a concurrent queue, without waiting. Values
+ * inserted at once are consecutive.
+ *
+ * @param q queue to append to
+ * @param values to be inserted
+ * @param count number of values
+ *
+ * @return number of values inserted, as many as there was room for
+ */
+int
+Yqueue_concurrent_pushbatch(YqueueConcurrent *q, void **values, int count);
+
+/**
+ * Retrieve and remove first values of a concurrent queue, without waiting.
+ *
+ * @param q queue to pop from
+ * @param[out] values retrieved values
+ * @param count maximum number of values
+ *
+ * @return number of values retrieved
+ */
+int
+Yqueue_concurrent_popbatch(YqueueConcurrent *q, void **values, int count);
+
+/**
+ * Insert a value at the end of a concurrent queue, waiting for room.
+ *
+ * @param q queue to append to
+ * @param value to be inserted
+ * @param timeout maximum time to wait in milliseconds, -1 to wait forever
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR on timeout or if queue is closed
+ */
+int
+Yqueue_concurrent_push(YqueueConcurrent *q, void *value, int timeout);
+
+/**
+ * Retrieve and remove the first value of a concurrent queue, waiting for
+ * one.
+ *
+ * @param q queue to pop from
+ * @param[out] valueref retrieved value
+ * @param timeout maximum time to wait in milliseconds, -1 to wait forever
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR on timeout or if queue is closed
+ *         and empty
+ */
+int
+Yqueue_concurrent_pop(YqueueConcurrent *q, void **valueref, int timeout);
+
+/**
+ * Close a concurrent queue. Further insertions fail, while values already
+ * queued can still be retrieved. Waiting threads are woken up.
+ *
+ * @param q queue to close
+ *
+ * @return YOSAL_OK on success
+ */
+int
+Yqueue_concurrent_close(YqueueConcurrent *q);
+
+/**
+ * Determine the number of values in a concurrent queue. This is only a
+ * snapshot when other threads are using the queue.
+ *
+ * @param q queue whose size is needed
+ *
+ * @return size of q
+ */
+int
+Yqueue_concurrent_size(YqueueConcurrent *q);
+
+/** @} */
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,25 @@
 extern "C" {
 #endif
 
+/* Thread caching allocator for Ymem_* functions, enabled by default */
+#ifndef YOSAL_CONFIG_YMEM_CACHE
+#define YOSAL_CONFIG_YMEM_CACHE 1
+#endif
+
+/* Accounting of memory allocated by Ymem_* functions, disabled by default */
+#ifndef YOSAL_CONFIG_YMEM_STATS
+#define YOSAL_CONFIG_YMEM_STATS 0
+#endif
+
+/* Size above which containers use Ymem_large_alloc, 0 to disable */
+#ifndef YOSAL_CONFIG_YMEM_LARGE_THRESHOLD
+#define YOSAL_CONFIG_YMEM_LARGE_THRESHOLD (2 * 1024 * 1024)
+#endif
+
+/* Whether containers should allocate size bytes with Ymem_large_alloc */
+#define YMEM_IS_LARGE(size) \
+  (YOSAL_CONFIG_YMEM_LARGE_THRESHOLD > 0 && (size) >= YOSAL_CONFIG_YMEM_LARGE_THRESHOLD)
+
 /**
  * @defgroup Yalloc Yalloc
  *
@@ -130,6 +149,366 @@ int Ymem_isaligned (void *ptr, size_t alignment);
 void *
 Ymem_malloc_aligned(size_t alignment, size_t size, void **alignedref);
 
+/**
+ * @brief Allocate memory aligned on a cache line
+ * @ingroup yosal
+ *
+ * Allocate memory starting on a cache line boundary, for structures
+ * keeping fields written by different threads on separate cache lines.
+ *
+ * @param size number of bytes to allocate
+ * @return pointer to allocated memory, to release with Ymem_free_cacheline(),
+ *         or NULL on error
+ */
+void *
+Ymem_malloc_cacheline(size_t size);
+
+/**
+ * @brief Release memory allocated by Ymem_malloc_cacheline()
+ * @ingroup yosal
+ *
+ * @param ptr pointer to release, or NULL
+ */
+void
+Ymem_free_cacheline(void *ptr);
+
+/**
+ * Memory allocator used by Ymem functions to obtain memory.
+ */
+typedef struct {
+  void* (*malloc)(size_t size);
+  void* (*realloc)(void *ptr, size_t size);
+  void (*free)(void *ptr);
+} YmemBackend;
+
+/**
+ * @brief Replace allocator used by Ymem functions
+ * @ingroup yosal
+ *
+ * Make all Ymem functions obtain memory from another allocator than
+ * libc. Unless built with YOSAL_CONFIG_YMEM_CACHE set to 0, small blocks
+ * are further cached per thread on top of that allocator, by size classes.
+ *
+ * This must be called before any allocation, since memory allocated by
+ * the previous backend would be released to the new one. The backend
+ * structure must remain valid afterward.
+ *
+ * @param backend allocator functions, or NULL to restore libc allocator
+ * @return YOSAL_OK on success, YOSAL_ERROR if backend is incomplete
+ */
+int
+Ymem_setbackend(const YmemBackend *backend);
+
+/* Back large allocation with transparent huge pages */
+#define YMEM_LARGE_HUGEPAGE   0x1
+/* Back large allocation with reserved huge pages (hugetlbfs) if available */
+#define YMEM_LARGE_HUGETLB    0x2
+/* Interleave pages of large allocation across NUMA nodes */
+#define YMEM_LARGE_INTERLEAVE 0x4
+
+/**
+ * @brief Allocate a large memory region
+ * @ingroup yosal
+ *
+ * Map a zero-filled, page aligned memory region directly from the system,
+ * for large and long-lived tables. Requested placement is only a hint,
+ * each one being silently skipped when not supported by the system.
+ * Without YMEM_LARGE_INTERLEAVE, pages are placed on the node of the
+ * thread first touching them.
+ *
+ * @param size number of bytes to allocate
+ * @param flags combination of YMEM_LARGE_* flags
+ * @return pointer to allocated memory, or NULL on error
+ */
+void *
+Ymem_large_alloc(size_t size, int flags);
+
+/**
+ * @brief Resize a large memory region
+ * @ingroup yosal
+ *
+ * Content is preserved up to the smaller of both sizes, the region being
+ * remapped rather than copied when possible.
+ *
+ * @param ptr region returned by Ymem_large_alloc, or NULL
+ * @param oldsize size ptr was allocated with
+ * @param size new size
+ * @param flags combination of YMEM_LARGE_* flags, for a new region
+ * @return pointer to resized memory, or NULL on error
+ */
+void *
+Ymem_large_realloc(void *ptr, size_t oldsize, size_t size, int flags);
+
+/**
+ * @brief Release a large memory region
+ * @ingroup yosal
+ *
+ * @param ptr region returned by Ymem_large_alloc
+ * @param size size ptr was allocated with
+ */
+void
+Ymem_large_free(void *ptr, size_t size);
+
+/**
+ * Tags attributing allocated memory to a subsystem
+ */
+enum {
+  YMEM_TAG_DEFAULT = 0,
+  YMEM_TAG_HASHMAP,
+  YMEM_TAG_ARRAY,
+  YMEM_TAG_QUEUE,
+  YMEM_TAG_BUFFER,
+  YMEM_TAG_CHANNEL,
+  YMEM_TAG_ARENA,
+  YMEM_TAG_POOL,
+  YMEM_TAG_LARGE,
+  /* First tag returned by Ymem_tag_register */
+  YMEM_TAG_USER
+};
+
+/* Maximum number of tags, including builtin ones */
+#define YMEM_TAG_MAX 32
+/* Pseudo tag selecting totals over all tags */
+#define YMEM_TAG_ALL (-1)
+
+/**
+ * @brief Allocate memory in heap, attributed to a tag
+ * @ingroup yosal
+ *
+ * Same as Ymem_malloc, with memory accounted under tag when built with
+ * YOSAL_CONFIG_YMEM_STATS.
+ *
+ * @param size number of bytes to allocate
+ * @param tag tag to account memory under
+ * @return pointer to allocated memory, or NULL on error
+ */
+void *
+Ymem_malloc_tag(size_t size, int tag);
+
+/**
+ * @brief Resize memory in heap, attributed to a tag
+ * @ingroup yosal
+ *
+ * Same as Ymem_realloc, with resized memory accounted under tag.
+ *
+ * @param ptr pointer to previously allocated memory region, or NULL
+ * @param size number of bytes to allocate
+ * @param tag tag to account memory under
+ * @return pointer to allocated memory, or NULL on error
+ */
+void *
+Ymem_realloc_tag(void *ptr, size_t size, int tag);
+
+/**
+ * @brief Register a tag for memory accounting
+ * @ingroup yosal
+ *
+ * Registering an already known name returns the same tag.
+ *
+ * @param name name of tag, must remain valid afterward
+ * @return tag, or -1 if no more tags are available
+ */
+int
+Ymem_tag_register(const char *name);
+
+/**
+ * Memory accounted under a tag
+ */
+typedef struct {
+  const char *name;
+  /* Bytes currently allocated */
+  size_t live;
+  /* High-water mark of live bytes */
+  size_t peak;
+  /* Number of allocations and releases */
+  size_t allocs;
+  size_t frees;
+} YmemStats;
+
+/**
+ * @brief Get memory accounted under a tag
+ * @ingroup yosal
+ *
+ * Sizes are those requested by callers, excluding allocator overhead.
+ *
+ * @param tag tag, or YMEM_TAG_ALL for totals
+ * @param[out] stats accounted memory
+ * @return YOSAL_OK on success, YOSAL_ERROR if tag is unknown or accounting
+ *         is not enabled
+ */
+int
+Ymem_stats(int tag, YmemStats *stats);
+
+/**
+ * Allocation site reported by the sampling profiler
+ */
+typedef struct {
+  /* Return address of call into Ymem */
+  void *site;
+  /* Number of sampled allocations, and their total size */
+  size_t samples;
+  size_t bytes;
+} YmemSite;
+
+/**
+ * @brief Enable sampling of allocation sites
+ * @ingroup yosal
+ *
+ * Record the caller of one allocation every period bytes allocated on
+ * average, so that sites allocating most are eventually reported.
+ *
+ * @param period sampling period in bytes, or 0 to disable sampling
+ * @return YOSAL_OK on success, YOSAL_ERROR if accounting is not enabled
+ */
+int
+Ymem_stats_sample(size_t period);
+
+/**
+ * @brief Get sampled allocation sites
+ * @ingroup yosal
+ *
+ * @param[out] sites array receiving sites, by decreasing sampled bytes
+ * @param maxsites capacity of sites
+ * @return number of sites stored
+ */
+int
+Ymem_stats_sites(YmemSite *sites, int maxsites);
+
+/**
+ * @brief Log memory accounting
+ * @ingroup yosal
+ *
+ * Log memory accounted under each tag and top sampled allocation sites.
+ */
+void
+Ymem_stats_dump();
+
+/**
+ * Arena of memory, released all at once
+ */
+typedef struct YarenaStruct Yarena;
+
+/**
+ * Position in an arena, to release all memory allocated after it.
+ */
+typedef struct {
+  void *block;
+  size_t pos;
+} YarenaSavepoint;
+
+/**
+ * @brief Create a memory arena
+ * @ingroup yosal
+ *
+ * Create an arena, allocating memory by bumping a pointer into blocks
+ * obtained from Ymem_malloc. Memory allocated from an arena is never
+ * released individually, but all at once by Yarena_reset or
+ * Yarena_release, or back to a savepoint with Yarena_rollback.
+ *
+ * An arena is not thread safe.
+ *
+ * @param blocksize size of blocks chained to hold allocations
+ * @return new arena, or NULL on error
+ */
+Yarena*
+Yarena_create(size_t blocksize);
+
+/**
+ * @brief Release an arena and all memory allocated from it
+ * @ingroup yosal
+ *
+ * @param arena arena to release
+ */
+void
+Yarena_release(Yarena *arena);
+
+/**
+ * @brief Release all memory allocated from an arena
+ * @ingroup yosal
+ *
+ * Release all memory allocated from an arena, keeping the arena and its
+ * first block for reuse.
+ *
+ * @param arena arena to reset
+ */
+void
+Yarena_reset(Yarena *arena);
+
+/**
+ * @brief Allocate memory from an arena
+ * @ingroup yosal
+ *
+ * Returned memory is aligned on twice the size of a pointer.
+ *
+ * @param arena arena to allocate from
+ * @param size number of bytes to allocate
+ * @return pointer to allocated memory, or NULL on error
+ */
+void*
+Yarena_alloc(Yarena *arena, size_t size);
+
+/**
+ * @brief Allocate aligned memory from an arena
+ * @ingroup yosal
+ *
+ * @param arena arena to allocate from
+ * @param alignment requested alignment, a power of 2
+ * @param size number of bytes to allocate
+ * @return pointer to allocated memory, or NULL on error
+ */
+void*
+Yarena_alloc_aligned(Yarena *arena, size_t alignment, size_t size);
+
+/**
+ * @brief Resize memory allocated from an arena
+ * @ingroup yosal
+ *
+ * The most recent allocation is resized in place when possible. Otherwise
+ * a new region is allocated and data copied, the previous one being only
+ * released with the arena.
+ *
+ * @param arena arena ptr was allocated from
+ * @param ptr previously allocated memory, or NULL
+ * @param oldsize size of previous allocation
+ * @param size new size
+ * @return pointer to resized memory, or NULL on error
+ */
+void*
+Yarena_realloc(Yarena *arena, void *ptr, size_t oldsize, size_t size);
+
+/**
+ * @brief Copy null terminated string into an arena
+ * @ingroup yosal
+ *
+ * @param arena arena to allocate from
+ * @param str null terminated string to copy
+ * @return pointer to copy of string, or NULL on error
+ */
+char*
+Yarena_strdup(Yarena *arena, const char *str);
+
+/**
+ * @brief Record current position of an arena
+ * @ingroup yosal
+ *
+ * @param arena arena
+ * @param[out] savepoint recorded position
+ */
+void
+Yarena_savepoint(Yarena *arena, YarenaSavepoint *savepoint);
+
+/**
+ * @brief Release all memory allocated after a savepoint
+ * @ingroup yosal
+ *
+ * Savepoints more recent than this one become invalid.
+ *
+ * @param arena arena
+ * @param savepoint position recorded by Yarena_savepoint
+ */
+void
+Yarena_rollback(Yarena *arena, const YarenaSavepoint *savepoint);
+
 #ifdef __cplusplus
 };
 #endif
@@ -18,6 +18,10 @@
 #ifndef _YOSAL_YBUFFER_H
 #define _YOSAL_YBUFFER_H 1
 
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,12 +35,169 @@ extern "C" {
  */
 typedef struct YbufferStruct Ybuffer;
 
+/**
+ * Storage for a Ybuffer allocated by the caller, e.g. on the stack. See
+ * Ybuffer_init_storage().
+ */
+typedef struct {
+  void *opaque[16];
+} YbufferStorage;
+
+/**
+ * Create a contiguous dynamic buffer. Storage is grown geometrically, so
+ * building a buffer from many small appends has a linear cost.
+ *
+ * @param initiallength initial capacity, or 0 to defer allocation
+ *
+ * @return new Ybuffer, or NULL on failure
+ */
 Ybuffer*
 Ybuffer_init(int initiallength);
 
+/**
+ * Create a rope buffer. Data is appended into a chain of chunks of
+ * chunksize bytes (larger for a single bigger append), so bytes already
+ * appended are never moved. Data can be exported with Ybuffer_iovec(), and
+ * is flattened only by Ybuffer_detach(), without copy if it fits in a
+ * single chunk.
+ *
+ * @param chunksize size of each chunk
+ *
+ * @return new Ybuffer, or NULL on failure
+ */
+Ybuffer*
+Ybuffer_init_rope(int chunksize);
+
+/**
+ * Create a rope buffer whose chunks grow geometrically. Each chunk is
+ * twice as large as the previous one, from chunksize up to maxchunksize,
+ * so that large contents span few chunks while small ones stay compact.
+ *
+ * @param chunksize size of first chunk
+ * @param maxchunksize largest size of a chunk
+ *
+ * @return new Ybuffer, or NULL on failure
+ */
+Ybuffer*
+Ybuffer_init_rope_growing(int chunksize, int maxchunksize);
+
+/**
+ * Initialize a Ybuffer on caller storage, without allocation. Data is
+ * first written into an optional caller buffer, and spills to the heap
+ * only when it gets too small. Both storage and data must remain valid
+ * until Ybuffer_fini() or Ybuffer_detach() is called, and are never freed
+ * by them.
+ *
+ * @param storage storage for the Ybuffer itself
+ * @param data initial data buffer, may be NULL
+ * @param datalen size of data buffer
+ *
+ * @return Ybuffer held by storage, or NULL on failure
+ */
+Ybuffer*
+Ybuffer_init_storage(YbufferStorage *storage, char *data, int datalen);
+
+/**
+ * Create a contiguous dynamic buffer allocated from an arena. Growing the
+ * buffer extends it in place when it is the most recent allocation of the
+ * arena. All memory, including data returned by Ybuffer_detach(), is
+ * owned by the arena and released along with it.
+ *
+ * @param arena arena to allocate from, or NULL to use heap
+ * @param initiallength initial capacity, or 0 to defer allocation
+ *
+ * @return new Ybuffer, or NULL on failure
+ */
+Ybuffer*
+Ybuffer_init_arena(Yarena *arena, int initiallength);
+
+/**
+ * Discard all data held by a Ybuffer, keeping its allocated memory for
+ * reuse. A rope buffer keeps its first chunk. This also clears a previous
+ * allocation failure.
+ *
+ * @param stream Ybuffer to reset
+ */
+void
+Ybuffer_reset(Ybuffer *stream);
+
+/**
+ * Make sure that at least n more bytes can be appended to a Ybuffer
+ * without allocation.
+ *
+ * @param stream Ybuffer
+ * @param n number of bytes
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR on failure
+ */
+int
+Ybuffer_reserve(Ybuffer *stream, size_t n);
+
+/**
+ * Return the end of data held by a Ybuffer, with room for at least n
+ * bytes, so that data can be produced in place. Written bytes become part
+ * of the buffer only when Ybuffer_commit() is called. The returned pointer
+ * is invalidated by any other operation on the buffer.
+ *
+ * @param stream Ybuffer
+ * @param n number of bytes to be written
+ *
+ * @return pointer to write into, or NULL on failure
+ */
+char*
+Ybuffer_tail(Ybuffer *stream, size_t n);
+
+/**
+ * Append n bytes written into the area returned by Ybuffer_tail().
+ *
+ * @param stream Ybuffer
+ * @param n number of bytes written, at most the size passed to
+ *        Ybuffer_tail()
+ */
+void
+Ybuffer_commit(Ybuffer *stream, size_t n);
+
+/**
+ * Return the number of bytes held by a Ybuffer.
+ *
+ * @param stream Ybuffer
+ *
+ * @return length of data
+ */
+size_t
+Ybuffer_length(Ybuffer *stream);
+
+/**
+ * Return the number of bytes of memory held by a Ybuffer, including
+ * unused capacity. Caller storage is not counted.
+ *
+ * @param stream Ybuffer
+ *
+ * @return memory footprint
+ */
+size_t
+Ybuffer_footprint(Ybuffer *stream);
+
+/**
+ * Describe data held by a Ybuffer as a vector of memory regions, suitable
+ * for writev(). Regions remain owned by the Ybuffer and are valid until
+ * the next append into it.
+ *
+ * @param stream Ybuffer
+ * @param iov array of iovec to fill, may be NULL
+ * @param iovcnt capacity of iov
+ *
+ * @return number of iovec entries required to describe all data, which can
+ *         be larger than iovcnt, or -1 on failure
+ */
+int
+Ybuffer_iovec(Ybuffer *stream, struct iovec *iov, int iovcnt);
+
 /**
  * This function returns a pointer to the data held by a Ybuffer and
- * destroys the encapsulating Ybuffer.
+ * destroys the encapsulating Ybuffer. Data is null terminated, and must be
+ * released with Ymem_free. If it is still held in caller storage given to
+ * Ybuffer_init_storage(), it is copied to the heap.
  *
  * @param stream YBuffer whose data is to be freed
  * @param[out] datalen Length of the data held by the Ybuffer
@@ -46,8 +207,9 @@ Ybuffer_init(int initiallength);
 char* Ybuffer_detach(Ybuffer *stream, int *datalen);
 
 /**
- * Clear all data contained by the Ybuffer after it is no longer needed. After
- * After calling this function it is safe to free the Ybuffer using Ymem_free.
+ * Release a Ybuffer and all data it contains, after it is no longer needed.
+ * For a Ybuffer created by Ybuffer_init_storage(), only heap memory is
+ * released.
  *
  * @param stream buffer to be cleaned
  */
@@ -95,6 +257,70 @@ Ybuffer_append_format(Ybuffer *stream, const char *format, ...)
 int
 Ybuffer_append_integer(Ybuffer *stream, int value);
 
+/**
+ * Append the decimal representation of a signed 64 bits integer. Digits
+ * are written directly into the buffer, without printf nor temporary copy.
+ *
+ * @param stream Ybuffer to append integer to
+ * @param value integer to be appended
+ *
+ * @return length of appended data or -1 on failure
+ */
+int
+Ybuffer_append_int64(Ybuffer *stream, int64_t value);
+
+/**
+ * Append the decimal representation of an unsigned 64 bits integer.
+ *
+ * @param stream Ybuffer to append integer to
+ * @param value integer to be appended
+ *
+ * @return length of appended data or -1 on failure
+ */
+int
+Ybuffer_append_uint64(Ybuffer *stream, uint64_t value);
+
+/**
+ * Append the shortest decimal representation of a double that reads back
+ * to the same value. Output doesn't depend on locale, and uses the same
+ * layout as JavaScript (e.g. 0.1, 1234.5, 1e+21, 5e-7). Non finite values
+ * are written as nan, inf and -inf.
+ *
+ * @param stream Ybuffer to append number to
+ * @param value number to be appended
+ *
+ * @return length of appended data or -1 on failure
+ */
+int
+Ybuffer_append_double(Ybuffer *stream, double value);
+
+/**
+ * Append bytes as lowercase hexadecimal, two digits per byte.
+ *
+ * @param stream Ybuffer to append data to
+ * @param data bytes to be encoded
+ * @param length number of bytes
+ *
+ * @return length of appended data or -1 on failure
+ */
+int
+Ybuffer_append_hex(Ybuffer *stream, const void *data, int length);
+
+/**
+ * Append a string escaped for inclusion into a JSON string literal.
+ * Quote, backslash and control characters are escaped, other bytes
+ * (including UTF-8 sequences) are copied as is. buflen can be -1 if the
+ * string is null terminated.
+ *
+ * @param stream Ybuffer to append data to
+ * @param buf string to be escaped
+ * @param buflen length of buf
+ *
+ * @return length of appended data or -1 on failure
+ */
+int
+Ybuffer_append_escaped(Ybuffer *stream, const char *buf, int buflen);
+
 /**
  * @}
  */
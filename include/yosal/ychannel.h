@@ -19,11 +19,14 @@
 #define _YOSAL_YCHANNEL_H 1
 
 #include "yosal/yosal.h"
+#include "yosal/ytime.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,28 +50,77 @@ extern "C" {
 /** An opaque channel type */
 typedef struct YchannelStruct Ychannel;
 
+/**
+ * Status returned by read and write callbacks of non-blocking engines when
+ * no progress can be made without blocking
+ */
+#define YCHANNEL_WOULDBLOCK ((int) -2)
+
+/** Poll events, @see YchannelPoll */
+#define YCHANNEL_POLLIN  0x1
+#define YCHANNEL_POLLOUT 0x2
+#define YCHANNEL_POLLERR 0x4
+
+/** Channel to be polled with YchannelPoll */
+typedef struct {
+  Ychannel *channel;
+  /** Requested events, combination of YCHANNEL_POLLIN and YCHANNEL_POLLOUT */
+  int events;
+  /** Returned events */
+  int revents;
+} YchannelPollEntry;
+
+/**
+ * I/O counters of a Ychannel, @see YchannelEnableStats
+ */
+typedef struct {
+  /** Bytes consumed from the channel */
+  uint64_t fetched;
+  /** Bytes returned without copy, by YchannelFetch() or YchannelReadUntil() */
+  uint64_t zerocopy;
+  /** Bytes copied, into caller buffers or between internal buffers */
+  uint64_t copied;
+  /** Bytes read by engine directly into caller buffers */
+  uint64_t direct;
+  /** Bytes written */
+  uint64_t written;
+  /** Number of engine read callback invocations */
+  uint64_t readcalls;
+  /** Number of engine write callback invocations */
+  uint64_t writecalls;
+  /** Number of push-back buffer allocations */
+  uint64_t pushallocs;
+  /** Time spent in engine read callback, in nanoseconds */
+  nsecs_t readtime;
+  /** Time spent in engine write callback, in nanoseconds */
+  nsecs_t writetime;
+} YchannelStats;
+
 /**
  * Callback that is used to read from a Ychannel. This function needs to know
  * how to read data from this Ychannel instance. This function can read up to
- * nbytes.
+ * nbytes. Larger transfers are split by the Ychannel into many calls.
  *
  * @param channel current Ychannel
  * @param readbuf buffer to read data into
  * @param nbytes number of bytes that are being requested
  *
- * @return number of bytes read, -1 on error and 0 on EOF
+ * @return number of bytes read, -1 at end of input or on error, or
+ *         YCHANNEL_WOULDBLOCK if no data is available without blocking
  */
 typedef int (*YchannelReadCB)(Ychannel *channel, void *readbuf, int nbytes);
 
 /**
  * Callback that is used to write to a Ychannel. This function needs to know
- * how to write data to this Ychannel instance.
+ * how to write data to this Ychannel instance. Larger transfers are split
+ * by the Ychannel into many calls.
  *
  * @param channel current Ychannel
  * @param buf buffer to be written into the Ychannel
  * @param towrite number of bytes to be written
  *
- * @return number of bytes written or -1 on error
+ * @return number of bytes written or -1 on error, or YCHANNEL_WOULDBLOCK
+ *         if no data can be written without blocking
  */
 typedef int (*YchannelWriteCB)(Ychannel *channel, const void *buf, int towrite);
 
@@ -94,6 +146,20 @@ typedef int (*YchannelFlushCB)(Ychannel *channel);
  */
 typedef int (*YchannelReleaseCB)(Ychannel *channel);
 
+/**
+ * Callback that is used by YchannelPoll() to check if an engine without
+ * file descriptor can make progress without blocking. When none of the
+ * events is ready, the engine may provide a file descriptor becoming
+ * readable once the engine may be ready, for YchannelPoll() to wait on.
+ *
+ * @param channel current Ychannel
+ * @param events combination of YCHANNEL_POLLIN and YCHANNEL_POLLOUT
+ * @param[out] fdref file descriptor to wait on, left to -1 if none
+ *
+ * @return ready events, or YCHANNEL_POLLERR on error
+ */
+typedef int (*YchannelPollCB)(Ychannel *channel, int events, int *fdref);
+
 /**
  * @brief Create new Ychannel from memory buffer
  * @ingroup yosal
@@ -106,7 +172,7 @@ typedef int (*YchannelReleaseCB)(Ychannel *channel);
  * @return Void
  */
 Ychannel*
-YchannelInitByteArray(const char *header, int hlength);
+YchannelInitByteArray(const char *header, size_t hlength);
 
 /**
  * @brief Create new Ychannel from Posix FILE
@@ -136,6 +202,31 @@ YchannelInitFile(FILE *file, int writable);
 Ychannel*
 YchannelInitFd(int fd, int writable);
 
+/**
+ * Switch the file descriptor of a Ychannel created with YchannelInitFd()
+ * to non-blocking mode. In this mode, reads and writes return partial
+ * results as soon as the descriptor would block, and YchannelWouldBlock()
+ * can be used to tell it from end of input or failure.
+ *
+ * @param channel
+ * @param nonblocking YTRUE to enable non-blocking mode
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR if not a file descriptor channel
+ */
+int
+YchannelSetNonBlocking(Ychannel *channel, YBOOL nonblocking);
+
+/**
+ * Get the file descriptor of a Ychannel created with YchannelInitFd(), for
+ * integration into an external event loop.
+ *
+ * @param channel
+ *
+ * @return file descriptor, or -1 if not a file descriptor channel
+ */
+int
+YchannelGetFd(Ychannel *channel);
+
 /**
  * @brief Create new readable Ychannel from Java InputStream
  * @ingroup yosal
@@ -164,6 +255,167 @@ YchannelInitJavaInputStream(JNIEnv *jenv, jobject inputstream);
 Ychannel*
 YchannelInitJavaOutputStream(JNIEnv *_env, jobject outputstream);
 
+/**
+ * @brief Create new readable Ychannel from direct Java ByteBuffer
+ * @ingroup yosal
+ *
+ * Allocate a Ychannel object reading, without copy, the remaining content
+ * of a direct java.nio.ByteBuffer, between its position and limit when
+ * the channel is created. The ByteBuffer is not updated when reading.
+ *
+ * @param jenv Java environment
+ * @param bytebuffer direct java.nio.ByteBuffer object
+ * @return A readable Ychannel object, or NULL if buffer is not direct
+ */
+Ychannel*
+YchannelInitJavaByteBuffer(JNIEnv *jenv, jobject bytebuffer);
+
+/**
+ * @brief Create new Ychannel from Java NIO channel
+ * @ingroup yosal
+ *
+ * Allocate a Ychannel object, using an existing
+ * java.nio.channels.ReadableByteChannel, or WritableByteChannel if
+ * writable is set. Data is transferred through direct ByteBuffers wrapping
+ * native memory, so it is never copied through Java arrays, and transfer
+ * size is not limited. A non-blocking channel that can't make progress is
+ * reported as YCHANNEL_WOULDBLOCK.
+ *
+ * @param jenv Java environment
+ * @param bytechannel Java ReadableByteChannel or WritableByteChannel object
+ * @param writable If true, create an output channel
+ * @return A Ychannel object.
+ */
+Ychannel*
+YchannelInitJavaByteChannel(JNIEnv *jenv, jobject bytechannel, int writable);
+
+/**
+ * @brief Create new Ychannel computing a digest of the data going through it
+ * @ingroup yosal
+ *
+ * Allocate a transformation Ychannel object, reading from or writing to an
+ * existing Ychannel, and feeding every byte fetched from or written to it
+ * into a digest as it passes through, so integrity check doesn't need a
+ * second pass over the data.
+ *
+ * For an input channel, the digest covers all data pulled from the
+ * underlying channel, which may be ahead of what was consumed by the
+ * caller because of prefetching. Read the channel up to its end before
+ * finalizing the digest. Data pushed back with YchannelPush is not hashed
+ * again.
+ *
+ * If auto-release is set on the returned channel, releasing it also
+ * releases the underlying channel. The digest is never released.
+ *
+ * @param channel an opened readable or writable Ychannel
+ * @param digest a Ydigest object, as returned by Ydigest_create() or
+ *               Ydigest_create_mac()
+ * @return A Ychannel object, readable or writable like the underlying one.
+ */
+Ychannel*
+YchannelInitDigest(Ychannel *channel, Ydigest *digest);
+
+/**
+ * @brief Create new writable Ychannel shared by many threads
+ * @ingroup yosal
+ *
+ * Allocate a writable Ychannel object that can be written to concurrently
+ * by many threads. Each call to YchannelWrite() is a record, and records
+ * are never interleaved in the underlying channel. Writers queue records
+ * without locking. The thread that obtains the channel lock writes all
+ * pending records, batched into as few writes as possible, while other
+ * writers return immediately. Records from a given thread are kept in order.
+ *
+ * When the underlying channel is non-blocking, bytes it doesn't take are
+ * kept, and written first by the following writes. YchannelFlush() and
+ * YchannelRelease() wait until all pending records are written, polling
+ * the underlying channel if needed. If auto-release is set on the returned
+ * channel, releasing it also releases the underlying channel.
+ *
+ * @param channel an opened writable Ychannel
+ * @return A writable Ychannel object.
+ */
+Ychannel*
+YchannelInitShared(Ychannel *channel);
+
+/**
+ * @brief Create a pair of Ychannel connected within the process
+ * @ingroup yosal
+ *
+ * Allocate a readable and a writable Ychannel, everything written into
+ * the writer being read from the reader, through a wait-free ring of
+ * bytes. Each end must be used by a single thread at a time, usually one
+ * producer thread and one consumer thread.
+ *
+ * In blocking mode, reader waits for data and writer waits for room.
+ * Otherwise they return partial results as YchannelWouldBlock() tells.
+ * Once the writer is released, the reader gets remaining data then end of
+ * input. Once the reader is released, writes fail.
+ *
+ * @param capacity size of ring in bytes, or 0 for default
+ * @param nonblocking YTRUE to create channels in non-blocking mode
+ * @param[out] readerref readable end
+ * @param[out] writerref writable end
+ * @return YOSAL_OK on success, YOSAL_ERROR on failure
+ */
+int
+YchannelInitPipe(int capacity, YBOOL nonblocking,
+                 Ychannel **readerref, Ychannel **writerref);
+
+/**
+ * @brief Create new in-memory writable Ychannel
+ * @ingroup yosal
+ *
+ * Allocate a writable Ychannel object, accumulating all data written
+ * into it in memory. Storage is a Ybuffer rope, chaining fixed size chunks,
+ * so previously written data is never reallocated nor copied.
+ *
+ * Written data can be retrieved either with YchannelGetIovec(), or
+ * with YchannelDetach().
+ *
+ * @return A writable Ychannel object.
+ */
+Ychannel*
+YchannelInitMemoryWriter();
+
+/**
+ * @brief Take ownership of the data written into an in-memory channel
+ * @ingroup yosal
+ *
+ * Return all data written into a Ychannel created by
+ * YchannelInitMemoryWriter() as a single null terminated buffer, and
+ * release the channel. When all data fits into a single chunk, it is
+ * handed over without copy. Otherwise it is flattened once into a buffer
+ * of the exact length.
+ *
+ * The returned buffer is owned by the caller and must be released with
+ * Ymem_free.
+ *
+ * @param channel a Ychannel returned by YchannelInitMemoryWriter()
+ * @param[out] lengthptr length of the returned data
+ * @return data written into the channel, or NULL if the channel is empty.
+ *         For other types of channel, returns NULL and doesn't release it.
+ */
+char*
+YchannelDetach(Ychannel *channel, size_t *lengthptr);
+
+/**
+ * @brief Obtain a zero-copy view of data written into an in-memory channel
+ * @ingroup yosal
+ *
+ * Describe data written into a Ychannel created by YchannelInitMemoryWriter()
+ * as a vector of memory regions, suitable for writev(). Regions remain
+ * owned by the channel and are valid until the next write into it.
+ *
+ * @param channel a Ychannel returned by YchannelInitMemoryWriter()
+ * @param iov array of iovec to fill, may be NULL
+ * @param iovcnt capacity of iov
+ * @return number of iovec entries required to describe all data, which
+ *         can be larger than iovcnt. -1 if channel is not an in-memory one.
+ */
+int
+YchannelGetIovec(Ychannel *channel, struct iovec *iov, int iovcnt);
+
 /**
  * Automatically release underlying file descriptor, FILE
  * or ByteArray
@@ -259,6 +511,20 @@ int YchannelSetLength(Ychannel* channel, uint64_t length);
  */
 int YchannelResetBuffer(Ychannel* channel);
 
+/**
+ * Set the memory buffer a readable Ychannel serves its input from, before
+ * any data provided by its engine. Ownership of the buffer is taken like
+ * for YchannelInitByteArray(), so engines lending memory they don't own
+ * must call YchannelResetBuffer() from their release callback.
+ *
+ * @param channel
+ * @param buffer memory buffer
+ * @param length length (in bytes) of the memory buffer
+ *
+ * @return YOSAL_OK on success
+ */
+int YchannelSetBuffer(Ychannel* channel, const char *buffer, size_t length);
+
 /**
  * Reset the length of a Ychannel to YCHANNEL_NO_LENGTH.
  *
@@ -290,18 +556,69 @@ YchannelEof(Ychannel *channel);
  * @return reference to data that has been read
  */
 const char*
-YchannelFetch(Ychannel *channel, int nbytes, int *olengthptr);
+YchannelFetch(Ychannel *channel, size_t nbytes, size_t *olengthptr);
+
+/**
+ * Obtain a contiguous window on the next nbytes of a Ychannel, without
+ * consuming them. Unlike YchannelFetch, the window is not limited to the
+ * remaining of the current internal buffer: data is compacted and more
+ * input is read as needed, so less than nbytes are returned only at end of
+ * input. Window is limited to the size of the internal read buffer (16KB).
+ *
+ * Memory being returned is owned by the Ychannel, and is valid until the
+ * next call to a function reading from it. Subsequent YchannelFetch calls
+ * return the same data without copy.
+ *
+ * @param channel
+ * @param nbytes number of bytes to peek
+ * @param[out] olengthptr number of bytes available in the returned window
+ *
+ * @return reference to data, or NULL if no more data is available
+ */
+const char*
+YchannelPeek(Ychannel *channel, size_t nbytes, size_t *olengthptr);
+
+/**
+ * Read one record terminated by a delimiter from a Ychannel, without copy.
+ * Returned slice includes the delimiter, and is consumed from input. It
+ * is only valid until next read operation on the channel.
+ *
+ * If no delimiter can be found within a full internal buffer (16KB), that
+ * window is returned as a partial record. Last record before end of input
+ * is returned even if not terminated.
+ *
+ * @param channel
+ * @param delim delimiter character
+ * @param olengthptr pointer to store length of the record, including delimiter
+ *
+ * @return pointer to start of the record, or NULL at end of input
+ */
+const char*
+YchannelReadUntil(Ychannel *channel, int delim, size_t *olengthptr);
 
 /**
- * Skip n bytes when reading from a Ychannel
+ * Read one line from a Ychannel, without copy. Same as YchannelReadUntil()
+ * with '\n' as delimiter.
+ *
+ * @param channel
+ * @param olengthptr pointer to store length of the line, including newline
+ *
+ * @return pointer to start of the line, or NULL at end of input
+ */
+const char*
+YchannelReadLine(Ychannel *channel, size_t *olengthptr);
+
+/**
+ * Skip n bytes when reading from a Ychannel. Count is 64 bits even on 32
+ * bits platforms, so that any offset in a large stream can be reached.
  *
  * @param channel
  * @param n number of bytes to skip
  *
  * @return number of bytes that were actually skipped
  */
-int
-YchannelSkip(Ychannel *channel, int n);
+uint64_t
+YchannelSkip(Ychannel *channel, uint64_t n);
 
 /**
  * Push bytes pack into the input stream
@@ -312,8 +629,8 @@ YchannelSkip(Ychannel *channel, int n);
  *
  * @return number of bytes that were actually pushed back into stream
  */
-int
-YchannelPush(Ychannel *channel, const char *data, int n);
+size_t
+YchannelPush(Ychannel *channel, const char *data, size_t n);
 
 /**
  * Read nbytes from a Ychannel. Same as fetch, but the memory being returend is
@@ -326,8 +643,8 @@ YchannelPush(Ychannel *channel, const char *data, int n);
  *
  * @return number of bytes that were actually read
  */
-int
-YchannelRead(Ychannel *channel, void *buf, int nbytes);
+size_t
+YchannelRead(Ychannel *channel, void *buf, size_t nbytes);
 
 /**
  * Write at most towrite bytes from buffer buf into a Ychannel.
@@ -336,10 +653,80 @@ YchannelRead(Ychannel *channel, void *buf, int nbytes);
  * @param buf
  * @param towrite
  *
- * @return number of bytes actually written
+ * @return number of bytes actually written, or -1 if channel is not writable
+ */
+ssize_t
+YchannelWrite(Ychannel *channel, const void *buf, size_t towrite);
+
+/**
+ * Check if the last read or write operation on a Ychannel returned short
+ * because its engine could not make progress without blocking.
+ *
+ * @param channel
+ *
+ * @return YTRUE if last operation would have blocked
+ */
+YBOOL
+YchannelWouldBlock(Ychannel *channel);
+
+/**
+ * Wait until some of the channels are ready for reading or writing.
+ * Channels having buffered input are ready immediately. Engines without
+ * file descriptor tell their readiness through the callback given to
+ * YchannelSetPollCB(), and are otherwise considered to never block, thus
+ * being ready immediately. End of input is reported as readable.
+ *
+ * @param entries channels to poll, with requested events. Returned events
+ *        are stored into revents of each entry
+ * @param count number of entries
+ * @param timeoutms maximum time to wait in milliseconds, or -1 to wait forever
+ *
+ * @return number of ready entries, 0 on timeout or -1 on error
  */
 int
-YchannelWrite(Ychannel *channel, const void *buf, int towrite);
+YchannelPoll(YchannelPollEntry *entries, int count, int timeoutms);
+
+/**
+ * Enable or disable I/O counters on a Ychannel. Counters are disabled by
+ * default, and cost a single test per operation in that case. When
+ * enabled, time spent in engine callbacks is measured with the monotonic
+ * clock.
+ *
+ * Counters are not synchronized, so a channel must only be used by one
+ * thread at a time while they are enabled. They can't be enabled on a
+ * channel created by YchannelInitShared(); enable them on the underlying
+ * channel instead, which is only written to under the shared channel lock.
+ *
+ * @param channel
+ * @param enable YTRUE to start counting, YFALSE to stop
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR for a shared channel
+ */
+int
+YchannelEnableStats(Ychannel *channel, YBOOL enable);
+
+/**
+ * Get I/O counters of a Ychannel.
+ *
+ * @param channel
+ * @param[out] stats counters, reset to 0 if not enabled on channel
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR if counters are not enabled
+ */
+int
+YchannelGetStats(Ychannel *channel, YchannelStats *stats);
+
+/**
+ * Get I/O counters aggregated over all channels for which they were
+ * enabled, accumulated when these channels are released or their
+ * counters disabled.
+ *
+ * @param[out] stats aggregated counters
+ *
+ * @return YOSAL_OK on success
+ */
+int
+YchannelGetGlobalStats(YchannelStats *stats);
 
 /**
  * Flush a Ychannel, @see YchannelFlushCB
@@ -362,6 +749,18 @@ YchannelFlush(Ychannel *channel);
 void*
 YchannelGetEngine(Ychannel *channel);
 
+/**
+ * Obtain the name of the engine of a channel, as given to YchannelInitGeneric.
+ * Engine implementations can compare it against their own name to check
+ * they own a channel before accessing its engine data.
+ *
+ * @param channel
+ *
+ * @return name of the engine of the Ychannel
+ */
+const char*
+YchannelGetName(Ychannel *channel);
+
 /**
  * Create a new Ychannel using an engine provided by the caller.
  *
@@ -379,6 +778,18 @@ YchannelInitGeneric(const char *name, void *enginedata,
                     YchannelReadCB readcb, YchannelWriteCB writecb,
                     YchannelFlushCB flushcb, YchannelReleaseCB releasecb);
 
+/**
+ * Set the callback telling YchannelPoll() whether the engine of a channel
+ * without file descriptor would block.
+ *
+ * @param channel
+ * @param pollcb engine poll function, or NULL if engine never blocks
+ *
+ * @return YOSAL_OK on success
+ */
+int
+YchannelSetPollCB(Ychannel *channel, YchannelPollCB pollcb);
+
 #ifdef __cplusplus
 };
 #endif
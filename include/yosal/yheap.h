@@ -0,0 +1,266 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+#ifndef _YOSAL_YHEAP_H
+#define _YOSAL_YHEAP_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct YheapStruct Yheap;
+typedef int (*YheapCompareFunc)(const void *a, const void *b);
+
+/**
+ * @defgroup Yheap
+ *
+ * @brief Priority queue
+ *
+ * Yheap is a 4-ary heap stored in an array, keeping the smallest value
+ * according to a comparison function at its top. A 4-ary heap is half as
+ * deep as a binary one, and the children of a node sit in the same cache
+ * line, making removals cheaper.
+ *
+ * Every inserted value gets a handle, stable while it stays in the heap,
+ * to change its priority or remove it. Handles of removed values are
+ * reused by later insertions.
+ *
+ * @{
+ */
+
+/**
+ * Create a new Yheap instance. All Yheaps have to be released using
+ * Yheap_release when they are no longer needed.
+ *
+ * @param compar comparison function, called with two values, returning a
+ *        negative, zero or positive integer if first value is respectively
+ *        smaller than, equal to, or greater than second one
+ *
+ * @return newly created Yheap, or NULL on error
+ */
+Yheap*
+Yheap_create(YheapCompareFunc compar);
+
+/**
+ * Release an existing Yheap. Values themselves are not released.
+ *
+ * @param h heap to be released
+ *
+ * @return YOSAL_OK on success
+ */
+int
+Yheap_release(Yheap *h);
+
+/**
+ * Insert a new value into a Yheap.
+ *
+ * @param h heap to insert into
+ * @param value to be inserted
+ *
+ * @return handle of inserted value, or -1 on error
+ */
+int
+Yheap_push(Yheap *h, void *value);
+
+/**
+ * Insert many values into a Yheap at once. Heap order is restored once
+ * for all, in linear time, which is faster than pushing values one by
+ * one when inserting many values relative to the size of the heap.
+ *
+ * @param h heap to insert into
+ * @param values to be inserted
+ * @param count number of values
+ * @param handles if not NULL, receives handles of inserted values
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR on failure
+ */
+int
+Yheap_pushbatch(Yheap *h, void **values, int count, int *handles);
+
+/**
+ * Retrieve and remove the smallest value from a Yheap.
+ *
+ * @param h heap to pop from
+ *
+ * @return retrieved value, or NULL if heap is empty
+ */
+void*
+Yheap_pop(Yheap *h);
+
+/**
+ * Retrieve and remove the smallest values from a Yheap, in order.
+ *
+ * @param h heap to pop from
+ * @param values receives retrieved values
+ * @param k maximum number of values to retrieve
+ *
+ * @return number of values retrieved
+ */
+int
+Yheap_popbatch(Yheap *h, void **values, int k);
+
+/**
+ * Obtain a reference to the smallest value of a Yheap.
+ *
+ * @param h heap to obtain reference from
+ *
+ * @return retrieved value, or NULL if heap is empty
+ */
+void*
+Yheap_top(Yheap *h);
+
+/**
+ * Replace a value of a Yheap, moving it according to its new priority.
+ * Passing the same value after it changed in place is valid as well.
+ *
+ * @param h heap holding value
+ * @param handle handle of value
+ * @param value new value
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR if handle is not in heap
+ */
+int
+Yheap_update(Yheap *h, int handle, void *value);
+
+/**
+ * Remove a value from a Yheap.
+ *
+ * @param h heap holding value
+ * @param handle handle of value
+ *
+ * @return removed value, or NULL if handle is not in heap
+ */
+void*
+Yheap_remove(Yheap *h, int handle);
+
+/**
+ * Obtain the value of a handle.
+ *
+ * @param h heap holding value
+ * @param handle handle of value
+ *
+ * @return value, or NULL if handle is not in heap
+ */
+void*
+Yheap_get(Yheap *h, int handle);
+
+/**
+ * Determine the size of a Yheap.
+ *
+ * @param h heap whose size is needed
+ *
+ * @return number of values in h
+ */
+int
+Yheap_size(Yheap *h);
+
+/** @} */
+
+typedef struct YtimerwheelStruct Ytimerwheel;
+typedef void (*YtimerwheelFunc)(void *data);
+/* Identifier of a timer, never reused */
+typedef int64_t YtimerId;
+
+/**
+ * @defgroup Ytimerwheel
+ *
+ * @brief Timeouts management
+ *
+ * Ytimerwheel is a hashed timing wheel: timers are spread over a ring of
+ * slots according to their expiration, each slot covering one tick of
+ * time. Adding and cancelling a timer is constant time, and advancing
+ * time only visits the slots of elapsed ticks. This suits large numbers
+ * of timeouts which mostly get cancelled before they expire.
+ *
+ * Timers expire with the resolution of a tick, expiration times being
+ * rounded up to the next one. A wheel is not thread safe.
+ *
+ * @{
+ */
+
+/**
+ * Create a new Ytimerwheel instance.
+ *
+ * @param resolution duration of a tick, in nanoseconds
+ * @param slots number of slots, rounded up to a power of 2. Timers
+ *        expiring beyond a full turn of the wheel are visited once per turn
+ * @param now current time, in nanoseconds
+ *
+ * @return newly created Ytimerwheel, or NULL on error
+ */
+Ytimerwheel*
+Ytimerwheel_create(nsecs_t resolution, int slots, nsecs_t now);
+
+/**
+ * Release an existing Ytimerwheel. Pending timers are dropped.
+ *
+ * @param w wheel to be released
+ *
+ * @return YOSAL_OK on success
+ */
+int
+Ytimerwheel_release(Ytimerwheel *w);
+
+/**
+ * Add a timer to a Ytimerwheel.
+ *
+ * @param w wheel to add timer to
+ * @param expire expiration time, in nanoseconds
+ * @param func function to call once timer expires
+ * @param data argument of func
+ *
+ * @return identifier of timer, or -1 on error
+ */
+YtimerId
+Ytimerwheel_add(Ytimerwheel *w, nsecs_t expire, YtimerwheelFunc func, void *data);
+
+/**
+ * Cancel a timer, before it expires.
+ *
+ * @param w wheel holding timer
+ * @param id identifier of timer
+ *
+ * @return YOSAL_OK on success, YOSAL_ERROR if timer already expired or
+ *         was cancelled
+ */
+int
+Ytimerwheel_cancel(Ytimerwheel *w, YtimerId id);
+
+/**
+ * Advance time of a Ytimerwheel, calling functions of expired timers.
+ * These functions may add and cancel timers.
+ *
+ * @param w wheel to advance
+ * @param now current time, in nanoseconds
+ *
+ * @return number of expired timers
+ */
+int
+Ytimerwheel_advance(Ytimerwheel *w, nsecs_t now);
+
+/**
+ * Determine the number of pending timers of a Ytimerwheel.
+ *
+ * @param w wheel whose size is needed
+ *
+ * @return number of pending timers
+ */
+int
+Ytimerwheel_size(Ytimerwheel *w);
+
+/** @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _YOSAL_YHEAP_H */
@@ -1,6 +1,11 @@
 #ifndef _YOSAL_YOPTIM_H
 #define	_YOSAL_YOPTIM_H
 
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
@@ -33,6 +38,127 @@ extern "C" {
 #  endif
 #endif
 
+/* Size of a cache line, to keep data written by different threads apart */
+#ifndef YCACHELINE_SIZE
+#  define YCACHELINE_SIZE 64
+#endif
+
+#undef YCACHELINE_ALIGNED
+#if defined(__GNUC__)
+#  define YCACHELINE_ALIGNED __attribute__((aligned(YCACHELINE_SIZE)))
+#else
+#  define YCACHELINE_ALIGNED
+#endif
+
+/* Hint to the processor that the current thread is spinning */
+#undef YCPU_RELAX
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#  define YCPU_RELAX() __builtin_ia32_pause()
+#elif defined(__GNUC__) && (defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7))
+#  define YCPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#  define YCPU_RELAX() do { } while (0)
+#endif
+
+/*
+ * Parking of threads waiting for a condition published without lock, e.g.
+ * the state of a lock-free ring.
+ *
+ * A thread about to sleep takes the lock, registers with Ypark_enter(),
+ * then checks the condition again before each Ypark_wait(). A thread
+ * publishing the condition calls Ypark_wake() without the lock. Both the
+ * registration and the read of the number of waiting threads are full
+ * barriers: either the waker sees the waiter registered, and signals it
+ * under the lock it sleeps with, or the waiter sees the published
+ * condition. Wakers only take the lock while some thread is waiting.
+ *
+ * Waiting threads usually spin for YPARK_SPIN polls before parking, since
+ * another thread is often about to make progress.
+ */
+#define YPARK_SPIN 64
+
+typedef struct {
+  /* Number of threads registered as waiting */
+  int waiting;
+  pthread_cond_t cond;
+} Ypark;
+
+static inline void
+Ypark_init(Ypark *park)
+{
+  park->waiting = 0;
+  pthread_cond_init(&park->cond, NULL);
+}
+
+static inline void
+Ypark_destroy(Ypark *park)
+{
+  pthread_cond_destroy(&park->cond);
+}
+
+/* Register calling thread, holding lock, before checking condition */
+static inline void
+Ypark_enter(Ypark *park)
+{
+  __sync_fetch_and_add(&park->waiting, 1);
+}
+
+static inline void
+Ypark_leave(Ypark *park)
+{
+  __sync_fetch_and_sub(&park->waiting, 1);
+}
+
+/* Absolute deadline, timeoutms milliseconds from now */
+static inline void
+Ypark_deadline(struct timespec *deadline, int timeoutms)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  deadline->tv_sec = now.tv_sec + timeoutms / 1000;
+  deadline->tv_nsec = now.tv_usec * 1000 + (long) (timeoutms % 1000) * 1000000;
+  if (deadline->tv_nsec >= 1000000000) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
+
+/* Sleep, holding lock, until woken up, or past deadline if not NULL.
+   Return non zero once timed out. */
+static inline int
+Ypark_wait(Ypark *park, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+  if (deadline == NULL) {
+    pthread_cond_wait(&park->cond, lock);
+    return 0;
+  }
+
+  return (pthread_cond_timedwait(&park->cond, lock, deadline) == ETIMEDOUT);
+}
+
+/* Wake up one or all waiting threads, after publishing condition */
+static inline void
+Ypark_wake(Ypark *park, pthread_mutex_t *lock, int all)
+{
+  if (__sync_fetch_and_add(&park->waiting, 0) > 0) {
+    pthread_mutex_lock(lock);
+    if (all) {
+      pthread_cond_broadcast(&park->cond);
+    } else {
+      pthread_cond_signal(&park->cond);
+    }
+    pthread_mutex_unlock(lock);
+  }
+}
+
+/* Wake up all waiting threads, holding lock, e.g. when shutting down */
+static inline void
+Ypark_wakeall(Ypark *park)
+{
+  pthread_cond_broadcast(&park->cond);
+}
+
 
 #ifdef	__cplusplus
 }
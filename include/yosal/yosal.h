@@ -34,6 +34,7 @@
 #include "yosal/yoptim.h"
 
 #include "yosal/yalloc.h"
+#include "yosal/ypool.h"
 
 #include "yosal/hash.h"
 #include "yosal/digest.h"
@@ -41,15 +42,19 @@
 
 #include "yosal/ybool.h"
 #include "yosal/yobject.h"
+#include "yosal/ythreadpool.h"
+#include "yosal/ysort.h"
 #include "yosal/hashmap.h"
 #include "yosal/queue.h"
 #include "yosal/array.h"
+#include "yosal/yring.h"
 
 #include "yosal/yalloc.h"
 #include "yosal/ybuffer.h"
 #include "yosal/ychannel.h"
 
 #include "yosal/ytime.h"
+#include "yosal/yheap.h"
 #include "yosal/yrandom.h"
 
 #include "yosal/ytest.h"
@@ -0,0 +1,98 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/**
+ * @file   ypool.h
+ * @addtogroup Ypool
+ * @brief  Pool allocator for fixed size objects
+ */
+#ifndef _YOSAL_YPOOL_H
+#define _YOSAL_YPOOL_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Use object pools for internal fixed size structures (hashmap entries),
+   disabled by default */
+#ifndef YOSAL_CONFIG_YPOOL
+#define YOSAL_CONFIG_YPOOL 0
+#endif
+
+/**
+ * @defgroup Ypool Ypool
+ *
+ * This module provides a thread safe allocator for objects of a fixed size.
+ * Each thread allocates from and releases to its own magazines, small
+ * stacks of objects, so that most operations are a few instructions and
+ * take no lock. Full and empty magazines are exchanged with a global
+ * depot, under a lock.
+ *
+ * @{
+ */
+typedef struct YpoolStruct Ypool;
+
+/**
+ * @brief Create an object pool
+ * @ingroup yosal
+ *
+ * @param objsize size of objects allocated from pool
+ * @return new pool, or NULL on error
+ */
+Ypool*
+Ypool_create(size_t objsize);
+
+/**
+ * @brief Release an object pool
+ * @ingroup yosal
+ *
+ * Release a pool and all memory it holds, including objects not yet
+ * released. No other thread may be using the pool at that time.
+ *
+ * @param pool pool to release
+ */
+void
+Ypool_release(Ypool *pool);
+
+/**
+ * @brief Allocate an object from a pool
+ * @ingroup yosal
+ *
+ * Returned memory is aligned on twice the size of a pointer.
+ *
+ * @param pool pool to allocate from
+ * @return pointer to object, or NULL on error
+ */
+void*
+Ypool_alloc(Ypool *pool);
+
+/**
+ * @brief Return an object to its pool
+ * @ingroup yosal
+ *
+ * Object can be released by another thread than the one that allocated it.
+ *
+ * @param pool pool object was allocated from
+ * @param obj object to release, may be NULL
+ */
+void
+Ypool_free(Ypool *pool, void *obj);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _YOSAL_YPOOL_H */
@@ -0,0 +1,192 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/**
+ * @file   yring.h
+ * @addtogroup Yring
+ * @brief  Single producer, single consumer rings
+ */
+#ifndef _YOSAL_YRING_H
+#define _YOSAL_YRING_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup Yring Yring
+ *
+ * This module provides wait-free rings between exactly one producer
+ * thread and one consumer thread. Each side only writes its own index,
+ * on its own cache line, and keeps a cached copy of the index of the
+ * other side, refreshed only when the ring looks full or empty, so that
+ * most operations don't touch any cache line written by the other thread.
+ *
+ * Yring transfers pointers, Ybytering transfers a stream of bytes.
+ * Neither ever blocks: waiting for data or room is left to the caller.
+ *
+ * @{
+ */
+typedef struct YringStruct Yring;
+typedef struct YbyteringStruct Ybytering;
+
+/**
+ * @brief Create a ring of pointers
+ * @ingroup yosal
+ *
+ * @param capacity maximum number of values, rounded up to a power of 2.
+ *        Minimum capacity is 2, a capacity of 1 being rounded up to 2
+ * @return new ring, or NULL on error, or if capacity is not positive
+ */
+Yring*
+Yring_create(int capacity);
+
+/**
+ * @brief Release a ring of pointers
+ * @ingroup yosal
+ *
+ * @param ring ring to release
+ */
+void
+Yring_release(Yring *ring);
+
+/**
+ * @brief Insert a value into a ring, from producer thread
+ * @ingroup yosal
+ *
+ * @param ring ring to append to
+ * @param value value to insert
+ * @return YOSAL_OK on success, YOSAL_ERROR if ring is full
+ */
+int
+Yring_push(Yring *ring, void *value);
+
+/**
+ * @brief Retrieve and remove the oldest value of a ring, from consumer thread
+ * @ingroup yosal
+ *
+ * @param ring ring to pop from
+ * @param[out] valueref retrieved value
+ * @return YOSAL_OK on success, YOSAL_ERROR if ring is empty
+ */
+int
+Yring_pop(Yring *ring, void **valueref);
+
+/**
+ * @brief Insert values into a ring, from producer thread
+ * @ingroup yosal
+ *
+ * Values are published to the consumer all at once.
+ *
+ * @param ring ring to append to
+ * @param values values to insert
+ * @param count number of values
+ * @return number of values inserted, as many as there was room for
+ */
+int
+Yring_pushbatch(Yring *ring, void **values, int count);
+
+/**
+ * @brief Retrieve and remove oldest values of a ring, from consumer thread
+ * @ingroup yosal
+ *
+ * @param ring ring to pop from
+ * @param[out] values retrieved values
+ * @param count maximum number of values
+ * @return number of values retrieved
+ */
+int
+Yring_popbatch(Yring *ring, void **values, int count);
+
+/**
+ * @brief Number of values in a ring
+ * @ingroup yosal
+ *
+ * This is only a snapshot when called while the other thread uses the ring.
+ *
+ * @param ring ring
+ * @return number of values
+ */
+int
+Yring_size(Yring *ring);
+
+/**
+ * @brief Create a ring of bytes
+ * @ingroup yosal
+ *
+ * @param capacity maximum number of bytes, rounded up to a power of 2.
+ *        Minimum capacity is 2, a capacity of 1 being rounded up to 2
+ * @return new ring, or NULL on error, or if capacity is not positive
+ */
+Ybytering*
+Ybytering_create(int capacity);
+
+/**
+ * @brief Release a ring of bytes
+ * @ingroup yosal
+ *
+ * @param ring ring to release
+ */
+void
+Ybytering_release(Ybytering *ring);
+
+/**
+ * @brief Write bytes into a ring, from producer thread
+ * @ingroup yosal
+ *
+ * @param ring ring to write to
+ * @param buf data to write
+ * @param nbytes number of bytes to write
+ * @return number of bytes written, as many as there was room for
+ */
+int
+Ybytering_write(Ybytering *ring, const void *buf, int nbytes);
+
+/**
+ * @brief Read bytes from a ring, from consumer thread
+ * @ingroup yosal
+ *
+ * @param ring ring to read from
+ * @param buf buffer receiving data
+ * @param nbytes maximum number of bytes to read
+ * @return number of bytes read
+ */
+int
+Ybytering_read(Ybytering *ring, void *buf, int nbytes);
+
+/**
+ * @brief Number of bytes that can be read from a ring, from consumer thread
+ * @ingroup yosal
+ *
+ * @param ring ring
+ * @return number of bytes
+ */
+int
+Ybytering_readable(Ybytering *ring);
+
+/**
+ * @brief Number of bytes that can be written into a ring, from producer thread
+ * @ingroup yosal
+ *
+ * @param ring ring
+ * @return number of bytes
+ */
+int
+Ybytering_writable(Ybytering *ring);
+
+/** @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _YOSAL_YRING_H */
@@ -0,0 +1,243 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/**
+ * @file   ysort.h
+ * @addtogroup Ysort
+ * @brief  Sorting of arrays
+ */
+#ifndef _YOSAL_YSORT_H
+#define _YOSAL_YSORT_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup Ysort Ysort
+ *
+ * This module provides an introsort: a quicksort with median of three
+ * pivots, finishing small partitions with an insertion sort, and falling
+ * back to a heapsort when partitions are too unbalanced, so that it never
+ * takes more than O(n log n) comparisons. It is not stable.
+ *
+ * Ysort sorts arrays of pointers through a comparison function. The
+ * YSORT_DEFINE macro generates a sort function for arrays of any type,
+ * with an inlined comparison, which is several times faster.
+ *
+ * A parallel merge sort splits large arrays across workers of a thread
+ * pool, sorting slices with an introsort before merging them.
+ *
+ * @{
+ */
+
+/**
+ * Comparison function, called like for qsort with pointers to two array
+ * elements, returning a negative, zero or positive integer if first
+ * element is respectively smaller than, equal to, or greater than second
+ */
+typedef int (*YsortCompareFunc)(const void *a, const void *b);
+
+/**
+ * @brief Sort an array of pointers
+ * @ingroup yosal
+ *
+ * @param base array to sort
+ * @param n number of elements
+ * @param compar comparison function
+ */
+void
+Ysort(void **base, size_t n, YsortCompareFunc compar);
+
+/**
+ * @brief Sort an array of pointers, in parallel
+ * @ingroup yosal
+ *
+ * Small arrays, or arrays whose copy can't be allocated, are sorted by
+ * calling thread alone.
+ *
+ * @param base array to sort
+ * @param n number of elements
+ * @param compar comparison function, called from many threads
+ * @param pool pool of workers sorting array, or NULL
+ * @return YOSAL_OK on success, YOSAL_ERROR on failure
+ */
+int
+Ysort_parallel(void **base, size_t n, YsortCompareFunc compar, Ythreadpool *pool);
+
+/* Partitions of at most this size are finished by insertion sort */
+#define YSORT_INSERTION_MAX 16
+
+#define YSORT_SWAP(type, a, b) do { type _t = (a); (a) = (b); (b) = _t; } while (0)
+
+/**
+ * Define a sort function with an extra context argument, available to the
+ * comparison as ysort_context:
+ * <code>static void name(type *base, size_t n, contexttype ysort_context)</code>
+ *
+ * @param name name of sort function
+ * @param type type of array elements
+ * @param contexttype type of context argument
+ * @param less macro or function returning non zero if first element
+ *        must be sorted before second one
+ */
+#define YSORT_DEFINE_CONTEXT(name, type, contexttype, less)                  \
+static inline void                                                           \
+name##_insertion(type *base, size_t n, contexttype ysort_context)             \
+{                                                                            \
+  size_t i;                                                                  \
+  size_t j;                                                                  \
+  type value;                                                                \
+                                                                             \
+  for (i = 1; i < n; i++) {                                                  \
+    value = base[i];                                                         \
+    for (j = i; j > 0 && less(value, base[j - 1]); j--) {                    \
+      base[j] = base[j - 1];                                                 \
+    }                                                                        \
+    base[j] = value;                                                         \
+  }                                                                          \
+}                                                                            \
+                                                                             \
+static inline void                                                           \
+name##_sift(type *base, size_t root, size_t n, contexttype ysort_context)    \
+{                                                                            \
+  type value = base[root];                                                   \
+  size_t child;                                                              \
+                                                                             \
+  while ((child = 2 * root + 1) < n) {                                       \
+    if (child + 1 < n && less(base[child], base[child + 1])) {               \
+      child++;                                                               \
+    }                                                                        \
+    if (!less(value, base[child])) {                                         \
+      break;                                                                 \
+    }                                                                        \
+    base[root] = base[child];                                                \
+    root = child;                                                            \
+  }                                                                          \
+  base[root] = value;                                                        \
+}                                                                            \
+                                                                             \
+static inline void                                                           \
+name##_heapsort(type *base, size_t n, contexttype ysort_context)             \
+{                                                                            \
+  size_t i;                                                                  \
+                                                                             \
+  for (i = n / 2; i > 0; i--) {                                              \
+    name##_sift(base, i - 1, n, ysort_context);                              \
+  }                                                                          \
+  for (i = n - 1; i > 0; i--) {                                              \
+    YSORT_SWAP(type, base[0], base[i]);                                      \
+    name##_sift(base, 0, i, ysort_context);                                  \
+  }                                                                          \
+}                                                                            \
+                                                                             \
+static inline void                                                           \
+name##_intro(type *base, size_t n, int depth, contexttype ysort_context)     \
+{                                                                            \
+  type pivot;                                                                \
+  size_t mid;                                                                \
+  size_t i;                                                                  \
+  size_t j;                                                                  \
+                                                                             \
+  while (n > YSORT_INSERTION_MAX) {                                          \
+    if (depth-- == 0) {                                                      \
+      name##_heapsort(base, n, ysort_context);                               \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    /* Median of first, middle and last elements */                          \
+    mid = n / 2;                                                             \
+    if (less(base[mid], base[0])) {                                          \
+      YSORT_SWAP(type, base[mid], base[0]);                                  \
+    }                                                                        \
+    if (less(base[n - 1], base[mid])) {                                      \
+      YSORT_SWAP(type, base[n - 1], base[mid]);                              \
+      if (less(base[mid], base[0])) {                                        \
+        YSORT_SWAP(type, base[mid], base[0]);                                \
+      }                                                                      \
+    }                                                                        \
+    pivot = base[mid];                                                       \
+                                                                             \
+    /* Hoare partition, leaving [0, i) before pivot and [j + 1, n) after */  \
+    i = 0;                                                                   \
+    j = n - 1;                                                               \
+    for (;;) {                                                               \
+      while (less(base[i], pivot)) {                                         \
+        i++;                                                                 \
+      }                                                                      \
+      while (less(pivot, base[j])) {                                         \
+        j--;                                                                 \
+      }                                                                      \
+      if (i >= j) {                                                          \
+        break;                                                               \
+      }                                                                      \
+      YSORT_SWAP(type, base[i], base[j]);                                    \
+      i++;                                                                   \
+      j--;                                                                   \
+    }                                                                        \
+                                                                             \
+    /* Recurse into smaller partition, loop on larger one */                 \
+    if (i < n - j - 1) {                                                     \
+      name##_intro(base, i, depth, ysort_context);                           \
+      base += j + 1;                                                         \
+      n -= j + 1;                                                            \
+    } else {                                                                 \
+      name##_intro(base + j + 1, n - j - 1, depth, ysort_context);           \
+      n = i;                                                                 \
+    }                                                                        \
+  }                                                                          \
+  name##_insertion(base, n, ysort_context);                                  \
+}                                                                            \
+                                                                             \
+static inline void                                                           \
+name(type *base, size_t n, contexttype ysort_context)                        \
+{                                                                            \
+  size_t m;                                                                  \
+  int depth = 0;                                                             \
+                                                                             \
+  for (m = n; m > 1; m >>= 1) {                                              \
+    depth += 2;                                                              \
+  }                                                                          \
+  name##_intro(base, n, depth, ysort_context);                               \
+}
+
+/**
+ * Define a sort function:
+ * <code>static void name(type *base, size_t n)</code>
+ *
+ * For example, to sort integers:
+ * <code>
+ * #define INT_LESS(a, b) ((a) < (b))
+ * YSORT_DEFINE(sortints, int, INT_LESS)
+ * </code>
+ *
+ * @param name name of sort function
+ * @param type type of array elements
+ * @param less macro or function returning non zero if first element
+ *        must be sorted before second one
+ */
+#define YSORT_DEFINE(name, type, less)                                       \
+YSORT_DEFINE_CONTEXT(name##_context, type, void*, less)                      \
+                                                                             \
+static inline void                                                           \
+name(type *base, size_t n)                                                   \
+{                                                                            \
+  name##_context(base, n, NULL);                                             \
+}
+
+/** @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _YOSAL_YSORT_H */
@@ -0,0 +1,158 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/**
+ * @file   ythreadpool.h
+ * @addtogroup Ythreadpool
+ * @brief  Work-stealing thread pool
+ */
+#ifndef _YOSAL_YTHREADPOOL_H
+#define _YOSAL_YTHREADPOOL_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup Ythreadpool Ythreadpool
+ *
+ * This module provides a pool of worker threads running tasks. Each worker
+ * has its own deque of tasks: tasks submitted from a worker are pushed to
+ * and taken from the bottom of its deque without contention, while idle
+ * workers steal from the top of the others. Tasks submitted from other
+ * threads go through a shared injection queue.
+ *
+ * Tasks may belong to a group, to wait for all of them. A thread waiting
+ * for a group runs pending tasks meanwhile, so that tasks can themselves
+ * submit and wait for subtasks without exhausting workers.
+ *
+ * @{
+ */
+typedef struct YthreadpoolStruct Ythreadpool;
+typedef struct YtaskgroupStruct Ytaskgroup;
+
+typedef void (*YthreadpoolFunc)(void *arg);
+typedef void (*YthreadpoolRangeFunc)(void *arg, size_t begin, size_t end);
+
+/**
+ * Pin each worker to a single CPU, spreading workers in turn over the CPUs
+ * the creating thread is allowed to run on. No CPU list can be given.
+ */
+#define YTHREADPOOL_AFFINITY 1
+
+/**
+ * @brief Create a thread pool
+ * @ingroup yosal
+ *
+ * @param nthreads number of worker threads, or 0 for one per online CPU
+ * @param flags combination of YTHREADPOOL_* flags
+ * @return new pool, or NULL on error
+ */
+Ythreadpool*
+Ythreadpool_create(int nthreads, int flags);
+
+/**
+ * @brief Release a thread pool
+ * @ingroup yosal
+ *
+ * Tasks already submitted are run before workers exit. No task may be
+ * submitted anymore, and every group must have been released.
+ *
+ * @param pool pool to release
+ */
+void
+Ythreadpool_release(Ythreadpool *pool);
+
+/**
+ * @brief Number of worker threads of a pool
+ * @ingroup yosal
+ *
+ * @param pool pool
+ * @return number of workers
+ */
+int
+Ythreadpool_size(Ythreadpool *pool);
+
+/**
+ * @brief Submit a task to a thread pool
+ * @ingroup yosal
+ *
+ * @param pool pool to run task
+ * @param group group of task, or NULL
+ * @param func function to call from a worker
+ * @param arg argument of func
+ * @return YOSAL_OK on success, YOSAL_ERROR on failure
+ */
+int
+Ythreadpool_submit(Ythreadpool *pool, Ytaskgroup *group,
+                   YthreadpoolFunc func, void *arg);
+
+/**
+ * @brief Call a function over a range, split across workers
+ * @ingroup yosal
+ *
+ * Range is split in halves until they are no larger than grain, calling
+ * func over each of them, and waiting until all calls returned. Without
+ * a pool, func is called once over the whole range.
+ *
+ * @param pool pool to run calls, or NULL
+ * @param begin first index of range
+ * @param end index following last one of range
+ * @param grain largest number of indexes per call, or 0 for a split
+ *        depending on number of workers
+ * @param func function to call over a subrange
+ * @param arg first argument of func
+ * @return YOSAL_OK on success, YOSAL_ERROR on failure
+ */
+int
+Ythreadpool_parallel_for(Ythreadpool *pool, size_t begin, size_t end, size_t grain,
+                         YthreadpoolRangeFunc func, void *arg);
+
+/**
+ * @brief Create a group of tasks
+ * @ingroup yosal
+ *
+ * @param pool pool running tasks of group
+ * @return new group, or NULL on error
+ */
+Ytaskgroup*
+Ytaskgroup_create(Ythreadpool *pool);
+
+/**
+ * @brief Wait until all tasks of a group returned
+ * @ingroup yosal
+ *
+ * This may be called from a task, the calling thread running other tasks
+ * until the group is done.
+ *
+ * @param group group to wait for
+ * @return YOSAL_OK on success, YOSAL_ERROR on failure
+ */
+int
+Ytaskgroup_wait(Ytaskgroup *group);
+
+/**
+ * @brief Release a group of tasks, after waiting for them
+ * @ingroup yosal
+ *
+ * @param group group to release
+ */
+void
+Ytaskgroup_release(Ytaskgroup *group);
+
+/** @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _YOSAL_YTHREADPOOL_H */
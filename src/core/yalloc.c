@@ -10,22 +10,632 @@
  * the License. See accompanying LICENSE file.
  */
 
+#define LOG_TAG "yosal::ymem"
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #ifndef WIN32
 #  include <unistd.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#endif
+#ifdef __linux__
+#  include <sys/syscall.h>
 #endif
 
 #include "yosal/yosal.h"
 
+#include <pthread.h>
+
+static void*
+defaultMalloc(size_t size)
+{
+  return malloc(size);
+}
+
+static void*
+defaultRealloc(void *ptr, size_t size)
+{
+  return realloc(ptr, size);
+}
+
+static void
+defaultFree(void *ptr)
+{
+  free(ptr);
+}
+
+static const YmemBackend gDefaultBackend = {
+  defaultMalloc,
+  defaultRealloc,
+  defaultFree
+};
+
+static const YmemBackend *gBackend = &gDefaultBackend;
+
+int
+Ymem_setbackend(const YmemBackend *backend)
+{
+  if (backend == NULL) {
+    backend = &gDefaultBackend;
+  }
+  if (backend->malloc == NULL || backend->realloc == NULL || backend->free == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  gBackend = backend;
+
+  return YOSAL_OK;
+}
+
+#if YOSAL_CONFIG_YMEM_CACHE
+/*
+ * Thread caching allocator. Small blocks are rounded up to a size class,
+ * and kept on per-thread free lists once released, so that most
+ * allocations and releases don't touch any shared state. Lists exceeding
+ * their limit move half of their blocks at once to a global depot, where
+ * other threads refill from, also by batches. Blocks released by another
+ * thread than the one that allocated them are thus returned in batches.
+ *
+ * Every block is preceded by a header recording its size class.
+ */
+#define YMEM_CLASS_COUNT 14
+#define YMEM_CLASS_LARGE YMEM_CLASS_COUNT
+/* Maximum number of blocks cached by each thread, per class */
+#define YMEM_CACHE_LIMIT 64
+/* Number of blocks moved between thread caches and depot at once */
+#define YMEM_CACHE_BATCH 32
+/* Maximum number of blocks held by depot, per class */
+#define YMEM_DEPOT_LIMIT 4096
+
+typedef union {
+  struct {
+    size_t sizeclass;
+    /* Requested size, for large blocks */
+    size_t size;
+  } h;
+  /* Keep payload aligned as strictly as malloc does */
+  long double align;
+} YmemHeader;
+
+typedef struct YmemBlockStruct YmemBlock;
+
+struct YmemBlockStruct {
+  YmemBlock *next;
+};
+
+typedef struct {
+  YmemBlock *head;
+  int count;
+} YmemFreeList;
+
+typedef struct {
+  YmemFreeList lists[YMEM_CLASS_COUNT];
+} YmemCache;
+
+typedef struct {
+  pthread_mutex_t lock;
+  YmemFreeList list;
+} YmemDepot;
+
+static const size_t gClassSizes[YMEM_CLASS_COUNT] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+static YmemDepot gDepots[YMEM_CLASS_COUNT];
+static pthread_key_t gCacheKey;
+static pthread_once_t gCacheOnce = PTHREAD_ONCE_INIT;
+static int gCacheReady = 0;
+
+#define HEADER_OF(ptr) (((YmemHeader*) (ptr)) - 1)
+#define PAYLOAD_OF(header) ((void*) (((YmemHeader*) (header)) + 1))
+
+static int
+sizeClass(size_t size)
+{
+  int c;
+
+  if (size > gClassSizes[YMEM_CLASS_COUNT - 1]) {
+    return YMEM_CLASS_LARGE;
+  }
+  for (c = 0; gClassSizes[c] < size; c++) {
+  }
+
+  return c;
+}
+
+/* Move up to count blocks from list into depot, then release the rest
+   to backend if depot is full */
+static void
+depotPut(int c, YmemFreeList *list, int count)
+{
+  YmemDepot *depot = &gDepots[c];
+  YmemBlock *first;
+  YmemBlock *last;
+  YmemBlock *block;
+  int n;
+
+  if (count <= 0 || list->head == NULL) {
+    return;
+  }
+
+  /* Detach batch from list, outside of lock */
+  first = list->head;
+  last = first;
+  for (n = 1; n < count && last->next != NULL; n++) {
+    last = last->next;
+  }
+  list->head = last->next;
+  list->count -= n;
+
+  pthread_mutex_lock(&depot->lock);
+  if (depot->list.count + n <= YMEM_DEPOT_LIMIT) {
+    last->next = depot->list.head;
+    depot->list.head = first;
+    depot->list.count += n;
+    first = NULL;
+  }
+  pthread_mutex_unlock(&depot->lock);
+
+  while (first != NULL) {
+    block = first;
+    first = block == last ? NULL : block->next;
+    gBackend->free(HEADER_OF(block));
+  }
+}
+
+/* Take a batch of blocks from depot into list */
+static void
+depotGet(int c, YmemFreeList *list)
+{
+  YmemDepot *depot = &gDepots[c];
+  YmemBlock *first;
+  YmemBlock *last;
+  int n;
+
+  pthread_mutex_lock(&depot->lock);
+  first = depot->list.head;
+  if (first != NULL) {
+    last = first;
+    for (n = 1; n < YMEM_CACHE_BATCH && last->next != NULL; n++) {
+      last = last->next;
+    }
+    depot->list.head = last->next;
+    depot->list.count -= n;
+    last->next = list->head;
+    list->head = first;
+    list->count += n;
+  }
+  pthread_mutex_unlock(&depot->lock);
+}
+
+/* Flush cache of exiting thread */
+static void
+cacheDestroy(void *data)
+{
+  YmemCache *cache = (YmemCache*) data;
+  int c;
+
+  for (c = 0; c < YMEM_CLASS_COUNT; c++) {
+    while (cache->lists[c].head != NULL) {
+      depotPut(c, &cache->lists[c], YMEM_CACHE_BATCH);
+    }
+  }
+
+  gBackend->free(cache);
+}
+
+static void
+cacheInit()
+{
+  int c;
+
+  for (c = 0; c < YMEM_CLASS_COUNT; c++) {
+    pthread_mutex_init(&gDepots[c].lock, NULL);
+    gDepots[c].list.head = NULL;
+    gDepots[c].list.count = 0;
+  }
+
+  if (pthread_key_create(&gCacheKey, cacheDestroy) == 0) {
+    gCacheReady = 1;
+  }
+}
+
+static YmemCache*
+threadCache()
+{
+  YmemCache *cache;
+
+  pthread_once(&gCacheOnce, cacheInit);
+  if (!gCacheReady) {
+    return NULL;
+  }
+
+  cache = (YmemCache*) pthread_getspecific(gCacheKey);
+  if (cache == NULL) {
+    cache = (YmemCache*) gBackend->malloc(sizeof(YmemCache));
+    if (cache == NULL) {
+      return NULL;
+    }
+    memset(cache, 0, sizeof(YmemCache));
+    if (pthread_setspecific(gCacheKey, cache) != 0) {
+      gBackend->free(cache);
+      return NULL;
+    }
+  }
+
+  return cache;
+}
+
+static void*
+cacheMalloc(size_t size)
+{
+  YmemCache *cache;
+  YmemFreeList *list;
+  YmemHeader *header;
+  YmemBlock *block;
+  int c;
+
+  c = sizeClass(size);
+  if (c != YMEM_CLASS_LARGE) {
+    cache = threadCache();
+    if (cache != NULL) {
+      list = &cache->lists[c];
+      if (list->head == NULL) {
+        depotGet(c, list);
+      }
+      block = list->head;
+      if (block != NULL) {
+        list->head = block->next;
+        list->count--;
+        return block;
+      }
+    }
+    size = gClassSizes[c];
+  }
+
+  header = (YmemHeader*) gBackend->malloc(sizeof(YmemHeader) + size);
+  if (header == NULL) {
+    return NULL;
+  }
+  header->h.sizeclass = c;
+  header->h.size = size;
+
+  return PAYLOAD_OF(header);
+}
+
+static void
+cacheFree(void *ptr)
+{
+  YmemHeader *header = HEADER_OF(ptr);
+  YmemCache *cache;
+  YmemFreeList *list;
+  YmemBlock *block;
+  int c;
+
+  c = (int) header->h.sizeclass;
+  if (c != YMEM_CLASS_LARGE) {
+    cache = threadCache();
+    if (cache != NULL) {
+      list = &cache->lists[c];
+      block = (YmemBlock*) ptr;
+      block->next = list->head;
+      list->head = block;
+      list->count++;
+      if (list->count > YMEM_CACHE_LIMIT) {
+        depotPut(c, list, YMEM_CACHE_LIMIT / 2);
+      }
+      return;
+    }
+  }
+
+  gBackend->free(header);
+}
+
+static void*
+cacheRealloc(void *ptr, size_t size)
+{
+  YmemHeader *header;
+  void *newptr;
+  size_t oldsize;
+
+  if (ptr == NULL) {
+    return cacheMalloc(size);
+  }
+
+  header = HEADER_OF(ptr);
+  oldsize = header->h.size;
+  if (header->h.sizeclass == YMEM_CLASS_LARGE && size > gClassSizes[YMEM_CLASS_COUNT - 1]) {
+    header = (YmemHeader*) gBackend->realloc(header, sizeof(YmemHeader) + size);
+    if (header == NULL) {
+      return NULL;
+    }
+    header->h.size = size;
+    return PAYLOAD_OF(header);
+  }
+
+  if (size <= oldsize && sizeClass(size) == (int) header->h.sizeclass) {
+    /* Still fits in same block */
+    return ptr;
+  }
+
+  newptr = cacheMalloc(size);
+  if (newptr == NULL) {
+    return NULL;
+  }
+  memcpy(newptr, ptr, oldsize < size ? oldsize : size);
+  cacheFree(ptr);
+
+  return newptr;
+}
+#endif
+
+/* Underlying allocator, caching small blocks per thread when enabled */
+static void*
+rawMalloc(size_t size)
+{
+#if YOSAL_CONFIG_YMEM_CACHE
+  return cacheMalloc(size);
+#else
+  return gBackend->malloc(size);
+#endif
+}
+
+static void*
+rawRealloc(void *ptr, size_t size)
+{
+#if YOSAL_CONFIG_YMEM_CACHE
+  return cacheRealloc(ptr, size);
+#else
+  return gBackend->realloc(ptr, size);
+#endif
+}
+
+static void
+rawFree(void *ptr)
+{
+#if YOSAL_CONFIG_YMEM_CACHE
+  cacheFree(ptr);
+#else
+  gBackend->free(ptr);
+#endif
+}
+
+static const char *gTagNames[YMEM_TAG_MAX] = {
+  "default", "hashmap", "array", "queue", "buffer", "channel", "arena", "pool",
+  "large"
+};
+static int gTagCount = YMEM_TAG_USER;
+static pthread_mutex_t gTagLock = PTHREAD_MUTEX_INITIALIZER;
+
+int
+Ymem_tag_register(const char *name)
+{
+  int tag;
+
+  if (name == NULL) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&gTagLock);
+  for (tag = 0; tag < gTagCount; tag++) {
+    if (strcmp(gTagNames[tag], name) == 0) {
+      break;
+    }
+  }
+  if (tag == gTagCount) {
+    if (gTagCount < YMEM_TAG_MAX) {
+      gTagNames[gTagCount++] = name;
+    } else {
+      tag = -1;
+    }
+  }
+  pthread_mutex_unlock(&gTagLock);
+
+  return tag;
+}
+
+#if YOSAL_CONFIG_YMEM_STATS
+/*
+ * Memory accounting. Every block is preceded by a header recording its
+ * requested size and tag, so that releases are accounted without callers
+ * passing them back. Counters are only updated atomically, which keeps
+ * the cost low enough for long-running processes.
+ *
+ * Sampling profiler records the caller of the allocation crossing each
+ * multiple of the sampling period, counting bytes allocated by all
+ * threads, into a small open-addressing table of sites.
+ */
+#define YMEM_SITE_COUNT 256
+/* Reallocation keeps tag of block */
+#define YMEM_TAG_KEEP (-1)
+
+typedef union {
+  struct {
+    size_t size;
+    int tag;
+  } h;
+  /* Keep payload aligned as strictly as malloc does */
+  long double align;
+} YmemStatsHeader;
+
+typedef struct {
+  size_t live;
+  size_t peak;
+  size_t allocs;
+  size_t frees;
+} YmemCounters;
+
+static YmemCounters gCounters[YMEM_TAG_MAX];
+static YmemCounters gTotal;
+static size_t gSamplePeriod = 0;
+static size_t gSampleBytes = 0;
+static YmemSite gSites[YMEM_SITE_COUNT];
+static pthread_mutex_t gSiteLock = PTHREAD_MUTEX_INITIALIZER;
+
+#define STATS_HEADER_OF(ptr) (((YmemStatsHeader*) (ptr)) - 1)
+#define STATS_PAYLOAD_OF(header) ((void*) (((YmemStatsHeader*) (header)) + 1))
+
+static void
+counterAdd(YmemCounters *counters, size_t size)
+{
+  size_t live;
+  size_t peak;
+
+  __sync_fetch_and_add(&counters->allocs, 1);
+  live = __sync_add_and_fetch(&counters->live, size);
+  do {
+    peak = __atomic_load_n(&counters->peak, __ATOMIC_RELAXED);
+  } while (peak < live &&
+           !__sync_bool_compare_and_swap(&counters->peak, peak, live));
+}
+
+static void
+counterSub(YmemCounters *counters, size_t size)
+{
+  __sync_fetch_and_add(&counters->frees, 1);
+  __sync_fetch_and_sub(&counters->live, size);
+}
+
+static void
+siteRecord(void *site, size_t size)
+{
+  size_t i;
+  size_t n;
+
+  i = (((size_t) site) >> 2) * 2654435761u;
+  pthread_mutex_lock(&gSiteLock);
+  for (n = 0; n < YMEM_SITE_COUNT; n++, i++) {
+    YmemSite *entry = &gSites[i & (YMEM_SITE_COUNT - 1)];
+    if (entry->site == NULL) {
+      entry->site = site;
+    }
+    if (entry->site == site) {
+      entry->samples++;
+      entry->bytes += size;
+      break;
+    }
+  }
+  /* Sample is dropped once table is full */
+  pthread_mutex_unlock(&gSiteLock);
+}
+
+static void
+statsAccount(int tag, size_t size, void *site)
+{
+  size_t period;
+  size_t before;
+
+  counterAdd(&gCounters[tag], size);
+  counterAdd(&gTotal, size);
+
+  period = __atomic_load_n(&gSamplePeriod, __ATOMIC_RELAXED);
+  if (period > 0) {
+    before = __sync_fetch_and_add(&gSampleBytes, size);
+    if (before / period != (before + size) / period) {
+      siteRecord(site, size);
+    }
+  }
+}
+
+static void
+statsRelease(int tag, size_t size)
+{
+  counterSub(&gCounters[tag], size);
+  counterSub(&gTotal, size);
+}
+
+static void*
+statsMalloc(size_t size, int tag, void *site)
+{
+  YmemStatsHeader *header;
+
+  if (tag < 0 || tag >= YMEM_TAG_MAX) {
+    tag = YMEM_TAG_DEFAULT;
+  }
+  if (size > ((size_t) -1) - sizeof(YmemStatsHeader)) {
+    return NULL;
+  }
+
+  header = (YmemStatsHeader*) rawMalloc(sizeof(YmemStatsHeader) + size);
+  if (header == NULL) {
+    return NULL;
+  }
+  header->h.size = size;
+  header->h.tag = tag;
+  statsAccount(tag, size, site);
+
+  return STATS_PAYLOAD_OF(header);
+}
+
+static void*
+statsRealloc(void *ptr, size_t size, int tag, void *site)
+{
+  YmemStatsHeader *header;
+  size_t oldsize;
+  int oldtag;
+
+  if (ptr == NULL) {
+    return statsMalloc(size, tag, site);
+  }
+  if (size > ((size_t) -1) - sizeof(YmemStatsHeader)) {
+    return NULL;
+  }
+
+  header = STATS_HEADER_OF(ptr);
+  oldsize = header->h.size;
+  oldtag = header->h.tag;
+  if (tag < 0 || tag >= YMEM_TAG_MAX) {
+    tag = oldtag;
+  }
+
+  header = (YmemStatsHeader*) rawRealloc(header, sizeof(YmemStatsHeader) + size);
+  if (header == NULL) {
+    return NULL;
+  }
+  header->h.size = size;
+  header->h.tag = tag;
+  statsRelease(oldtag, oldsize);
+  statsAccount(tag, size, site);
+
+  return STATS_PAYLOAD_OF(header);
+}
+
+static void
+statsFree(void *ptr)
+{
+  YmemStatsHeader *header = STATS_HEADER_OF(ptr);
+
+  statsRelease(header->h.tag, header->h.size);
+  rawFree(header);
+}
+#endif
+
 void *Ymem_malloc(size_t size)
 {
   if (size == 0) {
     return NULL;
   }
 
-  return malloc(size);
+#if YOSAL_CONFIG_YMEM_STATS
+  return statsMalloc(size, YMEM_TAG_DEFAULT, __builtin_return_address(0));
+#else
+  return rawMalloc(size);
+#endif
+}
+
+void *
+Ymem_malloc_tag(size_t size, int tag)
+{
+  if (size == 0) {
+    return NULL;
+  }
+
+#if YOSAL_CONFIG_YMEM_STATS
+  return statsMalloc(size, tag, __builtin_return_address(0));
+#else
+  return rawMalloc(size);
+#endif
 }
 
 void *
@@ -35,16 +645,156 @@ Ymem_realloc(void *ptr, size_t size)
     return NULL;
   }
 
-  return realloc(ptr, size);
+#if YOSAL_CONFIG_YMEM_STATS
+  return statsRealloc(ptr, size, YMEM_TAG_KEEP, __builtin_return_address(0));
+#else
+  return rawRealloc(ptr, size);
+#endif
+}
+
+void *
+Ymem_realloc_tag(void *ptr, size_t size, int tag)
+{
+  if (size <= 0) {
+    return NULL;
+  }
+
+#if YOSAL_CONFIG_YMEM_STATS
+  return statsRealloc(ptr, size, tag, __builtin_return_address(0));
+#else
+  return rawRealloc(ptr, size);
+#endif
 }
 
 void Ymem_free(void *ptr)
 {
   if (ptr != NULL) {
-    free(ptr);
+#if YOSAL_CONFIG_YMEM_STATS
+    statsFree(ptr);
+#else
+    rawFree(ptr);
+#endif
   }
 }
 
+int
+Ymem_stats(int tag, YmemStats *stats)
+{
+#if YOSAL_CONFIG_YMEM_STATS
+  YmemCounters *counters;
+  const char *name;
+
+  if (stats == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  if (tag == YMEM_TAG_ALL) {
+    counters = &gTotal;
+    name = "all";
+  } else {
+    pthread_mutex_lock(&gTagLock);
+    name = (tag >= 0 && tag < gTagCount) ? gTagNames[tag] : NULL;
+    pthread_mutex_unlock(&gTagLock);
+    if (name == NULL) {
+      return YOSAL_ERROR;
+    }
+    counters = &gCounters[tag];
+  }
+
+  stats->name = name;
+  stats->live = __atomic_load_n(&counters->live, __ATOMIC_RELAXED);
+  stats->peak = __atomic_load_n(&counters->peak, __ATOMIC_RELAXED);
+  stats->allocs = __atomic_load_n(&counters->allocs, __ATOMIC_RELAXED);
+  stats->frees = __atomic_load_n(&counters->frees, __ATOMIC_RELAXED);
+
+  return YOSAL_OK;
+#else
+  return YOSAL_ERROR;
+#endif
+}
+
+int
+Ymem_stats_sample(size_t period)
+{
+#if YOSAL_CONFIG_YMEM_STATS
+  __atomic_store_n(&gSamplePeriod, period, __ATOMIC_RELAXED);
+  return YOSAL_OK;
+#else
+  return YOSAL_ERROR;
+#endif
+}
+
+int
+Ymem_stats_sites(YmemSite *sites, int maxsites)
+{
+  int count = 0;
+#if YOSAL_CONFIG_YMEM_STATS
+  YmemSite sorted[YMEM_SITE_COUNT];
+  YmemSite site;
+  int i;
+  int j;
+
+  if (sites == NULL || maxsites <= 0) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&gSiteLock);
+  for (i = 0; i < YMEM_SITE_COUNT; i++) {
+    if (gSites[i].site == NULL) {
+      continue;
+    }
+    /* Insertion by decreasing sampled bytes */
+    site = gSites[i];
+    for (j = count; j > 0 && sorted[j - 1].bytes < site.bytes; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = site;
+    count++;
+  }
+  pthread_mutex_unlock(&gSiteLock);
+
+  if (count > maxsites) {
+    count = maxsites;
+  }
+  memcpy(sites, sorted, count * sizeof(YmemSite));
+#endif
+
+  return count;
+}
+
+void
+Ymem_stats_dump()
+{
+#if YOSAL_CONFIG_YMEM_STATS
+  YmemStats stats;
+  YmemSite sites[16];
+  int count;
+  int tag;
+  int i;
+
+  pthread_mutex_lock(&gTagLock);
+  count = gTagCount;
+  pthread_mutex_unlock(&gTagLock);
+
+  for (tag = YMEM_TAG_ALL; tag < count; tag++) {
+    if (Ymem_stats(tag, &stats) != YOSAL_OK || stats.allocs == 0) {
+      continue;
+    }
+    ALOGI("%-12s live %lu peak %lu allocs %lu frees %lu", stats.name,
+          (unsigned long) stats.live, (unsigned long) stats.peak,
+          (unsigned long) stats.allocs, (unsigned long) stats.frees);
+  }
+
+  count = Ymem_stats_sites(sites, sizeof(sites) / sizeof(sites[0]));
+  for (i = 0; i < count; i++) {
+    ALOGI("site %p samples %lu bytes %lu", sites[i].site,
+          (unsigned long) sites[i].samples, (unsigned long) sites[i].bytes);
+  }
+#else
+  ALOGI("Memory accounting disabled, build with YOSAL_CONFIG_YMEM_STATS");
+#endif
+}
+
 char *
 Ymem_strdup(const char *str)
 {
@@ -149,3 +899,497 @@ Ymem_malloc_aligned(size_t alignment, size_t size, void **alignedref)
 
     return ptr;
 }
+
+/* Allocation is kept in the cache line before the aligned region */
+void *
+Ymem_malloc_cacheline(size_t size)
+{
+    void *ptr;
+    void *alignedptr;
+
+    ptr = Ymem_malloc_aligned(YCACHELINE_SIZE, size + YCACHELINE_SIZE, &alignedptr);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    alignedptr = (char*) alignedptr + YCACHELINE_SIZE;
+    ((void**) alignedptr)[-1] = ptr;
+
+    return alignedptr;
+}
+
+void
+Ymem_free_cacheline(void *ptr)
+{
+    if (ptr != NULL) {
+        Ymem_free(((void**) ptr)[-1]);
+    }
+}
+
+/*
+ * Large allocations are mapped directly, so that they can be backed by
+ * huge pages and spread over NUMA nodes. Mapping length is only derived
+ * from requested size, rounded to a huge page for regions spanning at
+ * least one, so that releasing doesn't need any header, which would break
+ * page alignment.
+ */
+#define YMEM_HUGEPAGE_SIZE (2 * 1024 * 1024)
+/* Memory policy of mbind(), from linux/mempolicy.h */
+#define YMEM_MPOL_INTERLEAVE 3
+
+#ifndef WIN32
+static pthread_once_t gLargeOnce = PTHREAD_ONCE_INIT;
+static size_t gPageSize = 4096;
+/* Mask of online NUMA nodes, 0 if there is only one */
+static unsigned long gNodeMask = 0;
+
+/* Parse list of online nodes, such as "0-3,6" */
+static unsigned long
+nodeMask()
+{
+  char buf[128];
+  unsigned long mask = 0;
+  unsigned long node;
+  unsigned long last;
+  char *p;
+  ssize_t n;
+  int fd;
+
+  fd = open("/sys/devices/system/node/online", O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return 0;
+  }
+  buf[n] = '\0';
+
+  p = buf;
+  while (*p >= '0' && *p <= '9') {
+    node = strtoul(p, &p, 10);
+    last = node;
+    if (*p == '-') {
+      last = strtoul(p + 1, &p, 10);
+    }
+    for (; node <= last && node < sizeof(mask) * CHAR_BIT; node++) {
+      mask |= 1UL << node;
+    }
+    if (*p == ',') {
+      p++;
+    }
+  }
+
+  /* Single node, nothing to interleave */
+  if ((mask & (mask - 1)) == 0) {
+    return 0;
+  }
+
+  return mask;
+}
+
+static void
+largeInit()
+{
+  long pagesize;
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  if (pagesize > 0) {
+    gPageSize = (size_t) pagesize;
+  }
+  gNodeMask = nodeMask();
+}
+
+static size_t
+largeLength(size_t size)
+{
+  size_t granularity = gPageSize;
+
+  if (size >= YMEM_HUGEPAGE_SIZE) {
+    granularity = YMEM_HUGEPAGE_SIZE;
+  }
+  if (size > ((size_t) -1) - granularity) {
+    return 0;
+  }
+
+  return (size + granularity - 1) & ~(granularity - 1);
+}
+
+static void
+largeAdvise(void *ptr, size_t length, int flags)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if ((flags & YMEM_LARGE_HUGEPAGE) && length >= YMEM_HUGEPAGE_SIZE) {
+    madvise(ptr, length, MADV_HUGEPAGE);
+  }
+#endif
+#if defined(__linux__) && defined(SYS_mbind)
+  if ((flags & YMEM_LARGE_INTERLEAVE) && gNodeMask != 0) {
+    /* Unsupported policy or kernel is not an error */
+    syscall(SYS_mbind, ptr, length, YMEM_MPOL_INTERLEAVE,
+            &gNodeMask, sizeof(gNodeMask) * CHAR_BIT, 0);
+  }
+#endif
+}
+
+static void*
+largeMap(size_t length, int flags)
+{
+  void *ptr = MAP_FAILED;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+  if ((flags & YMEM_LARGE_HUGETLB) && length >= YMEM_HUGEPAGE_SIZE) {
+    /* Fails when no huge page is reserved */
+    ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (ptr == MAP_FAILED) {
+    ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+      return NULL;
+    }
+  }
+
+  largeAdvise(ptr, length, flags);
+
+  return ptr;
+}
+#endif
+
+void *
+Ymem_large_alloc(size_t size, int flags)
+{
+  void *ptr;
+#ifndef WIN32
+  size_t length;
+#endif
+
+  if (size == 0) {
+    return NULL;
+  }
+
+#ifndef WIN32
+  pthread_once(&gLargeOnce, largeInit);
+  length = largeLength(size);
+  if (length == 0) {
+    return NULL;
+  }
+  ptr = largeMap(length, flags);
+#else
+  ptr = Ymem_calloc(1, size);
+#endif
+
+#if YOSAL_CONFIG_YMEM_STATS
+  if (ptr != NULL) {
+    statsAccount(YMEM_TAG_LARGE, size, __builtin_return_address(0));
+  }
+#endif
+
+  return ptr;
+}
+
+void *
+Ymem_large_realloc(void *ptr, size_t oldsize, size_t size, int flags)
+{
+  void *newptr;
+#ifndef WIN32
+  size_t oldlength;
+  size_t length;
+#endif
+
+  if (ptr == NULL) {
+    return Ymem_large_alloc(size, flags);
+  }
+  if (size == 0) {
+    return NULL;
+  }
+
+#ifndef WIN32
+  pthread_once(&gLargeOnce, largeInit);
+  oldlength = largeLength(oldsize);
+  length = largeLength(size);
+  if (length == 0) {
+    return NULL;
+  }
+
+  newptr = NULL;
+  if (length == oldlength) {
+    newptr = ptr;
+  }
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+  if (newptr == NULL) {
+    /* Move pages rather than data, which fails for hugetlbfs mappings */
+    newptr = mremap(ptr, oldlength, length, MREMAP_MAYMOVE);
+    if (newptr == MAP_FAILED) {
+      newptr = NULL;
+    } else {
+      largeAdvise(newptr, length, flags);
+    }
+  }
+#endif
+  if (newptr == NULL) {
+    newptr = largeMap(length, flags);
+    if (newptr == NULL) {
+      return NULL;
+    }
+    memcpy(newptr, ptr, oldsize < size ? oldsize : size);
+    munmap(ptr, oldlength);
+  }
+#else
+  newptr = Ymem_realloc(ptr, size);
+  if (newptr == NULL) {
+    return NULL;
+  }
+  if (size > oldsize) {
+    memset(((char*) newptr) + oldsize, 0, size - oldsize);
+  }
+#endif
+
+#if YOSAL_CONFIG_YMEM_STATS
+  statsRelease(YMEM_TAG_LARGE, oldsize);
+  statsAccount(YMEM_TAG_LARGE, size, __builtin_return_address(0));
+#endif
+
+  return newptr;
+}
+
+void
+Ymem_large_free(void *ptr, size_t size)
+{
+  if (ptr == NULL) {
+    return;
+  }
+
+#if YOSAL_CONFIG_YMEM_STATS
+  statsRelease(YMEM_TAG_LARGE, size);
+#endif
+
+#ifndef WIN32
+  pthread_once(&gLargeOnce, largeInit);
+  munmap(ptr, largeLength(size));
+#else
+  Ymem_free(ptr);
+#endif
+}
+
+/*
+ * Arena allocator. Memory is carved out of chained blocks by bumping a
+ * position, and only released all at once, or back to a savepoint.
+ * Blocks are chained from most recent to oldest, the oldest one being
+ * allocated along with the arena and kept by Yarena_reset.
+ */
+#define YARENA_ALIGNMENT (2 * sizeof(void*))
+#define YARENA_BLOCK_MIN 256
+
+typedef struct YarenaBlockStruct YarenaBlock;
+
+struct YarenaBlockStruct {
+  YarenaBlock *prev;
+  size_t size;
+  size_t pos;
+};
+
+struct YarenaStruct {
+  YarenaBlock *current;
+  size_t blocksize;
+};
+
+/* Offset of data in blocks, preserving alignment */
+#define YARENA_HEADER_SIZE \
+  ((sizeof(YarenaBlock) + YARENA_ALIGNMENT - 1) & ~(YARENA_ALIGNMENT - 1))
+#define YARENA_STRUCT_SIZE \
+  ((sizeof(Yarena) + YARENA_ALIGNMENT - 1) & ~(YARENA_ALIGNMENT - 1))
+
+#define BLOCK_DATA(block) (((char*) (block)) + YARENA_HEADER_SIZE)
+
+Yarena*
+Yarena_create(size_t blocksize)
+{
+  Yarena *arena;
+  YarenaBlock *block;
+
+  if (blocksize < YARENA_BLOCK_MIN) {
+    blocksize = YARENA_BLOCK_MIN;
+  }
+
+  arena = (Yarena*) Ymem_malloc_tag(YARENA_STRUCT_SIZE + YARENA_HEADER_SIZE + blocksize,
+                                    YMEM_TAG_ARENA);
+  if (arena == NULL) {
+    return NULL;
+  }
+
+  block = (YarenaBlock*) (((char*) arena) + YARENA_STRUCT_SIZE);
+  block->prev = NULL;
+  block->size = blocksize;
+  block->pos = 0;
+
+  arena->current = block;
+  arena->blocksize = blocksize;
+
+  return arena;
+}
+
+/* Release all blocks more recent than block */
+static void
+arenaUnwind(Yarena *arena, YarenaBlock *block)
+{
+  YarenaBlock *prev;
+
+  while (arena->current != block && arena->current->prev != NULL) {
+    prev = arena->current->prev;
+    Ymem_free(arena->current);
+    arena->current = prev;
+  }
+}
+
+void
+Yarena_release(Yarena *arena)
+{
+  if (arena == NULL) {
+    return;
+  }
+
+  arenaUnwind(arena, NULL);
+  Ymem_free(arena);
+}
+
+void
+Yarena_reset(Yarena *arena)
+{
+  if (arena == NULL) {
+    return;
+  }
+
+  arenaUnwind(arena, NULL);
+  arena->current->pos = 0;
+}
+
+void*
+Yarena_alloc_aligned(Yarena *arena, size_t alignment, size_t size)
+{
+  YarenaBlock *block;
+  uintptr_t start;
+  size_t offset;
+  size_t blocksize;
+
+  if (arena == NULL || size == 0) {
+    return NULL;
+  }
+  if (alignment < YARENA_ALIGNMENT) {
+    alignment = YARENA_ALIGNMENT;
+  }
+  if ((alignment & (alignment - 1)) != 0) {
+    /* Alignment must be a power of 2 */
+    return NULL;
+  }
+
+  block = arena->current;
+  start = (uintptr_t) BLOCK_DATA(block) + block->pos;
+  offset = (size_t) (((start + alignment - 1) & ~((uintptr_t) alignment - 1)) - start);
+  if (size > block->size - block->pos || offset > block->size - block->pos - size) {
+    /* Chain a new block, larger one for large allocations */
+    blocksize = arena->blocksize;
+    if (size + alignment > blocksize) {
+      blocksize = size + alignment;
+    }
+    block = (YarenaBlock*) Ymem_malloc_tag(YARENA_HEADER_SIZE + blocksize, YMEM_TAG_ARENA);
+    if (block == NULL) {
+      return NULL;
+    }
+    block->prev = arena->current;
+    block->size = blocksize;
+    block->pos = 0;
+    arena->current = block;
+
+    start = (uintptr_t) BLOCK_DATA(block);
+    offset = (size_t) (((start + alignment - 1) & ~((uintptr_t) alignment - 1)) - start);
+  }
+
+  block->pos += offset + size;
+
+  return (void*) (start + offset);
+}
+
+void*
+Yarena_alloc(Yarena *arena, size_t size)
+{
+  return Yarena_alloc_aligned(arena, YARENA_ALIGNMENT, size);
+}
+
+void*
+Yarena_realloc(Yarena *arena, void *ptr, size_t oldsize, size_t size)
+{
+  YarenaBlock *block;
+  char *data;
+  void *newptr;
+
+  if (ptr == NULL) {
+    return Yarena_alloc(arena, size);
+  }
+  if (arena == NULL || size == 0) {
+    return NULL;
+  }
+
+  /* Most recent allocation can grow or shrink in place */
+  block = arena->current;
+  data = BLOCK_DATA(block);
+  if ((char*) ptr + oldsize == data + block->pos &&
+      (size_t) ((char*) ptr - data) + size <= block->size) {
+    block->pos = ((char*) ptr - data) + size;
+    return ptr;
+  }
+
+  if (size <= oldsize) {
+    return ptr;
+  }
+
+  newptr = Yarena_alloc(arena, size);
+  if (newptr != NULL) {
+    memcpy(newptr, ptr, oldsize);
+  }
+
+  return newptr;
+}
+
+char*
+Yarena_strdup(Yarena *arena, const char *str)
+{
+  char *result = NULL;
+  size_t l;
+
+  if (str != NULL) {
+    l = strlen(str);
+    result = (char*) Yarena_alloc(arena, l + 1);
+    if (result != NULL) {
+      memcpy(result, str, l + 1);
+    }
+  }
+
+  return result;
+}
+
+void
+Yarena_savepoint(Yarena *arena, YarenaSavepoint *savepoint)
+{
+  if (arena == NULL || savepoint == NULL) {
+    return;
+  }
+
+  savepoint->block = arena->current;
+  savepoint->pos = arena->current->pos;
+}
+
+void
+Yarena_rollback(Yarena *arena, const YarenaSavepoint *savepoint)
+{
+  if (arena == NULL || savepoint == NULL || savepoint->block == NULL) {
+    return;
+  }
+
+  arenaUnwind(arena, (YarenaBlock*) savepoint->block);
+  if (arena->current == savepoint->block) {
+    arena->current->pos = savepoint->pos;
+  }
+}
@@ -18,6 +18,7 @@
 #include <stdarg.h>
 
 #include "yosal/yosal.h"
+#include "ydtoa.h"
 
 enum {
   YBUFFER_STATUS_OK = 0,
@@ -25,6 +26,19 @@ enum {
   YBUFFER_STATUS_ERROR
 };
 
+/* Memory owned by caller, never freed by Ybuffer */
+#define YBUFFER_FLAG_STATIC_STRUCT 0x1
+#define YBUFFER_FLAG_STATIC_DATA   0x2
+
+typedef struct YbufferChunkStruct YbufferChunk;
+
+struct YbufferChunkStruct {
+  YbufferChunk *next;
+  char *data;
+  size_t size;
+  size_t length;
+};
+
 struct YbufferStruct
 {
   char *data;
@@ -32,15 +46,243 @@ struct YbufferStruct
   int dataincr;
   int pos;
   int status;
+  int flags;
+  /* Optional arena holding buffer and its data */
+  Yarena *arena;
+  /* Rope mode, when chunksize is not zero. Size of next chunk, doubling
+     from chunkinit up to chunkmax */
+  size_t chunksize;
+  size_t chunkinit;
+  size_t chunkmax;
+  YbufferChunk *first;
+  YbufferChunk *last;
+  int nchunks;
+  size_t length;
 };
 
+/* Fails to compile if YbufferStorage gets too small */
+typedef char YbufferStorageCheck[(sizeof(YbufferStorage) >= sizeof(Ybuffer)) ? 1 : -1];
+
+static YbufferChunk*
+chunkCreate(size_t size)
+{
+  YbufferChunk *chunk;
+
+  chunk = (YbufferChunk*) Ymem_malloc_tag(sizeof(YbufferChunk), YMEM_TAG_BUFFER);
+  if (chunk == NULL) {
+    return NULL;
+  }
+
+  chunk->data = (char*) Ymem_malloc_tag(size, YMEM_TAG_BUFFER);
+  if (chunk->data == NULL) {
+    Ymem_free(chunk);
+    return NULL;
+  }
+
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->length = 0;
+
+  return chunk;
+}
+
+static void
+ropeReset(Ybuffer *stream)
+{
+  YbufferChunk *chunk;
+  YbufferChunk *next;
+
+  chunk = stream->first;
+  while (chunk != NULL) {
+    next = chunk->next;
+    if (chunk->data != NULL) {
+      Ymem_free(chunk->data);
+    }
+    Ymem_free(chunk);
+    chunk = next;
+  }
+
+  stream->first = NULL;
+  stream->last = NULL;
+  stream->nchunks = 0;
+  stream->length = 0;
+  stream->chunksize = stream->chunkinit;
+}
+
+/* Size of chunk following one of current size */
+static void
+ropeGrow(Ybuffer *stream)
+{
+  if (stream->chunksize < stream->chunkmax) {
+    stream->chunksize *= 2;
+    if (stream->chunksize > stream->chunkmax) {
+      stream->chunksize = stream->chunkmax;
+    }
+  }
+}
+
+/* Append a new chunk to the rope, large enough for at least minsize bytes
+   and its null terminator */
+static YbufferChunk*
+ropeExtend(Ybuffer *stream, size_t minsize)
+{
+  YbufferChunk *chunk;
+  size_t size;
+
+  size = stream->chunksize;
+  if (minsize >= size) {
+    size = minsize + 1;
+  }
+
+  chunk = chunkCreate(size);
+  if (chunk == NULL) {
+    stream->status = YBUFFER_STATUS_ERROR;
+    return NULL;
+  }
+
+  if (stream->last == NULL) {
+    stream->first = chunk;
+  } else {
+    stream->last->next = chunk;
+  }
+  stream->last = chunk;
+  stream->nchunks++;
+  ropeGrow(stream);
+
+  return chunk;
+}
+
+static int
+ropeAppend(Ybuffer *stream, const char *buf, int buflen)
+{
+  YbufferChunk *chunk;
+  size_t avail;
+  int written = 0;
+
+  while (written < buflen) {
+    chunk = stream->last;
+    /* Always keep one spare byte per chunk, for null termination on detach */
+    if (chunk == NULL || chunk->length >= chunk->size - 1) {
+      chunk = ropeExtend(stream, buflen - written);
+      if (chunk == NULL) {
+        break;
+      }
+    }
+
+    avail = chunk->size - 1 - chunk->length;
+    if (avail > (size_t) (buflen - written)) {
+      avail = buflen - written;
+    }
+    memcpy(chunk->data + chunk->length, buf + written, avail);
+    chunk->length += avail;
+    written += avail;
+  }
+
+  stream->length += written;
+
+  if (written <= 0) {
+    /* Out of memory */
+    return -1;
+  }
+
+  return written;
+}
+
+/* Grow contiguous buffer geometrically, to hold at least minlen bytes */
+static int
+bufferGrow(Ybuffer *stream, int minlen)
+{
+  char *newbuf;
+  int newlen;
+
+  newlen = stream->datalen + stream->dataincr;
+  if (newlen < stream->datalen * 2) {
+    newlen = stream->datalen * 2;
+  }
+  if (newlen < minlen) {
+    newlen = minlen;
+  }
+
+  if (stream->arena != NULL) {
+    newbuf = (char*) Yarena_realloc(stream->arena, stream->data,
+                                    stream->datalen, newlen);
+  } else if (stream->flags & YBUFFER_FLAG_STATIC_DATA) {
+    /* Spill caller storage to heap */
+    newbuf = (char*) Ymem_malloc_tag(newlen, YMEM_TAG_BUFFER);
+    if (newbuf != NULL) {
+      memcpy(newbuf, stream->data, stream->pos + 1);
+      stream->flags &= ~YBUFFER_FLAG_STATIC_DATA;
+    }
+  } else {
+    newbuf = (char*) Ymem_realloc_tag(stream->data, newlen, YMEM_TAG_BUFFER);
+  }
+  if (newbuf == NULL) {
+    /*
+     * If failed to allocate larger buffer, abort.
+     * Older buffer is still valid
+     */
+    stream->status = YBUFFER_STATUS_ERROR;
+    return -1;
+  }
+
+  stream->data = newbuf;
+  stream->datalen = newlen;
+
+  return 0;
+}
+
+char*
+Ybuffer_tail(Ybuffer *stream, size_t n)
+{
+  YbufferChunk *chunk;
+
+  if (stream == NULL || stream->status != YBUFFER_STATUS_OK) {
+    return NULL;
+  }
+
+  if (stream->chunksize > 0) {
+    chunk = stream->last;
+    if (chunk == NULL || chunk->size - 1 - chunk->length < n) {
+      chunk = ropeExtend(stream, n);
+      if (chunk == NULL) {
+        return NULL;
+      }
+    }
+    return chunk->data + chunk->length;
+  }
+
+  if (stream->pos + n + 1 >= (size_t) stream->datalen) {
+    if (bufferGrow(stream, stream->pos + n + 1) != 0) {
+      return NULL;
+    }
+  }
+
+  return stream->data + stream->pos;
+}
+
+void
+Ybuffer_commit(Ybuffer *stream, size_t n)
+{
+  if (stream == NULL || n == 0) {
+    return;
+  }
+
+  if (stream->chunksize > 0) {
+    stream->last->length += n;
+    stream->length += n;
+  } else {
+    stream->pos += n;
+    stream->data[stream->pos] = '\0';
+  }
+}
+
 Ybuffer*
 Ybuffer_init(int initiallength)
 {
   char *data;
   Ybuffer *membuf;
 
-  membuf = (Ybuffer*) Ymem_malloc(sizeof(Ybuffer));
+  membuf = (Ybuffer*) Ymem_malloc_tag(sizeof(Ybuffer), YMEM_TAG_BUFFER);
   if (membuf == NULL) {
     return NULL;
   }
@@ -50,7 +292,7 @@ Ybuffer_init(int initiallength)
     membuf->datalen = 0;
     membuf->dataincr = 64;
   } else {
-      data = (char*) Ymem_malloc(initiallength);
+      data = (char*) Ymem_malloc_tag(initiallength, YMEM_TAG_BUFFER);
     if (data == NULL) {
       Ymem_free(membuf);
       return NULL;
@@ -62,10 +304,221 @@ Ybuffer_init(int initiallength)
 
   membuf->pos = 0;
   membuf->status = YBUFFER_STATUS_OK;
+  membuf->flags = 0;
+  membuf->arena = NULL;
+  membuf->chunksize = 0;
+  membuf->chunkinit = 0;
+  membuf->chunkmax = 0;
+  membuf->first = NULL;
+  membuf->last = NULL;
+  membuf->nchunks = 0;
+  membuf->length = 0;
+
+  return membuf;
+}
+
+Ybuffer*
+Ybuffer_init_rope(int chunksize)
+{
+  return Ybuffer_init_rope_growing(chunksize, chunksize);
+}
+
+Ybuffer*
+Ybuffer_init_rope_growing(int chunksize, int maxchunksize)
+{
+  Ybuffer *membuf;
+
+  membuf = Ybuffer_init(0);
+  if (membuf == NULL) {
+    return NULL;
+  }
+
+  if (chunksize < 64) {
+    chunksize = 64;
+  }
+  if (maxchunksize < chunksize) {
+    maxchunksize = chunksize;
+  }
+  membuf->chunksize = chunksize;
+  membuf->chunkinit = chunksize;
+  membuf->chunkmax = maxchunksize;
+
+  return membuf;
+}
+
+Ybuffer*
+Ybuffer_init_storage(YbufferStorage *storage, char *data, int datalen)
+{
+  Ybuffer *membuf = (Ybuffer*) storage;
+
+  if (storage == NULL) {
+    return NULL;
+  }
+
+  memset(membuf, 0, sizeof(Ybuffer));
+  membuf->flags = YBUFFER_FLAG_STATIC_STRUCT;
+  membuf->dataincr = 64;
+  membuf->status = YBUFFER_STATUS_OK;
+
+  if (data != NULL && datalen > 1) {
+    membuf->data = data;
+    membuf->datalen = datalen;
+    membuf->data[0] = '\0';
+    membuf->flags |= YBUFFER_FLAG_STATIC_DATA;
+  }
 
   return membuf;
 }
 
+Ybuffer*
+Ybuffer_init_arena(Yarena *arena, int initiallength)
+{
+  Ybuffer *membuf;
+
+  if (arena == NULL) {
+    return Ybuffer_init(initiallength);
+  }
+
+  membuf = (Ybuffer*) Yarena_alloc(arena, sizeof(Ybuffer));
+  if (membuf == NULL) {
+    return NULL;
+  }
+
+  memset(membuf, 0, sizeof(Ybuffer));
+  membuf->arena = arena;
+  membuf->dataincr = 64;
+  membuf->status = YBUFFER_STATUS_OK;
+  /* Memory is released along with arena */
+  membuf->flags = YBUFFER_FLAG_STATIC_STRUCT;
+
+  if (initiallength > 0) {
+    membuf->data = (char*) Yarena_alloc(arena, initiallength);
+    if (membuf->data == NULL) {
+      return NULL;
+    }
+    membuf->data[0] = '\0';
+    membuf->datalen = initiallength;
+    membuf->dataincr = initiallength;
+  }
+
+  return membuf;
+}
+
+void
+Ybuffer_reset(Ybuffer *stream)
+{
+  YbufferChunk *chunk;
+  YbufferChunk *next;
+
+  if (stream == NULL) {
+    return;
+  }
+
+  if (stream->chunksize > 0) {
+    /* Keep first chunk for reuse */
+    chunk = stream->first;
+    if (chunk != NULL) {
+      next = chunk->next;
+      chunk->next = NULL;
+      chunk->length = 0;
+      stream->first = next;
+      ropeReset(stream);
+      stream->first = chunk;
+      stream->last = chunk;
+      stream->nchunks = 1;
+      ropeGrow(stream);
+    }
+  } else {
+    stream->pos = 0;
+    if (stream->data != NULL) {
+      stream->data[0] = '\0';
+    }
+  }
+
+  stream->status = YBUFFER_STATUS_OK;
+}
+
+int
+Ybuffer_reserve(Ybuffer *stream, size_t n)
+{
+  if (Ybuffer_tail(stream, n) == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  return YOSAL_OK;
+}
+
+size_t
+Ybuffer_length(Ybuffer *stream)
+{
+  if (stream == NULL) {
+    return 0;
+  }
+  if (stream->chunksize > 0) {
+    return stream->length;
+  }
+
+  return stream->pos;
+}
+
+size_t
+Ybuffer_footprint(Ybuffer *stream)
+{
+  YbufferChunk *chunk;
+  size_t footprint = 0;
+
+  if (stream == NULL) {
+    return 0;
+  }
+
+  if (!(stream->flags & YBUFFER_FLAG_STATIC_STRUCT)) {
+    footprint += sizeof(Ybuffer);
+  }
+  if (!(stream->flags & YBUFFER_FLAG_STATIC_DATA)) {
+    footprint += stream->datalen;
+  }
+  for (chunk = stream->first; chunk != NULL; chunk = chunk->next) {
+    footprint += sizeof(YbufferChunk) + chunk->size;
+  }
+
+  return footprint;
+}
+
+int
+Ybuffer_iovec(Ybuffer *stream, struct iovec *iov, int iovcnt)
+{
+  YbufferChunk *chunk;
+  int i;
+
+  if (stream == NULL) {
+    return -1;
+  }
+
+  if (stream->chunksize == 0) {
+    if (stream->pos <= 0) {
+      return 0;
+    }
+    if (iov != NULL && iovcnt > 0) {
+      iov[0].iov_base = stream->data;
+      iov[0].iov_len = stream->pos;
+    }
+    return 1;
+  }
+
+  if (iov != NULL) {
+    i = 0;
+    chunk = stream->first;
+    while (chunk != NULL && i < iovcnt) {
+      iov[i].iov_base = chunk->data;
+      iov[i].iov_len = chunk->length;
+      chunk = chunk->next;
+      i++;
+    }
+  }
+
+  return stream->nchunks;
+}
+
 char*
 Ybuffer_detach(Ybuffer *stream, int *datalen)
 {
@@ -76,12 +529,52 @@ Ybuffer_detach(Ybuffer *stream, int *datalen)
     if (datalen != NULL) {
       *datalen = 0;
     }
+  } else if (stream->chunksize > 0) {
+    YbufferChunk *chunk = stream->first;
+    size_t pos = 0;
+
+    data = NULL;
+    if (stream->nchunks == 1) {
+      /* Hand over the only chunk, there is always room for terminator */
+      data = chunk->data;
+      pos = chunk->length;
+      chunk->data = NULL;
+    } else if (stream->nchunks > 1) {
+      /* Flatten rope once, into a buffer of the exact length */
+      data = (char*) Ymem_malloc_tag(stream->length + 1, YMEM_TAG_BUFFER);
+      if (data != NULL) {
+        while (chunk != NULL) {
+          memcpy(data + pos, chunk->data, chunk->length);
+          pos += chunk->length;
+          chunk = chunk->next;
+        }
+      }
+    }
+    if (data != NULL) {
+      data[pos] = '\0';
+    }
+    if (datalen != NULL) {
+      *datalen = (data != NULL ? (int) pos : 0);
+    }
+    ropeReset(stream);
+    if (!(stream->flags & YBUFFER_FLAG_STATIC_STRUCT)) {
+      Ymem_free(stream);
+    }
   } else {
     data = stream->data;
+    if (stream->flags & YBUFFER_FLAG_STATIC_DATA) {
+      /* Caller storage can't be handed over, copy it */
+      data = (char*) Ymem_malloc_tag(stream->pos + 1, YMEM_TAG_BUFFER);
+      if (data != NULL) {
+        memcpy(data, stream->data, stream->pos + 1);
+      }
+    }
     if (datalen != NULL) {
-      *datalen = stream->pos;
+      *datalen = (data != NULL ? stream->pos : 0);
+    }
+    if (!(stream->flags & YBUFFER_FLAG_STATIC_STRUCT)) {
+      Ymem_free(stream);
     }
-    Ymem_free(stream);
   }
 
   return data;
@@ -90,13 +583,21 @@ Ybuffer_detach(Ybuffer *stream, int *datalen)
 void
 Ybuffer_fini(Ybuffer *stream)
 {
-  char *data;
+  if (stream == NULL) {
+    return;
+  }
 
-  data = Ybuffer_detach(stream, NULL);
-  if (data != NULL) {
-    Ymem_free(data);
+  if (stream->chunksize > 0) {
+    ropeReset(stream);
+  } else if (stream->data != NULL && stream->arena == NULL &&
+             !(stream->flags & YBUFFER_FLAG_STATIC_DATA)) {
+    Ymem_free(stream->data);
   }
+  stream->data = NULL;
 
+  if (!(stream->flags & YBUFFER_FLAG_STATIC_STRUCT)) {
+    Ymem_free(stream);
+  }
 }
 
 int
@@ -117,28 +618,15 @@ Ybuffer_append(Ybuffer *stream, const char *buf, int buflen)
     buflen = strlen(buf);
   }
 
+  if (stream->chunksize > 0) {
+    return ropeAppend(stream, buf, buflen);
+  }
+
   if (stream->pos + buflen >= stream->datalen - 1) {
     /* Re-allocate larger buffer */
-    char *newbuf;
-    int newlen;
-
-    newlen = stream->datalen + stream->dataincr;
-    if (stream->pos + buflen >= newlen - 1) {
-      newlen = stream->pos + buflen + 1;
-    }
-
-    newbuf = (char*) Ymem_realloc(stream->data, newlen);
-    if (newbuf == NULL) {
-	/*
-	 * If failed to allocate larger buffer, abort.
-	 * Older buffer is still valid
-	 */
-      stream->status = YBUFFER_STATUS_ERROR;
+    if (bufferGrow(stream, stream->pos + buflen + 1) != 0) {
       return -1;
     }
-
-    stream->data = newbuf;
-    stream->datalen = newlen;
   }
 
   memcpy(stream->data + stream->pos, buf, buflen);
@@ -148,6 +636,46 @@ Ybuffer_append(Ybuffer *stream, const char *buf, int buflen)
   return buflen;
 }
 
+/* Format into the last chunk if it fits, otherwise into a new chunk large
+   enough. Bytes already in the rope are never moved */
+static int
+ropeAppendFormat(Ybuffer *stream, const char *format, va_list ap1, va_list ap2)
+{
+  YbufferChunk *chunk;
+  size_t space = 0;
+  int rc;
+
+  chunk = stream->last;
+  if (chunk != NULL) {
+    space = chunk->size - chunk->length;
+  }
+  if (space > 0) {
+    rc = vsnprintf(chunk->data + chunk->length, space, format, ap1);
+  } else {
+    rc = vsnprintf(NULL, 0, format, ap1);
+  }
+  if (rc < 0) {
+    return -1;
+  }
+
+  if ((size_t) rc >= space) {
+    chunk = ropeExtend(stream, rc);
+    if (chunk == NULL) {
+      return -1;
+    }
+    rc = vsnprintf(chunk->data, chunk->size, format, ap2);
+    if (rc < 0 || (size_t) rc >= chunk->size) {
+      stream->status = YBUFFER_STATUS_ERROR;
+      return -1;
+    }
+  }
+
+  chunk->length += rc;
+  stream->length += rc;
+
+  return rc;
+}
+
 int
 Ybuffer_append_format(Ybuffer *stream, const char *format, ...)
 {
@@ -165,27 +693,21 @@ Ybuffer_append_format(Ybuffer *stream, const char *format, ...)
 
   va_start(ap1, format);
   va_copy(ap2, ap1);
+  if (stream->chunksize > 0) {
+    rc = ropeAppendFormat(stream, format, ap1, ap2);
+    va_end(ap2);
+    va_end(ap1);
+    return rc;
+  }
+
   space = stream->datalen - stream->pos;
   rc = vsnprintf(stream->data + stream->pos, space, format, ap1);
   if (rc >= space) {
     /* Re-allocate larger buffer */
-    char *newbuf;
-    int newlen;
-
-    newlen = stream->datalen + stream->dataincr;
-    if (stream->pos + rc >= newlen - 1) {
-      newlen = stream->pos + rc + 1;
-    }
-
-    newbuf = (char*) Ymem_realloc(stream->data, newlen);
-    if (newbuf == NULL) {
+    if (bufferGrow(stream, stream->pos + rc + 1) != 0) {
       // Older buffer is still valid.
-      stream->status = YBUFFER_STATUS_ERROR;
       rc = -1;
     } else {
-      stream->data = newbuf;
-      stream->datalen = newlen;
-
       space = stream->datalen - stream->pos;
       rc = vsnprintf(stream->data + stream->pos, space, format, ap2);
       if (rc >= space) {
@@ -205,17 +727,230 @@ Ybuffer_append_format(Ybuffer *stream, const char *format, ...)
   return rc;
 }
 
+static const char gDigitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char gHexDigits[] = "0123456789abcdef";
+
+/* JSON escape for each byte: 0 if byte is copied as is, 'u' for \u00XX,
+   otherwise the character following the backslash */
+static const char gEscapes[256] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'u'
+  /* Bytes 128-255 are part of UTF-8 sequences, copied as is */
+};
+
+static int
+countDigits64(uint64_t value)
+{
+  int digits = 1;
+
+  for (;;) {
+    if (value < 10) return digits;
+    if (value < 100) return digits + 1;
+    if (value < 1000) return digits + 2;
+    if (value < 10000) return digits + 3;
+    value /= 10000;
+    digits += 4;
+  }
+}
+
+/* Write decimal digits of value backward, ending at out + ndigits */
+static void
+formatDigits(char *out, int ndigits, uint64_t value)
+{
+  char *p = out + ndigits;
+  unsigned int i;
+
+  while (value >= 100) {
+    i = (unsigned int) (value % 100) * 2;
+    value /= 100;
+    *--p = gDigitPairs[i + 1];
+    *--p = gDigitPairs[i];
+  }
+  if (value >= 10) {
+    i = (unsigned int) value * 2;
+    *--p = gDigitPairs[i + 1];
+    *--p = gDigitPairs[i];
+  } else {
+    *--p = (char) ('0' + value);
+  }
+}
+
 int
 Ybuffer_append_integer(Ybuffer *stream, int value)
 {
-    /* Buffer large enough to contain INT_MAX */
-    char buf[32];
-    int buflen;
+  return Ybuffer_append_int64(stream, value);
+}
+
+int
+Ybuffer_append_int64(Ybuffer *stream, int64_t value)
+{
+  uint64_t magnitude;
+  char *tail;
+  int negative;
+  int ndigits;
+
+  negative = (value < 0);
+  magnitude = negative ? (~((uint64_t) value) + 1) : (uint64_t) value;
+  ndigits = countDigits64(magnitude);
+
+  tail = Ybuffer_tail(stream, ndigits + negative);
+  if (tail == NULL) {
+    return -1;
+  }
+
+  if (negative) {
+    *tail = '-';
+  }
+  formatDigits(tail + negative, ndigits, magnitude);
+  Ybuffer_commit(stream, ndigits + negative);
+
+  return ndigits + negative;
+}
+
+int
+Ybuffer_append_uint64(Ybuffer *stream, uint64_t value)
+{
+  char *tail;
+  int ndigits;
+
+  ndigits = countDigits64(value);
+  tail = Ybuffer_tail(stream, ndigits);
+  if (tail == NULL) {
+    return -1;
+  }
+
+  formatDigits(tail, ndigits, value);
+  Ybuffer_commit(stream, ndigits);
 
-    buflen = snprintf(buf, sizeof(buf), "%d", value);
-    if (buflen >= sizeof(buf)) {
-	/* Buffer too short for integer value (should never happen) */
-	return -1;
+  return ndigits;
+}
+
+int
+Ybuffer_append_double(Ybuffer *stream, double value)
+{
+  char *tail;
+  int length;
+
+  tail = Ybuffer_tail(stream, YDTOA_BUFSIZE);
+  if (tail == NULL) {
+    return -1;
+  }
+
+  length = Ydtoa(value, tail);
+  Ybuffer_commit(stream, length);
+
+  return length;
+}
+
+int
+Ybuffer_append_hex(Ybuffer *stream, const void *data, int length)
+{
+  const unsigned char *bytes = (const unsigned char*) data;
+  char *tail;
+  int i;
+
+  if (stream == NULL || length < 0) {
+    return -1;
+  }
+  if (data == NULL || length == 0) {
+    return 0;
+  }
+
+  tail = Ybuffer_tail(stream, 2 * (size_t) length);
+  if (tail == NULL) {
+    return -1;
+  }
+
+  for (i = 0; i < length; i++) {
+    *tail++ = gHexDigits[bytes[i] >> 4];
+    *tail++ = gHexDigits[bytes[i] & 0xf];
+  }
+  Ybuffer_commit(stream, 2 * (size_t) length);
+
+  return 2 * length;
+}
+
+int
+Ybuffer_append_escaped(Ybuffer *stream, const char *buf, int buflen)
+{
+  const unsigned char *s = (const unsigned char*) buf;
+  char *tail;
+  char escape;
+  int total = 0;
+  int start;
+  int i;
+
+  if (stream == NULL || stream->status != YBUFFER_STATUS_OK) {
+    return -1;
+  }
+  if (buf == NULL || buflen == 0) {
+    return 0;
+  }
+  if (buflen < 0) {
+    buflen = strlen(buf);
+  }
+
+  start = 0;
+  for (i = 0; i < buflen; i++) {
+    escape = gEscapes[s[i]];
+    if (escape == 0) {
+      continue;
+    }
+
+    /* Copy run of plain characters at once */
+    if (i > start) {
+      if (Ybuffer_append(stream, buf + start, i - start) < 0) {
+        return -1;
+      }
+      total += i - start;
+    }
+    start = i + 1;
+
+    if (escape == 'u') {
+      tail = Ybuffer_tail(stream, 6);
+      if (tail == NULL) {
+        return -1;
+      }
+      memcpy(tail, "\\u00", 4);
+      tail[4] = gHexDigits[s[i] >> 4];
+      tail[5] = gHexDigits[s[i] & 0xf];
+      Ybuffer_commit(stream, 6);
+      total += 6;
+    } else {
+      tail = Ybuffer_tail(stream, 2);
+      if (tail == NULL) {
+        return -1;
+      }
+      tail[0] = '\\';
+      tail[1] = escape;
+      Ybuffer_commit(stream, 2);
+      total += 2;
+    }
+  }
+
+  if (i > start) {
+    if (Ybuffer_append(stream, buf + start, i - start) < 0) {
+      return -1;
     }
-    return Ybuffer_append(stream, buf, buflen);
+    total += i - start;
+  }
+
+  return total;
 }
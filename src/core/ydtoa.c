@@ -0,0 +1,451 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Shortest round-trip formatting of doubles, using the Grisu2 algorithm
+ * from Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers" (PLDI 2010). Output always reads back to the
+ * same double, and is the shortest such string in the vast majority of
+ * cases.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "yosal/yosal.h"
+#include "ydtoa.h"
+
+#define DP_SIGNIFICAND_MASK UINT64_C(0x000FFFFFFFFFFFFF)
+#define DP_EXPONENT_MASK    UINT64_C(0x7FF0000000000000)
+#define DP_HIDDEN_BIT       UINT64_C(0x0010000000000000)
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS    (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT     (-DP_EXPONENT_BIAS)
+
+/* Floating point number f * 2^e, with a 64 bits significand */
+typedef struct {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+/* Normalized powers of ten, from 1e-348 to 1e340 by steps of 8 */
+static const DiyFp gCachedPowers[] = {
+  { UINT64_C(0xfa8fd5a0081c0288), -1220 }, /* 1e-348 */
+  { UINT64_C(0xbaaee17fa23ebf76), -1193 }, /* 1e-340 */
+  { UINT64_C(0x8b16fb203055ac76), -1166 }, /* 1e-332 */
+  { UINT64_C(0xcf42894a5dce35ea), -1140 }, /* 1e-324 */
+  { UINT64_C(0x9a6bb0aa55653b2d), -1113 }, /* 1e-316 */
+  { UINT64_C(0xe61acf033d1a45df), -1087 }, /* 1e-308 */
+  { UINT64_C(0xab70fe17c79ac6ca), -1060 }, /* 1e-300 */
+  { UINT64_C(0xff77b1fcbebcdc4f), -1034 }, /* 1e-292 */
+  { UINT64_C(0xbe5691ef416bd60c), -1007 }, /* 1e-284 */
+  { UINT64_C(0x8dd01fad907ffc3c),  -980 }, /* 1e-276 */
+  { UINT64_C(0xd3515c2831559a83),  -954 }, /* 1e-268 */
+  { UINT64_C(0x9d71ac8fada6c9b5),  -927 }, /* 1e-260 */
+  { UINT64_C(0xea9c227723ee8bcb),  -901 }, /* 1e-252 */
+  { UINT64_C(0xaecc49914078536d),  -874 }, /* 1e-244 */
+  { UINT64_C(0x823c12795db6ce57),  -847 }, /* 1e-236 */
+  { UINT64_C(0xc21094364dfb5637),  -821 }, /* 1e-228 */
+  { UINT64_C(0x9096ea6f3848984f),  -794 }, /* 1e-220 */
+  { UINT64_C(0xd77485cb25823ac7),  -768 }, /* 1e-212 */
+  { UINT64_C(0xa086cfcd97bf97f4),  -741 }, /* 1e-204 */
+  { UINT64_C(0xef340a98172aace5),  -715 }, /* 1e-196 */
+  { UINT64_C(0xb23867fb2a35b28e),  -688 }, /* 1e-188 */
+  { UINT64_C(0x84c8d4dfd2c63f3b),  -661 }, /* 1e-180 */
+  { UINT64_C(0xc5dd44271ad3cdba),  -635 }, /* 1e-172 */
+  { UINT64_C(0x936b9fcebb25c996),  -608 }, /* 1e-164 */
+  { UINT64_C(0xdbac6c247d62a584),  -582 }, /* 1e-156 */
+  { UINT64_C(0xa3ab66580d5fdaf6),  -555 }, /* 1e-148 */
+  { UINT64_C(0xf3e2f893dec3f126),  -529 }, /* 1e-140 */
+  { UINT64_C(0xb5b5ada8aaff80b8),  -502 }, /* 1e-132 */
+  { UINT64_C(0x87625f056c7c4a8b),  -475 }, /* 1e-124 */
+  { UINT64_C(0xc9bcff6034c13053),  -449 }, /* 1e-116 */
+  { UINT64_C(0x964e858c91ba2655),  -422 }, /* 1e-108 */
+  { UINT64_C(0xdff9772470297ebd),  -396 }, /* 1e-100 */
+  { UINT64_C(0xa6dfbd9fb8e5b88f),  -369 }, /* 1e-92 */
+  { UINT64_C(0xf8a95fcf88747d94),  -343 }, /* 1e-84 */
+  { UINT64_C(0xb94470938fa89bcf),  -316 }, /* 1e-76 */
+  { UINT64_C(0x8a08f0f8bf0f156b),  -289 }, /* 1e-68 */
+  { UINT64_C(0xcdb02555653131b6),  -263 }, /* 1e-60 */
+  { UINT64_C(0x993fe2c6d07b7fac),  -236 }, /* 1e-52 */
+  { UINT64_C(0xe45c10c42a2b3b06),  -210 }, /* 1e-44 */
+  { UINT64_C(0xaa242499697392d3),  -183 }, /* 1e-36 */
+  { UINT64_C(0xfd87b5f28300ca0e),  -157 }, /* 1e-28 */
+  { UINT64_C(0xbce5086492111aeb),  -130 }, /* 1e-20 */
+  { UINT64_C(0x8cbccc096f5088cc),  -103 }, /* 1e-12 */
+  { UINT64_C(0xd1b71758e219652c),   -77 }, /* 1e-4 */
+  { UINT64_C(0x9c40000000000000),   -50 }, /* 1e4 */
+  { UINT64_C(0xe8d4a51000000000),   -24 }, /* 1e12 */
+  { UINT64_C(0xad78ebc5ac620000),     3 }, /* 1e20 */
+  { UINT64_C(0x813f3978f8940984),    30 }, /* 1e28 */
+  { UINT64_C(0xc097ce7bc90715b3),    56 }, /* 1e36 */
+  { UINT64_C(0x8f7e32ce7bea5c70),    83 }, /* 1e44 */
+  { UINT64_C(0xd5d238a4abe98068),   109 }, /* 1e52 */
+  { UINT64_C(0x9f4f2726179a2245),   136 }, /* 1e60 */
+  { UINT64_C(0xed63a231d4c4fb27),   162 }, /* 1e68 */
+  { UINT64_C(0xb0de65388cc8ada8),   189 }, /* 1e76 */
+  { UINT64_C(0x83c7088e1aab65db),   216 }, /* 1e84 */
+  { UINT64_C(0xc45d1df942711d9a),   242 }, /* 1e92 */
+  { UINT64_C(0x924d692ca61be758),   269 }, /* 1e100 */
+  { UINT64_C(0xda01ee641a708dea),   295 }, /* 1e108 */
+  { UINT64_C(0xa26da3999aef774a),   322 }, /* 1e116 */
+  { UINT64_C(0xf209787bb47d6b85),   348 }, /* 1e124 */
+  { UINT64_C(0xb454e4a179dd1877),   375 }, /* 1e132 */
+  { UINT64_C(0x865b86925b9bc5c2),   402 }, /* 1e140 */
+  { UINT64_C(0xc83553c5c8965d3d),   428 }, /* 1e148 */
+  { UINT64_C(0x952ab45cfa97a0b3),   455 }, /* 1e156 */
+  { UINT64_C(0xde469fbd99a05fe3),   481 }, /* 1e164 */
+  { UINT64_C(0xa59bc234db398c25),   508 }, /* 1e172 */
+  { UINT64_C(0xf6c69a72a3989f5c),   534 }, /* 1e180 */
+  { UINT64_C(0xb7dcbf5354e9bece),   561 }, /* 1e188 */
+  { UINT64_C(0x88fcf317f22241e2),   588 }, /* 1e196 */
+  { UINT64_C(0xcc20ce9bd35c78a5),   614 }, /* 1e204 */
+  { UINT64_C(0x98165af37b2153df),   641 }, /* 1e212 */
+  { UINT64_C(0xe2a0b5dc971f303a),   667 }, /* 1e220 */
+  { UINT64_C(0xa8d9d1535ce3b396),   694 }, /* 1e228 */
+  { UINT64_C(0xfb9b7cd9a4a7443c),   720 }, /* 1e236 */
+  { UINT64_C(0xbb764c4ca7a44410),   747 }, /* 1e244 */
+  { UINT64_C(0x8bab8eefb6409c1a),   774 }, /* 1e252 */
+  { UINT64_C(0xd01fef10a657842c),   800 }, /* 1e260 */
+  { UINT64_C(0x9b10a4e5e9913129),   827 }, /* 1e268 */
+  { UINT64_C(0xe7109bfba19c0c9d),   853 }, /* 1e276 */
+  { UINT64_C(0xac2820d9623bf429),   880 }, /* 1e284 */
+  { UINT64_C(0x80444b5e7aa7cf85),   907 }, /* 1e292 */
+  { UINT64_C(0xbf21e44003acdd2d),   933 }, /* 1e300 */
+  { UINT64_C(0x8e679c2f5e44ff8f),   960 }, /* 1e308 */
+  { UINT64_C(0xd433179d9c8cb841),   986 }, /* 1e316 */
+  { UINT64_C(0x9e19db92b4e31ba9),  1013 }, /* 1e324 */
+  { UINT64_C(0xeb96bf6ebadf77d9),  1039 }, /* 1e332 */
+  { UINT64_C(0xaf87023b9bf0ee6b),  1066 }, /* 1e340 */
+};
+
+static const uint32_t gPow10[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static const uint64_t gPow10_64[] = {
+  UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000),
+  UINT64_C(100000), UINT64_C(1000000), UINT64_C(10000000),
+  UINT64_C(100000000), UINT64_C(1000000000), UINT64_C(10000000000),
+  UINT64_C(100000000000), UINT64_C(1000000000000), UINT64_C(10000000000000),
+  UINT64_C(100000000000000), UINT64_C(1000000000000000),
+  UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+  UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+};
+
+static DiyFp
+diyfpMake(uint64_t f, int e)
+{
+  DiyFp r;
+
+  r.f = f;
+  r.e = e;
+
+  return r;
+}
+
+static DiyFp
+diyfpMultiply(DiyFp x, DiyFp y)
+{
+  const uint64_t M32 = 0xFFFFFFFF;
+  uint64_t a = x.f >> 32;
+  uint64_t b = x.f & M32;
+  uint64_t c = y.f >> 32;
+  uint64_t d = y.f & M32;
+  uint64_t ac = a * c;
+  uint64_t bc = b * c;
+  uint64_t ad = a * d;
+  uint64_t bd = b * d;
+  uint64_t tmp;
+
+  tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+  /* Round to nearest */
+  tmp += 1U << 31;
+
+  return diyfpMake(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64);
+}
+
+static DiyFp
+diyfpNormalize(DiyFp x)
+{
+  while ((x.f & (UINT64_C(1) << 63)) == 0) {
+    x.f <<= 1;
+    x.e--;
+  }
+
+  return x;
+}
+
+/* Boundaries of the interval of numbers rounding to value, normalized
+   to the same exponent */
+static void
+diyfpBoundaries(DiyFp v, DiyFp *minus, DiyFp *plus)
+{
+  DiyFp pl;
+  DiyFp mi;
+
+  pl = diyfpNormalize(diyfpMake((v.f << 1) + 1, v.e - 1));
+  if (v.f == DP_HIDDEN_BIT) {
+    /* Lower boundary is closer at a power of two */
+    mi = diyfpMake((v.f << 2) - 1, v.e - 2);
+  } else {
+    mi = diyfpMake((v.f << 1) - 1, v.e - 1);
+  }
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+
+  *minus = mi;
+  *plus = pl;
+}
+
+/* Cached power c = 10^-K such that the exponent of a number with binary
+   exponent e, multiplied by c, lies in [-60, -32] */
+static DiyFp
+cachedPower(int e, int *K)
+{
+  double dk;
+  int k;
+  int index;
+
+  dk = (-61 - e) * 0.30102999566398114 + 347;
+  k = (int) dk;
+  if (dk - k > 0.0) {
+    k++;
+  }
+
+  index = (k >> 3) + 1;
+  *K = -(-348 + index * 8);
+
+  return gCachedPowers[index];
+}
+
+static int
+countDigits32(uint32_t n)
+{
+  int digits = 1;
+
+  while (digits < 10 && n >= gPow10[digits]) {
+    digits++;
+  }
+
+  return digits;
+}
+
+static void
+grisuRound(char *buffer, int len, uint64_t delta, uint64_t rest,
+           uint64_t tenkappa, uint64_t wpw)
+{
+  /* Move last digit down, while it gets closer to exact value and stays
+     within the rounding interval */
+  while (rest < wpw && delta - rest >= tenkappa &&
+         (rest + tenkappa < wpw || wpw - rest > rest + tenkappa - wpw)) {
+    buffer[len - 1]--;
+    rest += tenkappa;
+  }
+}
+
+static int
+digitGen(DiyFp w, DiyFp mp, uint64_t delta, char *buffer, int *K)
+{
+  DiyFp one;
+  uint64_t wpw;
+  uint64_t p2;
+  uint64_t tmp;
+  uint32_t p1;
+  uint32_t d;
+  int kappa;
+  int len = 0;
+
+  one = diyfpMake(UINT64_C(1) << -mp.e, mp.e);
+  wpw = mp.f - w.f;
+  p1 = (uint32_t) (mp.f >> -one.e);
+  p2 = mp.f & (one.f - 1);
+  kappa = countDigits32(p1);
+
+  /* Integral part */
+  while (kappa > 0) {
+    d = p1 / gPow10[kappa - 1];
+    p1 %= gPow10[kappa - 1];
+    if (d != 0 || len != 0) {
+      buffer[len++] = (char) ('0' + d);
+    }
+    kappa--;
+    tmp = (((uint64_t) p1) << -one.e) + p2;
+    if (tmp <= delta) {
+      *K += kappa;
+      grisuRound(buffer, len, delta, tmp,
+                 ((uint64_t) gPow10[kappa]) << -one.e, wpw);
+      return len;
+    }
+  }
+
+  /* Fractional part */
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    d = (uint32_t) (p2 >> -one.e);
+    if (d != 0 || len != 0) {
+      buffer[len++] = (char) ('0' + d);
+    }
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *K += kappa;
+      grisuRound(buffer, len, delta, p2, one.f,
+                 (-kappa < 20 ? wpw * gPow10_64[-kappa] : 0));
+      return len;
+    }
+  }
+}
+
+/* Generate shortest digits of a positive value, such that
+   value = digits * 10^K */
+static int
+grisu2(double value, char *buffer, int *K)
+{
+  union {
+    double d;
+    uint64_t u;
+  } bits;
+  DiyFp v;
+  DiyFp w;
+  DiyFp wm;
+  DiyFp wp;
+  DiyFp c;
+  int biased;
+
+  bits.d = value;
+  biased = (int) ((bits.u & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+  if (biased != 0) {
+    v = diyfpMake((bits.u & DP_SIGNIFICAND_MASK) + DP_HIDDEN_BIT,
+                  biased - DP_EXPONENT_BIAS);
+  } else {
+    /* Denormal */
+    v = diyfpMake(bits.u & DP_SIGNIFICAND_MASK, DP_MIN_EXPONENT + 1);
+  }
+
+  diyfpBoundaries(v, &wm, &wp);
+  c = cachedPower(wp.e, K);
+  w = diyfpMultiply(diyfpNormalize(v), c);
+  wp = diyfpMultiply(wp, c);
+  wm = diyfpMultiply(wm, c);
+  /* Shrink interval to account for multiplication error */
+  wm.f++;
+  wp.f--;
+
+  return digitGen(w, wp, wp.f - wm.f, buffer, K);
+}
+
+static int
+writeExponent(int k, char *out)
+{
+  char *p = out;
+
+  if (k < 0) {
+    *p++ = '-';
+    k = -k;
+  } else {
+    *p++ = '+';
+  }
+
+  if (k >= 100) {
+    *p++ = (char) ('0' + k / 100);
+    k %= 100;
+    *p++ = (char) ('0' + k / 10);
+  } else if (k >= 10) {
+    *p++ = (char) ('0' + k / 10);
+  }
+  *p++ = (char) ('0' + k % 10);
+
+  return (int) (p - out);
+}
+
+/* Lay out digits * 10^k, following ECMAScript Number to string rules */
+static int
+prettify(char *buffer, int length, int k)
+{
+  /* 10^(kk-1) <= v < 10^kk */
+  int kk = length + k;
+  int offset;
+  int i;
+
+  if (length <= kk && kk <= 21) {
+    /* Integer, 1234e5 -> 123400000 */
+    for (i = length; i < kk; i++) {
+      buffer[i] = '0';
+    }
+    return kk;
+  }
+
+  if (0 < kk && kk <= 21) {
+    /* 1234e-2 -> 12.34 */
+    memmove(buffer + kk + 1, buffer + kk, length - kk);
+    buffer[kk] = '.';
+    return length + 1;
+  }
+
+  if (-6 < kk && kk <= 0) {
+    /* 1234e-6 -> 0.001234 */
+    offset = 2 - kk;
+    memmove(buffer + offset, buffer, length);
+    buffer[0] = '0';
+    buffer[1] = '.';
+    for (i = 2; i < offset; i++) {
+      buffer[i] = '0';
+    }
+    return length + offset;
+  }
+
+  if (length == 1) {
+    /* 1e30 */
+    buffer[1] = 'e';
+    return 2 + writeExponent(kk - 1, buffer + 2);
+  }
+
+  /* 1234e30 -> 1.234e33 */
+  memmove(buffer + 2, buffer + 1, length - 1);
+  buffer[1] = '.';
+  buffer[length + 1] = 'e';
+  return length + 2 + writeExponent(kk - 1, buffer + length + 2);
+}
+
+int
+Ydtoa(double value, char *out)
+{
+  char *p = out;
+  int length;
+  int K;
+
+  if (value != value) {
+    memcpy(out, "nan", 4);
+    return 3;
+  }
+
+  if (signbit(value)) {
+    *p++ = '-';
+    value = -value;
+  }
+
+  if (value == 0.0) {
+    *p++ = '0';
+  } else if (value > 1.7976931348623157e308) {
+    memcpy(p, "inf", 3);
+    p += 3;
+  } else {
+    length = grisu2(value, p, &K);
+    p += prettify(p, length, K);
+  }
+
+  *p = '\0';
+
+  return (int) (p - out);
+}
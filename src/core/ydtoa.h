@@ -0,0 +1,36 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+#ifndef _YOSAL_YDTOA_H
+#define _YOSAL_YDTOA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Room needed by Ydtoa for any double, including terminator */
+#define YDTOA_BUFSIZE 32
+
+#define Ydtoa YPRIVATE(Ydtoa)
+
+/*
+ * Format a double into the shortest decimal string that reads back to
+ * the same value, using '.' as separator regardless of locale. Output
+ * is null terminated, returns its length.
+ */
+int Ydtoa(double value, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _YOSAL_YDTOA_H */
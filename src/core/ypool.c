@@ -0,0 +1,388 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Magazine based object pool, following Bonwick and Adams, "Magazines and
+ * Vmem" (USENIX 2001). Each thread holds a loaded and a previous magazine,
+ * and only reaches the depot when both are empty on allocation, or both
+ * are full on release. Objects are carved out of slabs, never returned to
+ * the system before the pool is released. Objects released while no
+ * magazine can be allocated are linked into the depot through their first
+ * word, and reused before carving slabs again.
+ */
+#include <pthread.h>
+
+#include "yosal/yosal.h"
+
+/* Number of objects per magazine */
+#define YPOOL_MAGAZINE_SIZE 32
+/* Number of objects per slab */
+#define YPOOL_SLAB_OBJECTS 128
+#define YPOOL_ALIGNMENT (2 * sizeof(void*))
+
+typedef struct YpoolMagazineStruct YpoolMagazine;
+
+struct YpoolMagazineStruct {
+  YpoolMagazine *next;
+  int count;
+  void *objs[YPOOL_MAGAZINE_SIZE];
+};
+
+typedef struct YpoolSlabStruct YpoolSlab;
+
+struct YpoolSlabStruct {
+  YpoolSlab *next;
+};
+
+typedef struct YpoolSpareStruct YpoolSpare;
+
+struct YpoolSpareStruct {
+  YpoolSpare *next;
+};
+
+typedef struct YpoolThreadStruct YpoolThread;
+
+/* Magazines of a thread, registered in pool to be released with it */
+struct YpoolThreadStruct {
+  Ypool *pool;
+  YpoolMagazine *loaded;
+  YpoolMagazine *previous;
+  YpoolThread *next;
+  YpoolThread *prev;
+};
+
+struct YpoolStruct {
+  size_t objsize;
+  pthread_key_t key;
+  pthread_mutex_t lock;
+  /* Depot, protected by lock */
+  YpoolMagazine *full;
+  YpoolMagazine *empty;
+  YpoolSlab *slabs;
+  /* Objects released without magazine */
+  YpoolSpare *spare;
+  char *slabpos;
+  int slabavail;
+  YpoolThread *threads;
+};
+
+#define YPOOL_SLAB_HEADER \
+  ((sizeof(YpoolSlab) + YPOOL_ALIGNMENT - 1) & ~(YPOOL_ALIGNMENT - 1))
+
+static YpoolMagazine*
+magazineCreate()
+{
+  YpoolMagazine *magazine;
+
+  magazine = (YpoolMagazine*) Ymem_malloc_tag(sizeof(YpoolMagazine), YMEM_TAG_POOL);
+  if (magazine != NULL) {
+    magazine->next = NULL;
+    magazine->count = 0;
+  }
+
+  return magazine;
+}
+
+static void
+magazineList(YpoolMagazine **list, YpoolMagazine *magazine)
+{
+  magazine->next = *list;
+  *list = magazine;
+}
+
+static YpoolMagazine*
+magazineUnlist(YpoolMagazine **list)
+{
+  YpoolMagazine *magazine = *list;
+
+  if (magazine != NULL) {
+    *list = magazine->next;
+    magazine->next = NULL;
+  }
+
+  return magazine;
+}
+
+/* Fill magazine with spare then new objects. Must be called with lock held */
+static void
+slabFill(Ypool *pool, YpoolMagazine *magazine)
+{
+  YpoolSlab *slab;
+
+  while (magazine->count < YPOOL_MAGAZINE_SIZE && pool->spare != NULL) {
+    magazine->objs[magazine->count++] = pool->spare;
+    pool->spare = pool->spare->next;
+  }
+
+  while (magazine->count < YPOOL_MAGAZINE_SIZE) {
+    if (pool->slabavail <= 0) {
+      slab = (YpoolSlab*) Ymem_malloc_tag(YPOOL_SLAB_HEADER +
+                                          YPOOL_SLAB_OBJECTS * pool->objsize,
+                                          YMEM_TAG_POOL);
+      if (slab == NULL) {
+        break;
+      }
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+      pool->slabpos = ((char*) slab) + YPOOL_SLAB_HEADER;
+      pool->slabavail = YPOOL_SLAB_OBJECTS;
+    }
+
+    magazine->objs[magazine->count++] = pool->slabpos;
+    pool->slabpos += pool->objsize;
+    pool->slabavail--;
+  }
+}
+
+static void
+threadRelease(Ypool *pool, YpoolThread *thread)
+{
+  if (thread->prev != NULL) {
+    thread->prev->next = thread->next;
+  } else {
+    pool->threads = thread->next;
+  }
+  if (thread->next != NULL) {
+    thread->next->prev = thread->prev;
+  }
+
+  Ymem_free(thread);
+}
+
+/* Hand magazines of exiting thread over to depot */
+static void
+threadDestroy(void *data)
+{
+  YpoolThread *thread = (YpoolThread*) data;
+  Ypool *pool = thread->pool;
+  YpoolMagazine *magazines[2];
+  int i;
+
+  magazines[0] = thread->loaded;
+  magazines[1] = thread->previous;
+
+  pthread_mutex_lock(&pool->lock);
+  for (i = 0; i < 2; i++) {
+    if (magazines[i]->count > 0) {
+      magazineList(&pool->full, magazines[i]);
+    } else {
+      magazineList(&pool->empty, magazines[i]);
+    }
+  }
+  threadRelease(pool, thread);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static YpoolThread*
+threadGet(Ypool *pool)
+{
+  YpoolThread *thread;
+
+  thread = (YpoolThread*) pthread_getspecific(pool->key);
+  if (thread != NULL) {
+    return thread;
+  }
+
+  thread = (YpoolThread*) Ymem_malloc_tag(sizeof(YpoolThread), YMEM_TAG_POOL);
+  if (thread == NULL) {
+    return NULL;
+  }
+  thread->pool = pool;
+  thread->loaded = magazineCreate();
+  thread->previous = magazineCreate();
+  if (thread->loaded == NULL || thread->previous == NULL ||
+      pthread_setspecific(pool->key, thread) != 0) {
+    Ymem_free(thread->loaded);
+    Ymem_free(thread->previous);
+    Ymem_free(thread);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  thread->prev = NULL;
+  thread->next = pool->threads;
+  if (pool->threads != NULL) {
+    pool->threads->prev = thread;
+  }
+  pool->threads = thread;
+  pthread_mutex_unlock(&pool->lock);
+
+  return thread;
+}
+
+Ypool*
+Ypool_create(size_t objsize)
+{
+  Ypool *pool;
+
+  if (objsize == 0) {
+    return NULL;
+  }
+
+  pool = (Ypool*) Ymem_malloc_tag(sizeof(Ypool), YMEM_TAG_POOL);
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  if (objsize < sizeof(void*)) {
+    objsize = sizeof(void*);
+  }
+  pool->objsize = (objsize + YPOOL_ALIGNMENT - 1) & ~(YPOOL_ALIGNMENT - 1);
+  pool->full = NULL;
+  pool->empty = NULL;
+  pool->slabs = NULL;
+  pool->spare = NULL;
+  pool->slabpos = NULL;
+  pool->slabavail = 0;
+  pool->threads = NULL;
+
+  if (pthread_key_create(&pool->key, threadDestroy) != 0) {
+    Ymem_free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+
+  return pool;
+}
+
+void
+Ypool_release(Ypool *pool)
+{
+  YpoolMagazine *magazine;
+  YpoolSlab *slab;
+
+  if (pool == NULL) {
+    return;
+  }
+
+  /* Prevent destructor from running on exit of other threads */
+  pthread_key_delete(pool->key);
+
+  while (pool->threads != NULL) {
+    Ymem_free(pool->threads->loaded);
+    Ymem_free(pool->threads->previous);
+    threadRelease(pool, pool->threads);
+  }
+  while ((magazine = magazineUnlist(&pool->full)) != NULL) {
+    Ymem_free(magazine);
+  }
+  while ((magazine = magazineUnlist(&pool->empty)) != NULL) {
+    Ymem_free(magazine);
+  }
+  while ((slab = pool->slabs) != NULL) {
+    pool->slabs = slab->next;
+    Ymem_free(slab);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  Ymem_free(pool);
+}
+
+void*
+Ypool_alloc(Ypool *pool)
+{
+  YpoolThread *thread;
+  YpoolMagazine *magazine;
+
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  thread = threadGet(pool);
+  if (thread == NULL) {
+    return NULL;
+  }
+
+  if (thread->loaded->count == 0) {
+    if (thread->previous->count > 0) {
+      magazine = thread->loaded;
+      thread->loaded = thread->previous;
+      thread->previous = magazine;
+    } else {
+      /* Exchange empty magazine for a full one from depot */
+      pthread_mutex_lock(&pool->lock);
+      magazine = magazineUnlist(&pool->full);
+      if (magazine != NULL) {
+        magazineList(&pool->empty, thread->previous);
+        thread->previous = thread->loaded;
+        thread->loaded = magazine;
+      } else {
+        slabFill(pool, thread->loaded);
+      }
+      pthread_mutex_unlock(&pool->lock);
+
+      if (thread->loaded->count == 0) {
+        /* Out of memory */
+        return NULL;
+      }
+    }
+  }
+
+  return thread->loaded->objs[--thread->loaded->count];
+}
+
+/* Return object to depot, when it can't be cached by calling thread */
+static void
+depotFree(Ypool *pool, void *obj)
+{
+  YpoolSpare *spare = (YpoolSpare*) obj;
+
+  pthread_mutex_lock(&pool->lock);
+  spare->next = pool->spare;
+  pool->spare = spare;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void
+Ypool_free(Ypool *pool, void *obj)
+{
+  YpoolThread *thread;
+  YpoolMagazine *magazine;
+
+  if (pool == NULL || obj == NULL) {
+    return;
+  }
+
+  thread = threadGet(pool);
+  if (thread == NULL) {
+    depotFree(pool, obj);
+    return;
+  }
+
+  if (thread->loaded->count == YPOOL_MAGAZINE_SIZE) {
+    if (thread->previous->count < YPOOL_MAGAZINE_SIZE) {
+      magazine = thread->loaded;
+      thread->loaded = thread->previous;
+      thread->previous = magazine;
+    } else {
+      /* Exchange full magazine for an empty one from depot */
+      pthread_mutex_lock(&pool->lock);
+      magazine = magazineUnlist(&pool->empty);
+      pthread_mutex_unlock(&pool->lock);
+      if (magazine == NULL) {
+        magazine = magazineCreate();
+        if (magazine == NULL) {
+          depotFree(pool, obj);
+          return;
+        }
+      }
+
+      pthread_mutex_lock(&pool->lock);
+      magazineList(&pool->full, thread->previous);
+      pthread_mutex_unlock(&pool->lock);
+      thread->previous = thread->loaded;
+      thread->loaded = magazine;
+    }
+  }
+
+  thread->loaded->objs[thread->loaded->count++] = obj;
+}
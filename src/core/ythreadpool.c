@@ -0,0 +1,687 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Work-stealing thread pool. Deques follow Chase and Lev, "Dynamic
+ * Circular Work-Stealing Deque" (SPAA 2005), with the memory orderings of
+ * Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models"
+ * (PPoPP 2013), sequentially consistent operations standing for fences.
+ * Deques have a fixed capacity, tasks overflowing them going through the
+ * injection queue instead.
+ *
+ * Idle workers spin for a while, then park until some task is submitted.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#define LOG_TAG "yosal::ythreadpool"
+
+#include "yosal/yosal.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+/* Number of tasks per deque, a power of 2 */
+#define THREADPOOL_DEQUE_SIZE 1024
+/* Longest sleep of a thread waiting for a group, to look for tasks again */
+#define THREADPOOL_GROUP_WAIT_MS 1
+#define THREADPOOL_THREADS_MAX 256
+
+typedef struct YtaskStruct Ytask;
+
+struct YtaskStruct {
+  YthreadpoolFunc func;
+  void *arg;
+  Ytaskgroup *group;
+  /* Subrange of a parallel for, if rangefunc is set */
+  YthreadpoolRangeFunc rangefunc;
+  size_t begin;
+  size_t end;
+  size_t grain;
+};
+
+typedef struct {
+  /* Moved by thieves */
+  long top YCACHELINE_ALIGNED;
+  /* Moved by owner only */
+  long bottom YCACHELINE_ALIGNED;
+  Ytask *tasks[THREADPOOL_DEQUE_SIZE];
+  Ythreadpool *pool;
+  pthread_t thread;
+  int id;
+  unsigned int seed;
+} YthreadpoolWorker;
+
+struct YthreadpoolStruct {
+  YthreadpoolWorker *workers;
+  int nworkers;
+  /* Number of worker threads running */
+  int started;
+  int flags;
+  Ypool *tasks;
+  /* Worker running calling thread */
+  pthread_key_t key;
+  pthread_mutex_t lock;
+  /* Idle workers */
+  Ypark park;
+  /* Tasks submitted from outside of workers, protected by lock */
+  Yqueue *injection;
+  /* Size of injection queue, read without lock */
+  int injected;
+  int stopping;
+};
+
+struct YtaskgroupStruct {
+  Ythreadpool *pool;
+  /* Number of tasks not yet returned */
+  int pending;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static int
+dequePush(YthreadpoolWorker *w, Ytask *task)
+{
+  long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+
+  if (b - t >= THREADPOOL_DEQUE_SIZE) {
+    return YOSAL_ERROR;
+  }
+  __atomic_store_n(&w->tasks[b & (THREADPOOL_DEQUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+  __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELEASE);
+
+  return YOSAL_OK;
+}
+
+/* Take most recent task of own deque, racing with thieves for last one */
+static Ytask*
+dequeTake(YthreadpoolWorker *w)
+{
+  Ytask *task = NULL;
+  long b;
+  long t;
+
+  b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&w->bottom, b, __ATOMIC_SEQ_CST);
+  t = __atomic_load_n(&w->top, __ATOMIC_SEQ_CST);
+
+  if (t <= b) {
+    task = __atomic_load_n(&w->tasks[b & (THREADPOOL_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+      if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        task = NULL;
+      }
+      __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+
+  return task;
+}
+
+/* Steal oldest task of a deque, giving up when losing a race */
+static Ytask*
+dequeSteal(YthreadpoolWorker *w)
+{
+  Ytask *task;
+  long t;
+  long b;
+
+  t = __atomic_load_n(&w->top, __ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&w->bottom, __ATOMIC_SEQ_CST);
+  if (t >= b) {
+    return NULL;
+  }
+
+  task = __atomic_load_n(&w->tasks[t & (THREADPOOL_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, 0,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+
+  return task;
+}
+
+static int
+dequeSize(YthreadpoolWorker *w)
+{
+  long t = __atomic_load_n(&w->top, __ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&w->bottom, __ATOMIC_SEQ_CST);
+
+  return (b > t ? (int) (b - t) : 0);
+}
+
+static int
+threadpoolHasWork(Ythreadpool *pool)
+{
+  int i;
+
+  if (__atomic_load_n(&pool->injected, __ATOMIC_SEQ_CST) > 0) {
+    return 1;
+  }
+  for (i = 0; i < pool->nworkers; i++) {
+    if (dequeSize(&pool->workers[i]) > 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Wake up a parked worker, if any, once a task was published */
+static void
+threadpoolWake(Ythreadpool *pool)
+{
+  Ypark_wake(&pool->park, &pool->lock, 0);
+}
+
+static Ytask*
+threadpoolFind(Ythreadpool *pool, YthreadpoolWorker *self)
+{
+  Ytask *task = NULL;
+  unsigned int start = 0;
+  int i;
+
+  if (self != NULL) {
+    task = dequeTake(self);
+    if (task != NULL) {
+      return task;
+    }
+  }
+
+  if (__atomic_load_n(&pool->injected, __ATOMIC_ACQUIRE) > 0) {
+    pthread_mutex_lock(&pool->lock);
+    task = Yqueue_pop(pool->injection);
+    if (task != NULL) {
+      __sync_fetch_and_sub(&pool->injected, 1);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (task != NULL) {
+      return task;
+    }
+  }
+
+  /* Visit other workers from a random one, so that thieves spread */
+  if (self != NULL) {
+    self->seed = self->seed * 1103515245 + 12345;
+    start = (self->seed >> 16);
+  }
+  for (i = 0; i < pool->nworkers; i++) {
+    YthreadpoolWorker *victim = &pool->workers[(start + i) % pool->nworkers];
+    if (victim != self) {
+      task = dequeSteal(victim);
+      if (task != NULL) {
+        return task;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* Account for a returned task. Last one decrements under lock, so that
+   a waiter seeing the group done can release it once it got the lock. */
+static void
+groupDone(Ytaskgroup *group)
+{
+  int pending;
+
+  for (;;) {
+    pending = __atomic_load_n(&group->pending, __ATOMIC_ACQUIRE);
+    if (pending <= 1) {
+      break;
+    }
+    if (__sync_bool_compare_and_swap(&group->pending, pending, pending - 1)) {
+      return;
+    }
+  }
+
+  pthread_mutex_lock(&group->lock);
+  __sync_fetch_and_sub(&group->pending, 1);
+  pthread_cond_broadcast(&group->cond);
+  pthread_mutex_unlock(&group->lock);
+}
+
+static int
+threadpoolPush(Ythreadpool *pool, Ytask *task)
+{
+  YthreadpoolWorker *self;
+
+  if (task->group != NULL) {
+    __sync_fetch_and_add(&task->group->pending, 1);
+  }
+
+  self = (YthreadpoolWorker*) pthread_getspecific(pool->key);
+  if (self == NULL || self->pool != pool || dequePush(self, task) != YOSAL_OK) {
+    pthread_mutex_lock(&pool->lock);
+    if (Yqueue_push(pool->injection, task) < 0) {
+      pthread_mutex_unlock(&pool->lock);
+      if (task->group != NULL) {
+        groupDone(task->group);
+      }
+      return YOSAL_ERROR;
+    }
+    __sync_fetch_and_add(&pool->injected, 1);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  threadpoolWake(pool);
+
+  return YOSAL_OK;
+}
+
+static int
+rangeSubmit(Ythreadpool *pool, Ytaskgroup *group, size_t begin, size_t end,
+            size_t grain, YthreadpoolRangeFunc func, void *arg)
+{
+  Ytask *task;
+
+  task = (Ytask*) Ypool_alloc(pool->tasks);
+  if (task == NULL) {
+    return YOSAL_ERROR;
+  }
+  task->func = NULL;
+  task->arg = arg;
+  task->group = group;
+  task->rangefunc = func;
+  task->begin = begin;
+  task->end = end;
+  task->grain = grain;
+
+  if (threadpoolPush(pool, task) != YOSAL_OK) {
+    Ypool_free(pool->tasks, task);
+    return YOSAL_ERROR;
+  }
+
+  return YOSAL_OK;
+}
+
+/* Hand over upper halves of range to other workers, keeping the lower
+   one until it is small enough */
+static void
+rangeRun(Ythreadpool *pool, Ytask *task)
+{
+  size_t begin = task->begin;
+  size_t end = task->end;
+  size_t mid;
+
+  while (end - begin > task->grain) {
+    mid = begin + (end - begin) / 2;
+    if (rangeSubmit(pool, task->group, mid, end, task->grain,
+                    task->rangefunc, task->arg) != YOSAL_OK) {
+      break;
+    }
+    end = mid;
+  }
+
+  task->rangefunc(task->arg, begin, end);
+}
+
+static void
+threadpoolRun(Ythreadpool *pool, Ytask *task)
+{
+  Ytaskgroup *group = task->group;
+
+  if (task->rangefunc != NULL) {
+    rangeRun(pool, task);
+  } else {
+    task->func(task->arg);
+  }
+  Ypool_free(pool->tasks, task);
+
+  if (group != NULL) {
+    groupDone(group);
+  }
+}
+
+/* Pin worker to one of the CPUs it is allowed to run on, inherited from
+   the thread that created the pool */
+static void
+workerPin(YthreadpoolWorker *w)
+{
+#if defined(__linux__) && defined(CPU_SET)
+  cpu_set_t allowed;
+  cpu_set_t set;
+  int ncpus = 0;
+  int nth;
+  int cpu;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      ncpus++;
+    }
+  }
+  if (ncpus <= 0) {
+    return;
+  }
+
+  /* Worker i runs on the i-th allowed CPU */
+  nth = w->id % ncpus;
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      if (nth == 0) {
+        break;
+      }
+      nth--;
+    }
+  }
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    ALOGD("failed to pin worker %d", w->id);
+  }
+#endif
+}
+
+static void*
+workerRun(void *arg)
+{
+  YthreadpoolWorker *w = (YthreadpoolWorker*) arg;
+  Ythreadpool *pool = w->pool;
+  Ytask *task;
+  int spins = 0;
+  int stop;
+
+  pthread_setspecific(pool->key, w);
+  if (pool->flags & YTHREADPOOL_AFFINITY) {
+    workerPin(w);
+  }
+
+  for (;;) {
+    task = threadpoolFind(pool, w);
+    if (task != NULL) {
+      threadpoolRun(pool, task);
+      spins = 0;
+      continue;
+    }
+    if (spins < YPARK_SPIN) {
+      spins++;
+      YCPU_RELAX();
+      continue;
+    }
+    spins = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    Ypark_enter(&pool->park);
+    while (!pool->stopping && !threadpoolHasWork(pool)) {
+      Ypark_wait(&pool->park, &pool->lock, NULL);
+    }
+    Ypark_leave(&pool->park);
+    stop = (pool->stopping && !threadpoolHasWork(pool));
+    pthread_mutex_unlock(&pool->lock);
+    if (stop) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+Ythreadpool*
+Ythreadpool_create(int nthreads, int flags)
+{
+  Ythreadpool *pool;
+  YthreadpoolWorker *workers;
+  int i;
+
+  if (nthreads <= 0) {
+    nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0) {
+      nthreads = 1;
+    }
+  }
+  if (nthreads > THREADPOOL_THREADS_MAX) {
+    nthreads = THREADPOOL_THREADS_MAX;
+  }
+
+  pool = (Ythreadpool*) Ymem_malloc(sizeof(Ythreadpool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  memset(pool, 0, sizeof(Ythreadpool));
+  pool->flags = flags;
+
+  workers = (YthreadpoolWorker*) Ymem_malloc_cacheline(nthreads * sizeof(YthreadpoolWorker));
+  pool->tasks = Ypool_create(sizeof(Ytask));
+  pool->injection = Yqueue_create();
+  if (workers == NULL || pool->tasks == NULL || pool->injection == NULL ||
+      pthread_key_create(&pool->key, NULL) != 0) {
+    Yqueue_release(pool->injection);
+    Ypool_release(pool->tasks);
+    Ymem_free_cacheline(workers);
+    Ymem_free(pool);
+    return NULL;
+  }
+  memset(workers, 0, nthreads * sizeof(YthreadpoolWorker));
+  pool->workers = workers;
+  pthread_mutex_init(&pool->lock, NULL);
+  Ypark_init(&pool->park);
+
+  for (i = 0; i < nthreads; i++) {
+    workers[i].pool = pool;
+    workers[i].id = i;
+    workers[i].seed = (unsigned int) i * 2654435761U + 1;
+  }
+  /* Workers look at each other as soon as they start */
+  pool->nworkers = nthreads;
+  for (i = 0; i < nthreads; i++) {
+    if (pthread_create(&workers[i].thread, NULL, workerRun, &workers[i]) != 0) {
+      ALOGE("failed to start worker %d", i);
+      Ythreadpool_release(pool);
+      return NULL;
+    }
+    pool->started++;
+  }
+
+  return pool;
+}
+
+void
+Ythreadpool_release(Ythreadpool *pool)
+{
+  int i;
+
+  if (pool == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  Ypark_wakeall(&pool->park);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 0; i < pool->started; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+
+  Ypark_destroy(&pool->park);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_key_delete(pool->key);
+  Yqueue_release(pool->injection);
+  Ypool_release(pool->tasks);
+  Ymem_free_cacheline(pool->workers);
+  Ymem_free(pool);
+}
+
+int
+Ythreadpool_size(Ythreadpool *pool)
+{
+  if (pool == NULL) {
+    return 0;
+  }
+
+  return pool->nworkers;
+}
+
+int
+Ythreadpool_submit(Ythreadpool *pool, Ytaskgroup *group,
+                   YthreadpoolFunc func, void *arg)
+{
+  Ytask *task;
+
+  if (pool == NULL || func == NULL || (group != NULL && group->pool != pool)) {
+    return YOSAL_ERROR;
+  }
+
+  task = (Ytask*) Ypool_alloc(pool->tasks);
+  if (task == NULL) {
+    return YOSAL_ERROR;
+  }
+  task->func = func;
+  task->arg = arg;
+  task->group = group;
+  task->rangefunc = NULL;
+
+  if (threadpoolPush(pool, task) != YOSAL_OK) {
+    Ypool_free(pool->tasks, task);
+    return YOSAL_ERROR;
+  }
+
+  return YOSAL_OK;
+}
+
+int
+Ythreadpool_parallel_for(Ythreadpool *pool, size_t begin, size_t end, size_t grain,
+                         YthreadpoolRangeFunc func, void *arg)
+{
+  Ytaskgroup *group;
+  Ytask root;
+  int rc;
+
+  if (func == NULL) {
+    return YOSAL_ERROR;
+  }
+  if (end <= begin) {
+    return YOSAL_OK;
+  }
+  if (grain == 0) {
+    /* A few subranges per worker, to balance uneven ones */
+    grain = (end - begin) / (4 * (size_t) Ythreadpool_size(pool) + 1) + 1;
+  }
+  if (pool == NULL || end - begin <= grain) {
+    func(arg, begin, end);
+    return YOSAL_OK;
+  }
+
+  group = Ytaskgroup_create(pool);
+  if (group == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  /* Calling thread takes its share of the range */
+  root.func = NULL;
+  root.arg = arg;
+  root.group = group;
+  root.rangefunc = func;
+  root.begin = begin;
+  root.end = end;
+  root.grain = grain;
+  rangeRun(pool, &root);
+
+  rc = Ytaskgroup_wait(group);
+  Ytaskgroup_release(group);
+
+  return rc;
+}
+
+Ytaskgroup*
+Ytaskgroup_create(Ythreadpool *pool)
+{
+  Ytaskgroup *group;
+
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  group = (Ytaskgroup*) Ymem_malloc(sizeof(Ytaskgroup));
+  if (group == NULL) {
+    return NULL;
+  }
+  group->pool = pool;
+  group->pending = 0;
+  pthread_mutex_init(&group->lock, NULL);
+  pthread_cond_init(&group->cond, NULL);
+
+  return group;
+}
+
+int
+Ytaskgroup_wait(Ytaskgroup *group)
+{
+  Ythreadpool *pool;
+  YthreadpoolWorker *self;
+  struct timespec deadline;
+  Ytask *task;
+  int spins = 0;
+
+  if (group == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  pool = group->pool;
+  self = (YthreadpoolWorker*) pthread_getspecific(pool->key);
+  if (self != NULL && self->pool != pool) {
+    self = NULL;
+  }
+
+  /* Help running tasks, of this group or not, until group is done */
+  while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+    task = threadpoolFind(pool, self);
+    if (task != NULL) {
+      threadpoolRun(pool, task);
+      spins = 0;
+      continue;
+    }
+    if (spins < YPARK_SPIN) {
+      spins++;
+      YCPU_RELAX();
+      continue;
+    }
+    spins = 0;
+
+    /* Tasks of group are all running elsewhere, or about to be stolen */
+    Ypark_deadline(&deadline, THREADPOOL_GROUP_WAIT_MS);
+    pthread_mutex_lock(&group->lock);
+    if (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+      pthread_cond_timedwait(&group->cond, &group->lock, &deadline);
+    }
+    pthread_mutex_unlock(&group->lock);
+  }
+
+  /* Let last task leave group lock */
+  pthread_mutex_lock(&group->lock);
+  pthread_mutex_unlock(&group->lock);
+
+  return YOSAL_OK;
+}
+
+void
+Ytaskgroup_release(Ytaskgroup *group)
+{
+  if (group == NULL) {
+    return;
+  }
+
+  Ytaskgroup_wait(group);
+  pthread_cond_destroy(&group->cond);
+  pthread_mutex_destroy(&group->lock);
+  Ymem_free(group);
+}
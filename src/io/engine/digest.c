@@ -0,0 +1,157 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Transformation channel feeding all data going through it into a Ydigest
+ */
+#include "yosal/yosal.h"
+
+typedef struct {
+  Ychannel *channel;
+  Ydigest *digest;
+} YchannelDigest;
+
+static int
+YchannelDigestRead(Ychannel *channel, void *readbuf, int nbytes)
+{
+  YchannelDigest *engine;
+  const char *chunk;
+  size_t chunklen = 0;
+
+  engine = (YchannelDigest*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+  if (nbytes <= 0) {
+    return 0;
+  }
+
+  /* Fetch at most one segment, so the underlying channel never blocks to fill nbytes */
+  chunk = YchannelFetch(engine->channel, nbytes, &chunklen);
+  if (chunk == NULL || chunklen <= 0) {
+    if (YchannelWouldBlock(engine->channel)) {
+      return YCHANNEL_WOULDBLOCK;
+    }
+    /* Underlying channel is exhausted */
+    return -1;
+  }
+
+  memcpy(readbuf, chunk, chunklen);
+  /* Hash the copy while it is still hot in cache */
+  Ydigest_update(engine->digest, (const char*) readbuf, (int) chunklen);
+
+  return (int) chunklen;
+}
+
+static int
+YchannelDigestWrite(Ychannel *channel, const void *buf, int nbytes)
+{
+  YchannelDigest *engine;
+  ssize_t n;
+
+  engine = (YchannelDigest*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+  if (nbytes <= 0) {
+    return 0;
+  }
+
+  n = YchannelWrite(engine->channel, buf, nbytes);
+  if (n <= 0) {
+    if (YchannelWouldBlock(engine->channel)) {
+      return YCHANNEL_WOULDBLOCK;
+    }
+    return -1;
+  }
+
+  /* Only account for bytes the underlying channel actually accepted */
+  Ydigest_update(engine->digest, (const char*) buf, (int) n);
+
+  return (int) n;
+}
+
+static int
+YchannelDigestFlush(Ychannel *channel)
+{
+  YchannelDigest *engine;
+
+  engine = (YchannelDigest*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  return YchannelFlush(engine->channel);
+}
+
+static int
+YchannelDigestRelease(Ychannel *channel)
+{
+  YchannelDigest *engine;
+
+  engine = (YchannelDigest*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  if (engine->channel != NULL) {
+    if (YchannelGetAutoRelease(channel)) {
+      YchannelRelease(engine->channel);
+    }
+    engine->channel = NULL;
+  }
+
+  /* Digest is owned by the caller, who still needs it to get the result */
+  engine->digest = NULL;
+
+  Ymem_free(engine);
+
+  return 0;
+}
+
+Ychannel*
+YchannelInitDigest(Ychannel *input, Ydigest *digest)
+{
+  YchannelDigest *engine;
+  Ychannel *channel;
+
+  if (input == NULL || digest == NULL) {
+    return NULL;
+  }
+  if (!YchannelReadable(input) && !YchannelWritable(input)) {
+    return NULL;
+  }
+
+  engine = (YchannelDigest*) Ymem_malloc(sizeof(YchannelDigest));
+  if (engine == NULL) {
+    return NULL;
+  }
+
+  engine->channel = input;
+  engine->digest = digest;
+
+  if (YchannelWritable(input)) {
+    channel = YchannelInitGeneric("digest", engine,
+                                  NULL, YchannelDigestWrite,
+                                  YchannelDigestFlush, YchannelDigestRelease);
+  } else {
+    channel = YchannelInitGeneric("digest", engine,
+                                  YchannelDigestRead, NULL,
+                                  NULL, YchannelDigestRelease);
+  }
+
+  if (channel == NULL) {
+    Ymem_free(engine);
+  }
+
+  return channel;
+}
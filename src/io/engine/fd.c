@@ -16,6 +16,8 @@
 #include <fcntl.h>
 #include <errno.h>
 
+static const char YchannelFdName[] = "fd";
+
 typedef struct {
   int fd;
 } YchannelFd;
@@ -40,13 +42,19 @@ YchannelFdRead(Ychannel *channel, void *readbuf, int nbytes)
   while (1) {
     ssize_t n = read(engine->fd, readbuf, nbytes);
     if (n == 0) {
-      /* EOF */
+      /* EOF, normalize return code to -1 */
+      return -1;
     }
     else if (n <  0) {
-      if (errno == EAGAIN || errno == EINTR) {
+      if (errno == EINTR) {
         /* Retry */
         continue;
       }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        /* Non-blocking descriptor has no data yet */
+        return YCHANNEL_WOULDBLOCK;
+      }
+      return -1;
     } else {
       nread += n;
     }
@@ -73,11 +81,14 @@ YchannelFdWrite(Ychannel *channel, const void *buf, int nbytes)
     return 0;
   }
 
-  n = write(engine->fd, buf, nbytes);
+  do {
+    n = write(engine->fd, buf, nbytes);
+  } while (n < 0 && errno == EINTR);
+
   if (n <  0) {
-    if (errno == EAGAIN || errno == EINTR) {
-      /* Retry */
-      return 0;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      /* Non-blocking descriptor is full */
+      return YCHANNEL_WOULDBLOCK;
     }
     return -1;
   }
@@ -121,11 +132,11 @@ YchannelInitFd(int fd, int writable)
   engine->fd = fd;
 
   if (writable) {
-    channel = YchannelInitGeneric("fd", engine,
+    channel = YchannelInitGeneric(YchannelFdName, engine,
                                   NULL, YchannelFdWrite,
                                   NULL, YchannelFdRelease);
   } else {
-    channel = YchannelInitGeneric("fd", engine,
+    channel = YchannelInitGeneric(YchannelFdName, engine,
                                   YchannelFdRead, NULL,
                                   NULL, YchannelFdRelease);
   }
@@ -135,3 +146,55 @@ YchannelInitFd(int fd, int writable)
 
   return channel;
 }
+
+static YchannelFd*
+fdEngine(Ychannel *channel)
+{
+  if (YchannelGetName(channel) != YchannelFdName) {
+    return NULL;
+  }
+
+  return (YchannelFd*) YchannelGetEngine(channel);
+}
+
+int
+YchannelGetFd(Ychannel *channel)
+{
+  YchannelFd *engine;
+
+  engine = fdEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  return engine->fd;
+}
+
+int
+YchannelSetNonBlocking(Ychannel *channel, YBOOL nonblocking)
+{
+  YchannelFd *engine;
+  int flags;
+
+  engine = fdEngine(channel);
+  if (engine == NULL || engine->fd < 0) {
+    return YOSAL_ERROR;
+  }
+
+  flags = fcntl(engine->fd, F_GETFL, 0);
+  if (flags < 0) {
+    return YOSAL_ERROR;
+  }
+
+  if (nonblocking) {
+    flags |= O_NONBLOCK;
+  } else {
+    flags &= ~O_NONBLOCK;
+  }
+
+  if (fcntl(engine->fd, F_SETFL, flags) < 0) {
+    return YOSAL_ERROR;
+  }
+
+  return YOSAL_OK;
+}
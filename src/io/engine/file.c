@@ -37,7 +37,7 @@ YchannelFileRead(Ychannel *channel, void *readbuf, int nbytes)
   n = fread(readbuf, 1, nbytes, engine->file);
   if (n <= 0) {
     if (feof(engine->file)) {
-      /* Returning 0 bytes will signal EOF */
+      /* EOF, normalize return code to -1 */
       return -1;
     }
   }
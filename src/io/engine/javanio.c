@@ -0,0 +1,333 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Java NIO engines, transferring data through direct ByteBuffers so that
+ * it lands directly in native memory
+ */
+#include "yosal/yosal.h"
+
+#include <pthread.h>
+
+#if YOSAL_CONFIG_JNI
+/* Method IDs of java.nio base classes and interfaces. They are resolved only
+   once, since system classes are never unloaded */
+typedef struct {
+  int ready;
+  jmethodID readMethodID;
+  jmethodID writeMethodID;
+  jmethodID closeMethodID;
+  jmethodID positionMethodID;
+  jmethodID limitMethodID;
+} YchannelJavaNioMethods;
+
+static YchannelJavaNioMethods gJavaNioMethods;
+static pthread_mutex_t gJavaNioMutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+  JNIEnv *env;
+  /* Global reference on ByteBuffer or channel */
+  jobject object;
+  const YchannelJavaNioMethods *methods;
+} YchannelJavaNio;
+
+static jmethodID
+methodLookup(JNIEnv *_env, const char *classname,
+             const char *name, const char *signature)
+{
+  jmethodID methodID = NULL;
+  jclass clazz;
+
+  clazz = (*_env)->FindClass(_env, classname);
+  if (clazz == NULL || (*_env)->ExceptionCheck(_env)) {
+    (*_env)->ExceptionClear(_env);
+    return NULL;
+  }
+
+  methodID = (*_env)->GetMethodID(_env, clazz, name, signature);
+  if ((*_env)->ExceptionCheck(_env)) {
+    (*_env)->ExceptionClear(_env);
+    methodID = NULL;
+  }
+  (*_env)->DeleteLocalRef(_env, clazz);
+
+  return methodID;
+}
+
+static const YchannelJavaNioMethods*
+javaNioMethods(JNIEnv *_env)
+{
+  YchannelJavaNioMethods *methods = &gJavaNioMethods;
+
+  pthread_mutex_lock(&gJavaNioMutex);
+  if (!methods->ready) {
+    methods->readMethodID =
+      methodLookup(_env, "java/nio/channels/ReadableByteChannel",
+                   "read", "(Ljava/nio/ByteBuffer;)I");
+    methods->writeMethodID =
+      methodLookup(_env, "java/nio/channels/WritableByteChannel",
+                   "write", "(Ljava/nio/ByteBuffer;)I");
+    methods->closeMethodID =
+      methodLookup(_env, "java/nio/channels/Channel", "close", "()V");
+    methods->positionMethodID =
+      methodLookup(_env, "java/nio/Buffer", "position", "()I");
+    methods->limitMethodID =
+      methodLookup(_env, "java/nio/Buffer", "limit", "()I");
+
+    if (methods->readMethodID != NULL && methods->writeMethodID != NULL &&
+        methods->closeMethodID != NULL && methods->positionMethodID != NULL &&
+        methods->limitMethodID != NULL) {
+      methods->ready = 1;
+    }
+  }
+  pthread_mutex_unlock(&gJavaNioMutex);
+
+  return (methods->ready ? methods : NULL);
+}
+
+static YchannelJavaNio*
+engineCreate(JNIEnv *_env, jobject object)
+{
+  YchannelJavaNio *engine;
+  const YchannelJavaNioMethods *methods;
+
+  methods = javaNioMethods(_env);
+  if (methods == NULL) {
+    return NULL;
+  }
+
+  engine = (YchannelJavaNio*) Ymem_malloc(sizeof(YchannelJavaNio));
+  if (engine == NULL) {
+    return NULL;
+  }
+
+  /* Guarantee that object is not released while in use */
+  engine->object = (*_env)->NewGlobalRef(_env, object);
+  if (engine->object == NULL) {
+    Ymem_free(engine);
+    return NULL;
+  }
+  engine->env = _env;
+  engine->methods = methods;
+
+  return engine;
+}
+
+static void
+engineRelease(YchannelJavaNio *engine)
+{
+  if (engine->object != NULL) {
+    (*engine->env)->DeleteGlobalRef(engine->env, engine->object);
+    engine->object = NULL;
+  }
+
+  Ymem_free(engine);
+}
+
+/* Call read(ByteBuffer) or write(ByteBuffer) on a direct buffer wrapping
+   native memory */
+static int
+byteChannelTransfer(YchannelJavaNio *engine, jmethodID methodID,
+                    void *buf, int nbytes)
+{
+  JNIEnv *_env = engine->env;
+  jobject bytebuffer;
+  int n;
+
+  bytebuffer = (*_env)->NewDirectByteBuffer(_env, buf, (jlong) nbytes);
+  if (bytebuffer == NULL || (*_env)->ExceptionCheck(_env)) {
+    (*_env)->ExceptionClear(_env);
+    return -1;
+  }
+
+  n = (*_env)->CallIntMethod(_env, engine->object, methodID, bytebuffer);
+  if ((*_env)->ExceptionCheck(_env)) {
+    /* (*_env)->ExceptionDescribe(_env); */
+    (*_env)->ExceptionClear(_env);
+    n = -1;
+  } else if (n < 0) {
+    /* EOF, normalize return code to -1 */
+    n = -1;
+  } else if (n == 0) {
+    /* Only possible for a non-blocking channel */
+    n = YCHANNEL_WOULDBLOCK;
+  }
+
+  (*_env)->DeleteLocalRef(_env, bytebuffer);
+
+  return n;
+}
+
+static int
+YchannelJavaByteChannelRead(Ychannel *channel, void *readbuf, int nbytes)
+{
+  YchannelJavaNio *engine;
+
+  engine = (YchannelJavaNio*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+  if (nbytes <= 0) {
+    return 0;
+  }
+
+  return byteChannelTransfer(engine, engine->methods->readMethodID,
+                             readbuf, nbytes);
+}
+
+static int
+YchannelJavaByteChannelWrite(Ychannel *channel, const void *buf, int nbytes)
+{
+  YchannelJavaNio *engine;
+
+  engine = (YchannelJavaNio*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+  if (nbytes <= 0) {
+    return 0;
+  }
+
+  /* Buffer is only read by write(), constness is preserved */
+  return byteChannelTransfer(engine, engine->methods->writeMethodID,
+                             (void*) buf, nbytes);
+}
+
+static int
+YchannelJavaByteChannelRelease(Ychannel *channel)
+{
+  YchannelJavaNio *engine;
+  JNIEnv *_env;
+
+  engine = (YchannelJavaNio*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  _env = engine->env;
+  if (YchannelGetAutoRelease(channel)) {
+    (*_env)->CallVoidMethod(_env, engine->object, engine->methods->closeMethodID);
+    if ((*_env)->ExceptionCheck(_env)) {
+      (*_env)->ExceptionClear(_env);
+    }
+  }
+
+  engineRelease(engine);
+
+  return 0;
+}
+
+static int
+YchannelJavaByteBufferRelease(Ychannel *channel)
+{
+  YchannelJavaNio *engine;
+
+  engine = (YchannelJavaNio*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  /* Buffer memory is owned by the ByteBuffer */
+  YchannelResetBuffer(channel);
+  engineRelease(engine);
+
+  return 0;
+}
+#endif
+
+Ychannel*
+YchannelInitJavaByteBuffer(JNIEnv *_env, jobject bytebuffer)
+{
+  Ychannel *channel = NULL;
+
+#if YOSAL_CONFIG_JNI
+  YchannelJavaNio *engine;
+  const char *address;
+  jlong capacity;
+  jint position;
+  jint limit;
+
+  if (bytebuffer == NULL) {
+    return NULL;
+  }
+
+  /* Only direct buffers expose their native memory */
+  address = (const char*) (*_env)->GetDirectBufferAddress(_env, bytebuffer);
+  capacity = (*_env)->GetDirectBufferCapacity(_env, bytebuffer);
+  if (address == NULL || capacity < 0) {
+    return NULL;
+  }
+
+  engine = engineCreate(_env, bytebuffer);
+  if (engine == NULL) {
+    return NULL;
+  }
+
+  position = (*_env)->CallIntMethod(_env, bytebuffer, engine->methods->positionMethodID);
+  limit = (*_env)->CallIntMethod(_env, bytebuffer, engine->methods->limitMethodID);
+  if ((*_env)->ExceptionCheck(_env)) {
+    (*_env)->ExceptionClear(_env);
+    engineRelease(engine);
+    return NULL;
+  }
+  if (position < 0 || limit < position || limit > capacity) {
+    engineRelease(engine);
+    return NULL;
+  }
+
+  channel = YchannelInitGeneric("javabytebuffer", engine,
+                                NULL, NULL,
+                                NULL, YchannelJavaByteBufferRelease);
+  if (channel == NULL) {
+    engineRelease(engine);
+    return NULL;
+  }
+
+  YchannelSetBuffer(channel, address + position, (size_t) (limit - position));
+#endif
+
+  return channel;
+}
+
+Ychannel*
+YchannelInitJavaByteChannel(JNIEnv *_env, jobject bytechannel, int writable)
+{
+  Ychannel *channel = NULL;
+
+#if YOSAL_CONFIG_JNI
+  YchannelJavaNio *engine;
+
+  if (bytechannel == NULL) {
+    return NULL;
+  }
+
+  engine = engineCreate(_env, bytechannel);
+  if (engine == NULL) {
+    return NULL;
+  }
+
+  if (writable) {
+    channel = YchannelInitGeneric("javabytechannel", engine,
+                                  NULL, YchannelJavaByteChannelWrite,
+                                  NULL, YchannelJavaByteChannelRelease);
+  } else {
+    channel = YchannelInitGeneric("javabytechannel", engine,
+                                  YchannelJavaByteChannelRead, NULL,
+                                  NULL, YchannelJavaByteChannelRelease);
+  }
+  if (channel == NULL) {
+    engineRelease(engine);
+  }
+#endif
+
+  return channel;
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Growable in-memory output channel
+ */
+#include "yosal/yosal.h"
+
+/* Rope chunks holding written data double in size, from first to largest */
+#define MEMORY_CHUNK_MIN (4*1024)
+#define MEMORY_CHUNK_MAX (1024*1024)
+
+static const char YchannelMemoryName[] = "memory";
+
+typedef struct {
+  /* Rope of written data, NULL once detached */
+  Ybuffer *buffer;
+} YchannelMemory;
+
+static int
+YchannelMemoryWrite(Ychannel *channel, const void *buf, int nbytes)
+{
+  YchannelMemory *engine;
+
+  engine = (YchannelMemory*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  return Ybuffer_append(engine->buffer, (const char*) buf, nbytes);
+}
+
+static int
+YchannelMemoryRelease(Ychannel *channel)
+{
+  YchannelMemory *engine;
+
+  engine = (YchannelMemory*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  Ybuffer_fini(engine->buffer);
+  Ymem_free(engine);
+
+  return 0;
+}
+
+Ychannel*
+YchannelInitMemoryWriter()
+{
+  YchannelMemory *engine;
+  Ychannel *channel;
+
+  engine = (YchannelMemory*) Ymem_malloc(sizeof(YchannelMemory));
+  if (engine == NULL) {
+    return NULL;
+  }
+
+  engine->buffer = Ybuffer_init_rope_growing(MEMORY_CHUNK_MIN, MEMORY_CHUNK_MAX);
+  if (engine->buffer == NULL) {
+    Ymem_free(engine);
+    return NULL;
+  }
+
+  channel = YchannelInitGeneric(YchannelMemoryName, engine,
+                                NULL, YchannelMemoryWrite,
+                                NULL, YchannelMemoryRelease);
+  if (channel == NULL) {
+    Ybuffer_fini(engine->buffer);
+    Ymem_free(engine);
+  }
+
+  return channel;
+}
+
+static YchannelMemory*
+memoryEngine(Ychannel *channel)
+{
+  if (YchannelGetName(channel) != YchannelMemoryName) {
+    return NULL;
+  }
+
+  return (YchannelMemory*) YchannelGetEngine(channel);
+}
+
+char*
+YchannelDetach(Ychannel *channel, size_t *lengthptr)
+{
+  YchannelMemory *engine;
+  char *data = NULL;
+  size_t length = 0;
+
+  engine = memoryEngine(channel);
+  if (engine == NULL) {
+    if (lengthptr != NULL) {
+      *lengthptr = 0;
+    }
+    return NULL;
+  }
+
+  /* Take over data, so that channel release doesn't free it */
+  length = Ybuffer_length(engine->buffer);
+  data = Ybuffer_detach(engine->buffer, NULL);
+  engine->buffer = NULL;
+  if (data == NULL) {
+    length = 0;
+  }
+  YchannelRelease(channel);
+
+  if (lengthptr != NULL) {
+    *lengthptr = length;
+  }
+
+  return data;
+}
+
+int
+YchannelGetIovec(Ychannel *channel, struct iovec *iov, int iovcnt)
+{
+  YchannelMemory *engine;
+
+  engine = memoryEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  return Ybuffer_iovec(engine->buffer, iov, iovcnt);
+}
@@ -0,0 +1,351 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * In-process pipe, a pair of channels transferring bytes through a
+ * single producer, single consumer ring. Both ends share the same engine,
+ * released with the last of them. A blocked end spins for a short while,
+ * then parks until the other end makes progress.
+ *
+ * For YchannelPoll(), each end gets an event file descriptor once polled.
+ * A polled end is armed before checking the ring again, the other end
+ * signaling the event after its next update of the ring.
+ */
+#include "yosal/yosal.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/* Default capacity of ring */
+#define PIPE_CAPACITY (64*1024)
+
+typedef struct {
+  /* Event file descriptor, created once end is polled */
+  int fd;
+  /* Set while end is polled, until event is signaled */
+  int armed;
+} YchannelPipeEvent;
+
+typedef struct {
+  Ybytering *ring;
+  int nonblocking;
+  /* Set once each end is released */
+  int readerClosed;
+  int writerClosed;
+  /* Number of ends not yet released */
+  int refs;
+  /* Threads blocked on either end */
+  pthread_mutex_t lock;
+  Ypark park;
+  /* Readiness of each end, for polling */
+  YchannelPipeEvent readEvent;
+  YchannelPipeEvent writeEvent;
+} YchannelPipe;
+
+typedef int (*YchannelPipeReady)(YchannelPipe *pipe);
+
+static int
+pipeClosed(int *closed)
+{
+  return __atomic_load_n(closed, __ATOMIC_ACQUIRE);
+}
+
+static int
+pipeReadReady(YchannelPipe *pipe)
+{
+  return (Ybytering_readable(pipe->ring) > 0 || pipeClosed(&pipe->writerClosed));
+}
+
+static int
+pipeWriteReady(YchannelPipe *pipe)
+{
+  return (Ybytering_writable(pipe->ring) > 0 || pipeClosed(&pipe->readerClosed));
+}
+
+/* Wake up other end if it is parked or polled, after updating ring */
+static void
+pipeWake(YchannelPipe *pipe, YchannelPipeEvent *event)
+{
+  Ypark_wake(&pipe->park, &pipe->lock, 1);
+
+  if (__sync_fetch_and_add(&event->armed, 0) &&
+      __sync_fetch_and_and(&event->armed, 0)) {
+    eventfd_write(event->fd, 1);
+  }
+}
+
+static int
+pipePoll(YchannelPipe *pipe, YchannelPipeEvent *event,
+         YchannelPipeReady ready, int *fdref)
+{
+  eventfd_t value;
+
+  if (ready(pipe)) {
+    return 1;
+  }
+
+  if (event->fd < 0) {
+    event->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event->fd < 0) {
+      return -1;
+    }
+  }
+
+  /* Arming with a full barrier before checking the ring again, so that
+     any later update of the other end signals the event. Stale signals
+     are consumed first. */
+  __sync_fetch_and_or(&event->armed, 1);
+  eventfd_read(event->fd, &value);
+  if (ready(pipe)) {
+    return 1;
+  }
+
+  *fdref = event->fd;
+
+  return 0;
+}
+
+static void
+pipeWait(YchannelPipe *pipe, YchannelPipeReady ready)
+{
+  int i;
+
+  for (i = 0; i < YPARK_SPIN; i++) {
+    if (ready(pipe)) {
+      return;
+    }
+    YCPU_RELAX();
+  }
+
+  pthread_mutex_lock(&pipe->lock);
+  Ypark_enter(&pipe->park);
+  while (!ready(pipe)) {
+    Ypark_wait(&pipe->park, &pipe->lock, NULL);
+  }
+  Ypark_leave(&pipe->park);
+  pthread_mutex_unlock(&pipe->lock);
+}
+
+static void
+pipeClose(YchannelPipe *pipe, int *closed, YchannelPipeEvent *event)
+{
+  __atomic_store_n(closed, 1, __ATOMIC_RELEASE);
+  pipeWake(pipe, event);
+
+  if (__sync_sub_and_fetch(&pipe->refs, 1) == 0) {
+    if (pipe->readEvent.fd >= 0) {
+      close(pipe->readEvent.fd);
+    }
+    if (pipe->writeEvent.fd >= 0) {
+      close(pipe->writeEvent.fd);
+    }
+    Ypark_destroy(&pipe->park);
+    pthread_mutex_destroy(&pipe->lock);
+    Ybytering_release(pipe->ring);
+    Ymem_free(pipe);
+  }
+}
+
+static int
+YchannelPipeRead(Ychannel *channel, void *buf, int nbytes)
+{
+  YchannelPipe *pipe;
+  int n;
+
+  pipe = (YchannelPipe*) YchannelGetEngine(channel);
+  if (pipe == NULL) {
+    return -1;
+  }
+
+  n = Ybytering_read(pipe->ring, buf, nbytes);
+  while (n == 0) {
+    if (pipeClosed(&pipe->writerClosed)) {
+      /* Data written before writer was released */
+      n = Ybytering_read(pipe->ring, buf, nbytes);
+      if (n == 0) {
+        /* EOF, normalize return code to -1 */
+        return -1;
+      }
+      return n;
+    }
+    if (pipe->nonblocking) {
+      return YCHANNEL_WOULDBLOCK;
+    }
+    pipeWait(pipe, pipeReadReady);
+    n = Ybytering_read(pipe->ring, buf, nbytes);
+  }
+
+  pipeWake(pipe, &pipe->writeEvent);
+
+  return n;
+}
+
+static int
+YchannelPipeWrite(Ychannel *channel, const void *buf, int nbytes)
+{
+  YchannelPipe *pipe;
+  int n;
+
+  pipe = (YchannelPipe*) YchannelGetEngine(channel);
+  if (pipe == NULL) {
+    return -1;
+  }
+
+  n = 0;
+  while (!pipeClosed(&pipe->readerClosed)) {
+    n = Ybytering_write(pipe->ring, buf, nbytes);
+    if (n > 0) {
+      pipeWake(pipe, &pipe->readEvent);
+      return n;
+    }
+    if (pipe->nonblocking) {
+      return YCHANNEL_WOULDBLOCK;
+    }
+    pipeWait(pipe, pipeWriteReady);
+  }
+
+  /* Nobody left to read */
+  return -1;
+}
+
+static int
+YchannelPipeReaderPoll(Ychannel *channel, int events, int *fdref)
+{
+  YchannelPipe *pipe;
+
+  pipe = (YchannelPipe*) YchannelGetEngine(channel);
+  if (pipe == NULL) {
+    return YCHANNEL_POLLERR;
+  }
+
+  switch (pipePoll(pipe, &pipe->readEvent, pipeReadReady, fdref)) {
+  case 0:
+    return 0;
+  case 1:
+    return (events & YCHANNEL_POLLIN);
+  default:
+    return YCHANNEL_POLLERR;
+  }
+}
+
+static int
+YchannelPipeWriterPoll(Ychannel *channel, int events, int *fdref)
+{
+  YchannelPipe *pipe;
+
+  pipe = (YchannelPipe*) YchannelGetEngine(channel);
+  if (pipe == NULL) {
+    return YCHANNEL_POLLERR;
+  }
+
+  switch (pipePoll(pipe, &pipe->writeEvent, pipeWriteReady, fdref)) {
+  case 0:
+    return 0;
+  case 1:
+    return (events & YCHANNEL_POLLOUT);
+  default:
+    return YCHANNEL_POLLERR;
+  }
+}
+
+static int
+YchannelPipeReaderRelease(Ychannel *channel)
+{
+  YchannelPipe *pipe;
+
+  pipe = (YchannelPipe*) YchannelGetEngine(channel);
+  if (pipe == NULL) {
+    return -1;
+  }
+
+  pipeClose(pipe, &pipe->readerClosed, &pipe->writeEvent);
+
+  return 0;
+}
+
+static int
+YchannelPipeWriterRelease(Ychannel *channel)
+{
+  YchannelPipe *pipe;
+
+  pipe = (YchannelPipe*) YchannelGetEngine(channel);
+  if (pipe == NULL) {
+    return -1;
+  }
+
+  pipeClose(pipe, &pipe->writerClosed, &pipe->readEvent);
+
+  return 0;
+}
+
+int
+YchannelInitPipe(int capacity, YBOOL nonblocking,
+                 Ychannel **readerref, Ychannel **writerref)
+{
+  YchannelPipe *pipe;
+  Ychannel *reader;
+  Ychannel *writer;
+
+  if (readerref == NULL || writerref == NULL) {
+    return YOSAL_ERROR;
+  }
+  if (capacity <= 0) {
+    capacity = PIPE_CAPACITY;
+  }
+
+  pipe = (YchannelPipe*) Ymem_malloc_tag(sizeof(YchannelPipe), YMEM_TAG_CHANNEL);
+  if (pipe == NULL) {
+    return YOSAL_ERROR;
+  }
+  pipe->ring = Ybytering_create(capacity);
+  if (pipe->ring == NULL) {
+    Ymem_free(pipe);
+    return YOSAL_ERROR;
+  }
+  pipe->nonblocking = nonblocking ? 1 : 0;
+  pipe->readerClosed = 0;
+  pipe->writerClosed = 0;
+  pipe->refs = 2;
+  pthread_mutex_init(&pipe->lock, NULL);
+  Ypark_init(&pipe->park);
+  pipe->readEvent.fd = -1;
+  pipe->readEvent.armed = 0;
+  pipe->writeEvent.fd = -1;
+  pipe->writeEvent.armed = 0;
+
+  reader = YchannelInitGeneric("pipe", pipe,
+                               YchannelPipeRead, NULL,
+                               NULL, YchannelPipeReaderRelease);
+  if (reader == NULL) {
+    pipe->refs = 1;
+    pipeClose(pipe, &pipe->readerClosed, &pipe->writeEvent);
+    return YOSAL_ERROR;
+  }
+  YchannelSetPollCB(reader, YchannelPipeReaderPoll);
+
+  writer = YchannelInitGeneric("pipe", pipe,
+                               NULL, YchannelPipeWrite,
+                               NULL, YchannelPipeWriterRelease);
+  if (writer == NULL) {
+    /* Releasing reader drops last reference */
+    pipe->refs = 1;
+    YchannelRelease(reader);
+    return YOSAL_ERROR;
+  }
+  YchannelSetPollCB(writer, YchannelPipeWriterPoll);
+
+  *readerref = reader;
+  *writerref = writer;
+
+  return YOSAL_OK;
+}
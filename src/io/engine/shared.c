@@ -0,0 +1,387 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Output channel shared by many writer threads. Each write is a record,
+ * queued on a lock-free stack, and written by whichever thread owns the
+ * channel lock at that time, batched with other pending records.
+ *
+ * When the underlying channel would block, bytes it didn't take stay in
+ * the staging buffer, and records not yet staged in a backlog, both
+ * written first by the next drain.
+ */
+#include "yosal/yosal.h"
+
+#include <pthread.h>
+
+/* Size of staging buffer used to batch records into a single write */
+#define SHARED_STAGING_SIZE (64*1024)
+
+typedef struct YchannelSharedRecordStruct YchannelSharedRecord;
+
+struct YchannelSharedRecordStruct {
+  YchannelSharedRecord *next;
+  int length;
+};
+
+typedef struct {
+  Ychannel *channel;
+  /* Records waiting to be written, most recent first */
+  YchannelSharedRecord *pending;
+  /* Serialize writes to underlying channel, and protect fields below */
+  pthread_mutex_t lock;
+  char *staging;
+  int stagingsize;
+  /* Staged bytes, of which the first ones were already written */
+  int staged;
+  int written;
+  /* Records taken from pending but not yet staged, in submission order */
+  YchannelSharedRecord *backlog;
+  YchannelSharedRecord *backlogtail;
+  /* Bytes of first backlog record already written, if it is a large one */
+  int offset;
+  int failed;
+} YchannelShared;
+
+static YchannelSharedRecord*
+recordsHead(YchannelShared *engine)
+{
+#if defined(__ATOMIC_ACQUIRE)
+  return __atomic_load_n(&engine->pending, __ATOMIC_ACQUIRE);
+#else
+  YchannelSharedRecord *head;
+
+  head = *((YchannelSharedRecord * volatile *) &engine->pending);
+  __sync_synchronize();
+  return head;
+#endif
+}
+
+static YchannelSharedRecord*
+recordsTake(YchannelShared *engine)
+{
+  YchannelSharedRecord *head;
+
+  do {
+    head = recordsHead(engine);
+  } while (!__sync_bool_compare_and_swap(&engine->pending, head, NULL));
+
+  return head;
+}
+
+static int
+sharedFailed(YchannelShared *engine)
+{
+  return __sync_fetch_and_add(&engine->failed, 0);
+}
+
+/* Write as much of data as underlying channel takes. Return number of
+   bytes written, or -1 once channel failed */
+static int
+sharedWrite(YchannelShared *engine, const char *data, int length)
+{
+  int n;
+
+  if (length <= 0) {
+    return 0;
+  }
+
+  n = (int) YchannelWrite(engine->channel, data, length);
+  if (n < 0 || (n < length && !YchannelWouldBlock(engine->channel))) {
+    __sync_lock_test_and_set(&engine->failed, 1);
+    return -1;
+  }
+
+  return n;
+}
+
+/* Write staged bytes. Return non zero if some are left */
+static int
+stagingWrite(YchannelShared *engine)
+{
+  int n;
+
+  n = sharedWrite(engine, engine->staging + engine->written,
+                  engine->staged - engine->written);
+  if (n < 0) {
+    return 1;
+  }
+  engine->written += n;
+  if (engine->written < engine->staged) {
+    return 1;
+  }
+  engine->staged = 0;
+  engine->written = 0;
+
+  return 0;
+}
+
+/* Stage or write records of backlog, until underlying channel would block */
+static void
+backlogWrite(YchannelShared *engine)
+{
+  YchannelSharedRecord *record;
+  const char *data;
+  int n;
+
+  while ((record = engine->backlog) != NULL && !sharedFailed(engine)) {
+    data = (const char*) (record + 1);
+
+    if (engine->staged + record->length > engine->stagingsize) {
+      if (stagingWrite(engine)) {
+        return;
+      }
+    }
+    if (record->length > engine->stagingsize) {
+      /* Large records are written as is */
+      n = sharedWrite(engine, data + engine->offset, record->length - engine->offset);
+      if (n < 0) {
+        return;
+      }
+      engine->offset += n;
+      if (engine->offset < record->length) {
+        return;
+      }
+      engine->offset = 0;
+    } else {
+      memcpy(engine->staging + engine->staged, data, record->length);
+      engine->staged += record->length;
+    }
+
+    engine->backlog = record->next;
+    Ymem_free(record);
+  }
+
+  if (!sharedFailed(engine)) {
+    stagingWrite(engine);
+  }
+}
+
+/* Drop everything not yet written, once underlying channel failed */
+static void
+backlogDrop(YchannelShared *engine)
+{
+  YchannelSharedRecord *record;
+
+  while ((record = engine->backlog) != NULL) {
+    engine->backlog = record->next;
+    Ymem_free(record);
+  }
+  engine->offset = 0;
+  engine->staged = 0;
+  engine->written = 0;
+}
+
+/* Write all pending records, as far as underlying channel takes them.
+   Must be called with lock held */
+static void
+sharedDrain(YchannelShared *engine)
+{
+  YchannelSharedRecord *head;
+  YchannelSharedRecord *record;
+  YchannelSharedRecord *next;
+
+  while ((head = recordsTake(engine)) != NULL) {
+    /* Reverse list to get records in submission order */
+    record = NULL;
+    while (head != NULL) {
+      next = head->next;
+      head->next = record;
+      record = head;
+      head = next;
+    }
+
+    if (engine->backlog == NULL) {
+      engine->backlog = record;
+    } else {
+      engine->backlogtail->next = record;
+    }
+    while (record->next != NULL) {
+      record = record->next;
+    }
+    engine->backlogtail = record;
+
+    backlogWrite(engine);
+  }
+
+  /* Retry what a previous drain left */
+  if (engine->staged > 0 || engine->backlog != NULL) {
+    backlogWrite(engine);
+  }
+  if (sharedFailed(engine)) {
+    backlogDrop(engine);
+  }
+}
+
+/* Write all pending records, waiting for a non-blocking underlying
+   channel to take them. Must be called with lock held */
+static void
+sharedDrainAll(YchannelShared *engine)
+{
+  YchannelPollEntry entry;
+
+  for (;;) {
+    sharedDrain(engine);
+    if (engine->staged == 0 && engine->backlog == NULL) {
+      return;
+    }
+
+    entry.channel = engine->channel;
+    entry.events = YCHANNEL_POLLOUT;
+    if (YchannelPoll(&entry, 1, -1) < 0 || (entry.revents & YCHANNEL_POLLERR)) {
+      __sync_lock_test_and_set(&engine->failed, 1);
+    }
+  }
+}
+
+static int
+YchannelSharedWrite(Ychannel *channel, const void *buf, int nbytes)
+{
+  YchannelShared *engine;
+  YchannelSharedRecord *record;
+  YchannelSharedRecord *head;
+
+  engine = (YchannelShared*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+  if (sharedFailed(engine)) {
+    return -1;
+  }
+  if (nbytes <= 0) {
+    return 0;
+  }
+
+  record = (YchannelSharedRecord*) Ymem_malloc_tag(sizeof(YchannelSharedRecord) + nbytes,
+                                                   YMEM_TAG_CHANNEL);
+  if (record == NULL) {
+    return -1;
+  }
+  record->length = nbytes;
+  memcpy(record + 1, buf, nbytes);
+
+  do {
+    head = recordsHead(engine);
+    record->next = head;
+  } while (!__sync_bool_compare_and_swap(&engine->pending, head, record));
+
+  /* If another thread holds the lock, it will write this record before
+     releasing it, or the check after unlock will catch it */
+  while (recordsHead(engine) != NULL) {
+    if (pthread_mutex_trylock(&engine->lock) != 0) {
+      break;
+    }
+    sharedDrain(engine);
+    pthread_mutex_unlock(&engine->lock);
+  }
+
+  return nbytes;
+}
+
+static int
+YchannelSharedFlush(Ychannel *channel)
+{
+  YchannelShared *engine;
+  int rc;
+
+  engine = (YchannelShared*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  pthread_mutex_lock(&engine->lock);
+  sharedDrainAll(engine);
+  rc = YchannelFlush(engine->channel);
+  pthread_mutex_unlock(&engine->lock);
+
+  if (sharedFailed(engine)) {
+    return YOSAL_ERROR;
+  }
+
+  return rc;
+}
+
+static int
+YchannelSharedRelease(Ychannel *channel)
+{
+  YchannelShared *engine;
+
+  engine = (YchannelShared*) YchannelGetEngine(channel);
+  if (engine == NULL) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&engine->lock);
+  sharedDrainAll(engine);
+  pthread_mutex_unlock(&engine->lock);
+  pthread_mutex_destroy(&engine->lock);
+
+  if (engine->channel != NULL) {
+    if (YchannelGetAutoRelease(channel)) {
+      YchannelRelease(engine->channel);
+    }
+    engine->channel = NULL;
+  }
+
+  Ymem_free(engine->staging);
+  Ymem_free(engine);
+
+  return 0;
+}
+
+Ychannel*
+YchannelInitShared(Ychannel *output)
+{
+  YchannelShared *engine;
+  Ychannel *channel;
+
+  if (output == NULL || !YchannelWritable(output)) {
+    return NULL;
+  }
+
+  engine = (YchannelShared*) Ymem_malloc(sizeof(YchannelShared));
+  if (engine == NULL) {
+    return NULL;
+  }
+
+  engine->staging = (char*) Ymem_malloc_tag(SHARED_STAGING_SIZE, YMEM_TAG_CHANNEL);
+  if (engine->staging == NULL) {
+    Ymem_free(engine);
+    return NULL;
+  }
+  if (pthread_mutex_init(&engine->lock, NULL) != 0) {
+    Ymem_free(engine->staging);
+    Ymem_free(engine);
+    return NULL;
+  }
+
+  engine->channel = output;
+  engine->pending = NULL;
+  engine->stagingsize = SHARED_STAGING_SIZE;
+  engine->staged = 0;
+  engine->written = 0;
+  engine->backlog = NULL;
+  engine->backlogtail = NULL;
+  engine->offset = 0;
+  engine->failed = 0;
+
+  channel = YchannelInitGeneric("shared", engine,
+                                NULL, YchannelSharedWrite,
+                                YchannelSharedFlush, YchannelSharedRelease);
+  if (channel == NULL) {
+    pthread_mutex_destroy(&engine->lock);
+    Ymem_free(engine->staging);
+    Ymem_free(engine);
+  }
+
+  return channel;
+}
@@ -16,45 +16,71 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#include <poll.h>
 
 /* Size of read buffer for prefetching */
 #define INPUT_BUF_SIZE   (16*1024)
 #define OUTPUT_BUF_SIZE  (16*1024)
 
+/* Minimum size of push-back buffer */
+#define PUSHBACK_BUF_SIZE 64
+
+/* Maximum number of bytes passed to engine callbacks in a single call */
+#define ENGINE_CHUNK_MAX (1024*1024*1024)
+
+/* Number of channels that can be polled without allocation */
+#define YCHANNEL_POLL_STATIC 16
+
 #define YCHANNEL_READ  0
 #define YCHANNEL_WRITE 1
 
 #define YCHANNEL_NO_LENGTH ((uint64_t) -1)
 
+/* Update a counter, only if statistics are enabled on channel */
+#define YCHANNEL_STAT_ADD(channel, field, n) \
+  do { if ((channel)->stats != NULL) { (channel)->stats->field += (n); } } while (0)
+
+/* Counters of all released channels */
+static YchannelStats gYchannelGlobalStats;
+static pthread_mutex_t gYchannelGlobalStatsMutex = PTHREAD_MUTEX_INITIALIZER;
+
 
 /* Expanded data source object for stdio and stream input */
 struct YchannelStruct {
   /** @privatesection */
+  const char *name;
   int rwmode;
 
   /* length (optional) */
   uint64_t inlength;
   uint64_t incount;
 
-  /* Push-back buffer */
-  const char *pbuf;
-  uint32_t ppos;
-  uint32_t plength;
+  /* Push-back buffer. Pending content is at [ppos, plength), and pushed
+     bytes are prepended into the free space before ppos */
+  char *pbuf;
+  size_t ppos;
+  size_t plength;
+  size_t psize;
 
   /* Static header */
   const char *hbuf;
-  uint32_t hpos;
-  uint32_t hlength;
+  size_t hpos;
+  size_t hlength;
 
   /* Read (prefetch) buffer */
   char *rbuf;
-  uint32_t rpos;
-  uint32_t rlength;
-  uint32_t rsize;
+  size_t rpos;
+  size_t rlength;
+  size_t rsize;
 
   YBOOL terminated;
+  /* Last engine call returned YCHANNEL_WOULDBLOCK */
+  YBOOL wouldblock;
   int autorelease;
 
+  /* Counters, or NULL if not enabled */
+  YchannelStats *stats;
+
   /* Backend private data */
   void *enginedata;
 
@@ -62,6 +88,7 @@ struct YchannelStruct {
   YchannelWriteCB writecb;
   YchannelFlushCB flushcb;
   YchannelReleaseCB releasecb;
+  YchannelPollCB pollcb;
 };
 
 static Ychannel*
@@ -69,13 +96,14 @@ YchannelInit()
 {
     Ychannel *channel = NULL;
 
-    channel = (Ychannel*) Ymem_malloc(sizeof(Ychannel));
+    channel = (Ychannel*) Ymem_malloc_tag(sizeof(Ychannel), YMEM_TAG_CHANNEL);
     if (channel == NULL) {
         return NULL;
     }
 
     memset(channel, 0, sizeof(Ychannel));
 
+    channel->name = NULL;
     channel->rwmode = YCHANNEL_READ;
 
     channel->inlength = YCHANNEL_NO_LENGTH;
@@ -88,6 +116,7 @@ YchannelInit()
     channel->pbuf = NULL;
     channel->ppos = 0;
     channel->plength = 0;
+    channel->psize = 0;
 
     channel->rbuf = NULL;
     channel->rlength = 0;
@@ -95,8 +124,10 @@ YchannelInit()
     channel->rsize = 0;
 
     channel->terminated = YFALSE;
+    channel->wouldblock = YFALSE;
     channel->autorelease = 0;
 
+    channel->stats = NULL;
     channel->enginedata = NULL;
 
     return channel;
@@ -149,20 +180,39 @@ YchannelResetBuffer(Ychannel* channel)
   return YOSAL_OK;
 }
 
+int
+YchannelSetBuffer(Ychannel* channel, const char *buffer, size_t length)
+{
+  if (!YchannelReadable(channel)) {
+    return YOSAL_ERROR;
+  }
+
+  if (channel->hbuf != NULL && channel->hbuf != buffer) {
+    Ymem_free((void*) channel->hbuf);
+  }
+  channel->hbuf = buffer;
+  channel->hlength = (buffer != NULL ? length : 0);
+  channel->hpos = 0;
+  return YOSAL_OK;
+}
+
 uint64_t
 YchannelGetLength(Ychannel* channel) {
-  int length = channel->inlength;
+  if (channel == NULL) {
+    return YCHANNEL_NO_LENGTH;
+  }
 
-  return length;
+  return channel->inlength;
 }
 
 Ychannel*
-YchannelInitByteArray(const char *header, int hlength)
+YchannelInitByteArray(const char *header, size_t hlength)
 {
     Ychannel *channel;
 
     channel = YchannelInit();
     if (channel != NULL) {
+        channel->name = "bytearray";
         channel->rwmode = YCHANNEL_READ;
         channel->hbuf = header;
         channel->hlength = hlength;
@@ -172,10 +222,99 @@ YchannelInitByteArray(const char *header, int hlength)
     return channel;
 }
 
+static void
+YchannelStatsAdd(YchannelStats *total, const YchannelStats *stats,
+                 pthread_mutex_t *mutex)
+{
+  if (mutex != NULL) {
+    pthread_mutex_lock(mutex);
+  }
+
+  total->fetched += stats->fetched;
+  total->zerocopy += stats->zerocopy;
+  total->copied += stats->copied;
+  total->direct += stats->direct;
+  total->written += stats->written;
+  total->readcalls += stats->readcalls;
+  total->writecalls += stats->writecalls;
+  total->pushallocs += stats->pushallocs;
+  total->readtime += stats->readtime;
+  total->writetime += stats->writetime;
+
+  if (mutex != NULL) {
+    pthread_mutex_unlock(mutex);
+  }
+}
+
+int
+YchannelEnableStats(Ychannel *channel, YBOOL enable)
+{
+  if (channel == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  if (enable) {
+    /* Counters are not synchronized, and shared channels are written to
+       by many threads */
+    if (channel->name != NULL && strcmp(channel->name, "shared") == 0) {
+      return YOSAL_ERROR;
+    }
+    if (channel->stats == NULL) {
+      channel->stats = (YchannelStats*) Ymem_malloc_tag(sizeof(YchannelStats),
+                                                        YMEM_TAG_CHANNEL);
+      if (channel->stats == NULL) {
+        return YOSAL_ERROR;
+      }
+      memset(channel->stats, 0, sizeof(YchannelStats));
+    }
+  } else if (channel->stats != NULL) {
+    /* Keep global counters consistent with what was measured */
+    YchannelStatsAdd(&gYchannelGlobalStats, channel->stats,
+                     &gYchannelGlobalStatsMutex);
+    Ymem_free(channel->stats);
+    channel->stats = NULL;
+  }
+
+  return YOSAL_OK;
+}
+
+int
+YchannelGetStats(Ychannel *channel, YchannelStats *stats)
+{
+  if (stats == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  memset(stats, 0, sizeof(YchannelStats));
+  if (channel == NULL || channel->stats == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  memcpy(stats, channel->stats, sizeof(YchannelStats));
+  return YOSAL_OK;
+}
+
+int
+YchannelGetGlobalStats(YchannelStats *stats)
+{
+  if (stats == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  memset(stats, 0, sizeof(YchannelStats));
+  YchannelStatsAdd(stats, &gYchannelGlobalStats, &gYchannelGlobalStatsMutex);
+
+  return YOSAL_OK;
+}
+
 int
 YchannelRelease(Ychannel *channel)
 {
   if (channel != NULL) {
+    /* Release engine first, it may take back ownership of static buffer */
+    if (channel->releasecb != NULL) {
+      channel->releasecb(channel);
+    }
     if (channel->rbuf != NULL) {
       Ymem_free((void*) channel->rbuf);
       channel->rbuf = NULL;
@@ -185,11 +324,14 @@ YchannelRelease(Ychannel *channel)
       channel->hbuf = NULL;
     }
     if (channel->pbuf != NULL) {
-      Ymem_free((void*) channel->pbuf);
+      Ymem_free(channel->pbuf);
       channel->pbuf = NULL;
     }
-    if (channel->releasecb != NULL) {
-      channel->releasecb(channel);
+    if (channel->stats != NULL) {
+      YchannelStatsAdd(&gYchannelGlobalStats, channel->stats,
+                       &gYchannelGlobalStatsMutex);
+      Ymem_free(channel->stats);
+      channel->stats = NULL;
     }
 
     Ymem_free(channel);
@@ -252,38 +394,60 @@ YchannelEof(Ychannel *channel)
   return channel->terminated;
 }
 
+/* Read from engine. A would-block status is reported as an empty read,
+   and recorded so that it is not mistaken for end of input */
 static int
-YchannelReadDirect(Ychannel *channel, void *buf, int nbytes)
+YchannelReadDirect(Ychannel *channel, void *buf, size_t nbytes)
 {
+  int nread;
+
   if (channel == NULL || channel->readcb == NULL || nbytes <= 0) {
     return 0;
   }
 
-  return channel->readcb(channel, buf, nbytes);
+  /* Engine callbacks take an int count */
+  if (nbytes > ENGINE_CHUNK_MAX) {
+    nbytes = ENGINE_CHUNK_MAX;
+  }
+
+  if (channel->stats != NULL) {
+    nsecs_t start = Ytime(YTIME_CLOCK_MONOTONIC);
+    nread = channel->readcb(channel, buf, (int) nbytes);
+    channel->stats->readtime += Ytime(YTIME_CLOCK_MONOTONIC) - start;
+    channel->stats->readcalls++;
+  } else {
+    nread = channel->readcb(channel, buf, (int) nbytes);
+  }
+  if (nread == YCHANNEL_WOULDBLOCK) {
+    channel->wouldblock = YTRUE;
+    return 0;
+  }
+
+  channel->wouldblock = YFALSE;
+  return nread;
 }
 
 static const char*
-YchannelFetchData(Ychannel *channel, int rbytes, int *olengthptr, int doread)
+YchannelFetchData(Ychannel *channel, size_t rbytes, size_t *olengthptr, int doread)
 {
   const char *result = NULL;
-  int olength = 0;
-  int nbytes;
+  size_t olength = 0;
+  size_t nbytes;
 
   if (!YchannelReadable(channel)) {
     return NULL;
   }
 
   nbytes = rbytes;
-  if (nbytes < 0) {
-    nbytes = 0;
+  if (doread) {
+    channel->wouldblock = YFALSE;
   }
 
   if (channel->inlength != YCHANNEL_NO_LENGTH) {
-    if (channel->inlength < nbytes) {
-      nbytes = (int) channel->inlength;
-    }
-    if (channel->inlength - nbytes < channel->incount) {
-      nbytes = channel->inlength - channel->incount;
+    if (channel->incount >= channel->inlength) {
+      nbytes = 0;
+    } else if (channel->inlength - channel->incount < nbytes) {
+      nbytes = (size_t) (channel->inlength - channel->incount);
     }
   }
 
@@ -311,7 +475,7 @@ YchannelFetchData(Ychannel *channel, int rbytes, int *olengthptr, int doread)
         channel->rpos = 0;
         /* fetch more data from underlying input, and save it in read buffer */
         if (channel->rbuf == NULL) {
-          channel->rbuf = Ymem_malloc(INPUT_BUF_SIZE);
+          channel->rbuf = Ymem_malloc_tag(INPUT_BUF_SIZE, YMEM_TAG_CHANNEL);
           if (channel->rbuf != NULL) {
             channel->rsize = INPUT_BUF_SIZE;
           } else {
@@ -345,28 +509,41 @@ YchannelFetchData(Ychannel *channel, int rbytes, int *olengthptr, int doread)
     *olengthptr = olength;
   }
 
-  ALOGV("Fetched %d/%d bytes", olength, rbytes);
+  ALOGV("Fetched %llu/%llu bytes",
+        (unsigned long long) olength, (unsigned long long) rbytes);
 
   channel->incount += olength;
+  YCHANNEL_STAT_ADD(channel, fetched, olength);
 
   return result;
 }
 
 const char*
-YchannelFetch(Ychannel *channel, int nbytes, int *olengthptr)
+YchannelFetch(Ychannel *channel, size_t nbytes, size_t *olengthptr)
 {
-  return YchannelFetchData(channel, nbytes, olengthptr, YTRUE);
+  const char *result;
+  size_t olength = 0;
+
+  result = YchannelFetchData(channel, nbytes, &olength, YTRUE);
+  YCHANNEL_STAT_ADD(channel, zerocopy, olength);
+
+  if (olengthptr != NULL) {
+    *olengthptr = olength;
+  }
+
+  return result;
 }
 
 /* An alternative to fetch, copying the read data into a buffer given by the caller */
-int
-YchannelRead(Ychannel *channel, void *buf, int toread)
+size_t
+YchannelRead(Ychannel *channel, void *buf, size_t toread)
 {
   const char *chunk;
-  int chunklen;
-  int nbytes;
+  size_t chunklen;
+  size_t nbytes;
   char *nextc = (char*) buf;
   int directio;
+  int nread;
 
   if (!YchannelReadable(channel)) {
     return 0;
@@ -377,6 +554,7 @@ YchannelRead(Ychannel *channel, void *buf, int toread)
   }
 
   nbytes = 0;
+  channel->wouldblock = YFALSE;
 
   /* Get as many bytes as possible from prefetched buffer */
   while (toread > 0) {
@@ -388,6 +566,7 @@ YchannelRead(Ychannel *channel, void *buf, int toread)
     if (nextc != NULL) {
       memcpy(nextc, chunk, chunklen);
       nextc += chunklen;
+      YCHANNEL_STAT_ADD(channel, copied, chunklen);
     }
     toread -= chunklen;
     nbytes += chunklen;
@@ -400,6 +579,7 @@ YchannelRead(Ychannel *channel, void *buf, int toread)
   /* If it is safe to do direct I/O if all internal buffers are empty or fully consumed */
   directio = YFALSE;
   if ( (nextc != NULL) &&
+       (channel->inlength == YCHANNEL_NO_LENGTH) &&
        (channel->plength <= 0 || channel->ppos >= channel->plength) &&
        (channel->hlength <= 0 || channel->hpos >= channel->hlength) &&
        (channel->rlength <= 0 || channel->rpos >= channel->rlength) ) {
@@ -409,19 +589,23 @@ YchannelRead(Ychannel *channel, void *buf, int toread)
   if (directio) {
     /* If this is not a transformation channel, read data directly from I/O engine */
     while (toread > 0) {
-      chunklen = YchannelReadDirect(channel, nextc, toread);
-      if (chunklen <= 0) {
+      nread = YchannelReadDirect(channel, nextc, toread);
+      if (nread <= 0) {
         break;
       }
-      nextc += chunklen;
-      toread -= chunklen;
-      nbytes += chunklen;
+      nextc += nread;
+      toread -= nread;
+      nbytes += nread;
+      channel->incount += nread;
+      YCHANNEL_STAT_ADD(channel, fetched, nread);
+      YCHANNEL_STAT_ADD(channel, direct, nread);
     }
   }
 
-  /* Get missing chunk using standard fetch method */
-  while (toread > 0) {
-    chunk = YchannelFetch(channel, toread, &chunklen);
+  /* Get missing chunk using standard fetch method, unless engine has
+     nothing more to provide without blocking */
+  while (toread > 0 && !channel->wouldblock) {
+    chunk = YchannelFetchData(channel, toread, &chunklen, YTRUE);
     if (chunk == NULL || chunklen <= 0) {
       break;
     }
@@ -429,6 +613,7 @@ YchannelRead(Ychannel *channel, void *buf, int toread)
     if (nextc != NULL) {
       memcpy(nextc, chunk, chunklen);
       nextc += chunklen;
+      YCHANNEL_STAT_ADD(channel, copied, chunklen);
     }
     toread -= chunklen;
     nbytes += chunklen;
@@ -439,18 +624,85 @@ YchannelRead(Ychannel *channel, void *buf, int toread)
 
 /* Skip bytes from channel. This is not optimized for large skip,
    but doesn't require underlying input channel to be seekable */
-int
-YchannelSkip(Ychannel *channel, int nbytes)
+uint64_t
+YchannelSkip(Ychannel *channel, uint64_t nbytes)
 {
-  return YchannelRead(channel, NULL, nbytes);
+  uint64_t skipped = 0;
+  size_t chunk;
+  size_t n;
+
+  /* Chunk so that skip count fits size_t on 32 bits platforms */
+  while (skipped < nbytes) {
+    chunk = ENGINE_CHUNK_MAX;
+    if (nbytes - skipped < chunk) {
+      chunk = (size_t) (nbytes - skipped);
+    }
+    n = YchannelRead(channel, NULL, chunk);
+    skipped += n;
+    if (n < chunk) {
+      break;
+    }
+  }
+
+  return skipped;
 }
 
-int
-YchannelPush(Ychannel *channel, const char *data, int n)
+/* Reallocate push-back buffer to prepend n bytes to its pending content,
+   and make room for at least tailroom bytes after it. Buffer grows
+   geometrically, and free space is kept in front of pending content so that
+   next pushes are done in place */
+static int
+YchannelPushBackGrow(Ychannel *channel, const char *data, size_t n,
+                     size_t tailroom)
 {
   char *buffer;
-  int bufferlen;
-  int preserve = 0;
+  size_t pending = 0;
+  size_t bufferlen;
+  size_t pos;
+
+  if (channel->plength > 0 && channel->ppos < channel->plength) {
+    pending = channel->plength - channel->ppos;
+  }
+
+  bufferlen = channel->psize * 2;
+  if (bufferlen < pending + n + tailroom) {
+    bufferlen = (pending + n + tailroom) * 2;
+  }
+  if (bufferlen < PUSHBACK_BUF_SIZE) {
+    bufferlen = PUSHBACK_BUF_SIZE;
+  }
+
+  buffer = (char*) Ymem_malloc_tag(bufferlen, YMEM_TAG_CHANNEL);
+  if (buffer == NULL) {
+    return YOSAL_ERROR;
+  }
+  YCHANNEL_STAT_ADD(channel, pushallocs, 1);
+  YCHANNEL_STAT_ADD(channel, copied, n + pending);
+
+  pos = bufferlen - pending - n - tailroom;
+  /* data may reference the previous buffer, so copy before releasing it */
+  if (n > 0) {
+    memcpy(buffer + pos, data, n);
+  }
+  if (pending > 0) {
+    memcpy(buffer + pos + n, channel->pbuf + channel->ppos, pending);
+  }
+
+  if (channel->pbuf != NULL) {
+    Ymem_free(channel->pbuf);
+  }
+  channel->pbuf = buffer;
+  channel->psize = bufferlen;
+  channel->ppos = pos;
+  channel->plength = pos + n + pending;
+
+  return YOSAL_OK;
+}
+
+size_t
+YchannelPush(Ychannel *channel, const char *data, size_t n)
+{
+  YBOOL pending;
 
   if (!YchannelReadable(channel)) {
     return 0;
@@ -461,49 +713,300 @@ YchannelPush(Ychannel *channel, const char *data, int n)
   }
 
   if (n > channel->incount) {
-    ALOGV("Trying to push %d bytes in a channel at offset %llu",
-          n, (unsigned long long) channel->incount);
+    ALOGV("Trying to push %llu bytes in a channel at offset %llu",
+          (unsigned long long) n, (unsigned long long) channel->incount);
     /* Since the push-back buffer is allocated dynamically, push can still succeed */
   }
 
-  /* Number of bytes to keep from previous push-back request */
-  preserve = 0;
-  if (channel->plength > 0 && channel->ppos < channel->plength) {
-    preserve = channel->plength - channel->ppos;
+  pending = (channel->plength > 0 && channel->ppos < channel->plength);
+
+  if (pending && channel->ppos >= n && data == channel->pbuf + channel->ppos - n) {
+    /* Rewind push-back buffer, bytes were just fetched from it */
+    channel->ppos -= n;
+  } else if (!pending && channel->rpos >= n &&
+             data == channel->rbuf + channel->rpos - n) {
+    /* Rewind read buffer, bytes were just fetched from it */
+    channel->rpos -= n;
+  } else if (!pending && channel->rpos == 0 && channel->hpos >= n &&
+             data == channel->hbuf + channel->hpos - n) {
+    /* Rewind static header, bytes were just fetched from it and nothing
+       was consumed from read buffer since */
+    channel->hpos -= n;
+  } else {
+    if (!pending && channel->pbuf != NULL) {
+      /* Buffer is empty, so all its space can be used for new push */
+      channel->ppos = channel->psize;
+      channel->plength = channel->psize;
+    }
+    if (channel->pbuf != NULL && channel->ppos >= n) {
+      /* Prepend in place */
+      channel->ppos -= n;
+      memmove(channel->pbuf + channel->ppos, data, n);
+      YCHANNEL_STAT_ADD(channel, copied, n);
+    } else if (YchannelPushBackGrow(channel, data, n, 0) != YOSAL_OK) {
+      return 0;
+    }
   }
 
-  bufferlen = preserve + n;
-  buffer = (char*) Ymem_malloc(bufferlen);
-  if (buffer == NULL) {
-    return 0;
+  if (n < channel->incount) {
+    channel->incount = channel->incount - n;
+  } else {
+    channel->incount = 0;
   }
 
-  memcpy(buffer, data, n);
-  if (preserve > 0) {
-    memcpy(buffer + n, channel->pbuf + channel->ppos, preserve);
+  return n;
+}
+
+/* Append up to n bytes following the content of the push-back buffer to it,
+   taking them from static header, read buffer and then underlying engine */
+static size_t
+YchannelPushBackGather(Ychannel *channel, size_t n)
+{
+  size_t gathered = 0;
+  size_t avail;
+  int nread;
+
+  if (channel->plength <= 0 || channel->ppos >= channel->plength) {
+    /* Buffer is empty, so all its space can be used after content */
+    channel->ppos = 0;
+    channel->plength = 0;
+  }
+  if (channel->pbuf == NULL || channel->psize - channel->plength < n) {
+    if (YchannelPushBackGrow(channel, NULL, 0, n) != YOSAL_OK) {
+      return 0;
+    }
   }
 
-  if (channel->pbuf != NULL) {
-    Ymem_free((void*) channel->pbuf);
+  if (channel->hlength > 0 && channel->hpos < channel->hlength) {
+    avail = channel->hlength - channel->hpos;
+    if (avail > n) {
+      avail = n;
+    }
+    memcpy(channel->pbuf + channel->plength, channel->hbuf + channel->hpos, avail);
+    YCHANNEL_STAT_ADD(channel, copied, avail);
+    channel->hpos += avail;
+    channel->plength += avail;
+    gathered += avail;
   }
-  channel->pbuf = buffer;
-  channel->ppos = 0;
-  channel->plength = bufferlen;
-  if (n < channel->incount) {
-    channel->incount = channel->incount - n;
+
+  if (gathered < n && channel->rlength > 0 && channel->rpos < channel->rlength) {
+    avail = channel->rlength - channel->rpos;
+    if (avail > n - gathered) {
+      avail = n - gathered;
+    }
+    memcpy(channel->pbuf + channel->plength, channel->rbuf + channel->rpos, avail);
+    YCHANNEL_STAT_ADD(channel, copied, avail);
+    channel->rpos += avail;
+    channel->plength += avail;
+    gathered += avail;
+  }
+
+  while (gathered < n) {
+    nread = YchannelReadDirect(channel, channel->pbuf + channel->plength, n - gathered);
+    if (nread < 0) {
+      channel->terminated = YTRUE;
+    }
+    if (nread <= 0) {
+      break;
+    }
+    channel->plength += nread;
+    gathered += nread;
+  }
+
+  return gathered;
+}
+
+/* Return contiguous window on at least nbytes of input if available,
+   including all following data already available contiguously */
+static const char*
+YchannelPeekWindow(Ychannel *channel, size_t nbytes, size_t *olengthptr)
+{
+  const char *result = NULL;
+  size_t olength = 0;
+  size_t avail;
+  uint64_t remaining = YCHANNEL_NO_LENGTH;
+  int nread;
+
+  if (!YchannelReadable(channel)) {
+    nbytes = 0;
   } else {
-    channel->incount = 0;
+    channel->wouldblock = YFALSE;
   }
 
-  return n;
+  if (nbytes > INPUT_BUF_SIZE) {
+    nbytes = INPUT_BUF_SIZE;
+  }
+  if (nbytes > 0 && channel->inlength != YCHANNEL_NO_LENGTH) {
+    if (channel->incount >= channel->inlength) {
+      remaining = 0;
+    } else {
+      remaining = channel->inlength - channel->incount;
+    }
+    if (remaining < nbytes) {
+      nbytes = (size_t) remaining;
+    }
+  }
+
+  if (nbytes > 0) {
+    if (channel->plength > 0 && channel->ppos < channel->plength) {
+      /* Window starts in push-back buffer */
+      avail = channel->plength - channel->ppos;
+      if (avail < nbytes) {
+        avail += YchannelPushBackGather(channel, nbytes - avail);
+      }
+      result = channel->pbuf + channel->ppos;
+      olength = avail;
+    } else if (channel->hlength > 0 && channel->hpos < channel->hlength) {
+      /* Window starts in static header */
+      avail = channel->hlength - channel->hpos;
+      if (avail < nbytes && channel->readcb != NULL) {
+        avail = YchannelPushBackGather(channel, nbytes);
+        result = channel->pbuf + channel->ppos;
+      } else {
+        result = channel->hbuf + channel->hpos;
+      }
+      olength = avail;
+    } else {
+      /* Window starts in read buffer */
+      if (channel->rbuf == NULL) {
+        channel->rbuf = Ymem_malloc_tag(INPUT_BUF_SIZE, YMEM_TAG_CHANNEL);
+        if (channel->rbuf != NULL) {
+          channel->rsize = INPUT_BUF_SIZE;
+        } else {
+          channel->rsize = 0;
+        }
+      }
+
+      avail = 0;
+      if (channel->rlength > 0 && channel->rpos < channel->rlength) {
+        avail = channel->rlength - channel->rpos;
+      }
+      if (avail < nbytes && channel->rbuf != NULL) {
+        /* Compact read buffer, and refill it up to requested window */
+        if (avail > 0 && channel->rpos > 0) {
+          memmove(channel->rbuf, channel->rbuf + channel->rpos, avail);
+          YCHANNEL_STAT_ADD(channel, copied, avail);
+        }
+        channel->rpos = 0;
+        channel->rlength = avail;
+
+        while (channel->rlength < nbytes) {
+          nread = YchannelReadDirect(channel, channel->rbuf + channel->rlength,
+                                     channel->rsize - channel->rlength);
+          if (nread < 0) {
+            channel->terminated = YTRUE;
+          }
+          if (nread <= 0) {
+            break;
+          }
+          channel->rlength += nread;
+        }
+        avail = channel->rlength;
+      }
+      if (avail > 0) {
+        result = channel->rbuf + channel->rpos;
+      }
+      olength = avail;
+    }
+
+    if (olength > remaining) {
+      olength = (size_t) remaining;
+    }
+  }
+
+  if (olengthptr != NULL) {
+    *olengthptr = olength;
+  }
+
+  return (olength > 0 ? result : NULL);
 }
 
-int
-YchannelWrite(Ychannel *channel, const void *buf, int towrite)
+const char*
+YchannelPeek(Ychannel *channel, size_t nbytes, size_t *olengthptr)
 {
-  jint written;
+  const char *result;
+  size_t olength = 0;
+
+  result = YchannelPeekWindow(channel, nbytes, &olength);
+  if (olength > nbytes) {
+    olength = nbytes;
+  }
+
+  if (olengthptr != NULL) {
+    *olengthptr = olength;
+  }
+
+  return (olength > 0 ? result : NULL);
+}
+
+const char*
+YchannelReadUntil(Ychannel *channel, int delim, size_t *olengthptr)
+{
+  const char *window;
+  const char *found;
+  size_t scanned = 0;
+  size_t avail = 0;
+  size_t olength = 0;
+
+  window = YchannelPeekWindow(channel, 1, &avail);
+  while (window != NULL) {
+    /* libc memchr is vectorized (SSE2/AVX2 on glibc, NEON on bionic) */
+    found = (const char*) memchr(window + scanned, delim, avail - scanned);
+    if (found != NULL) {
+      olength = (size_t) (found - window) + 1;
+      break;
+    }
+    if (avail >= INPUT_BUF_SIZE) {
+      /* No delimiter within a full window, return it as a partial record */
+      olength = avail;
+      break;
+    }
+
+    /* Extend window with at least one more read, only scanning new data */
+    scanned = avail;
+    window = YchannelPeekWindow(channel, avail + 1, &avail);
+    if (window != NULL && avail <= scanned) {
+      if (channel->wouldblock) {
+        /* Record not complete yet, keep it buffered until more data comes */
+        window = NULL;
+      } else {
+        /* End of input, return last unterminated record */
+        olength = avail;
+      }
+      break;
+    }
+  }
+
+  if (window == NULL || olength <= 0) {
+    window = NULL;
+    olength = 0;
+  } else {
+    /* Consume record, which fetch returns in place */
+    window = YchannelFetchData(channel, olength, &olength, YFALSE);
+    YCHANNEL_STAT_ADD(channel, zerocopy, olength);
+  }
+
+  if (olengthptr != NULL) {
+    *olengthptr = olength;
+  }
+
+  return window;
+}
+
+const char*
+YchannelReadLine(Ychannel *channel, size_t *olengthptr)
+{
+  return YchannelReadUntil(channel, '\n', olengthptr);
+}
+
+ssize_t
+YchannelWrite(Ychannel *channel, const void *buf, size_t towrite)
+{
+  size_t written;
+  size_t chunk;
   const char *nextc;
   int nbytes;
+  YBOOL wouldblock;
 
   if (!YchannelWritable(channel)) {
     return -1;
@@ -515,10 +1018,28 @@ YchannelWrite(Ychannel *channel, const void *buf, int towrite)
 
   written = 0;
   nextc = (char*) buf;
+  wouldblock = YFALSE;
 
   if (channel->writecb != NULL) {
     while (written < towrite) {
-      nbytes = channel->writecb(channel, nextc, towrite - written);
+      /* Engine callbacks take an int count */
+      chunk = towrite - written;
+      if (chunk > ENGINE_CHUNK_MAX) {
+        chunk = ENGINE_CHUNK_MAX;
+      }
+      if (channel->stats != NULL) {
+        nsecs_t start = Ytime(YTIME_CLOCK_MONOTONIC);
+        nbytes = channel->writecb(channel, nextc, (int) chunk);
+        channel->stats->writetime += Ytime(YTIME_CLOCK_MONOTONIC) - start;
+        channel->stats->writecalls++;
+      } else {
+        nbytes = channel->writecb(channel, nextc, (int) chunk);
+      }
+      if (nbytes == YCHANNEL_WOULDBLOCK || nbytes == 0) {
+        /* Engine can't accept more data now, return partial progress */
+        wouldblock = YTRUE;
+        break;
+      }
       if (nbytes < 0) {
         /* Write failed, no retry */
         break;
@@ -528,7 +1049,14 @@ YchannelWrite(Ychannel *channel, const void *buf, int towrite)
     }
   }
 
-  return written;
+  /* Only update status on change, so that engines safe for concurrent
+     writers don't race on it */
+  if (channel->wouldblock != wouldblock) {
+    channel->wouldblock = wouldblock;
+  }
+  YCHANNEL_STAT_ADD(channel, written, written);
+
+  return (ssize_t) written;
 }
 
 int
@@ -545,6 +1073,167 @@ YchannelFlush(Ychannel *channel)
   return YOSAL_OK;
 }
 
+YBOOL
+YchannelWouldBlock(Ychannel *channel)
+{
+  if (channel == NULL) {
+    return YFALSE;
+  }
+
+  return channel->wouldblock;
+}
+
+/* Check if some input is available from internal buffers, without
+   calling engine */
+static YBOOL
+YchannelBuffered(Ychannel *channel)
+{
+  if (channel->plength > 0 && channel->ppos < channel->plength) {
+    return YTRUE;
+  }
+  if (channel->hlength > 0 && channel->hpos < channel->hlength) {
+    return YTRUE;
+  }
+  if (channel->rlength > 0 && channel->rpos < channel->rlength) {
+    return YTRUE;
+  }
+
+  return YFALSE;
+}
+
+int
+YchannelPoll(YchannelPollEntry *entries, int count, int timeoutms)
+{
+  struct pollfd pollfds[YCHANNEL_POLL_STATIC];
+  struct pollfd *fds;
+  Ychannel *channel;
+  int nready = 0;
+  int ready;
+  int wanted;
+  int fd;
+  int rc;
+  int i;
+
+  if (entries == NULL || count <= 0) {
+    return 0;
+  }
+
+  if (count <= YCHANNEL_POLL_STATIC) {
+    fds = pollfds;
+  } else {
+    fds = (struct pollfd*) Ymem_malloc(count * sizeof(struct pollfd));
+    if (fds == NULL) {
+      return -1;
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    channel = entries[i].channel;
+    entries[i].revents = 0;
+    fds[i].fd = -1;
+    fds[i].events = 0;
+    fds[i].revents = 0;
+
+    if (channel == NULL) {
+      continue;
+    }
+
+    wanted = 0;
+    if ((entries[i].events & YCHANNEL_POLLIN) && YchannelReadable(channel)) {
+      if (YchannelBuffered(channel) || channel->terminated) {
+        /* Reading won't block */
+        entries[i].revents |= YCHANNEL_POLLIN;
+      } else {
+        wanted |= YCHANNEL_POLLIN;
+      }
+    }
+    if ((entries[i].events & YCHANNEL_POLLOUT) && YchannelWritable(channel)) {
+      wanted |= YCHANNEL_POLLOUT;
+    }
+
+    if (wanted != 0 && channel->pollcb != NULL) {
+      /* Engine is asked again once its file descriptor is readable */
+      fd = -1;
+      entries[i].revents |= channel->pollcb(channel, wanted, &fd);
+      if (entries[i].revents == 0 && fd >= 0) {
+        fds[i].fd = fd;
+        fds[i].events = POLLIN;
+      }
+    } else if (wanted != 0) {
+      fd = YchannelGetFd(channel);
+      if (fd < 0) {
+        /* Engine never blocks */
+        entries[i].revents |= wanted;
+      } else {
+        fds[i].fd = fd;
+        if (wanted & YCHANNEL_POLLIN) {
+          fds[i].events |= POLLIN;
+        }
+        if (wanted & YCHANNEL_POLLOUT) {
+          fds[i].events |= POLLOUT;
+        }
+      }
+    }
+    if (entries[i].revents != 0) {
+      nready++;
+    }
+  }
+
+  /* Don't wait when some channels are already known to be ready */
+  do {
+    rc = poll(fds, count, (nready > 0 ? 0 : timeoutms));
+  } while (rc < 0 && errno == EINTR);
+
+  if (rc < 0) {
+    nready = -1;
+  } else if (rc > 0) {
+    for (i = 0; i < count; i++) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      channel = entries[i].channel;
+      if (channel->pollcb != NULL) {
+        wanted = 0;
+        if (YchannelReadable(channel)) {
+          wanted |= (entries[i].events & YCHANNEL_POLLIN);
+        }
+        if (YchannelWritable(channel)) {
+          wanted |= (entries[i].events & YCHANNEL_POLLOUT);
+        }
+        fd = -1;
+        entries[i].revents = channel->pollcb(channel, wanted, &fd);
+        if (entries[i].revents != 0) {
+          nready++;
+        }
+        continue;
+      }
+      ready = (entries[i].revents != 0);
+      if (fds[i].revents & (POLLIN | POLLHUP)) {
+        /* Hang up is reported as readable, next read returns end of input */
+        if (fds[i].events & POLLIN) {
+          entries[i].revents |= YCHANNEL_POLLIN;
+        }
+      }
+      if (fds[i].revents & POLLOUT) {
+        entries[i].revents |= YCHANNEL_POLLOUT;
+      }
+      if (fds[i].revents & (POLLERR | POLLNVAL)) {
+        entries[i].revents |= YCHANNEL_POLLERR;
+      }
+      /* Only count events that were asked for, and entry once */
+      if (!ready && entries[i].revents != 0) {
+        nready++;
+      }
+    }
+  }
+
+  if (fds != pollfds) {
+    Ymem_free(fds);
+  }
+
+  return nready;
+}
+
 void*
 YchannelGetEngine(Ychannel *channel)
 {
@@ -555,6 +1244,28 @@ YchannelGetEngine(Ychannel *channel)
   return channel->enginedata;
 }
 
+int
+YchannelSetPollCB(Ychannel *channel, YchannelPollCB pollcb)
+{
+  if (channel == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  channel->pollcb = pollcb;
+
+  return YOSAL_OK;
+}
+
+const char*
+YchannelGetName(Ychannel *channel)
+{
+  if (channel == NULL) {
+    return NULL;
+  }
+
+  return channel->name;
+}
+
 Ychannel*
 YchannelInitGeneric(const char *name, void *enginedata,
                     YchannelReadCB readcb, YchannelWriteCB writecb,
@@ -573,6 +1284,7 @@ YchannelInitGeneric(const char *name, void *enginedata,
     channel->rwmode = YCHANNEL_READ;
   }
 
+  channel->name = name;
   channel->enginedata = enginedata;
   channel->readcb = readcb;
   channel->writecb = writecb;
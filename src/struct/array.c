@@ -12,13 +12,59 @@
 
 #include "yosal/yosal.h"
 
+#include <string.h>
+
 struct YArrayStruct {
   int length;
   int maxlength;
   int (*releaseElement) (void*);
   void **elements;
+  /* Optional arena holding array and its elements */
+  Yarena *arena;
 };
 
+/* Resize table of elements, large tables being mapped directly to reduce
+   TLB misses */
+static void**
+elementsResize(YArray *array, int newlength)
+{
+  size_t oldsize = array->maxlength * sizeof(void*);
+  size_t size = newlength * sizeof(void*);
+  void **elements;
+
+  if (array->arena != NULL) {
+    return (void**) Yarena_realloc(array->arena, array->elements, oldsize, size);
+  }
+
+  if (YMEM_IS_LARGE(size)) {
+    if (YMEM_IS_LARGE(oldsize)) {
+      return (void**) Ymem_large_realloc(array->elements, oldsize, size,
+                                         YMEM_LARGE_HUGEPAGE);
+    }
+    elements = (void**) Ymem_large_alloc(size, YMEM_LARGE_HUGEPAGE);
+    if (elements != NULL && array->elements != NULL) {
+      memcpy(elements, array->elements, oldsize);
+      Ymem_free(array->elements);
+    }
+    return elements;
+  }
+
+  elements = (void**) Ymem_realloc_tag(array->elements, size, YMEM_TAG_ARRAY);
+
+  return elements;
+}
+
+static void
+elementsFree(YArray *array)
+{
+  size_t size = array->maxlength * sizeof(void*);
+
+  if (YMEM_IS_LARGE(size)) {
+    Ymem_large_free(array->elements, size);
+    return;
+  }
+  Ymem_free(array->elements);
+}
 
 YArray*
 YArray_create()
@@ -28,26 +74,36 @@ YArray_create()
 
 YArray*
 YArray_createLength(int initlength)
+{
+  return YArray_createArena(NULL, initlength);
+}
+
+YArray*
+YArray_createArena(Yarena *arena, int initlength)
 {
   YArray *array;
 
-  array = Ymem_malloc(sizeof(YArray));
+  if (arena != NULL) {
+    array = Yarena_alloc(arena, sizeof(YArray));
+  } else {
+    array = Ymem_malloc_tag(sizeof(YArray), YMEM_TAG_ARRAY);
+  }
   if (array == NULL) {
     return NULL;
   }
 
-  if (initlength <= 0) {
-    array->elements = NULL;
-  } else {
-    array->elements = Ymem_malloc(initlength * sizeof(void*));
-    if (array->elements == NULL) {
-      initlength = 0;
-    }
-  }
-
+  array->elements = NULL;
   array->length = 0;
-  array->maxlength = initlength;
+  array->maxlength = 0;
   array->releaseElement = NULL;
+  array->arena = arena;
+
+  if (initlength > 0) {
+    array->elements = elementsResize(array, initlength);
+    if (array->elements != NULL) {
+      array->maxlength = initlength;
+    }
+  }
 
   return array;
 }
@@ -94,7 +150,7 @@ YArray_append(YArray *array, void *element)
       newlength = array->maxlength + (array->maxlength / 4);
     }
 
-    elements = (void**) Ymem_realloc(array->elements, newlength*sizeof(void*));
+    elements = elementsResize(array, newlength);
     if (elements == NULL) {
       return YOSAL_ERROR;
     }
@@ -118,8 +174,13 @@ YArray_release(YArray *array)
 
   YArray_reset(array);
 
+  if (array->arena != NULL) {
+    /* Memory is released with arena */
+    return YOSAL_OK;
+  }
+
   if (array->elements != NULL) {
-    Ymem_free(array->elements);
+    elementsFree(array);
   }
 
   Ymem_free(array);
@@ -192,3 +253,54 @@ YArray_setElementReleaseFunc(YArray *array, YArrayElementReleaseFunc releaseElem
   array->releaseElement = releaseElement;
   return YOSAL_OK;
 }
+
+int
+YArray_sort(YArray *array, YsortCompareFunc compar)
+{
+  if (array == NULL || compar == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  Ysort(array->elements, array->length, compar);
+
+  return YOSAL_OK;
+}
+
+int
+YArray_sortParallel(YArray *array, YsortCompareFunc compar, Ythreadpool *pool)
+{
+  if (array == NULL || compar == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  return Ysort_parallel(array->elements, array->length, compar, pool);
+}
+
+int
+YArray_bsearch(YArray *array, const void *key, YsortCompareFunc compar)
+{
+  int lo = 0;
+  int hi;
+  int mid;
+
+  if (array == NULL || compar == NULL) {
+    return -1;
+  }
+
+  /* Lower bound, so that first of equal elements is found */
+  hi = array->length;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (compar(&key, &array->elements[mid]) > 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo < array->length && compar(&key, &array->elements[lo]) == 0) {
+    return lo;
+  }
+
+  return -1;
+}
@@ -53,9 +53,13 @@
  of values is under the responsibility of the caller.
  */
 
+/* Entry and its key are allocated from map arena */
+#define YHASHMAP_ENTRY_ARENA 0x1
+
 struct YhashmapEntryStruct {
   void* key;
   int keylen;
+  int flags;
   void* value;
   int valuelen;
   uint32_t hash;
@@ -68,6 +72,8 @@ struct YhashmapStruct {
   size_t bucketMax;
   size_t size;
   pthread_mutex_t lock;
+  /* Optional arena holding map, buckets, entries and keys */
+  Yarena *arena;
 };
 
 /* Compute bucket for a given hash */
@@ -85,6 +91,43 @@ calculateIndex(size_t bucketCount, uint32_t hash)
 #endif
 }
 
+/* Allocate zero-filled buckets, large tables being mapped directly to
+   reduce TLB misses and spread them over NUMA nodes */
+static YhashmapEntry**
+bucketsAlloc(Yhashmap* map, size_t bucketCount)
+{
+  YhashmapEntry** buckets;
+  size_t size = bucketCount * sizeof(YhashmapEntry*);
+
+  if (map->arena != NULL) {
+    buckets = Yarena_alloc(map->arena, size);
+  } else if (YMEM_IS_LARGE(size)) {
+    return Ymem_large_alloc(size, YMEM_LARGE_HUGEPAGE | YMEM_LARGE_INTERLEAVE);
+  } else {
+    buckets = Ymem_malloc_tag(size, YMEM_TAG_HASHMAP);
+  }
+  if (buckets != NULL) {
+    memset(buckets, 0, size);
+  }
+
+  return buckets;
+}
+
+static void
+bucketsFree(Yhashmap* map, YhashmapEntry** buckets, size_t bucketCount)
+{
+  size_t size = bucketCount * sizeof(YhashmapEntry*);
+
+  if (map->arena != NULL) {
+    return;
+  }
+  if (YMEM_IS_LARGE(size)) {
+    Ymem_large_free(buckets, size);
+    return;
+  }
+  Ymem_free(buckets);
+}
+
 static void
 expandIfNecessary(Yhashmap* map)
 {
@@ -97,7 +140,9 @@ expandIfNecessary(Yhashmap* map)
   if (map->size > ((map->bucketCount * 3) / 4)) {
     size_t i;
     size_t newBucketCount = map->bucketCount << 1;
-    YhashmapEntry** newBuckets = Ymem_calloc(newBucketCount, sizeof(YhashmapEntry*));
+    YhashmapEntry** newBuckets;
+
+    newBuckets = bucketsAlloc(map, newBucketCount);
     if (newBuckets == NULL) {
       /* Abort expansion. */
       return;
@@ -116,20 +161,61 @@ expandIfNecessary(Yhashmap* map)
     }
 
     /* Copy over internals. */
-    Ymem_free(map->buckets);
+    bucketsFree(map, map->buckets, map->bucketCount);
 
     map->buckets = newBuckets;
     map->bucketCount = newBucketCount;
   }
 }
 
+#if YOSAL_CONFIG_YPOOL
+/* Pool shared by all maps not allocated from an arena */
+static Ypool *gEntryPool = NULL;
+static pthread_once_t gEntryPoolOnce = PTHREAD_ONCE_INIT;
+
+static void
+entryPoolInit()
+{
+  gEntryPool = Ypool_create(sizeof(YhashmapEntry));
+}
+#endif
+
+static YhashmapEntry*
+entryAlloc()
+{
+#if YOSAL_CONFIG_YPOOL
+  pthread_once(&gEntryPoolOnce, entryPoolInit);
+  if (gEntryPool != NULL) {
+    return Ypool_alloc(gEntryPool);
+  }
+#endif
+  return Ymem_malloc_tag(sizeof(YhashmapEntry), YMEM_TAG_HASHMAP);
+}
+
+static void
+entryFree(YhashmapEntry *entry)
+{
+#if YOSAL_CONFIG_YPOOL
+  if (gEntryPool != NULL) {
+    Ypool_free(gEntryPool, entry);
+    return;
+  }
+#endif
+  Ymem_free(entry);
+}
+
 static YhashmapEntry*
-createEntry(const void* key, int keylen, int hash, int nullterminate)
+createEntry(Yhashmap* map, const void* key, int keylen, int hash, int nullterminate)
 {
   char *keydup = NULL;
   int keyalloc = 0;
+  YhashmapEntry* entry;
 
-  YhashmapEntry* entry = Ymem_malloc(sizeof(YhashmapEntry));
+  if (map->arena != NULL) {
+    entry = Yarena_alloc(map->arena, sizeof(YhashmapEntry));
+  } else {
+    entry = entryAlloc();
+  }
   if (entry == NULL) {
     return NULL;
   }
@@ -139,10 +225,16 @@ createEntry(const void* key, int keylen, int hash, int nullterminate)
     if (nullterminate) {
       keyalloc++;
     }
-    keydup = Ymem_malloc(keyalloc);
+    if (map->arena != NULL) {
+      keydup = Yarena_alloc(map->arena, keyalloc);
+    } else {
+      keydup = Ymem_malloc_tag(keyalloc, YMEM_TAG_HASHMAP);
+    }
     if (keydup == NULL) {
       /* Running out of memory, clean up and return failure */
-      Ymem_free(entry);
+      if (map->arena == NULL) {
+        entryFree(entry);
+      }
       return NULL;
     }
     memcpy(keydup, key, keylen);
@@ -156,6 +248,7 @@ createEntry(const void* key, int keylen, int hash, int nullterminate)
 
   entry->key = keydup;
   entry->keylen = keylen;
+  entry->flags = (map->arena != NULL ? YHASHMAP_ENTRY_ARENA : 0);
   entry->value = NULL;
   entry->valuelen = 0;
   entry->hash = hash;
@@ -198,12 +291,23 @@ hashKey(const void* key, int keylen)
 Yhashmap*
 Yhashmap_create(int initialCapacity)
 {
-  size_t i;
+  return Yhashmap_create_arena(NULL, initialCapacity);
+}
+
+Yhashmap*
+Yhashmap_create_arena(Yarena *arena, int initialCapacity)
+{
+  Yhashmap *map;
 
-  Yhashmap *map = Ymem_malloc(sizeof(struct YhashmapStruct));
+  if (arena != NULL) {
+    map = Yarena_alloc(arena, sizeof(struct YhashmapStruct));
+  } else {
+    map = Ymem_malloc_tag(sizeof(struct YhashmapStruct), YMEM_TAG_HASHMAP);
+  }
   if (map == NULL) {
     return NULL;
   }
+  map->arena = arena;
 
   if (initialCapacity < 2) {
     initialCapacity = 2;
@@ -223,14 +327,13 @@ Yhashmap_create(int initialCapacity)
   /* Number of elements in map */
   map->size = 0;
 
-  map->buckets = Ymem_malloc(map->bucketCount * sizeof(YhashmapEntry*));
+  map->buckets = bucketsAlloc(map, map->bucketCount);
   if (map->buckets == NULL) {
-    Ymem_free(map);
+    if (arena == NULL) {
+      Ymem_free(map);
+    }
     return NULL;
   }
-  for (i = 0; i < map->bucketCount; i++) {
-    map->buckets[i] = NULL;
-  }
 
   pthread_mutex_init(&map->lock, NULL);
 
@@ -251,21 +354,24 @@ Yhashmap_release(Yhashmap *hashmap)
     while (entry != NULL) {
       YhashmapEntry* next = entry->next;
 
-	    if (entry->keylen > 0 && entry->key != NULL) {
-        Ymem_free(entry->key);
-	    }
 	    if (entry->valuelen > 0 && entry->value != NULL) {
         Ymem_free(entry->value);
 	    }
-
-      Ymem_free(entry);
+      if (!(entry->flags & YHASHMAP_ENTRY_ARENA)) {
+        if (entry->keylen > 0 && entry->key != NULL) {
+          Ymem_free(entry->key);
+        }
+        entryFree(entry);
+      }
       entry = next;
     }
   }
 
-  Ymem_free(hashmap->buckets);
   pthread_mutex_destroy(&hashmap->lock);
-  Ymem_free(hashmap);
+  bucketsFree(hashmap, hashmap->buckets, hashmap->bucketCount);
+  if (hashmap->arena == NULL) {
+    Ymem_free(hashmap);
+  }
 
   return YOSAL_OK;
 }
@@ -326,7 +432,7 @@ Yhashmap_put(Yhashmap* map,
 
     /* Add a new entry. */
     if (current == NULL) {
-      *p = createEntry(key, keylen, hash, nullterminate);
+      *p = createEntry(map, key, keylen, hash, nullterminate);
       if (*p == NULL) {
         /* Out of memory */
         errno = ENOMEM;
@@ -414,6 +520,30 @@ Yhashmap_collisions(Yhashmap* map)
   return collisions;
 }
 
+size_t
+Yhashmap_footprint(Yhashmap* map)
+{
+  size_t footprint;
+  size_t i;
+
+  if (map == NULL) {
+    return 0;
+  }
+
+  footprint = sizeof(struct YhashmapStruct) + map->bucketCount * sizeof(YhashmapEntry*);
+  for (i = 0; i < map->bucketCount; i++) {
+    YhashmapEntry* entry = map->buckets[i];
+    while (entry != NULL) {
+      footprint += sizeof(YhashmapEntry) + entry->keylen;
+      if (entry->valuelen > 0) {
+        footprint += entry->valuelen;
+      }
+      entry = entry->next;
+    }
+  }
+  return footprint;
+}
+
 void*
 Yhashmap_key(const YhashmapEntry *pEntry, int *lenptr)
 {
@@ -461,7 +591,7 @@ Yhashmap_setvalue(YhashmapEntry *pEntry, void *value, int valuelen)
 	    valuelen = strlen(value);
     }
     if (valuelen > 0) {
-	    valuedup = Ymem_malloc(valuelen);
+	    valuedup = Ymem_malloc_tag(valuelen, YMEM_TAG_HASHMAP);
 	    if (valuedup == NULL) {
         /* Out of memory */
         errno = ENOMEM;
@@ -509,13 +639,15 @@ Yhashmap_remove(Yhashmap *map, YhashmapEntry *pEntry)
     }
   }
 
-  if (pEntry->keylen > 0 && pEntry->key != NULL) {
-    Ymem_free(pEntry->key);
-  }
   if (pEntry->valuelen > 0 && pEntry->value != NULL) {
     Ymem_free(pEntry->value);
   }
-  Ymem_free(pEntry);
+  if (!(pEntry->flags & YHASHMAP_ENTRY_ARENA)) {
+    if (pEntry->keylen > 0 && pEntry->key != NULL) {
+      Ymem_free(pEntry->key);
+    }
+    entryFree(pEntry);
+  }
 
   return YOSAL_OK;
 }
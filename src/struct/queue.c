@@ -26,31 +26,100 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
 
+/* Values are stored in a circular array, a record being one of its slots */
 struct YqueueRecordStruct {
   void *value;
-  struct YqueueRecordStruct *next;
 };
 
 struct YqueueStruct {
+  /* Slots, a power of 2 of them */
+  YqueueRecord *records;
+  unsigned int capacity;
+  /* Slot of first value */
+  unsigned int head;
   unsigned int count;
-  YqueueRecord *first;
-  YqueueRecord *last;
+  /* Optional arena holding queue and its records */
+  Yarena *arena;
 };
 
+/* Initial number of slots, allocated with first value */
+#define QUEUE_CAPACITY_MIN 8
+
+/* Double number of slots. Values wrapping around the end of the array are
+   moved after the previous end, so that they stay in order. */
+static int
+queueGrow(Yqueue *l)
+{
+  YqueueRecord *records;
+  unsigned int capacity;
+  unsigned int wrapped;
+
+  if (l->capacity == 0) {
+    capacity = QUEUE_CAPACITY_MIN;
+  } else {
+    capacity = l->capacity * 2;
+    if (capacity <= l->capacity || capacity > UINT_MAX / sizeof(YqueueRecord)) {
+      return YOSAL_ERROR;
+    }
+  }
+
+  if (l->arena != NULL) {
+    records = Yarena_realloc(l->arena, l->records,
+                             l->capacity * sizeof(YqueueRecord),
+                             capacity * sizeof(YqueueRecord));
+  } else {
+    records = Ymem_realloc_tag(l->records, capacity * sizeof(YqueueRecord),
+                               YMEM_TAG_QUEUE);
+  }
+  if (records == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  if (l->head + l->count > l->capacity) {
+    wrapped = l->head + l->count - l->capacity;
+    memcpy(records + l->capacity, records, wrapped * sizeof(YqueueRecord));
+  }
+
+  l->records = records;
+  l->capacity = capacity;
+
+  return YOSAL_OK;
+}
+
+/* Slot of the n-th value */
+static YqueueRecord*
+queueRecord(Yqueue *l, unsigned int n)
+{
+  return &l->records[(l->head + n) & (l->capacity - 1)];
+}
+
 Yqueue*
 Yqueue_create()
+{
+  return Yqueue_create_arena(NULL);
+}
+
+Yqueue*
+Yqueue_create_arena(Yarena *arena)
 {
   Yqueue *l;
 
-  l = Ymem_malloc(sizeof(Yqueue));
+  if (arena != NULL) {
+    l = Yarena_alloc(arena, sizeof(Yqueue));
+  } else {
+    l = Ymem_malloc_tag(sizeof(Yqueue), YMEM_TAG_QUEUE);
+  }
   if (l == NULL) {
     return NULL;
   }
 
+  l->records = NULL;
+  l->capacity = 0;
+  l->head = 0;
   l->count = 0;
-  l->first = NULL;
-  l->last = NULL;
+  l->arena = arena;
 
   return l;
 }
@@ -58,9 +127,9 @@ Yqueue_create()
 int
 Yqueue_release(Yqueue *l)
 {
-  if (l != NULL) {
-    while (Yqueue_size(l) > 0) {
-      Yqueue_pop(l);
+  if (l != NULL && l->arena == NULL) {
+    if (l->records != NULL) {
+      Ymem_free(l->records);
     }
     Ymem_free(l);
   }
@@ -71,20 +140,14 @@ Yqueue_release(Yqueue *l)
 int
 Yqueue_push(Yqueue *l, void *value)
 {
-  YqueueRecord *record;
-
-  record = Ymem_malloc(sizeof(YqueueRecord));
-  record->value = value;
-  record->next = NULL;
-
-  if (l->last != NULL) {
-    l->last->next = record;
+  if (l == NULL) {
+    return -1;
   }
-  if (l->first == NULL) {
-    l->first = record;
+  if (l->count >= l->capacity && queueGrow(l) != YOSAL_OK) {
+    return -1;
   }
 
-  l->last = record;
+  queueRecord(l, l->count)->value = value;
   l->count++;
 
   return l->count;
@@ -93,17 +156,15 @@ Yqueue_push(Yqueue *l, void *value)
 int
 Yqueue_insert(Yqueue *l, void *value)
 {
-  YqueueRecord *record;
-
-  record = Ymem_malloc(sizeof(YqueueRecord));
-  record->value = value;
-  record->next = l->first;
-
-  if (l->last == NULL) {
-    l->last = record;
+  if (l == NULL) {
+    return -1;
+  }
+  if (l->count >= l->capacity && queueGrow(l) != YOSAL_OK) {
+    return -1;
   }
 
-  l->first = record;
+  l->head = (l->head - 1) & (l->capacity - 1);
+  l->records[l->head].value = value;
   l->count++;
 
   return l->count;
@@ -112,35 +173,49 @@ Yqueue_insert(Yqueue *l, void *value)
 void*
 Yqueue_pop(Yqueue *l)
 {
-  YqueueRecord *record;
   void* value;
 
-  if (l == NULL || l->first == NULL) {
+  if (l == NULL || l->count == 0) {
     return NULL;
   }
 
-  record = l->first;
-  value = record->value;
+  value = l->records[l->head].value;
+  l->head = (l->head + 1) & (l->capacity - 1);
+  l->count--;
+
+  return value;
+}
 
-  l->first = record->next;
-  if (l->first == NULL) {
-    /* This was last element, list is now empty */
-    l->last = NULL;
+void*
+Yqueue_poplast(Yqueue *l)
+{
+  if (l == NULL || l->count == 0) {
+    return NULL;
   }
+
   l->count--;
 
-  Ymem_free(record);
-  return value;
+  return queueRecord(l, l->count)->value;
 }
 
 void*
 Yqueue_fetch(Yqueue *l)
 {
-  if (l == NULL || l->first == NULL) {
+  if (l == NULL || l->count == 0) {
+    return NULL;
+  }
+
+  return l->records[l->head].value;
+}
+
+void*
+Yqueue_fetchlast(Yqueue *l)
+{
+  if (l == NULL || l->count == 0) {
     return NULL;
   }
 
-  return l->first->value;
+  return queueRecord(l, l->count - 1)->value;
 }
 
 int
@@ -157,19 +232,27 @@ Yqueue_size(Yqueue *l)
 YqueueRecord*
 Yqueue_first(Yqueue *l)
 {
-  if (l == NULL) {
+  if (l == NULL || l->count == 0) {
     return NULL;
   }
-  return l->first;
+  return &l->records[l->head];
 }
 
 YqueueRecord*
 Yqueue_next(Yqueue *l, YqueueRecord *element)
 {
+  unsigned int n;
+
   if (l == NULL || element == NULL) {
     return NULL;
   }
-  return element->next;
+
+  /* Position of next value from start of queue */
+  n = ((unsigned int) (element - l->records) - l->head + 1) & (l->capacity - 1);
+  if (n == 0 || n >= l->count) {
+    return NULL;
+  }
+  return queueRecord(l, n);
 }
 
 void*
@@ -182,9 +265,8 @@ void**
 Yqueue_array(Yqueue *l, int(*compar)(const void *, const void *))
 {
   void **qarray;
-  YqueueRecord *qrec;
+  unsigned int first;
   int qlen;
-  int i;
 
   if (l == NULL) {
     return NULL;
@@ -196,16 +278,20 @@ Yqueue_array(Yqueue *l, int(*compar)(const void *, const void *))
   }
 
   qarray = Ymem_malloc(qlen * sizeof(void*));
+  if (qarray == NULL) {
+    return NULL;
+  }
 
-  i = 0;
-  qrec = Yqueue_first(l);
-  while (qrec != NULL) {
-    qarray[i++] = Yqueue_value(qrec);
-    qrec = Yqueue_next(l, qrec);
+  /* Values are contiguous, unless they wrap around end of array */
+  first = l->capacity - l->head;
+  if (first > l->count) {
+    first = l->count;
   }
+  memcpy(qarray, l->records + l->head, first * sizeof(void*));
+  memcpy(qarray + first, l->records, (l->count - first) * sizeof(void*));
 
-  if (compar != NULL && qlen > 1) {
-    qsort(qarray, qlen, sizeof(void*), compar);
+  if (compar != NULL) {
+    Ysort(qarray, qlen, compar);
   }
 
   return qarray;
@@ -0,0 +1,361 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Bounded multi-producer multi-consumer queue, after the array based
+ * queue of Dmitry Vyukov.
+ *
+ * Each cell of the ring carries a sequence number. A cell at position pos
+ * is free for a producer when its sequence is pos, and holds a value for
+ * a consumer when its sequence is pos + 1. Producers and consumers claim
+ * positions with a compare-and-swap on their own counter, then publish
+ * the cell by advancing its sequence, so that they never wait on each
+ * other unless the queue is full or empty.
+ */
+#include "yosal/yosal.h"
+
+#include <pthread.h>
+
+#define QUEUE_CAPACITY_MAX (1 << 30)
+
+typedef struct {
+  size_t seq;
+  void *value;
+} YqueueConcurrentCell;
+
+struct YqueueConcurrentStruct {
+  /* Next position to push into, shared by producers */
+  size_t enqueuePos YCACHELINE_ALIGNED;
+  /* Next position to pop from, shared by consumers */
+  size_t dequeuePos YCACHELINE_ALIGNED;
+  /* Fields below are mostly read */
+  YqueueConcurrentCell *cells YCACHELINE_ALIGNED;
+  size_t mask;
+  int closed;
+  /* Threads blocked on a full or empty queue */
+  pthread_mutex_t lock;
+  Ypark notFull;
+  Ypark notEmpty;
+};
+
+/* Claim and fill up to count consecutive free cells */
+static int
+pushCells(YqueueConcurrent *q, void **values, int count)
+{
+  YqueueConcurrentCell *cell;
+  intptr_t dif = 0;
+  size_t pos;
+  int n;
+  int i;
+
+  pos = __atomic_load_n(&q->enqueuePos, __ATOMIC_RELAXED);
+  for (;;) {
+    for (n = 0; n < count; n++) {
+      cell = &q->cells[(pos + n) & q->mask];
+      dif = (intptr_t) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + n));
+      if (dif != 0) {
+        break;
+      }
+    }
+    if (n == 0) {
+      if (dif < 0) {
+        /* Full */
+        return 0;
+      }
+      /* Another producer took this position */
+      pos = __atomic_load_n(&q->enqueuePos, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&q->enqueuePos, &pos, pos + n, 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    cell = &q->cells[(pos + i) & q->mask];
+    cell->value = values[i];
+    __atomic_store_n(&cell->seq, pos + i + 1, __ATOMIC_RELEASE);
+  }
+
+  return n;
+}
+
+/* Claim and empty up to count consecutive filled cells */
+static int
+popCells(YqueueConcurrent *q, void **values, int count)
+{
+  YqueueConcurrentCell *cell;
+  intptr_t dif = 0;
+  size_t pos;
+  int n;
+  int i;
+
+  pos = __atomic_load_n(&q->dequeuePos, __ATOMIC_RELAXED);
+  for (;;) {
+    for (n = 0; n < count; n++) {
+      cell = &q->cells[(pos + n) & q->mask];
+      dif = (intptr_t) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + n + 1));
+      if (dif != 0) {
+        break;
+      }
+    }
+    if (n == 0) {
+      if (dif < 0) {
+        /* Empty */
+        return 0;
+      }
+      /* Another consumer took this position */
+      pos = __atomic_load_n(&q->dequeuePos, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&q->dequeuePos, &pos, pos + n, 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    cell = &q->cells[(pos + i) & q->mask];
+    values[i] = cell->value;
+    __atomic_store_n(&cell->seq, pos + i + q->mask + 1, __ATOMIC_RELEASE);
+  }
+
+  return n;
+}
+
+YqueueConcurrent*
+Yqueue_concurrent_create(int capacity)
+{
+  YqueueConcurrent *q;
+  size_t size;
+  size_t i;
+
+  if (capacity <= 0 || capacity > QUEUE_CAPACITY_MAX) {
+    return NULL;
+  }
+  size = 2;
+  while (size < (size_t) capacity) {
+    size <<= 1;
+  }
+
+  q = (YqueueConcurrent*) Ymem_malloc_cacheline(sizeof(YqueueConcurrent));
+  if (q == NULL) {
+    return NULL;
+  }
+  memset(q, 0, sizeof(YqueueConcurrent));
+
+  q->cells = (YqueueConcurrentCell*) Ymem_malloc_tag(size * sizeof(YqueueConcurrentCell),
+                                                     YMEM_TAG_QUEUE);
+  if (q->cells == NULL) {
+    Ymem_free_cacheline(q);
+    return NULL;
+  }
+  for (i = 0; i < size; i++) {
+    q->cells[i].seq = i;
+    q->cells[i].value = NULL;
+  }
+  q->mask = size - 1;
+
+  pthread_mutex_init(&q->lock, NULL);
+  Ypark_init(&q->notFull);
+  Ypark_init(&q->notEmpty);
+
+  return q;
+}
+
+int
+Yqueue_concurrent_release(YqueueConcurrent *q)
+{
+  if (q == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  Ypark_destroy(&q->notEmpty);
+  Ypark_destroy(&q->notFull);
+  pthread_mutex_destroy(&q->lock);
+  Ymem_free(q->cells);
+  Ymem_free_cacheline(q);
+
+  return YOSAL_OK;
+}
+
+int
+Yqueue_concurrent_pushbatch(YqueueConcurrent *q, void **values, int count)
+{
+  int n;
+
+  if (q == NULL || values == NULL || count <= 0) {
+    return 0;
+  }
+  if (__atomic_load_n(&q->closed, __ATOMIC_RELAXED)) {
+    return 0;
+  }
+
+  n = pushCells(q, values, count);
+  if (n > 0) {
+    Ypark_wake(&q->notEmpty, &q->lock, n > 1);
+  }
+
+  return n;
+}
+
+int
+Yqueue_concurrent_popbatch(YqueueConcurrent *q, void **values, int count)
+{
+  int n;
+
+  if (q == NULL || values == NULL || count <= 0) {
+    return 0;
+  }
+
+  n = popCells(q, values, count);
+  if (n > 0) {
+    Ypark_wake(&q->notFull, &q->lock, n > 1);
+  }
+
+  return n;
+}
+
+int
+Yqueue_concurrent_trypush(YqueueConcurrent *q, void *value)
+{
+  if (Yqueue_concurrent_pushbatch(q, &value, 1) != 1) {
+    return YOSAL_ERROR;
+  }
+
+  return YOSAL_OK;
+}
+
+int
+Yqueue_concurrent_trypop(YqueueConcurrent *q, void **valueref)
+{
+  if (Yqueue_concurrent_popbatch(q, valueref, 1) != 1) {
+    return YOSAL_ERROR;
+  }
+
+  return YOSAL_OK;
+}
+
+int
+Yqueue_concurrent_push(YqueueConcurrent *q, void *value, int timeout)
+{
+  struct timespec deadline;
+  int n = 0;
+  int timedout = 0;
+
+  if (Yqueue_concurrent_trypush(q, value) == YOSAL_OK) {
+    return YOSAL_OK;
+  }
+  if (q == NULL || timeout == 0) {
+    return YOSAL_ERROR;
+  }
+  if (timeout > 0) {
+    Ypark_deadline(&deadline, timeout);
+  }
+
+  pthread_mutex_lock(&q->lock);
+  Ypark_enter(&q->notFull);
+  while (!__atomic_load_n(&q->closed, __ATOMIC_RELAXED)) {
+    n = pushCells(q, &value, 1);
+    if (n > 0 || timedout) {
+      break;
+    }
+    timedout = Ypark_wait(&q->notFull, &q->lock, timeout > 0 ? &deadline : NULL);
+  }
+  Ypark_leave(&q->notFull);
+  pthread_mutex_unlock(&q->lock);
+
+  if (n == 0) {
+    return YOSAL_ERROR;
+  }
+  Ypark_wake(&q->notEmpty, &q->lock, 0);
+
+  return YOSAL_OK;
+}
+
+int
+Yqueue_concurrent_pop(YqueueConcurrent *q, void **valueref, int timeout)
+{
+  struct timespec deadline;
+  int n = 0;
+  int timedout = 0;
+
+  if (Yqueue_concurrent_trypop(q, valueref) == YOSAL_OK) {
+    return YOSAL_OK;
+  }
+  if (q == NULL || valueref == NULL || timeout == 0) {
+    return YOSAL_ERROR;
+  }
+  if (timeout > 0) {
+    Ypark_deadline(&deadline, timeout);
+  }
+
+  pthread_mutex_lock(&q->lock);
+  Ypark_enter(&q->notEmpty);
+  for (;;) {
+    n = popCells(q, valueref, 1);
+    if (n > 0 || timedout || __atomic_load_n(&q->closed, __ATOMIC_RELAXED)) {
+      break;
+    }
+    timedout = Ypark_wait(&q->notEmpty, &q->lock, timeout > 0 ? &deadline : NULL);
+  }
+  Ypark_leave(&q->notEmpty);
+  pthread_mutex_unlock(&q->lock);
+
+  if (n == 0) {
+    return YOSAL_ERROR;
+  }
+  Ypark_wake(&q->notFull, &q->lock, 0);
+
+  return YOSAL_OK;
+}
+
+int
+Yqueue_concurrent_close(YqueueConcurrent *q)
+{
+  if (q == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  pthread_mutex_lock(&q->lock);
+  __atomic_store_n(&q->closed, 1, __ATOMIC_SEQ_CST);
+  Ypark_wakeall(&q->notFull);
+  Ypark_wakeall(&q->notEmpty);
+  pthread_mutex_unlock(&q->lock);
+
+  return YOSAL_OK;
+}
+
+int
+Yqueue_concurrent_size(YqueueConcurrent *q)
+{
+  size_t dequeuePos;
+  size_t enqueuePos;
+  intptr_t size;
+
+  if (q == NULL) {
+    return 0;
+  }
+
+  dequeuePos = __atomic_load_n(&q->dequeuePos, __ATOMIC_ACQUIRE);
+  enqueuePos = __atomic_load_n(&q->enqueuePos, __ATOMIC_ACQUIRE);
+  size = (intptr_t) (enqueuePos - dequeuePos);
+  if (size < 0) {
+    return 0;
+  }
+  if ((size_t) size > q->mask + 1) {
+    return (int) (q->mask + 1);
+  }
+
+  return (int) size;
+}
@@ -0,0 +1,370 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * 4-ary heap. Each node carries the handle of its value, and positions
+ * tell for each handle where its node is. Nodes past the end of the heap
+ * keep the handles of removed values, so that the next insertion takes
+ * its handle from the node it is about to fill.
+ */
+#include "yosal/yosal.h"
+
+#include <string.h>
+
+#define HEAP_ARITY 4
+#define HEAP_CAPACITY_MIN 16
+
+#define HEAP_PARENT(i) (((i) - 1) / HEAP_ARITY)
+#define HEAP_CHILD(i) ((i) * HEAP_ARITY + 1)
+
+typedef struct {
+  void *value;
+  int handle;
+} YheapNode;
+
+struct YheapStruct {
+  YheapNode *nodes;
+  /* Position of node of each handle */
+  int *positions;
+  int count;
+  /* Number of handles ever given, all nodes below it holding one */
+  int handles;
+  int capacity;
+  YheapCompareFunc compar;
+};
+
+static int
+heapGrow(Yheap *h, int needed)
+{
+  YheapNode *nodes;
+  int *positions;
+  int capacity;
+
+  capacity = (h->capacity > 0 ? h->capacity : HEAP_CAPACITY_MIN);
+  while (capacity < needed) {
+    if (capacity > (1 << 29)) {
+      return YOSAL_ERROR;
+    }
+    capacity *= 2;
+  }
+  if (capacity <= h->capacity) {
+    return YOSAL_OK;
+  }
+
+  nodes = Ymem_realloc_tag(h->nodes, capacity * sizeof(YheapNode), YMEM_TAG_QUEUE);
+  if (nodes == NULL) {
+    return YOSAL_ERROR;
+  }
+  h->nodes = nodes;
+  positions = Ymem_realloc_tag(h->positions, capacity * sizeof(int), YMEM_TAG_QUEUE);
+  if (positions == NULL) {
+    return YOSAL_ERROR;
+  }
+  h->positions = positions;
+  h->capacity = capacity;
+
+  return YOSAL_OK;
+}
+
+static void
+heapPlace(Yheap *h, int i, YheapNode node)
+{
+  h->nodes[i] = node;
+  h->positions[node.handle] = i;
+}
+
+static void
+heapSiftUp(Yheap *h, int i)
+{
+  YheapNode node = h->nodes[i];
+  int parent;
+
+  while (i > 0) {
+    parent = HEAP_PARENT(i);
+    if (h->compar(node.value, h->nodes[parent].value) >= 0) {
+      break;
+    }
+    heapPlace(h, i, h->nodes[parent]);
+    i = parent;
+  }
+  heapPlace(h, i, node);
+}
+
+static void
+heapSiftDown(Yheap *h, int i)
+{
+  YheapNode node = h->nodes[i];
+  int child;
+  int last;
+  int best;
+
+  for (;;) {
+    child = HEAP_CHILD(i);
+    if (child >= h->count) {
+      break;
+    }
+    last = child + HEAP_ARITY;
+    if (last > h->count) {
+      last = h->count;
+    }
+    best = child;
+    for (child++; child < last; child++) {
+      if (h->compar(h->nodes[child].value, h->nodes[best].value) < 0) {
+        best = child;
+      }
+    }
+    if (h->compar(h->nodes[best].value, node.value) >= 0) {
+      break;
+    }
+    heapPlace(h, i, h->nodes[best]);
+    i = best;
+  }
+  heapPlace(h, i, node);
+}
+
+/* Append a node at end of heap, without restoring order */
+static int
+heapAppend(Yheap *h, void *value)
+{
+  int handle;
+
+  if (h->count >= h->handles) {
+    /* No handle left to reuse */
+    h->nodes[h->count].handle = h->handles++;
+  }
+  handle = h->nodes[h->count].handle;
+  h->nodes[h->count].value = value;
+  h->positions[handle] = h->count;
+  h->count++;
+
+  return handle;
+}
+
+/* Remove node at a position, keeping its handle past the end of heap */
+static void*
+heapRemoveAt(Yheap *h, int i)
+{
+  YheapNode removed = h->nodes[i];
+  int last;
+
+  h->count--;
+  last = h->count;
+  if (i != last) {
+    heapPlace(h, i, h->nodes[last]);
+    heapPlace(h, last, removed);
+    if (i > 0 && h->compar(h->nodes[i].value, h->nodes[HEAP_PARENT(i)].value) < 0) {
+      heapSiftUp(h, i);
+    } else {
+      heapSiftDown(h, i);
+    }
+  }
+
+  return removed.value;
+}
+
+/* Position of node of a handle, or -1 if handle is not in heap */
+static int
+heapPosition(Yheap *h, int handle)
+{
+  int i;
+
+  if (h == NULL || handle < 0 || handle >= h->handles) {
+    return -1;
+  }
+  i = h->positions[handle];
+  if (i >= h->count) {
+    return -1;
+  }
+
+  return i;
+}
+
+Yheap*
+Yheap_create(YheapCompareFunc compar)
+{
+  Yheap *h;
+
+  if (compar == NULL) {
+    return NULL;
+  }
+
+  h = Ymem_malloc_tag(sizeof(Yheap), YMEM_TAG_QUEUE);
+  if (h == NULL) {
+    return NULL;
+  }
+  memset(h, 0, sizeof(Yheap));
+  h->compar = compar;
+
+  return h;
+}
+
+int
+Yheap_release(Yheap *h)
+{
+  if (h != NULL) {
+    if (h->nodes != NULL) {
+      Ymem_free(h->nodes);
+    }
+    if (h->positions != NULL) {
+      Ymem_free(h->positions);
+    }
+    Ymem_free(h);
+  }
+
+  return YOSAL_OK;
+}
+
+int
+Yheap_push(Yheap *h, void *value)
+{
+  int handle;
+
+  if (h == NULL) {
+    return -1;
+  }
+  if (h->count >= h->capacity && heapGrow(h, h->count + 1) != YOSAL_OK) {
+    return -1;
+  }
+
+  handle = heapAppend(h, value);
+  heapSiftUp(h, h->count - 1);
+
+  return handle;
+}
+
+int
+Yheap_pushbatch(Yheap *h, void **values, int count, int *handles)
+{
+  int handle;
+  int first;
+  int i;
+
+  if (h == NULL || count < 0 || (count > 0 && values == NULL)) {
+    return YOSAL_ERROR;
+  }
+  if (count > (1 << 29) - h->count || heapGrow(h, h->count + count) != YOSAL_OK) {
+    return YOSAL_ERROR;
+  }
+
+  first = h->count;
+  for (i = 0; i < count; i++) {
+    handle = heapAppend(h, values[i]);
+    if (handles != NULL) {
+      handles[i] = handle;
+    }
+  }
+
+  if (count > first) {
+    /* Rebuild whole heap bottom-up, sifting down every inner node */
+    for (i = HEAP_PARENT(h->count - 1); i >= 0; i--) {
+      heapSiftDown(h, i);
+    }
+  } else {
+    for (i = first; i < h->count; i++) {
+      heapSiftUp(h, i);
+    }
+  }
+
+  return YOSAL_OK;
+}
+
+void*
+Yheap_pop(Yheap *h)
+{
+  if (h == NULL || h->count == 0) {
+    return NULL;
+  }
+
+  return heapRemoveAt(h, 0);
+}
+
+int
+Yheap_popbatch(Yheap *h, void **values, int k)
+{
+  int n;
+
+  if (h == NULL || values == NULL) {
+    return 0;
+  }
+
+  for (n = 0; n < k && h->count > 0; n++) {
+    values[n] = heapRemoveAt(h, 0);
+  }
+
+  return n;
+}
+
+void*
+Yheap_top(Yheap *h)
+{
+  if (h == NULL || h->count == 0) {
+    return NULL;
+  }
+
+  return h->nodes[0].value;
+}
+
+int
+Yheap_update(Yheap *h, int handle, void *value)
+{
+  int i;
+
+  i = heapPosition(h, handle);
+  if (i < 0) {
+    return YOSAL_ERROR;
+  }
+
+  h->nodes[i].value = value;
+  if (i > 0 && h->compar(value, h->nodes[HEAP_PARENT(i)].value) < 0) {
+    heapSiftUp(h, i);
+  } else {
+    heapSiftDown(h, i);
+  }
+
+  return YOSAL_OK;
+}
+
+void*
+Yheap_remove(Yheap *h, int handle)
+{
+  int i;
+
+  i = heapPosition(h, handle);
+  if (i < 0) {
+    return NULL;
+  }
+
+  return heapRemoveAt(h, i);
+}
+
+void*
+Yheap_get(Yheap *h, int handle)
+{
+  int i;
+
+  i = heapPosition(h, handle);
+  if (i < 0) {
+    return NULL;
+  }
+
+  return h->nodes[i].value;
+}
+
+int
+Yheap_size(Yheap *h)
+{
+  if (h == NULL) {
+    return 0;
+  }
+
+  return h->count;
+}
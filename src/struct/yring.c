@@ -0,0 +1,315 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Single producer, single consumer rings. Indexes grow forever, and are
+ * only masked when accessing slots, so that a full ring is told apart
+ * from an empty one without wasting a slot. Producer publishes slots with
+ * a release store of its tail, consumer frees them with a release store
+ * of its head.
+ */
+#include "yosal/yosal.h"
+
+#define YRING_CAPACITY_MAX (1 << 30)
+
+struct YringStruct {
+  /* Written by consumer only */
+  size_t head YCACHELINE_ALIGNED;
+  size_t tailCache;
+  /* Written by producer only */
+  size_t tail YCACHELINE_ALIGNED;
+  size_t headCache;
+  /* Read only */
+  char *data YCACHELINE_ALIGNED;
+  size_t mask;
+};
+
+struct YbyteringStruct {
+  struct YringStruct ring;
+};
+
+static Yring*
+ringCreate(int capacity, size_t slotsize, size_t structsize)
+{
+  Yring *ring;
+  size_t size;
+
+  if (capacity <= 0 || capacity > YRING_CAPACITY_MAX) {
+    return NULL;
+  }
+  size = 2;
+  while (size < (size_t) capacity) {
+    size <<= 1;
+  }
+
+  ring = (Yring*) Ymem_malloc_cacheline(structsize);
+  if (ring == NULL) {
+    return NULL;
+  }
+  memset(ring, 0, structsize);
+
+  ring->data = (char*) Ymem_malloc_tag(size * slotsize, YMEM_TAG_QUEUE);
+  if (ring->data == NULL) {
+    Ymem_free_cacheline(ring);
+    return NULL;
+  }
+  ring->mask = size - 1;
+
+  return ring;
+}
+
+static void
+ringRelease(Yring *ring)
+{
+  Ymem_free(ring->data);
+  Ymem_free_cacheline(ring);
+}
+
+/* Number of free slots seen by producer, reading head of consumer only
+   when the cached one doesn't show enough room */
+static size_t
+ringWritable(Yring *ring, size_t wanted)
+{
+  size_t capacity = ring->mask + 1;
+  size_t room;
+
+  room = capacity - (ring->tail - ring->headCache);
+  if (room < wanted) {
+    ring->headCache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    room = capacity - (ring->tail - ring->headCache);
+  }
+
+  return room;
+}
+
+/* Number of filled slots seen by consumer, reading tail of producer only
+   when the cached one doesn't show enough data */
+static size_t
+ringReadable(Yring *ring, size_t wanted)
+{
+  size_t available;
+
+  available = ring->tailCache - ring->head;
+  if (available < wanted) {
+    ring->tailCache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    available = ring->tailCache - ring->head;
+  }
+
+  return available;
+}
+
+Yring*
+Yring_create(int capacity)
+{
+  return ringCreate(capacity, sizeof(void*), sizeof(Yring));
+}
+
+void
+Yring_release(Yring *ring)
+{
+  if (ring != NULL) {
+    ringRelease(ring);
+  }
+}
+
+int
+Yring_push(Yring *ring, void *value)
+{
+  if (ring == NULL || ringWritable(ring, 1) == 0) {
+    return YOSAL_ERROR;
+  }
+
+  ((void**) ring->data)[ring->tail & ring->mask] = value;
+  __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+
+  return YOSAL_OK;
+}
+
+int
+Yring_pop(Yring *ring, void **valueref)
+{
+  if (ring == NULL || ringReadable(ring, 1) == 0) {
+    return YOSAL_ERROR;
+  }
+
+  if (valueref != NULL) {
+    *valueref = ((void**) ring->data)[ring->head & ring->mask];
+  }
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+
+  return YOSAL_OK;
+}
+
+int
+Yring_pushbatch(Yring *ring, void **values, int count)
+{
+  void **slots;
+  size_t n;
+  size_t i;
+
+  if (ring == NULL || values == NULL || count <= 0) {
+    return 0;
+  }
+
+  n = ringWritable(ring, count);
+  if (n > (size_t) count) {
+    n = count;
+  }
+  slots = (void**) ring->data;
+  for (i = 0; i < n; i++) {
+    slots[(ring->tail + i) & ring->mask] = values[i];
+  }
+  __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+
+  return (int) n;
+}
+
+int
+Yring_popbatch(Yring *ring, void **values, int count)
+{
+  void **slots;
+  size_t n;
+  size_t i;
+
+  if (ring == NULL || values == NULL || count <= 0) {
+    return 0;
+  }
+
+  n = ringReadable(ring, count);
+  if (n > (size_t) count) {
+    n = count;
+  }
+  slots = (void**) ring->data;
+  for (i = 0; i < n; i++) {
+    values[i] = slots[(ring->head + i) & ring->mask];
+  }
+  __atomic_store_n(&ring->head, ring->head + n, __ATOMIC_RELEASE);
+
+  return (int) n;
+}
+
+int
+Yring_size(Yring *ring)
+{
+  size_t head;
+  size_t tail;
+
+  if (ring == NULL) {
+    return 0;
+  }
+
+  head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  return (int) (tail - head);
+}
+
+Ybytering*
+Ybytering_create(int capacity)
+{
+  return (Ybytering*) ringCreate(capacity, 1, sizeof(Ybytering));
+}
+
+void
+Ybytering_release(Ybytering *bytering)
+{
+  if (bytering != NULL) {
+    ringRelease(&bytering->ring);
+  }
+}
+
+int
+Ybytering_write(Ybytering *bytering, const void *buf, int nbytes)
+{
+  Yring *ring;
+  size_t offset;
+  size_t first;
+  size_t n;
+
+  if (bytering == NULL || buf == NULL || nbytes <= 0) {
+    return 0;
+  }
+
+  ring = &bytering->ring;
+  n = ringWritable(ring, nbytes);
+  if (n > (size_t) nbytes) {
+    n = nbytes;
+  }
+  if (n == 0) {
+    return 0;
+  }
+
+  /* Region may wrap around end of ring */
+  offset = ring->tail & ring->mask;
+  first = ring->mask + 1 - offset;
+  if (first > n) {
+    first = n;
+  }
+  memcpy(ring->data + offset, buf, first);
+  memcpy(ring->data, ((const char*) buf) + first, n - first);
+  __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+
+  return (int) n;
+}
+
+int
+Ybytering_read(Ybytering *bytering, void *buf, int nbytes)
+{
+  Yring *ring;
+  size_t offset;
+  size_t first;
+  size_t n;
+
+  if (bytering == NULL || buf == NULL || nbytes <= 0) {
+    return 0;
+  }
+
+  ring = &bytering->ring;
+  n = ringReadable(ring, nbytes);
+  if (n > (size_t) nbytes) {
+    n = nbytes;
+  }
+  if (n == 0) {
+    return 0;
+  }
+
+  offset = ring->head & ring->mask;
+  first = ring->mask + 1 - offset;
+  if (first > n) {
+    first = n;
+  }
+  memcpy(buf, ring->data + offset, first);
+  memcpy(((char*) buf) + first, ring->data, n - first);
+  __atomic_store_n(&ring->head, ring->head + n, __ATOMIC_RELEASE);
+
+  return (int) n;
+}
+
+int
+Ybytering_readable(Ybytering *bytering)
+{
+  if (bytering == NULL) {
+    return 0;
+  }
+
+  return (int) ringReadable(&bytering->ring, (size_t) -1);
+}
+
+int
+Ybytering_writable(Ybytering *bytering)
+{
+  if (bytering == NULL) {
+    return 0;
+  }
+
+  return (int) ringWritable(&bytering->ring, (size_t) -1);
+}
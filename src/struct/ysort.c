@@ -0,0 +1,237 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Parallel merge sort. Array is cut into a few slices per worker, each
+ * one sorted by an introsort, then runs are merged pairwise, back and
+ * forth between array and a copy. Once there are fewer runs than workers,
+ * merging two runs is itself split: both runs are cut at the positions
+ * of evenly spaced elements of the first one, found in the second one by
+ * binary search, and pieces are merged independently.
+ */
+#include "yosal/yosal.h"
+
+#include <string.h>
+
+/* Smallest array sorted in parallel */
+#define SORT_PARALLEL_MIN 8192
+/* Number of tasks per worker, to balance uneven ones */
+#define SORT_TASKS_PER_WORKER 4
+
+#define SORT_POINTER_LESS(a, b) (ysort_context(&(a), &(b)) < 0)
+
+YSORT_DEFINE_CONTEXT(sortPointers, void*, YsortCompareFunc, SORT_POINTER_LESS)
+
+typedef struct {
+  void **src;
+  void **dst;
+  size_t n;
+  /* Length of runs, before merging */
+  size_t width;
+  /* Number of pieces each merge is split into */
+  size_t parts;
+  YsortCompareFunc compar;
+} SortContext;
+
+void
+Ysort(void **base, size_t n, YsortCompareFunc compar)
+{
+  if (base == NULL || compar == NULL || n < 2) {
+    return;
+  }
+
+  sortPointers(base, n, compar);
+}
+
+static void
+sortSlices(void *arg, size_t begin, size_t end)
+{
+  SortContext *ctx = (SortContext*) arg;
+  size_t first;
+  size_t last;
+  size_t i;
+
+  for (i = begin; i < end; i++) {
+    first = i * ctx->width;
+    last = first + ctx->width;
+    if (last > ctx->n) {
+      last = ctx->n;
+    }
+    if (first < last) {
+      sortPointers(ctx->src + first, last - first, ctx->compar);
+    }
+  }
+}
+
+/* First position in sorted run of an element not smaller than key */
+static size_t
+sortLowerBound(void **run, size_t n, void *key, YsortCompareFunc compar)
+{
+  size_t lo = 0;
+  size_t hi = n;
+  size_t mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (compar(&run[mid], &key) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+/* Position in second run matching a position in first one */
+static size_t
+sortSplit(void **a, size_t na, void **b, size_t nb, size_t pos, YsortCompareFunc compar)
+{
+  if (pos == 0) {
+    return 0;
+  }
+  if (pos >= na) {
+    return nb;
+  }
+
+  return sortLowerBound(b, nb, a[pos], compar);
+}
+
+static void
+sortMerge(void **a, size_t na, void **b, size_t nb, void **dst, YsortCompareFunc compar)
+{
+  size_t i = 0;
+  size_t j = 0;
+
+  while (i < na && j < nb) {
+    if (compar(&b[j], &a[i]) < 0) {
+      *dst++ = b[j++];
+    } else {
+      *dst++ = a[i++];
+    }
+  }
+  memcpy(dst, a + i, (na - i) * sizeof(void*));
+  memcpy(dst + (na - i), b + j, (nb - j) * sizeof(void*));
+}
+
+static void
+sortMergePieces(void *arg, size_t begin, size_t end)
+{
+  SortContext *ctx = (SortContext*) arg;
+  size_t pair;
+  size_t part;
+  size_t first;
+  size_t mid;
+  size_t last;
+  size_t na;
+  size_t nb;
+  size_t a0, a1;
+  size_t b0, b1;
+  size_t i;
+
+  for (i = begin; i < end; i++) {
+    pair = i / ctx->parts;
+    part = i % ctx->parts;
+
+    first = pair * 2 * ctx->width;
+    mid = first + ctx->width;
+    if (mid > ctx->n) {
+      mid = ctx->n;
+    }
+    last = mid + ctx->width;
+    if (last > ctx->n) {
+      last = ctx->n;
+    }
+    na = mid - first;
+    nb = last - mid;
+
+    a0 = na * part / ctx->parts;
+    a1 = na * (part + 1) / ctx->parts;
+    b0 = sortSplit(ctx->src + first, na, ctx->src + mid, nb, a0, ctx->compar);
+    b1 = sortSplit(ctx->src + first, na, ctx->src + mid, nb, a1, ctx->compar);
+    if (part == ctx->parts - 1) {
+      /* Whole remainder of second run, even if first one is empty */
+      b1 = nb;
+    }
+
+    sortMerge(ctx->src + first + a0, a1 - a0, ctx->src + mid + b0, b1 - b0,
+              ctx->dst + first + a0 + b0, ctx->compar);
+  }
+}
+
+int
+Ysort_parallel(void **base, size_t n, YsortCompareFunc compar, Ythreadpool *pool)
+{
+  SortContext ctx;
+  void **copy;
+  void **tmp;
+  size_t size;
+  size_t tasks;
+  size_t slices;
+  size_t pairs;
+
+  if (compar == NULL || (base == NULL && n > 0)) {
+    return YOSAL_ERROR;
+  }
+
+  tasks = (size_t) Ythreadpool_size(pool) * SORT_TASKS_PER_WORKER;
+  if (tasks <= SORT_TASKS_PER_WORKER || n < SORT_PARALLEL_MIN) {
+    Ysort(base, n, compar);
+    return YOSAL_OK;
+  }
+
+  size = n * sizeof(void*);
+  if (YMEM_IS_LARGE(size)) {
+    copy = (void**) Ymem_large_alloc(size, YMEM_LARGE_HUGEPAGE);
+  } else {
+    copy = (void**) Ymem_malloc(size);
+  }
+  if (copy == NULL) {
+    Ysort(base, n, compar);
+    return YOSAL_OK;
+  }
+
+  ctx.src = base;
+  ctx.dst = copy;
+  ctx.n = n;
+  ctx.compar = compar;
+
+  slices = tasks;
+  ctx.width = (n + slices - 1) / slices;
+  if (Ythreadpool_parallel_for(pool, 0, slices, 1, sortSlices, &ctx) != YOSAL_OK) {
+    sortSlices(&ctx, 0, slices);
+  }
+
+  for (; ctx.width < n; ctx.width *= 2) {
+    pairs = (n + 2 * ctx.width - 1) / (2 * ctx.width);
+    ctx.parts = (pairs < tasks ? (tasks + pairs - 1) / pairs : 1);
+    if (Ythreadpool_parallel_for(pool, 0, pairs * ctx.parts, 1,
+                                 sortMergePieces, &ctx) != YOSAL_OK) {
+      sortMergePieces(&ctx, 0, pairs * ctx.parts);
+    }
+    tmp = ctx.src;
+    ctx.src = ctx.dst;
+    ctx.dst = tmp;
+  }
+
+  if (ctx.src != base) {
+    memcpy(base, ctx.src, size);
+  }
+
+  if (YMEM_IS_LARGE(size)) {
+    Ymem_large_free(copy, size);
+  } else {
+    Ymem_free(copy);
+  }
+
+  return YOSAL_OK;
+}
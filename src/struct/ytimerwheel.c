@@ -0,0 +1,295 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Hashed timing wheel. Timers are entries of a single array, linked by
+ * index into circular lists, one per slot. The first entries of the array
+ * are the heads of these lists, followed by the head of the list of
+ * expired timers whose function is yet to be called. Identifiers combine
+ * the index of an entry with a generation, bumped every time the entry is
+ * released, so that stale identifiers are told apart.
+ */
+#include "yosal/yosal.h"
+
+#include <string.h>
+
+#define TIMERWHEEL_SLOTS_MAX (1 << 20)
+#define TIMERWHEEL_ENTRIES_MIN 64
+
+typedef struct {
+  /* Tick of expiration */
+  int64_t tick;
+  YtimerwheelFunc func;
+  void *data;
+  int prev;
+  int next;
+  uint32_t generation;
+} YtimerwheelEntry;
+
+struct YtimerwheelStruct {
+  YtimerwheelEntry *entries;
+  int capacity;
+  /* Number of entries in use, including list heads */
+  int used;
+  /* First released entry, linked by next */
+  int spare;
+  int slots;
+  /* Head of list of expired timers */
+  int expired;
+  nsecs_t resolution;
+  /* Last tick whose timers expired */
+  int64_t tick;
+  int count;
+};
+
+static void
+entryUnlink(Ytimerwheel *w, int e)
+{
+  YtimerwheelEntry *entry = &w->entries[e];
+
+  w->entries[entry->prev].next = entry->next;
+  w->entries[entry->next].prev = entry->prev;
+}
+
+/* Append an entry at end of a list */
+static void
+entryAppend(Ytimerwheel *w, int head, int e)
+{
+  int last = w->entries[head].prev;
+
+  w->entries[e].prev = last;
+  w->entries[e].next = head;
+  w->entries[last].next = e;
+  w->entries[head].prev = e;
+}
+
+static int
+entryAlloc(Ytimerwheel *w)
+{
+  YtimerwheelEntry *entries;
+  int capacity;
+  int e;
+
+  if (w->spare >= 0) {
+    e = w->spare;
+    w->spare = w->entries[e].next;
+    return e;
+  }
+
+  if (w->used >= w->capacity) {
+    if (w->capacity > (1 << 28)) {
+      return -1;
+    }
+    capacity = w->capacity * 2;
+    entries = Ymem_realloc_tag(w->entries, capacity * sizeof(YtimerwheelEntry),
+                               YMEM_TAG_QUEUE);
+    if (entries == NULL) {
+      return -1;
+    }
+    w->entries = entries;
+    w->capacity = capacity;
+  }
+
+  e = w->used++;
+  w->entries[e].generation = 0;
+
+  return e;
+}
+
+static void
+entryRelease(Ytimerwheel *w, int e)
+{
+  w->entries[e].generation = (w->entries[e].generation + 1) & 0x7fffffff;
+  w->entries[e].next = w->spare;
+  w->spare = e;
+}
+
+Ytimerwheel*
+Ytimerwheel_create(nsecs_t resolution, int slots, nsecs_t now)
+{
+  Ytimerwheel *w;
+  int size;
+  int i;
+
+  if (resolution <= 0 || slots > TIMERWHEEL_SLOTS_MAX || now < 0) {
+    return NULL;
+  }
+  size = 1;
+  while (size < slots) {
+    size <<= 1;
+  }
+
+  w = Ymem_malloc_tag(sizeof(Ytimerwheel), YMEM_TAG_QUEUE);
+  if (w == NULL) {
+    return NULL;
+  }
+  w->capacity = TIMERWHEEL_ENTRIES_MIN;
+  while (w->capacity < size + 1) {
+    w->capacity *= 2;
+  }
+  w->entries = Ymem_malloc_tag(w->capacity * sizeof(YtimerwheelEntry), YMEM_TAG_QUEUE);
+  if (w->entries == NULL) {
+    Ymem_free(w);
+    return NULL;
+  }
+
+  /* Empty lists point to their own head */
+  w->slots = size;
+  w->expired = size;
+  for (i = 0; i <= size; i++) {
+    memset(&w->entries[i], 0, sizeof(YtimerwheelEntry));
+    w->entries[i].prev = i;
+    w->entries[i].next = i;
+  }
+  w->used = size + 1;
+  w->spare = -1;
+  w->resolution = resolution;
+  w->tick = now / resolution;
+  w->count = 0;
+
+  return w;
+}
+
+int
+Ytimerwheel_release(Ytimerwheel *w)
+{
+  if (w != NULL) {
+    Ymem_free(w->entries);
+    Ymem_free(w);
+  }
+
+  return YOSAL_OK;
+}
+
+YtimerId
+Ytimerwheel_add(Ytimerwheel *w, nsecs_t expire, YtimerwheelFunc func, void *data)
+{
+  YtimerwheelEntry *entry;
+  int64_t tick;
+  int e;
+
+  if (w == NULL || func == NULL) {
+    return -1;
+  }
+
+  e = entryAlloc(w);
+  if (e < 0) {
+    return -1;
+  }
+
+  /* Timers already expired are due at next tick */
+  tick = (expire + w->resolution - 1) / w->resolution;
+  if (expire < 0 || tick <= w->tick) {
+    tick = w->tick + 1;
+  }
+
+  entry = &w->entries[e];
+  entry->tick = tick;
+  entry->func = func;
+  entry->data = data;
+  entryAppend(w, (int) (tick & (w->slots - 1)), e);
+  w->count++;
+
+  return (((YtimerId) entry->generation) << 32) | (YtimerId) e;
+}
+
+int
+Ytimerwheel_cancel(Ytimerwheel *w, YtimerId id)
+{
+  int e;
+
+  if (w == NULL || id < 0) {
+    return YOSAL_ERROR;
+  }
+
+  e = (int) (id & 0xffffffff);
+  if (e <= w->expired || e >= w->used ||
+      w->entries[e].generation != (uint32_t) (id >> 32) ||
+      w->entries[e].func == NULL) {
+    return YOSAL_ERROR;
+  }
+
+  entryUnlink(w, e);
+  w->entries[e].func = NULL;
+  entryRelease(w, e);
+  w->count--;
+
+  return YOSAL_OK;
+}
+
+int
+Ytimerwheel_advance(Ytimerwheel *w, nsecs_t now)
+{
+  YtimerwheelEntry *entry;
+  YtimerwheelFunc func;
+  void *data;
+  int64_t target;
+  int64_t ticks;
+  int64_t t;
+  int slot;
+  int next;
+  int e;
+  int fired;
+
+  if (w == NULL || now < 0) {
+    return 0;
+  }
+
+  target = now / w->resolution;
+  if (target <= w->tick) {
+    return 0;
+  }
+
+  /* Gather expired timers, visiting each slot at most once */
+  ticks = target - w->tick;
+  if (ticks > w->slots) {
+    ticks = w->slots;
+  }
+  for (t = 1; t <= ticks; t++) {
+    slot = (int) ((w->tick + t) & (w->slots - 1));
+    for (e = w->entries[slot].next; e != slot; e = next) {
+      next = w->entries[e].next;
+      if (w->entries[e].tick <= target) {
+        entryUnlink(w, e);
+        entryAppend(w, w->expired, e);
+      }
+    }
+  }
+  w->tick = target;
+
+  /* Functions may add or cancel timers, so that the list is read again
+     after each call */
+  fired = 0;
+  while ((e = w->entries[w->expired].next) != w->expired) {
+    entry = &w->entries[e];
+    func = entry->func;
+    data = entry->data;
+    entryUnlink(w, e);
+    entry->func = NULL;
+    entryRelease(w, e);
+    w->count--;
+    fired++;
+    func(data);
+  }
+
+  return fired;
+}
+
+int
+Ytimerwheel_size(Ytimerwheel *w)
+{
+  if (w == NULL) {
+    return 0;
+  }
+
+  return w->count;
+}
@@ -0,0 +1,499 @@
+/**
+ * Copyright 2013 Yahoo! Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may
+ * obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License. See accompanying LICENSE file.
+ */
+
+/*
+ * Throughput benchmark for Ychannel engines. Each run is reported as one
+ * JSON object per line, for tracking results over time. Bytes and counters
+ * are those of a single pass, throughput is averaged over all passes.
+ */
+#include "yosal/yosal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define BENCH_MB (1024*1024)
+/* Shortest measured time of each run, over as many passes as needed */
+#define BENCH_MIN_NS (100 * YOSAL_NS_PER_MS)
+
+typedef struct {
+  /* File holding input data, and file receiving written data */
+  const char *path;
+  const char *outpath;
+  char *data;
+  size_t length;
+} BenchInput;
+
+/* Engine under test. Add an entry to the engines table for new engines */
+typedef struct {
+  const char *name;
+  Ychannel* (*openread)(BenchInput *input);
+  Ychannel* (*openwrite)(BenchInput *input);
+  void (*close)(Ychannel *channel);
+} BenchEngine;
+
+typedef struct {
+  const char *name;
+  /* Return number of bytes consumed, or written */
+  uint64_t (*run)(Ychannel *channel, char *buf, size_t bufsize, size_t total);
+  YBOOL write;
+} BenchPattern;
+
+static const size_t gBufSizes[] = { 16, 256, 4096, 65536, 1024*1024 };
+
+static int
+usage()
+{
+  fprintf(stderr, "usage: bench-yosal [-s size in MB] [-e engine] [-p pattern]\n");
+
+  return 0;
+}
+
+static Ychannel*
+openByteArray(BenchInput *input)
+{
+  return YchannelInitByteArray(input->data, input->length);
+}
+
+static void
+closeByteArray(Ychannel *channel)
+{
+  /* Input buffer is owned by the benchmark */
+  YchannelResetBuffer(channel);
+  YchannelRelease(channel);
+}
+
+static Ychannel*
+openFdRead(BenchInput *input)
+{
+  Ychannel *channel;
+  int fd;
+
+  fd = open(input->path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  channel = YchannelInitFd(fd, 0);
+  if (channel == NULL) {
+    close(fd);
+    return NULL;
+  }
+  YchannelSetAutoRelease(channel, 1);
+
+  return channel;
+}
+
+static Ychannel*
+openFdWrite(BenchInput *input)
+{
+  Ychannel *channel;
+  int fd;
+
+  fd = open(input->outpath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+  channel = YchannelInitFd(fd, 1);
+  if (channel == NULL) {
+    close(fd);
+    return NULL;
+  }
+  YchannelSetAutoRelease(channel, 1);
+
+  return channel;
+}
+
+static Ychannel*
+openFileWith(const char *path, const char *mode, int writable)
+{
+  Ychannel *channel;
+  FILE *file;
+
+  file = fopen(path, mode);
+  if (file == NULL) {
+    return NULL;
+  }
+  channel = YchannelInitFile(file, writable);
+  if (channel == NULL) {
+    fclose(file);
+    return NULL;
+  }
+  YchannelSetAutoRelease(channel, 1);
+
+  return channel;
+}
+
+static Ychannel*
+openFileRead(BenchInput *input)
+{
+  return openFileWith(input->path, "rb", 0);
+}
+
+static Ychannel*
+openFileWrite(BenchInput *input)
+{
+  return openFileWith(input->outpath, "wb", 1);
+}
+
+static Ychannel*
+openMemoryWrite(BenchInput *input)
+{
+  return YchannelInitMemoryWriter();
+}
+
+static void
+closeGeneric(Ychannel *channel)
+{
+  YchannelFlush(channel);
+  YchannelRelease(channel);
+}
+
+static const BenchEngine gEngines[] = {
+  { "bytearray", openByteArray, NULL, closeByteArray },
+  { "fd", openFdRead, openFdWrite, closeGeneric },
+  { "file", openFileRead, openFileWrite, closeGeneric },
+  { "memory", NULL, openMemoryWrite, closeGeneric },
+};
+
+static uint64_t
+runFetch(Ychannel *channel, char *buf, size_t bufsize, size_t total)
+{
+  uint64_t consumed = 0;
+  const char *chunk;
+  size_t len;
+
+  while ((chunk = YchannelFetch(channel, bufsize, &len)) != NULL && len > 0) {
+    consumed += len;
+  }
+
+  return consumed;
+}
+
+static uint64_t
+runRead(Ychannel *channel, char *buf, size_t bufsize, size_t total)
+{
+  uint64_t consumed = 0;
+  size_t len;
+
+  while ((len = YchannelRead(channel, buf, bufsize)) > 0) {
+    consumed += len;
+  }
+
+  return consumed;
+}
+
+static uint64_t
+runSkip(Ychannel *channel, char *buf, size_t bufsize, size_t total)
+{
+  uint64_t consumed = 0;
+  uint64_t skipped;
+  size_t len;
+
+  /* Sparse access, one byte read after each skip */
+  while (1) {
+    skipped = YchannelSkip(channel, bufsize);
+    consumed += skipped;
+    len = YchannelRead(channel, buf, 1);
+    consumed += len;
+    if (skipped < bufsize || len <= 0) {
+      break;
+    }
+  }
+
+  return consumed;
+}
+
+static uint64_t
+runPush(Ychannel *channel, char *buf, size_t bufsize, size_t total)
+{
+  uint64_t consumed = 0;
+  const char *chunk;
+  size_t half;
+  size_t len;
+
+  /* Look-ahead parser, giving back second half of each fetch */
+  while ((chunk = YchannelFetch(channel, bufsize, &len)) != NULL && len > 0) {
+    half = len / 2;
+    if (half > 0 && YchannelPush(channel, chunk + len - half, half) == half) {
+      len -= half;
+    }
+    consumed += len;
+  }
+
+  return consumed;
+}
+
+static uint64_t
+runWrite(Ychannel *channel, char *buf, size_t bufsize, size_t total)
+{
+  uint64_t written = 0;
+  ssize_t n;
+
+  while (written < total) {
+    n = YchannelWrite(channel, buf, bufsize);
+    if (n <= 0) {
+      break;
+    }
+    written += n;
+  }
+
+  return written;
+}
+
+static const BenchPattern gPatterns[] = {
+  { "fetch", runFetch, YFALSE },
+  { "read", runRead, YFALSE },
+  { "skip", runSkip, YFALSE },
+  { "push", runPush, YFALSE },
+  { "write", runWrite, YTRUE },
+};
+
+/* Number of read and write system calls issued so far, or -1 if unknown */
+static int64_t
+syscallCount()
+{
+  char line[128];
+  long long syscr = -1;
+  long long syscw = -1;
+  FILE *file;
+
+  file = fopen("/proc/self/io", "r");
+  if (file == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (strncmp(line, "syscr:", 6) == 0) {
+      syscr = atoll(line + 6);
+    } else if (strncmp(line, "syscw:", 6) == 0) {
+      syscw = atoll(line + 6);
+    }
+  }
+  fclose(file);
+
+  if (syscr < 0 || syscw < 0) {
+    return -1;
+  }
+
+  return syscr + syscw;
+}
+
+static Ychannel*
+benchOpen(const BenchEngine *engine, const BenchPattern *pattern, BenchInput *input)
+{
+  if (pattern->write) {
+    return (engine->openwrite != NULL ? engine->openwrite(input) : NULL);
+  }
+
+  return (engine->openread != NULL ? engine->openread(input) : NULL);
+}
+
+/* Time passes until BENCH_MIN_NS elapsed, without counters which would
+   time every engine call. Counters are collected by an extra pass. */
+static int
+benchRun(const BenchEngine *engine, const BenchPattern *pattern,
+         BenchInput *input, char *buf, size_t bufsize)
+{
+  Ychannel *channel;
+  YchannelStats stats;
+  uint64_t nbytes;
+  uint64_t total = 0;
+  int64_t syscalls;
+  int64_t syscallsend;
+  nsecs_t start;
+  nsecs_t elapsed;
+  double mb;
+  double seconds;
+  double syscallspermb = -1;
+  int passes = 0;
+
+  /* Counters of a single pass */
+  channel = benchOpen(engine, pattern, input);
+  if (channel == NULL) {
+    return -1;
+  }
+  YchannelEnableStats(channel, YTRUE);
+  nbytes = pattern->run(channel, buf, bufsize, input->length);
+  YchannelGetStats(channel, &stats);
+  engine->close(channel);
+
+  syscalls = syscallCount();
+  start = Ytime(YTIME_CLOCK_MONOTONIC);
+  do {
+    channel = benchOpen(engine, pattern, input);
+    if (channel == NULL) {
+      return -1;
+    }
+    total += pattern->run(channel, buf, bufsize, input->length);
+    engine->close(channel);
+    passes++;
+    elapsed = Ytime(YTIME_CLOCK_MONOTONIC) - start;
+  } while (elapsed < BENCH_MIN_NS);
+  syscallsend = syscallCount();
+
+  mb = (double) total / BENCH_MB;
+  seconds = (double) elapsed / YOSAL_NS_PER_SECOND;
+  if (syscalls >= 0 && syscallsend >= syscalls && mb > 0) {
+    /* Account for the 2 syscalls needed to sample /proc/self/io */
+    syscallspermb = (double) (syscallsend - syscalls - 2) / mb;
+  }
+
+  printf("{\"engine\":\"%s\",\"pattern\":\"%s\",\"bufsize\":%llu,"
+         "\"bytes\":%llu,\"passes\":%d,\"seconds\":%.6f,\"mbps\":%.2f,"
+         "\"syscalls_per_mb\":%.2f,"
+         "\"zerocopy\":%llu,\"copied\":%llu,\"direct\":%llu,"
+         "\"readcalls\":%llu,\"writecalls\":%llu,\"pushallocs\":%llu,"
+         "\"engine_seconds\":%.6f}\n",
+         engine->name, pattern->name, (unsigned long long) bufsize,
+         (unsigned long long) nbytes, passes, seconds, mb / seconds, syscallspermb,
+         (unsigned long long) stats.zerocopy, (unsigned long long) stats.copied,
+         (unsigned long long) stats.direct, (unsigned long long) stats.readcalls,
+         (unsigned long long) stats.writecalls, (unsigned long long) stats.pushallocs,
+         (double) (stats.readtime + stats.writetime) / YOSAL_NS_PER_SECOND);
+  fflush(stdout);
+
+  return 0;
+}
+
+static int
+benchInputCreate(BenchInput *input, size_t length)
+{
+  const char *tmpdir;
+  char path[256];
+  size_t written;
+  size_t i;
+  FILE *file;
+  int fd;
+
+  input->data = (char*) Ymem_malloc(length);
+  if (input->data == NULL) {
+    return YOSAL_ERROR;
+  }
+  for (i = 0; i < length; i++) {
+    input->data[i] = "abcdefghijklmnopqrstuvwxyz0123456789\n"[i % 37];
+  }
+  input->length = length;
+
+  tmpdir = getenv("TMPDIR");
+  if (tmpdir == NULL) {
+    tmpdir = "/tmp";
+  }
+  snprintf(path, sizeof(path), "%s/bench-yosal-XXXXXX", tmpdir);
+  fd = mkstemp(path);
+  if (fd < 0) {
+    return YOSAL_ERROR;
+  }
+  file = fdopen(fd, "wb");
+  if (file == NULL) {
+    close(fd);
+    return YOSAL_ERROR;
+  }
+  written = fwrite(input->data, 1, length, file);
+  fclose(file);
+  if (written != length) {
+    unlink(path);
+    return YOSAL_ERROR;
+  }
+  input->path = Ymem_strdup(path);
+
+  snprintf(path, sizeof(path), "%s.out", input->path);
+  input->outpath = Ymem_strdup(path);
+
+  return YOSAL_OK;
+}
+
+static void
+benchInputRelease(BenchInput *input)
+{
+  if (input->path != NULL) {
+    unlink(input->path);
+    Ymem_free((void*) input->path);
+  }
+  if (input->outpath != NULL) {
+    unlink(input->outpath);
+    Ymem_free((void*) input->outpath);
+  }
+  if (input->data != NULL) {
+    Ymem_free(input->data);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *enginename = NULL;
+  const char *patternname = NULL;
+  BenchInput input;
+  size_t sizemb = 32;
+  size_t maxbufsize;
+  char *buf;
+  int e, p, b;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:e:p:h")) != -1) {
+    switch (opt) {
+    case 's':
+      sizemb = (size_t) atoi(optarg);
+      break;
+    case 'e':
+      enginename = optarg;
+      break;
+    case 'p':
+      patternname = optarg;
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+  if (sizemb <= 0) {
+    usage();
+    return 1;
+  }
+
+  Yosal_init();
+
+  memset(&input, 0, sizeof(input));
+  if (benchInputCreate(&input, sizemb * BENCH_MB) != YOSAL_OK) {
+    fprintf(stderr, "failed to create %u MB benchmark input\n", (unsigned) sizemb);
+    benchInputRelease(&input);
+    return 1;
+  }
+
+  maxbufsize = gBufSizes[sizeof(gBufSizes) / sizeof(gBufSizes[0]) - 1];
+  buf = (char*) Ymem_malloc(maxbufsize);
+  if (buf == NULL) {
+    benchInputRelease(&input);
+    return 1;
+  }
+  memcpy(buf, input.data, maxbufsize < input.length ? maxbufsize : input.length);
+
+  for (e = 0; e < sizeof(gEngines) / sizeof(gEngines[0]); e++) {
+    if (enginename != NULL && strcmp(enginename, gEngines[e].name) != 0) {
+      continue;
+    }
+    for (p = 0; p < sizeof(gPatterns) / sizeof(gPatterns[0]); p++) {
+      if (patternname != NULL && strcmp(patternname, gPatterns[p].name) != 0) {
+        continue;
+      }
+      for (b = 0; b < sizeof(gBufSizes) / sizeof(gBufSizes[0]); b++) {
+        benchRun(&gEngines[e], &gPatterns[p], &input, buf, gBufSizes[b]);
+      }
+    }
+  }
+
+  Ymem_free(buf);
+  benchInputRelease(&input);
+
+  return 0;
+}
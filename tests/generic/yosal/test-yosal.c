@@ -16,6 +16,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
 
 static int
 usage()
@@ -337,6 +341,2693 @@ test_yrandom()
   return 1;
 }
 
+/* Test allocator backend, counting calls into libc */
+static int gTestBackendMallocs = 0;
+static int gTestBackendFrees = 0;
+
+static void*
+testBackendMalloc(size_t size)
+{
+  __sync_fetch_and_add(&gTestBackendMallocs, 1);
+  return malloc(size);
+}
+
+static void*
+testBackendRealloc(void *ptr, size_t size)
+{
+  return realloc(ptr, size);
+}
+
+static void
+testBackendFree(void *ptr)
+{
+  __sync_fetch_and_add(&gTestBackendFrees, 1);
+  free(ptr);
+}
+
+#define TEST_YMEM_THREADS 4
+#define TEST_YMEM_BLOCKS  2000
+
+typedef struct {
+  unsigned char *blocks[TEST_YMEM_BLOCKS];
+  size_t sizes[TEST_YMEM_BLOCKS];
+  int id;
+  int errors;
+} TestYmemThread;
+
+static void*
+testYmemAlloc(void *arg)
+{
+  TestYmemThread *t = (TestYmemThread*) arg;
+  int i;
+
+  for (i = 0; i < TEST_YMEM_BLOCKS; i++) {
+    t->sizes[i] = 1 + (i * 37 + t->id * 101) % 3000;
+    t->blocks[i] = (unsigned char*) Ymem_malloc(t->sizes[i]);
+    if (t->blocks[i] == NULL) {
+      t->errors++;
+      continue;
+    }
+    memset(t->blocks[i], t->id + 1, t->sizes[i]);
+  }
+
+  return NULL;
+}
+
+/* Verify, grow then release blocks allocated by another thread */
+static void*
+testYmemRelease(void *arg)
+{
+  TestYmemThread *t = (TestYmemThread*) arg;
+  unsigned char *block;
+  size_t j;
+  int i;
+
+  for (i = 0; i < TEST_YMEM_BLOCKS; i++) {
+    block = t->blocks[i];
+    if (block == NULL) {
+      continue;
+    }
+    for (j = 0; j < t->sizes[i]; j++) {
+      if (block[j] != t->id + 1) {
+        t->errors++;
+        break;
+      }
+    }
+    if (i % 3 == 0) {
+      block = (unsigned char*) Ymem_realloc(block, t->sizes[i] * 2);
+      if (block == NULL || block[t->sizes[i] - 1] != t->id + 1) {
+        t->errors++;
+      }
+    }
+    Ymem_free(block);
+  }
+
+  return NULL;
+}
+
+/* Backend is set before any allocation, and kept for all other tests */
+static int
+test_ymem_backend()
+{
+  static const YmemBackend backend = {
+    testBackendMalloc, testBackendRealloc, testBackendFree
+  };
+  static const YmemBackend incomplete = { testBackendMalloc, NULL, NULL };
+  void *ptr;
+
+  printf("Test yosal::ymem backend\n");
+
+  YTEST_EXPECT_EQ(Ymem_setbackend(&incomplete), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(Ymem_setbackend(&backend), YOSAL_OK);
+
+  /* Large blocks always reach backend */
+  ptr = Ymem_malloc(64 * 1024);
+  YTEST_EXPECT_TRUE(ptr != NULL);
+  Ymem_free(ptr);
+  YTEST_EXPECT_EQ(gTestBackendMallocs, 1);
+  YTEST_EXPECT_EQ(gTestBackendFrees, 1);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ymem()
+{
+  TestYmemThread *threads;
+  pthread_t tids[TEST_YMEM_THREADS];
+  int i;
+
+  printf("Test yosal::ymem\n");
+
+  threads = (TestYmemThread*) Ymem_calloc(TEST_YMEM_THREADS, sizeof(TestYmemThread));
+  YTEST_ASSERT_TRUE(threads != NULL);
+
+  /* Blocks are released by other threads than the ones allocating them */
+  for (i = 0; i < TEST_YMEM_THREADS; i++) {
+    threads[i].id = i;
+    YTEST_ASSERT_EQ(pthread_create(&tids[i], NULL, testYmemAlloc, &threads[i]), 0);
+  }
+  for (i = 0; i < TEST_YMEM_THREADS; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  for (i = 0; i < TEST_YMEM_THREADS; i++) {
+    YTEST_ASSERT_EQ(pthread_create(&tids[i], NULL, testYmemRelease,
+                                   &threads[(i + 1) % TEST_YMEM_THREADS]), 0);
+  }
+  for (i = 0; i < TEST_YMEM_THREADS; i++) {
+    pthread_join(tids[i], NULL);
+    YTEST_EXPECT_EQ(threads[i].errors, 0);
+  }
+  Ymem_free(threads);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ymem_stats()
+{
+  YmemStats before;
+  YmemStats after;
+  YmemSite sites[4];
+  YBOOL isNew;
+  YhashmapEntry *entry;
+  Yhashmap *map;
+  Ybuffer *buffer;
+  size_t footprint;
+  void *ptr;
+  int tag;
+  int i;
+
+  printf("Test yosal::ymem stats\n");
+
+  tag = Ymem_tag_register("test");
+  YTEST_EXPECT_TRUE(tag >= YMEM_TAG_USER);
+  YTEST_EXPECT_EQ(Ymem_tag_register("test"), tag);
+  YTEST_EXPECT_EQ(Ymem_tag_register("hashmap"), YMEM_TAG_HASHMAP);
+
+  if (Ymem_stats(YMEM_TAG_ALL, &before) == YOSAL_OK) {
+    YTEST_EXPECT_EQ(Ymem_stats(YMEM_TAG_MAX, &before), YOSAL_ERROR);
+
+    /* Live bytes follow allocations, peak keeps their maximum */
+    YTEST_ASSERT_EQ(Ymem_stats(tag, &before), YOSAL_OK);
+    YTEST_EXPECT_EQ(before.live, 0);
+    ptr = Ymem_malloc_tag(1000, tag);
+    YTEST_ASSERT_TRUE(ptr != NULL);
+    ptr = Ymem_realloc(ptr, 3000);
+    YTEST_ASSERT_TRUE(ptr != NULL);
+    YTEST_ASSERT_EQ(Ymem_stats(tag, &after), YOSAL_OK);
+    YTEST_EXPECT_EQ(after.live, 3000);
+    YTEST_EXPECT_EQ(after.peak, 3000);
+    YTEST_EXPECT_EQ(after.allocs, 2);
+    Ymem_free(ptr);
+    YTEST_ASSERT_EQ(Ymem_stats(tag, &after), YOSAL_OK);
+    YTEST_EXPECT_EQ(after.live, 0);
+    YTEST_EXPECT_EQ(after.peak, 3000);
+    YTEST_EXPECT_EQ(after.frees, 2);
+    YTEST_EXPECT_TRUE(strcmp(after.name, "test") == 0);
+
+    /* Every allocation is sampled with a period of one byte */
+    YTEST_EXPECT_EQ(Ymem_stats_sample(1), YOSAL_OK);
+    for (i = 0; i < 10; i++) {
+      ptr = Ymem_malloc(100);
+      Ymem_free(ptr);
+    }
+    YTEST_EXPECT_EQ(Ymem_stats_sample(0), YOSAL_OK);
+    YTEST_ASSERT_TRUE(Ymem_stats_sites(sites, 4) >= 1);
+    YTEST_EXPECT_TRUE(sites[0].site != NULL);
+    YTEST_EXPECT_TRUE(sites[0].bytes >= 1000);
+
+    Ymem_stats_dump();
+  } else {
+    YTEST_EXPECT_EQ(Ymem_stats_sample(1), YOSAL_ERROR);
+    YTEST_EXPECT_EQ(Ymem_stats_sites(sites, 4), 0);
+  }
+
+  /* Containers report memory they hold */
+  map = Yhashmap_create(16);
+  YTEST_ASSERT_TRUE(map != NULL);
+  footprint = Yhashmap_footprint(map);
+  YTEST_EXPECT_TRUE(footprint > 0);
+  entry = Yhashmap_put(map, "key", 3, &isNew);
+  YTEST_ASSERT_TRUE(entry != NULL);
+  Yhashmap_setvalue(entry, "0123456789", 10);
+  YTEST_EXPECT_TRUE(Yhashmap_footprint(map) >= footprint + 13);
+  Yhashmap_release(map);
+
+  buffer = Ybuffer_init(100);
+  YTEST_ASSERT_TRUE(buffer != NULL);
+  YTEST_EXPECT_TRUE(Ybuffer_footprint(buffer) >= 100);
+  for (i = 0; i < 100; i++) {
+    Ybuffer_append(buffer, "0123456789", 10);
+  }
+  YTEST_EXPECT_TRUE(Ybuffer_footprint(buffer) > 1000);
+  Ybuffer_fini(buffer);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ymem_large()
+{
+  const size_t size = 3 * 1024 * 1024;
+  YhashmapEntry *entry;
+  Yhashmap *map;
+  YArray *array;
+  char key[16];
+  char *ptr;
+  size_t i;
+  int n;
+
+  printf("Test yosal::ymem large\n");
+
+  /* Regions are page aligned and zero filled */
+  ptr = (char*) Ymem_large_alloc(size, YMEM_LARGE_HUGEPAGE | YMEM_LARGE_HUGETLB |
+                                 YMEM_LARGE_INTERLEAVE);
+  YTEST_ASSERT_TRUE(ptr != NULL);
+  YTEST_EXPECT_TRUE(Ymem_isaligned(ptr, 4096));
+  for (i = 0; i < size; i += 4096) {
+    YTEST_ASSERT_EQ(ptr[i], 0);
+    ptr[i] = (char) (i >> 12);
+  }
+  ptr = (char*) Ymem_large_realloc(ptr, size, 2 * size, YMEM_LARGE_HUGEPAGE);
+  YTEST_ASSERT_TRUE(ptr != NULL);
+  for (i = 0; i < size; i += 4096) {
+    YTEST_ASSERT_EQ(ptr[i], (char) (i >> 12));
+  }
+  ptr[2 * size - 1] = 1;
+  Ymem_large_free(ptr, 2 * size);
+
+  ptr = (char*) Ymem_large_alloc(10000, 0);
+  YTEST_ASSERT_TRUE(ptr != NULL);
+  memset(ptr, 1, 10000);
+  Ymem_large_free(ptr, 10000);
+
+  /* Containers switch to large allocations above threshold */
+  map = Yhashmap_create(400000);
+  YTEST_ASSERT_TRUE(map != NULL);
+  for (n = 0; n < 1000; n++) {
+    snprintf(key, sizeof(key), "%d", n);
+    entry = Yhashmap_put(map, key, -1, NULL);
+    YTEST_ASSERT_TRUE(entry != NULL);
+  }
+  YTEST_EXPECT_EQ(Yhashmap_size(map), 1000);
+  YTEST_EXPECT_TRUE(Yhashmap_get(map, "999", -1) != NULL);
+  Yhashmap_release(map);
+
+  array = YArray_create();
+  YTEST_ASSERT_TRUE(array != NULL);
+  for (n = 1; n <= 400000; n++) {
+    YTEST_ASSERT_EQ(YArray_append(array, (void*) (intptr_t) n), YOSAL_OK);
+  }
+  YTEST_EXPECT_EQ(YArray_length(array), 400000);
+  YTEST_EXPECT_TRUE(YArray_get(array, 0) == (void*) (intptr_t) 1);
+  YTEST_EXPECT_TRUE(YArray_get(array, 399999) == (void*) (intptr_t) 400000);
+  YArray_release(array);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_yarena()
+{
+  Yarena *arena;
+  YarenaSavepoint savepoint;
+  YarenaSavepoint current;
+  Yhashmap *map;
+  YhashmapEntry *entry;
+  YArray *array;
+  Yqueue *queue;
+  Ybuffer *buffer;
+  char key[16];
+  char *p;
+  char *q;
+  int i;
+  int len;
+
+  printf("Test yosal::yarena\n");
+
+  arena = Yarena_create(1024);
+  YTEST_ASSERT_TRUE(arena != NULL);
+
+  /* Most recent allocation grows in place */
+  p = Yarena_alloc(arena, 16);
+  q = Yarena_realloc(arena, p, 16, 64);
+  YTEST_EXPECT_TRUE(p == q);
+
+  /* Allocations spanning several blocks, suitably aligned */
+  for (i = 0; i < 1000; i++) {
+    p = Yarena_alloc(arena, 1 + i % 100);
+    YTEST_ASSERT_TRUE(p != NULL);
+    YTEST_EXPECT_TRUE(Ymem_isaligned(p, 2 * sizeof(void*)));
+    memset(p, i, 1 + i % 100);
+  }
+  p = Yarena_alloc_aligned(arena, 256, 10);
+  YTEST_EXPECT_TRUE(p != NULL && Ymem_isaligned(p, 256));
+  YTEST_EXPECT_TRUE(Yarena_alloc_aligned(arena, 24, 10) == NULL);
+  p = Yarena_alloc(arena, 100000);
+  YTEST_ASSERT_TRUE(p != NULL);
+  memset(p, 0, 100000);
+  YTEST_EXPECT_STREQ(Yarena_strdup(arena, "arena"), "arena");
+
+  /* Rollback releases everything allocated after savepoint */
+  Yarena_savepoint(arena, &savepoint);
+  for (i = 0; i < 100; i++) {
+    Yarena_alloc(arena, 500);
+  }
+  Yarena_rollback(arena, &savepoint);
+  Yarena_savepoint(arena, &current);
+  YTEST_EXPECT_TRUE(current.block == savepoint.block);
+  YTEST_EXPECT_EQ(current.pos, savepoint.pos);
+
+  Yarena_reset(arena);
+
+  /* Containers allocated from arena */
+  map = Yhashmap_create_arena(arena, 4);
+  YTEST_ASSERT_TRUE(map != NULL);
+  for (i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    entry = Yhashmap_put(map, key, -1, NULL);
+    YTEST_ASSERT_TRUE(entry != NULL);
+    if (i % 10 == 0) {
+      Yhashmap_setvalue(entry, key, -1);
+    }
+  }
+  YTEST_EXPECT_EQ(Yhashmap_size(map), 1000);
+  entry = Yhashmap_get(map, "key500", -1);
+  YTEST_EXPECT_TRUE(entry != NULL);
+  YTEST_EXPECT_MEMEQ(Yhashmap_value(entry, &len), "key500", 6);
+  Yhashmap_remove(map, Yhashmap_get(map, "key10", -1));
+  YTEST_EXPECT_EQ(Yhashmap_size(map), 999);
+  Yhashmap_release(map);
+
+  array = YArray_createArena(arena, 0);
+  YTEST_ASSERT_TRUE(array != NULL);
+  for (i = 0; i < 1000; i++) {
+    YTEST_EXPECT_EQ(YArray_append(array, (void*) (intptr_t) (i + 1)), YOSAL_OK);
+  }
+  YTEST_EXPECT_EQ(YArray_length(array), 1000);
+  YTEST_EXPECT_TRUE(YArray_get(array, 999) == (void*) (intptr_t) 1000);
+  YArray_release(array);
+
+  queue = Yqueue_create_arena(arena);
+  YTEST_ASSERT_TRUE(queue != NULL);
+  for (i = 0; i < 3; i++) {
+    Yqueue_push(queue, (void*) (intptr_t) (i + 1));
+  }
+  YTEST_EXPECT_TRUE(Yqueue_pop(queue) == (void*) (intptr_t) 1);
+  Yqueue_push(queue, (void*) (intptr_t) 4);
+  YTEST_EXPECT_EQ(Yqueue_size(queue), 3);
+  YTEST_EXPECT_TRUE(Yqueue_pop(queue) == (void*) (intptr_t) 2);
+  Yqueue_release(queue);
+
+  buffer = Ybuffer_init_arena(arena, 0);
+  YTEST_ASSERT_TRUE(buffer != NULL);
+  for (i = 0; i < 1000; i++) {
+    Ybuffer_append(buffer, "0123456789", 10);
+  }
+  p = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_EQ(len, 10000);
+  YTEST_EXPECT_EQ(strlen(p), 10000);
+
+  Yarena_release(arena);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+#define TEST_YPOOL_THREADS 4
+#define TEST_YPOOL_OBJECTS 5000
+
+typedef struct {
+  Ypool *pool;
+  void *objs[TEST_YPOOL_OBJECTS];
+  int id;
+  int errors;
+} TestYpoolThread;
+
+static void*
+testYpoolAlloc(void *arg)
+{
+  TestYpoolThread *t = (TestYpoolThread*) arg;
+  int i;
+
+  for (i = 0; i < TEST_YPOOL_OBJECTS; i++) {
+    t->objs[i] = Ypool_alloc(t->pool);
+    if (t->objs[i] == NULL) {
+      t->errors++;
+      continue;
+    }
+    memset(t->objs[i], t->id, 24);
+  }
+
+  return NULL;
+}
+
+static void*
+testYpoolFree(void *arg)
+{
+  TestYpoolThread *t = (TestYpoolThread*) arg;
+  unsigned char *obj;
+  int i;
+
+  for (i = 0; i < TEST_YPOOL_OBJECTS; i++) {
+    obj = (unsigned char*) t->objs[i];
+    if (obj == NULL || obj[0] != t->id || obj[23] != t->id) {
+      t->errors++;
+    }
+    Ypool_free(t->pool, obj);
+  }
+
+  return NULL;
+}
+
+static int
+test_ypool()
+{
+  TestYpoolThread *threads;
+  pthread_t tids[TEST_YPOOL_THREADS];
+  Ypool *pool;
+  void *objs[100];
+  void *obj;
+  int i;
+
+  printf("Test yosal::ypool\n");
+
+  pool = Ypool_create(24);
+  YTEST_ASSERT_TRUE(pool != NULL);
+
+  for (i = 0; i < 100; i++) {
+    objs[i] = Ypool_alloc(pool);
+    YTEST_ASSERT_TRUE(objs[i] != NULL);
+    YTEST_EXPECT_TRUE(Ymem_isaligned(objs[i], 2 * sizeof(void*)));
+    YTEST_EXPECT_TRUE(i == 0 || objs[i] != objs[i - 1]);
+  }
+  obj = objs[99];
+  for (i = 0; i < 100; i++) {
+    Ypool_free(pool, objs[i]);
+  }
+  /* Most recently released object is reused first */
+  YTEST_EXPECT_TRUE(Ypool_alloc(pool) == obj);
+
+  /* Objects released by another thread, on exit of which magazines go
+     back to depot */
+  threads = (TestYpoolThread*) Ymem_calloc(TEST_YPOOL_THREADS, sizeof(TestYpoolThread));
+  YTEST_ASSERT_TRUE(threads != NULL);
+  for (i = 0; i < TEST_YPOOL_THREADS; i++) {
+    threads[i].pool = pool;
+    threads[i].id = i + 1;
+    YTEST_ASSERT_EQ(pthread_create(&tids[i], NULL, testYpoolAlloc, &threads[i]), 0);
+  }
+  for (i = 0; i < TEST_YPOOL_THREADS; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  for (i = 0; i < TEST_YPOOL_THREADS; i++) {
+    YTEST_ASSERT_EQ(pthread_create(&tids[i], NULL, testYpoolFree,
+                                   &threads[(i + 1) % TEST_YPOOL_THREADS]), 0);
+  }
+  for (i = 0; i < TEST_YPOOL_THREADS; i++) {
+    pthread_join(tids[i], NULL);
+    YTEST_EXPECT_EQ(threads[i].errors, 0);
+  }
+  Ymem_free(threads);
+
+  Ypool_release(pool);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+testYqueueCompare(const void *a, const void *b)
+{
+  intptr_t va = (intptr_t) *((void* const*) a);
+  intptr_t vb = (intptr_t) *((void* const*) b);
+
+  return (va > vb) - (va < vb);
+}
+
+static int
+test_yqueue()
+{
+  Yqueue *queue;
+  YqueueRecord *record;
+  void **values;
+  intptr_t expected;
+  int errors;
+  int i;
+
+  printf("Test yosal::yqueue\n");
+
+  queue = Yqueue_create();
+  YTEST_ASSERT_TRUE(queue != NULL);
+  YTEST_EXPECT_TRUE(Yqueue_pop(queue) == NULL);
+  YTEST_EXPECT_TRUE(Yqueue_poplast(queue) == NULL);
+  YTEST_EXPECT_TRUE(Yqueue_first(queue) == NULL);
+
+  /* Insertions at both ends, growing while values wrap around */
+  for (i = 0; i < 100; i++) {
+    YTEST_EXPECT_EQ(Yqueue_push(queue, (void*) (intptr_t) (i + 1)), 2 * i + 1);
+    YTEST_EXPECT_EQ(Yqueue_insert(queue, (void*) (intptr_t) (-i - 1)), 2 * i + 2);
+  }
+  YTEST_EXPECT_EQ(Yqueue_size(queue), 200);
+  YTEST_EXPECT_TRUE(Yqueue_fetch(queue) == (void*) (intptr_t) -100);
+  YTEST_EXPECT_TRUE(Yqueue_fetchlast(queue) == (void*) (intptr_t) 100);
+
+  /* Iteration sees values in order */
+  errors = 0;
+  expected = -100;
+  for (record = Yqueue_first(queue); record != NULL; record = Yqueue_next(queue, record)) {
+    if (Yqueue_value(record) != (void*) expected) {
+      errors++;
+    }
+    expected = (expected == -1 ? 1 : expected + 1);
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  YTEST_EXPECT_EQ(expected, 101);
+
+  /* Copy keeps order, unless sorted */
+  values = Yqueue_array(queue, NULL);
+  YTEST_ASSERT_TRUE(values != NULL);
+  YTEST_EXPECT_TRUE(values[0] == (void*) (intptr_t) -100);
+  YTEST_EXPECT_TRUE(values[199] == (void*) (intptr_t) 100);
+  Ymem_free(values);
+  Yqueue_push(queue, (void*) (intptr_t) 0);
+  values = Yqueue_array(queue, testYqueueCompare);
+  YTEST_ASSERT_TRUE(values != NULL);
+  for (i = 0; i < 201; i++) {
+    if (values[i] != (void*) (intptr_t) (i - 100)) {
+      errors++;
+    }
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  Ymem_free(values);
+
+  /* Removals at both ends */
+  YTEST_EXPECT_TRUE(Yqueue_poplast(queue) == (void*) (intptr_t) 0);
+  for (i = 0; i < 100; i++) {
+    if (Yqueue_pop(queue) != (void*) (intptr_t) (i - 100) ||
+        Yqueue_poplast(queue) != (void*) (intptr_t) (100 - i)) {
+      errors++;
+    }
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  YTEST_EXPECT_EQ(Yqueue_size(queue), 0);
+  YTEST_EXPECT_TRUE(Yqueue_fetch(queue) == NULL);
+  YTEST_EXPECT_TRUE(Yqueue_array(queue, NULL) == NULL);
+
+  /* Queue used as a FIFO keeps its array */
+  for (i = 0; i < 10000; i++) {
+    Yqueue_push(queue, (void*) (intptr_t) i);
+    if (Yqueue_pop(queue) != (void*) (intptr_t) i) {
+      errors++;
+    }
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  Yqueue_release(queue);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+testYheapCompare(const void *a, const void *b)
+{
+  intptr_t va = (intptr_t) a;
+  intptr_t vb = (intptr_t) b;
+
+  return (va > vb) - (va < vb);
+}
+
+#define TEST_YHEAP_VALUES 1000
+
+static int
+test_yheap()
+{
+  Yheap *heap;
+  void *values[TEST_YHEAP_VALUES];
+  int handles[TEST_YHEAP_VALUES];
+  intptr_t previous;
+  intptr_t v;
+  int errors;
+  int handle;
+  int n;
+  int i;
+
+  printf("Test yosal::yheap\n");
+
+  heap = Yheap_create(testYheapCompare);
+  YTEST_ASSERT_TRUE(heap != NULL);
+  YTEST_EXPECT_TRUE(Yheap_pop(heap) == NULL);
+  YTEST_EXPECT_TRUE(Yheap_top(heap) == NULL);
+
+  /* Values come out in order, whatever order they went in */
+  for (i = 0; i < TEST_YHEAP_VALUES; i++) {
+    v = (i * 7919) % TEST_YHEAP_VALUES;
+    handles[v] = Yheap_push(heap, (void*) v);
+    YTEST_EXPECT_TRUE(handles[v] >= 0);
+  }
+  YTEST_EXPECT_EQ(Yheap_size(heap), TEST_YHEAP_VALUES);
+  YTEST_EXPECT_TRUE(Yheap_top(heap) == (void*) (intptr_t) 0);
+  YTEST_EXPECT_TRUE(Yheap_get(heap, handles[500]) == (void*) (intptr_t) 500);
+
+  /* Priorities change through handles */
+  YTEST_EXPECT_EQ(Yheap_update(heap, handles[500], (void*) (intptr_t) -1), YOSAL_OK);
+  YTEST_EXPECT_TRUE(Yheap_top(heap) == (void*) (intptr_t) -1);
+  YTEST_EXPECT_EQ(Yheap_update(heap, handles[500], (void*) (intptr_t) 5000), YOSAL_OK);
+  YTEST_EXPECT_TRUE(Yheap_remove(heap, handles[0]) == (void*) (intptr_t) 0);
+  YTEST_EXPECT_TRUE(Yheap_remove(heap, handles[0]) == NULL);
+  YTEST_EXPECT_EQ(Yheap_update(heap, handles[0], NULL), YOSAL_ERROR);
+  YTEST_EXPECT_TRUE(Yheap_top(heap) == (void*) (intptr_t) 1);
+
+  /* Smallest values, in order */
+  n = Yheap_popbatch(heap, values, 10);
+  YTEST_EXPECT_EQ(n, 10);
+  YTEST_EXPECT_TRUE(values[0] == (void*) (intptr_t) 1);
+  YTEST_EXPECT_TRUE(values[9] == (void*) (intptr_t) 10);
+
+  /* Handles of removed values are reused */
+  handle = Yheap_push(heap, (void*) (intptr_t) 3);
+  YTEST_EXPECT_TRUE(handle >= 0 && handle < TEST_YHEAP_VALUES);
+  YTEST_EXPECT_TRUE(Yheap_get(heap, handle) == (void*) (intptr_t) 3);
+
+  errors = 0;
+  previous = -1;
+  while (Yheap_size(heap) > 0) {
+    v = (intptr_t) Yheap_pop(heap);
+    if (v < previous) {
+      errors++;
+    }
+    previous = v;
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  YTEST_EXPECT_EQ(previous, 5000);
+
+  /* Bulk insertion, into an empty heap then into a larger one */
+  for (i = 0; i < TEST_YHEAP_VALUES; i++) {
+    values[i] = (void*) (intptr_t) (TEST_YHEAP_VALUES - i);
+  }
+  YTEST_EXPECT_EQ(Yheap_pushbatch(heap, values, TEST_YHEAP_VALUES, handles), YOSAL_OK);
+  YTEST_EXPECT_TRUE(Yheap_get(heap, handles[0]) == (void*) (intptr_t) TEST_YHEAP_VALUES);
+  YTEST_EXPECT_EQ(Yheap_pushbatch(heap, values, 10, NULL), YOSAL_OK);
+  YTEST_EXPECT_EQ(Yheap_size(heap), TEST_YHEAP_VALUES + 10);
+  previous = 0;
+  while (Yheap_size(heap) > 0) {
+    v = (intptr_t) Yheap_pop(heap);
+    if (v < previous) {
+      errors++;
+    }
+    previous = v;
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  Yheap_release(heap);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+typedef struct {
+  Ytimerwheel *wheel;
+  YtimerId cancel;
+  int fired;
+} TestTimer;
+
+static void
+testTimerFire(void *data)
+{
+  TestTimer *timer = (TestTimer*) data;
+
+  timer->fired++;
+  if (timer->cancel >= 0) {
+    Ytimerwheel_cancel(timer->wheel, timer->cancel);
+  }
+}
+
+static int
+test_ytimerwheel()
+{
+  Ytimerwheel *wheel;
+  TestTimer timers[100];
+  YtimerId ids[100];
+  int errors;
+  int i;
+
+  printf("Test yosal::ytimerwheel\n");
+
+  /* 1ms ticks, wheel covering 64ms */
+  wheel = Ytimerwheel_create(1000000, 64, 5000000);
+  YTEST_ASSERT_TRUE(wheel != NULL);
+  memset(timers, 0, sizeof(timers));
+  for (i = 0; i < 100; i++) {
+    timers[i].wheel = wheel;
+    timers[i].cancel = -1;
+    /* Some timers expire beyond a full turn of the wheel */
+    ids[i] = Ytimerwheel_add(wheel, 5000000 + (i + 1) * 1500000, testTimerFire, &timers[i]);
+    YTEST_EXPECT_TRUE(ids[i] >= 0);
+  }
+  YTEST_EXPECT_EQ(Ytimerwheel_size(wheel), 100);
+  YTEST_EXPECT_EQ(Ytimerwheel_cancel(wheel, ids[10]), YOSAL_OK);
+  YTEST_EXPECT_EQ(Ytimerwheel_cancel(wheel, ids[10]), YOSAL_ERROR);
+
+  /* Expiration is rounded up to the next tick */
+  YTEST_EXPECT_EQ(Ytimerwheel_advance(wheel, 6400000), 0);
+  YTEST_EXPECT_EQ(Ytimerwheel_advance(wheel, 7000000), 1);
+  YTEST_EXPECT_EQ(timers[0].fired, 1);
+
+  /* A timer may cancel another one expiring at the same time */
+  timers[1].cancel = ids[2];
+  YTEST_EXPECT_EQ(Ytimerwheel_advance(wheel, 9500000), 1);
+  YTEST_EXPECT_EQ(timers[2].fired, 0);
+  YTEST_EXPECT_EQ(Ytimerwheel_cancel(wheel, ids[2]), YOSAL_ERROR);
+
+  /* Jumping over many turns expires every due timer */
+  YTEST_EXPECT_EQ(Ytimerwheel_advance(wheel, 5000000 + 50 * 1500000), 46);
+  YTEST_EXPECT_EQ(Ytimerwheel_advance(wheel, 5000000 + 200 * 1500000), 50);
+  YTEST_EXPECT_EQ(Ytimerwheel_size(wheel), 0);
+  errors = 0;
+  for (i = 0; i < 100; i++) {
+    if (timers[i].fired != (i == 2 || i == 10 ? 0 : 1)) {
+      errors++;
+    }
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+
+  /* Identifiers are not reused, past timers expire at next tick */
+  YTEST_EXPECT_EQ(Ytimerwheel_cancel(wheel, ids[0]), YOSAL_ERROR);
+  ids[0] = Ytimerwheel_add(wheel, 0, testTimerFire, &timers[0]);
+  YTEST_EXPECT_TRUE(ids[0] >= 0);
+  YTEST_EXPECT_EQ(Ytimerwheel_cancel(wheel, ids[1]), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(Ytimerwheel_advance(wheel, 5000000 + 201 * 1500000), 1);
+  YTEST_EXPECT_EQ(timers[0].fired, 2);
+  Ytimerwheel_release(wheel);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+#define TEST_CQUEUE_THREADS 4
+#define TEST_CQUEUE_VALUES 20000
+
+typedef struct {
+  YqueueConcurrent *queue;
+  int id;
+  int count;
+  long long sum;
+  int errors;
+} TestCqueueThread;
+
+static void*
+testCqueueProduce(void *arg)
+{
+  TestCqueueThread *thread = (TestCqueueThread*) arg;
+  void *batch[8];
+  intptr_t base = (intptr_t) thread->id * TEST_CQUEUE_VALUES;
+  int i = 0;
+  int j;
+  int n;
+
+  while (i < TEST_CQUEUE_VALUES) {
+    if (i % 16 == 0 && i + 8 <= TEST_CQUEUE_VALUES) {
+      /* Values pushed by batch remain ordered */
+      for (j = 0; j < 8; j++) {
+        batch[j] = (void*) (base + i + j + 1);
+      }
+      n = Yqueue_concurrent_pushbatch(thread->queue, batch, 8);
+      i += n;
+      if (n < 8) {
+        continue;
+      }
+    } else {
+      if (Yqueue_concurrent_push(thread->queue, (void*) (base + i + 1), -1) != YOSAL_OK) {
+        thread->errors++;
+        break;
+      }
+      i++;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+testCqueueCheck(TestCqueueThread *thread, intptr_t *last, void *value)
+{
+  intptr_t v = (intptr_t) value - 1;
+  int producer = (int) (v / TEST_CQUEUE_VALUES);
+
+  /* Each consumer sees values of a producer in order */
+  if (producer < 0 || producer >= TEST_CQUEUE_THREADS || v <= last[producer]) {
+    thread->errors++;
+    return;
+  }
+  last[producer] = v;
+  thread->count++;
+  thread->sum += v + 1;
+}
+
+static void*
+testCqueueConsume(void *arg)
+{
+  TestCqueueThread *thread = (TestCqueueThread*) arg;
+  intptr_t last[TEST_CQUEUE_THREADS];
+  void *batch[8];
+  void *value;
+  int i;
+  int n;
+
+  for (i = 0; i < TEST_CQUEUE_THREADS; i++) {
+    last[i] = -1;
+  }
+
+  for (;;) {
+    n = Yqueue_concurrent_popbatch(thread->queue, batch, 8);
+    for (i = 0; i < n; i++) {
+      testCqueueCheck(thread, last, batch[i]);
+    }
+    if (n > 0) {
+      continue;
+    }
+    if (Yqueue_concurrent_pop(thread->queue, &value, -1) != YOSAL_OK) {
+      /* Closed and empty */
+      break;
+    }
+    testCqueueCheck(thread, last, value);
+  }
+
+  return NULL;
+}
+
+static int
+test_yqueue_concurrent()
+{
+  TestCqueueThread producers[TEST_CQUEUE_THREADS];
+  TestCqueueThread consumers[TEST_CQUEUE_THREADS];
+  pthread_t tids[2 * TEST_CQUEUE_THREADS];
+  YqueueConcurrent *queue;
+  void *values[8];
+  void *value;
+  long long sum = 0;
+  int count = 0;
+  int i;
+
+  printf("Test yosal::yqueue concurrent\n");
+
+  YTEST_EXPECT_TRUE(Yqueue_concurrent_create(0) == NULL);
+  YTEST_EXPECT_TRUE(Yqueue_concurrent_create(-1) == NULL);
+
+  /* Capacity is rounded up to a power of 2 */
+  queue = Yqueue_concurrent_create(3);
+  YTEST_ASSERT_TRUE(queue != NULL);
+  for (i = 0; i < 4; i++) {
+    YTEST_EXPECT_EQ(Yqueue_concurrent_trypush(queue, (void*) (intptr_t) (i + 1)), YOSAL_OK);
+  }
+  YTEST_EXPECT_EQ(Yqueue_concurrent_trypush(queue, (void*) (intptr_t) 5), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_push(queue, (void*) (intptr_t) 5, 10), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_size(queue), 4);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_trypop(queue, &value), YOSAL_OK);
+  YTEST_EXPECT_TRUE(value == (void*) (intptr_t) 1);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_popbatch(queue, values, 8), 3);
+  YTEST_EXPECT_TRUE(values[0] == (void*) (intptr_t) 2);
+  YTEST_EXPECT_TRUE(values[2] == (void*) (intptr_t) 4);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_trypop(queue, &value), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_pop(queue, &value, 10), YOSAL_ERROR);
+  /* Batch insertion stops once full */
+  YTEST_EXPECT_EQ(Yqueue_concurrent_pushbatch(queue, values, 8), 4);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_close(queue), YOSAL_OK);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_popbatch(queue, values, 2), 2);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_trypush(queue, (void*) (intptr_t) 5), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_pop(queue, &value, -1), YOSAL_OK);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_pop(queue, &value, -1), YOSAL_OK);
+  YTEST_EXPECT_EQ(Yqueue_concurrent_pop(queue, &value, -1), YOSAL_ERROR);
+  Yqueue_concurrent_release(queue);
+
+  /* Small queue forces producers and consumers to block on each other */
+  queue = Yqueue_concurrent_create(64);
+  YTEST_ASSERT_TRUE(queue != NULL);
+  memset(producers, 0, sizeof(producers));
+  memset(consumers, 0, sizeof(consumers));
+  for (i = 0; i < TEST_CQUEUE_THREADS; i++) {
+    consumers[i].queue = queue;
+    consumers[i].id = i;
+    YTEST_ASSERT_EQ(pthread_create(&tids[i], NULL, testCqueueConsume, &consumers[i]), 0);
+  }
+  for (i = 0; i < TEST_CQUEUE_THREADS; i++) {
+    producers[i].queue = queue;
+    producers[i].id = i;
+    YTEST_ASSERT_EQ(pthread_create(&tids[TEST_CQUEUE_THREADS + i], NULL,
+                                   testCqueueProduce, &producers[i]), 0);
+  }
+  for (i = 0; i < TEST_CQUEUE_THREADS; i++) {
+    pthread_join(tids[TEST_CQUEUE_THREADS + i], NULL);
+    YTEST_EXPECT_EQ(producers[i].errors, 0);
+  }
+  Yqueue_concurrent_close(queue);
+  for (i = 0; i < TEST_CQUEUE_THREADS; i++) {
+    pthread_join(tids[i], NULL);
+    YTEST_EXPECT_EQ(consumers[i].errors, 0);
+    count += consumers[i].count;
+    sum += consumers[i].sum;
+  }
+  YTEST_EXPECT_EQ(count, TEST_CQUEUE_THREADS * TEST_CQUEUE_VALUES);
+  count = TEST_CQUEUE_THREADS * TEST_CQUEUE_VALUES;
+  YTEST_EXPECT_TRUE(sum == ((long long) count * (count + 1)) / 2);
+  Yqueue_concurrent_release(queue);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+#define TEST_YRING_VALUES 100000
+
+static void*
+testYringProduce(void *arg)
+{
+  Yring *ring = (Yring*) arg;
+  void *values[7];
+  int next = 1;
+  int n;
+  int i;
+
+  /* Alternate single and batch insertions */
+  while (next <= TEST_YRING_VALUES) {
+    if (next % 2) {
+      if (Yring_push(ring, (void*) (intptr_t) next) == YOSAL_OK) {
+        next++;
+        continue;
+      }
+    } else {
+      for (i = 0; i < 7 && next + i <= TEST_YRING_VALUES; i++) {
+        values[i] = (void*) (intptr_t) (next + i);
+      }
+      n = Yring_pushbatch(ring, values, i);
+      if (n > 0) {
+        next += n;
+        continue;
+      }
+    }
+    sched_yield();
+  }
+
+  return NULL;
+}
+
+static int
+test_yring()
+{
+  pthread_t tid;
+  Yring *ring;
+  Ybytering *bytering;
+  void *values[8];
+  void *value;
+  char buf[16];
+  int expected;
+  int errors;
+  int n;
+  int i;
+
+  printf("Test yosal::yring\n");
+
+  YTEST_EXPECT_TRUE(Yring_create(0) == NULL);
+  YTEST_EXPECT_TRUE(Ybytering_create(-1) == NULL);
+
+  /* Capacity is rounded up to a power of 2 */
+  ring = Yring_create(3);
+  YTEST_ASSERT_TRUE(ring != NULL);
+  YTEST_EXPECT_EQ(Yring_pop(ring, &value), YOSAL_ERROR);
+  for (i = 0; i < 4; i++) {
+    YTEST_EXPECT_EQ(Yring_push(ring, (void*) (intptr_t) (i + 1)), YOSAL_OK);
+  }
+  YTEST_EXPECT_EQ(Yring_push(ring, (void*) (intptr_t) 5), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(Yring_size(ring), 4);
+  YTEST_EXPECT_EQ(Yring_pop(ring, &value), YOSAL_OK);
+  YTEST_EXPECT_TRUE(value == (void*) (intptr_t) 1);
+  /* Batch insertion wraps around end of ring, and stops once full */
+  values[0] = (void*) (intptr_t) 5;
+  values[1] = (void*) (intptr_t) 6;
+  YTEST_EXPECT_EQ(Yring_pushbatch(ring, values, 2), 1);
+  YTEST_EXPECT_EQ(Yring_popbatch(ring, values, 8), 4);
+  YTEST_EXPECT_TRUE(values[0] == (void*) (intptr_t) 2);
+  YTEST_EXPECT_TRUE(values[3] == (void*) (intptr_t) 5);
+  YTEST_EXPECT_EQ(Yring_size(ring), 0);
+  Yring_release(ring);
+
+  /* Values are received in order from another thread */
+  ring = Yring_create(64);
+  YTEST_ASSERT_TRUE(ring != NULL);
+  YTEST_ASSERT_EQ(pthread_create(&tid, NULL, testYringProduce, ring), 0);
+  expected = 1;
+  errors = 0;
+  while (expected <= TEST_YRING_VALUES) {
+    n = Yring_popbatch(ring, values, 1 + expected % 8);
+    if (n == 0) {
+      sched_yield();
+      continue;
+    }
+    for (i = 0; i < n; i++) {
+      if (values[i] != (void*) (intptr_t) expected) {
+        errors++;
+      }
+      expected++;
+    }
+  }
+  pthread_join(tid, NULL);
+  YTEST_EXPECT_EQ(errors, 0);
+  YTEST_EXPECT_EQ(Yring_pop(ring, &value), YOSAL_ERROR);
+  Yring_release(ring);
+
+  /* Bytes wrap around end of ring */
+  bytering = Ybytering_create(8);
+  YTEST_ASSERT_TRUE(bytering != NULL);
+  YTEST_EXPECT_EQ(Ybytering_writable(bytering), 8);
+  YTEST_EXPECT_EQ(Ybytering_write(bytering, "abcdef", 6), 6);
+  YTEST_EXPECT_EQ(Ybytering_read(bytering, buf, 4), 4);
+  YTEST_EXPECT_TRUE(memcmp(buf, "abcd", 4) == 0);
+  YTEST_EXPECT_EQ(Ybytering_write(bytering, "ghijklmnop", 10), 6);
+  YTEST_EXPECT_EQ(Ybytering_writable(bytering), 0);
+  YTEST_EXPECT_EQ(Ybytering_readable(bytering), 8);
+  YTEST_EXPECT_EQ(Ybytering_read(bytering, buf, sizeof(buf)), 8);
+  YTEST_EXPECT_TRUE(memcmp(buf, "efghijkl", 8) == 0);
+  YTEST_EXPECT_EQ(Ybytering_read(bytering, buf, sizeof(buf)), 0);
+  Ybytering_release(bytering);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+#define TEST_THREADPOOL_TASKS 10000
+#define TEST_THREADPOOL_DEPTH 10
+#define TEST_THREADPOOL_RANGE 1000000
+
+static void
+testThreadpoolCount(void *arg)
+{
+  __sync_fetch_and_add((int*) arg, 1);
+}
+
+typedef struct {
+  Ythreadpool *pool;
+  int depth;
+  int *count;
+} TestThreadpoolNode;
+
+/* Each task waits for two subtasks, down to a given depth */
+static void
+testThreadpoolTree(void *arg)
+{
+  TestThreadpoolNode *node = (TestThreadpoolNode*) arg;
+  TestThreadpoolNode children[2];
+  Ytaskgroup *group;
+  int i;
+
+  __sync_fetch_and_add(node->count, 1);
+  if (node->depth == 0) {
+    return;
+  }
+
+  group = Ytaskgroup_create(node->pool);
+  if (group == NULL) {
+    return;
+  }
+  for (i = 0; i < 2; i++) {
+    children[i].pool = node->pool;
+    children[i].depth = node->depth - 1;
+    children[i].count = node->count;
+    Ythreadpool_submit(node->pool, group, testThreadpoolTree, &children[i]);
+  }
+  Ytaskgroup_release(group);
+}
+
+static void
+testThreadpoolRange(void *arg, size_t begin, size_t end)
+{
+  unsigned char *visited = (unsigned char*) arg;
+  size_t i;
+
+  for (i = begin; i < end; i++) {
+    visited[i]++;
+  }
+}
+
+static int
+test_ythreadpool()
+{
+  Ythreadpool *pool;
+  Ytaskgroup *group;
+  TestThreadpoolNode root;
+  unsigned char *visited;
+  int count;
+  int errors;
+  int i;
+
+  printf("Test yosal::ythreadpool\n");
+
+  pool = Ythreadpool_create(4, YTHREADPOOL_AFFINITY);
+  YTEST_ASSERT_TRUE(pool != NULL);
+  YTEST_EXPECT_EQ(Ythreadpool_size(pool), 4);
+
+  /* Tasks submitted from outside of pool */
+  count = 0;
+  group = Ytaskgroup_create(pool);
+  YTEST_ASSERT_TRUE(group != NULL);
+  for (i = 0; i < TEST_THREADPOOL_TASKS; i++) {
+    YTEST_ASSERT_EQ(Ythreadpool_submit(pool, group, testThreadpoolCount, &count), YOSAL_OK);
+  }
+  YTEST_EXPECT_EQ(Ytaskgroup_wait(group), YOSAL_OK);
+  YTEST_EXPECT_EQ(__atomic_load_n(&count, __ATOMIC_ACQUIRE), TEST_THREADPOOL_TASKS);
+  Ytaskgroup_release(group);
+
+  /* Tasks waiting for their own subtasks */
+  count = 0;
+  root.pool = pool;
+  root.depth = TEST_THREADPOOL_DEPTH;
+  root.count = &count;
+  group = Ytaskgroup_create(pool);
+  YTEST_ASSERT_TRUE(group != NULL);
+  YTEST_ASSERT_EQ(Ythreadpool_submit(pool, group, testThreadpoolTree, &root), YOSAL_OK);
+  Ytaskgroup_release(group);
+  YTEST_EXPECT_EQ(count, (1 << (TEST_THREADPOOL_DEPTH + 1)) - 1);
+
+  /* Every index is visited exactly once */
+  visited = Ymem_calloc(TEST_THREADPOOL_RANGE, 1);
+  YTEST_ASSERT_TRUE(visited != NULL);
+  YTEST_EXPECT_EQ(Ythreadpool_parallel_for(pool, 0, TEST_THREADPOOL_RANGE, 0,
+                                           testThreadpoolRange, visited), YOSAL_OK);
+  YTEST_EXPECT_EQ(Ythreadpool_parallel_for(pool, 10, TEST_THREADPOOL_RANGE, 1000,
+                                           testThreadpoolRange, visited), YOSAL_OK);
+  YTEST_EXPECT_EQ(Ythreadpool_parallel_for(NULL, 0, 10, 0,
+                                           testThreadpoolRange, visited), YOSAL_OK);
+  errors = 0;
+  for (i = 0; i < TEST_THREADPOOL_RANGE; i++) {
+    if (visited[i] != 2) {
+      errors++;
+    }
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  Ymem_free(visited);
+
+  /* Pending tasks are run before release */
+  count = 0;
+  for (i = 0; i < TEST_THREADPOOL_TASKS; i++) {
+    YTEST_ASSERT_EQ(Ythreadpool_submit(pool, NULL, testThreadpoolCount, &count), YOSAL_OK);
+  }
+  Ythreadpool_release(pool);
+  YTEST_EXPECT_EQ(count, TEST_THREADPOOL_TASKS);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+#define TEST_YSORT_INT_LESS(a, b) ((a) < (b))
+
+YSORT_DEFINE(testSortInts, int, TEST_YSORT_INT_LESS)
+
+#define TEST_YSORT_VALUES 100000
+
+static int
+testYsortCompare(const void *a, const void *b)
+{
+  intptr_t va = (intptr_t) *((void* const*) a);
+  intptr_t vb = (intptr_t) *((void* const*) b);
+
+  return (va > vb) - (va < vb);
+}
+
+typedef struct {
+  int id;
+  const char *name;
+} TestYsortRecord;
+
+static int
+testYsortCompareRecord(const void *a, const void *b)
+{
+  const TestYsortRecord *ra = *((const TestYsortRecord* const*) a);
+  const TestYsortRecord *rb = *((const TestYsortRecord* const*) b);
+
+  return (ra->id > rb->id) - (ra->id < rb->id);
+}
+
+/* Compare an integer key with a record */
+static int
+testYsortCompareId(const void *key, const void *element)
+{
+  int id = *(*((const int* const*) key));
+  const TestYsortRecord *r = *((const TestYsortRecord* const*) element);
+
+  return (id > r->id) - (id < r->id);
+}
+
+static int
+test_ysort()
+{
+  TestYsortRecord records[3] = { { 10, "ten" }, { 20, "twenty" }, { 30, "thirty" } };
+  Ythreadpool *pool;
+  YArray *array;
+  int *ints;
+  int id;
+  uint32_t seed = 1;
+  long long sum;
+  long long sorted;
+  int errors;
+  int pass;
+  int i;
+
+  printf("Test yosal::ysort\n");
+
+  /* Random, descending, and mostly equal integers */
+  ints = Ymem_malloc(TEST_YSORT_VALUES * sizeof(int));
+  YTEST_ASSERT_TRUE(ints != NULL);
+  errors = 0;
+  for (pass = 0; pass < 3; pass++) {
+    for (i = 0; i < TEST_YSORT_VALUES; i++) {
+      seed = seed * 1103515245 + 12345;
+      if (pass == 0) {
+        ints[i] = (int) (seed >> 8);
+      } else if (pass == 1) {
+        ints[i] = TEST_YSORT_VALUES - i;
+      } else {
+        ints[i] = (seed >> 16) % 3;
+      }
+    }
+    testSortInts(ints, TEST_YSORT_VALUES);
+    for (i = 1; i < TEST_YSORT_VALUES; i++) {
+      if (ints[i - 1] > ints[i]) {
+        errors++;
+      }
+    }
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  Ymem_free(ints);
+
+  /* Sort and search an array of pointers */
+  array = YArray_create();
+  YTEST_ASSERT_TRUE(array != NULL);
+  for (i = 0; i < 1000; i++) {
+    YArray_append(array, (void*) (intptr_t) (((i * 7919) % 1000) * 2 + 1));
+  }
+  YArray_append(array, (void*) (intptr_t) 501);
+  YTEST_EXPECT_EQ(YArray_sort(array, testYsortCompare), YOSAL_OK);
+  YTEST_EXPECT_TRUE(YArray_get(array, 0) == (void*) (intptr_t) 1);
+  YTEST_EXPECT_TRUE(YArray_get(array, 1000) == (void*) (intptr_t) 1999);
+  YTEST_EXPECT_EQ(YArray_bsearch(array, (void*) (intptr_t) 1, testYsortCompare), 0);
+  YTEST_EXPECT_EQ(YArray_bsearch(array, (void*) (intptr_t) 501, testYsortCompare), 250);
+  YTEST_EXPECT_EQ(YArray_bsearch(array, (void*) (intptr_t) 1999, testYsortCompare), 1000);
+  YTEST_EXPECT_EQ(YArray_bsearch(array, (void*) (intptr_t) 500, testYsortCompare), -1);
+  YTEST_EXPECT_EQ(YArray_bsearch(array, (void*) (intptr_t) 2001, testYsortCompare), -1);
+  YArray_release(array);
+
+  /* Search with a key of another type than elements */
+  array = YArray_create();
+  YTEST_ASSERT_TRUE(array != NULL);
+  for (i = 0; i < 3; i++) {
+    YArray_append(array, &records[2 - i]);
+  }
+  YTEST_EXPECT_EQ(YArray_sort(array, testYsortCompareRecord), YOSAL_OK);
+  id = 20;
+  YTEST_EXPECT_EQ(YArray_bsearch(array, &id, testYsortCompareId), 1);
+  id = 30;
+  YTEST_EXPECT_EQ(YArray_bsearch(array, &id, testYsortCompareId), 2);
+  id = 15;
+  YTEST_EXPECT_EQ(YArray_bsearch(array, &id, testYsortCompareId), -1);
+  YArray_release(array);
+
+  /* Parallel sort gives a sorted permutation */
+  pool = Ythreadpool_create(4, 0);
+  YTEST_ASSERT_TRUE(pool != NULL);
+  array = YArray_createLength(TEST_YSORT_VALUES);
+  YTEST_ASSERT_TRUE(array != NULL);
+  sum = 0;
+  for (i = 0; i < TEST_YSORT_VALUES; i++) {
+    seed = seed * 1103515245 + 12345;
+    /* Many duplicates, to cover splits of merges at equal elements */
+    YArray_append(array, (void*) (intptr_t) ((seed >> 12) % 5000 + 1));
+    sum += (seed >> 12) % 5000 + 1;
+  }
+  YTEST_EXPECT_EQ(YArray_sortParallel(array, testYsortCompare, pool), YOSAL_OK);
+  sorted = 0;
+  for (i = 0; i < TEST_YSORT_VALUES; i++) {
+    sorted += (intptr_t) YArray_get(array, i);
+    if (i > 0 && YArray_get(array, i - 1) > YArray_get(array, i)) {
+      errors++;
+    }
+  }
+  YTEST_EXPECT_EQ(errors, 0);
+  YTEST_EXPECT_TRUE(sorted == sum);
+  YArray_release(array);
+  Ythreadpool_release(pool);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ybuffer()
+{
+  Ybuffer *buffer;
+  struct iovec iov[16];
+  char line[32];
+  char *data;
+  int niov;
+  int len;
+  int i;
+  size_t total;
+
+  printf("Test yosal::ybuffer\n");
+
+  /* Contiguous buffer, grown from many small appends */
+  buffer = Ybuffer_init(0);
+  YTEST_ASSERT_TRUE(buffer != NULL);
+  for (i = 0; i < 10000; i++) {
+    YTEST_EXPECT_EQ(Ybuffer_append_format(buffer, "%08d\n", i), 9);
+  }
+  YTEST_EXPECT_EQ(Ybuffer_length(buffer), 90000);
+  YTEST_EXPECT_EQ(Ybuffer_iovec(buffer, iov, 16), 1);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_EQ(len, 90000);
+  YTEST_EXPECT_MEMEQ(data + len - 9, "00009999\n", 9);
+  Ymem_free(data);
+
+  /* Small rope, detached without copy */
+  buffer = Ybuffer_init_rope(1024);
+  YTEST_ASSERT_TRUE(buffer != NULL);
+  YTEST_EXPECT_EQ(Ybuffer_append(buffer, "value=", -1), 6);
+  YTEST_EXPECT_EQ(Ybuffer_append_integer(buffer, -42), 3);
+  YTEST_EXPECT_EQ(Ybuffer_iovec(buffer, iov, 16), 1);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_EQ(len, 9);
+  YTEST_EXPECT_STREQ(data, "value=-42");
+  Ymem_free(data);
+
+  /* Large rope, exported as iovec then flattened */
+  buffer = Ybuffer_init_rope(16 * 1024);
+  for (i = 0; i < 10000; i++) {
+    snprintf(line, sizeof(line), "%08d\n", i);
+    if (i % 2 == 0) {
+      YTEST_EXPECT_EQ(Ybuffer_append(buffer, line, 9), 9);
+    } else {
+      YTEST_EXPECT_EQ(Ybuffer_append_format(buffer, "%s", line), 9);
+    }
+  }
+  niov = Ybuffer_iovec(buffer, iov, 16);
+  YTEST_EXPECT_TRUE(niov > 1 && niov <= 16);
+  total = 0;
+  for (i = 0; i < niov; i++) {
+    total += iov[i].iov_len;
+  }
+  YTEST_EXPECT_EQ(total, 90000);
+  YTEST_EXPECT_EQ(Ybuffer_length(buffer), 90000);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_EQ(len, 90000);
+  YTEST_EXPECT_EQ(strlen(data), 90000);
+  for (i = 0; i < 10000; i++) {
+    snprintf(line, sizeof(line), "%08d\n", i);
+    if (memcmp(data + i * 9, line, 9) != 0) {
+      break;
+    }
+  }
+  YTEST_EXPECT_EQ(i, 10000);
+  Ymem_free(data);
+
+  /* Growing rope doubles chunks up to largest size, also after reset */
+  buffer = Ybuffer_init_rope_growing(1024, 8192);
+  YTEST_ASSERT_TRUE(buffer != NULL);
+  memset(line, 'r', sizeof(line));
+  for (i = 0; i < 10000; i++) {
+    YTEST_EXPECT_EQ(Ybuffer_append(buffer, line, 10), 10);
+  }
+  /* 1023 + 2047 + 4095 + 12 * 8191 bytes, keeping a spare byte per chunk */
+  YTEST_EXPECT_EQ(Ybuffer_iovec(buffer, iov, 16), 15);
+  Ybuffer_reset(buffer);
+  for (i = 0; i < 307; i++) {
+    YTEST_EXPECT_EQ(Ybuffer_append(buffer, line, 10), 10);
+  }
+  YTEST_EXPECT_EQ(Ybuffer_iovec(buffer, iov, 16), 2);
+  Ybuffer_fini(buffer);
+
+  /* Single append larger than chunk size */
+  buffer = Ybuffer_init_rope(64);
+  memset(line, 'x', sizeof(line));
+  YTEST_EXPECT_EQ(Ybuffer_append(buffer, "head", 4), 4);
+  for (i = 0; i < 10; i++) {
+    YTEST_EXPECT_EQ(Ybuffer_append(buffer, line, sizeof(line)), sizeof(line));
+  }
+  YTEST_EXPECT_EQ(Ybuffer_length(buffer), 4 + 10 * sizeof(line));
+  Ybuffer_fini(buffer);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ybuffer_format()
+{
+  static const struct {
+    double value;
+    const char *expected;
+  } doubles[] = {
+    { 0.0, "0" },
+    { 1.0, "1" },
+    { -1.5, "-1.5" },
+    { 0.1, "0.1" },
+    { 1234.5678, "1234.5678" },
+    { 1e21, "1e+21" },
+    { 1e20, "100000000000000000000" },
+    { 5e-7, "5e-7" },
+    { 0.000001, "0.000001" },
+    { 1.7976931348623157e308, "1.7976931348623157e+308" },
+    { 5e-324, "5e-324" },
+    { 0.3, "0.3" },
+    { 2.0 / 3.0, "0.6666666666666666" }
+  };
+  Ybuffer *buffer;
+  union {
+    double d;
+    uint64_t u;
+  } bits;
+  char *data;
+  char *end;
+  int len;
+  int i;
+
+  printf("Test yosal::ybuffer formatting\n");
+
+  buffer = Ybuffer_init(0);
+  YTEST_ASSERT_TRUE(buffer != NULL);
+  YTEST_EXPECT_EQ(Ybuffer_append_int64(buffer, 0), 1);
+  Ybuffer_append(buffer, " ", 1);
+  YTEST_EXPECT_EQ(Ybuffer_append_int64(buffer, INT64_MIN), 20);
+  Ybuffer_append(buffer, " ", 1);
+  YTEST_EXPECT_EQ(Ybuffer_append_uint64(buffer, UINT64_MAX), 20);
+  Ybuffer_append(buffer, " ", 1);
+  YTEST_EXPECT_EQ(Ybuffer_append_integer(buffer, -42), 3);
+  Ybuffer_append(buffer, " ", 1);
+  YTEST_EXPECT_EQ(Ybuffer_append_hex(buffer, "\x01\xab\xff", 3), 6);
+  Ybuffer_append(buffer, " ", 1);
+  YTEST_EXPECT_EQ(Ybuffer_append_escaped(buffer, "a\"b\\c\n\x01\xc3\xa9", -1), 17);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_STREQ(data, "0 -9223372036854775808 18446744073709551615 -42 01abff "
+                     "a\\\"b\\\\c\\n\\u0001\xc3\xa9");
+  Ymem_free(data);
+
+  for (i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++) {
+    buffer = Ybuffer_init_rope(64);
+    YTEST_EXPECT_EQ(Ybuffer_append_double(buffer, doubles[i].value),
+                    strlen(doubles[i].expected));
+    data = Ybuffer_detach(buffer, &len);
+    YTEST_EXPECT_STREQ(data, doubles[i].expected);
+    Ymem_free(data);
+  }
+
+  /* Any finite double reads back to itself */
+  for (i = 0; i < 10000; i++) {
+    bits.u = ((uint64_t) Yrandom() << 32) | Yrandom();
+    if ((bits.u & UINT64_C(0x7FF0000000000000)) == UINT64_C(0x7FF0000000000000)) {
+      continue;
+    }
+    buffer = Ybuffer_init(32);
+    len = Ybuffer_append_double(buffer, bits.d);
+    data = Ybuffer_detach(buffer, NULL);
+    if (len <= 0 || strtod(data, &end) != bits.d || *end != '\0') {
+      Ymem_free(data);
+      break;
+    }
+    Ymem_free(data);
+  }
+  YTEST_EXPECT_EQ(i, 10000);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ybuffer_reuse()
+{
+  YbufferStorage storage;
+  char small[16];
+  Ybuffer *buffer;
+  char *tail;
+  char *data;
+  int len;
+  int i;
+
+  printf("Test yosal::ybuffer reuse\n");
+
+  /* Stack buffer, spilling to heap once too small */
+  buffer = Ybuffer_init_storage(&storage, small, sizeof(small));
+  YTEST_ASSERT_TRUE(buffer != NULL);
+  YTEST_EXPECT_EQ(Ybuffer_append(buffer, "hello", 5), 5);
+  YTEST_EXPECT_STREQ(small, "hello");
+  Ybuffer_reset(buffer);
+  YTEST_EXPECT_EQ(Ybuffer_length(buffer), 0);
+  for (i = 0; i < 100; i++) {
+    YTEST_EXPECT_EQ(Ybuffer_append_int64(buffer, i % 10), 1);
+  }
+  YTEST_EXPECT_EQ(Ybuffer_length(buffer), 100);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_EQ(len, 100);
+  YTEST_EXPECT_MEMEQ(data, "0123456789", 10);
+  YTEST_EXPECT_TRUE(data != small);
+  Ymem_free(data);
+
+  /* Detached data never points to caller storage */
+  buffer = Ybuffer_init_storage(&storage, small, sizeof(small));
+  Ybuffer_append(buffer, "abc", 3);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_EQ(len, 3);
+  YTEST_EXPECT_TRUE(data != small);
+  YTEST_EXPECT_STREQ(data, "abc");
+  Ymem_free(data);
+
+  /* In-place writes */
+  buffer = Ybuffer_init(0);
+  YTEST_EXPECT_EQ(Ybuffer_reserve(buffer, 1000), YOSAL_OK);
+  tail = Ybuffer_tail(buffer, 8);
+  YTEST_ASSERT_TRUE(tail != NULL);
+  memcpy(tail, "abcdefgh", 8);
+  Ybuffer_commit(buffer, 3);
+  YTEST_EXPECT_EQ(Ybuffer_append(buffer, "z", 1), 1);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_STREQ(data, "abcz");
+  Ymem_free(data);
+
+  /* Rope reset keeps first chunk */
+  buffer = Ybuffer_init_rope(64);
+  for (i = 0; i < 100; i++) {
+    Ybuffer_append(buffer, "0123456789", 10);
+  }
+  YTEST_EXPECT_TRUE(Ybuffer_iovec(buffer, NULL, 0) > 1);
+  Ybuffer_reset(buffer);
+  YTEST_EXPECT_EQ(Ybuffer_length(buffer), 0);
+  YTEST_EXPECT_EQ(Ybuffer_append(buffer, "xyz", 3), 3);
+  YTEST_EXPECT_EQ(Ybuffer_iovec(buffer, NULL, 0), 1);
+  data = Ybuffer_detach(buffer, &len);
+  YTEST_EXPECT_STREQ(data, "xyz");
+  Ymem_free(data);
+
+  /* Stack storage without data buffer */
+  buffer = Ybuffer_init_storage(&storage, NULL, 0);
+  Ybuffer_append(buffer, "heap", 4);
+  Ybuffer_fini(buffer);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ychannel_digest()
+{
+  char hmac[YOSAL_DIGEST_SHA1_HEX];
+  char refhmac[YOSAL_DIGEST_SHA1_HEX];
+  const char *input = "The quick brown fox jumps over the lazy dog";
+  const char *chunk;
+  Ydigest *refdigest;
+  Ydigest *digest;
+  Ychannel *channel;
+  Ychannel *tee;
+  FILE *file;
+  size_t len;
+  int total;
+
+  printf("Test yosal::ychannel digest\n");
+
+  refdigest = Ydigest_create(YOSAL_DIGEST_MODE_SHA1);
+  Ydigest_update(refdigest, input, -1);
+  Ydigest_hex(refdigest, refhmac);
+  Ydigest_release(refdigest);
+
+  /* Input channel, consumed by small fetches */
+  digest = Ydigest_create(YOSAL_DIGEST_MODE_SHA1);
+  channel = YchannelInitByteArray(Ymem_strdup(input), strlen(input));
+  tee = YchannelInitDigest(channel, digest);
+  YTEST_EXPECT_TRUE(tee != NULL);
+  YTEST_EXPECT_TRUE(YchannelReadable(tee));
+  YchannelSetAutoRelease(tee, 1);
+
+  total = 0;
+  while (!YchannelEof(tee)) {
+    chunk = YchannelFetch(tee, 5, &len);
+    if (chunk == NULL || len <= 0) {
+      break;
+    }
+    YTEST_EXPECT_MEMEQ(chunk, input + total, len);
+    total += len;
+  }
+  YTEST_EXPECT_EQ(total, strlen(input));
+  YchannelRelease(tee);
+
+  Ydigest_hex(digest, hmac);
+  YTEST_EXPECT_STREQ(refhmac, hmac);
+  Ydigest_release(digest);
+
+  /* Output channel */
+  file = tmpfile();
+  YTEST_ASSERT_TRUE(file != NULL);
+  digest = Ydigest_create(YOSAL_DIGEST_MODE_SHA1);
+  channel = YchannelInitFile(file, 1);
+  tee = YchannelInitDigest(channel, digest);
+  YTEST_EXPECT_TRUE(YchannelWritable(tee));
+  YTEST_EXPECT_EQ(YchannelWrite(tee, input, 10), 10);
+  YTEST_EXPECT_EQ(YchannelWrite(tee, input + 10, strlen(input) - 10), strlen(input) - 10);
+  YTEST_EXPECT_EQ(YchannelFlush(tee), YOSAL_OK);
+  YchannelRelease(tee);
+  YchannelRelease(channel);
+  YTEST_EXPECT_EQ(ftell(file), strlen(input));
+  fclose(file);
+
+  Ydigest_hex(digest, hmac);
+  YTEST_EXPECT_STREQ(refhmac, hmac);
+  Ydigest_release(digest);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ychannel_memory()
+{
+  struct iovec iov[16];
+  Ychannel *channel;
+  char *data;
+  char line[16];
+  size_t len;
+  int i;
+  int niov;
+
+  printf("Test yosal::ychannel memory writer\n");
+
+  /* Small output, handed over as a single chunk */
+  channel = YchannelInitMemoryWriter();
+  YTEST_ASSERT_TRUE(channel != NULL);
+  YTEST_EXPECT_TRUE(YchannelWritable(channel));
+  YTEST_EXPECT_EQ(YchannelWrite(channel, "hello ", 6), 6);
+  YTEST_EXPECT_EQ(YchannelWrite(channel, "world", 5), 5);
+  YTEST_EXPECT_EQ(YchannelGetIovec(channel, iov, 16), 1);
+  data = YchannelDetach(channel, &len);
+  YTEST_EXPECT_EQ(len, 11);
+  YTEST_EXPECT_STREQ(data, "hello world");
+  Ymem_free(data);
+
+  /* Large output, spanning multiple chunks */
+  channel = YchannelInitMemoryWriter();
+  for (i = 0; i < 10000; i++) {
+    snprintf(line, sizeof(line), "%08d\n", i);
+    YTEST_EXPECT_EQ(YchannelWrite(channel, line, 9), 9);
+  }
+  niov = YchannelGetIovec(channel, iov, 16);
+  YTEST_EXPECT_TRUE(niov > 1 && niov <= 16);
+  len = 0;
+  for (i = 0; i < niov; i++) {
+    len += iov[i].iov_len;
+  }
+  YTEST_EXPECT_EQ(len, 90000);
+
+  data = YchannelDetach(channel, &len);
+  YTEST_EXPECT_EQ(len, 90000);
+  YTEST_EXPECT_MEMEQ(data, "00000000\n00000001\n", 18);
+  YTEST_EXPECT_MEMEQ(data + len - 9, "00009999\n", 9);
+  YTEST_EXPECT_EQ(strlen(data), 90000);
+  Ymem_free(data);
+
+  /* Only in-memory channels can be detached */
+  channel = YchannelInitByteArray(NULL, 0);
+  YTEST_EXPECT_ISNULL(YchannelDetach(channel, &len));
+  YTEST_EXPECT_EQ(YchannelGetIovec(channel, iov, 16), -1);
+  YchannelRelease(channel);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+/* Test engine returning input in small pieces */
+typedef struct {
+  const char *data;
+  int length;
+  int pos;
+  int step;
+} TestSlowEngine;
+
+static int
+testSlowRead(Ychannel *channel, void *readbuf, int nbytes)
+{
+  TestSlowEngine *engine = (TestSlowEngine*) YchannelGetEngine(channel);
+  int n = engine->length - engine->pos;
+
+  if (n <= 0) {
+    return -1;
+  }
+  if (n > engine->step) {
+    n = engine->step;
+  }
+  if (n > nbytes) {
+    n = nbytes;
+  }
+  memcpy(readbuf, engine->data + engine->pos, n);
+  engine->pos += n;
+
+  return n;
+}
+
+static int
+test_ychannel_peek()
+{
+  const char *input = "record-00|record-01|record-02|record-03|record-04|";
+  TestSlowEngine engine;
+  const char *chunk;
+  char data[16];
+  Ychannel *channel;
+  size_t len;
+  int i;
+
+  printf("Test yosal::ychannel peek\n");
+
+  engine.data = input;
+  engine.length = strlen(input);
+  engine.pos = 0;
+  engine.step = 7;
+  channel = YchannelInitGeneric("slow", &engine, testSlowRead, NULL, NULL, NULL);
+  YTEST_ASSERT_TRUE(channel != NULL);
+
+  for (i = 0; i < 5; i++) {
+    /* Records span over many reads from engine */
+    chunk = YchannelPeek(channel, 10, &len);
+    YTEST_EXPECT_EQ(len, 10);
+    snprintf(data, sizeof(data), "record-%02d|", i);
+    YTEST_EXPECT_MEMEQ(chunk, data, 10);
+    /* Peek doesn't consume */
+    YTEST_EXPECT_TRUE(YchannelPeek(channel, 10, &len) == chunk);
+    YTEST_EXPECT_TRUE(YchannelFetch(channel, 10, &len) == chunk);
+    YTEST_EXPECT_EQ(len, 10);
+
+    if (i == 2) {
+      /* Window starting in push-back buffer */
+      YTEST_EXPECT_EQ(YchannelPush(channel, "XY", 2), 2);
+      chunk = YchannelPeek(channel, 5, &len);
+      YTEST_EXPECT_EQ(len, 5);
+      YTEST_EXPECT_MEMEQ(chunk, "XYrec", 5);
+      YTEST_EXPECT_EQ(YchannelRead(channel, data, 2), 2);
+    }
+  }
+
+  YTEST_EXPECT_TRUE(YchannelPeek(channel, 10, &len) == NULL);
+  YTEST_EXPECT_EQ(len, 0);
+  YTEST_EXPECT_TRUE(YchannelEof(channel));
+  YchannelRelease(channel);
+
+  /* Static header windows are returned in place */
+  channel = YchannelInitByteArray(input, strlen(input));
+  chunk = YchannelPeek(channel, 100, &len);
+  YTEST_EXPECT_TRUE(chunk == input);
+  YTEST_EXPECT_EQ(len, strlen(input));
+  YchannelResetBuffer(channel);
+  YchannelRelease(channel);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ychannel_readline()
+{
+  const char *input = "first\nsecond line\n\nlast";
+  const char *expected[] = { "first\n", "second line\n", "\n", "last" };
+  TestSlowEngine engine;
+  const char *line;
+  char *longinput;
+  Ychannel *channel;
+  size_t len;
+  int i;
+
+  printf("Test yosal::ychannel readline\n");
+
+  engine.data = input;
+  engine.length = strlen(input);
+  engine.pos = 0;
+  engine.step = 3;
+  channel = YchannelInitGeneric("slow", &engine, testSlowRead, NULL, NULL, NULL);
+  YTEST_ASSERT_TRUE(channel != NULL);
+
+  for (i = 0; i < 4; i++) {
+    /* Lines are split over many reads from engine */
+    line = YchannelReadLine(channel, &len);
+    YTEST_ASSERT_TRUE(line != NULL);
+    YTEST_EXPECT_EQ(len, strlen(expected[i]));
+    YTEST_EXPECT_MEMEQ(line, expected[i], len);
+  }
+  YTEST_EXPECT_TRUE(YchannelReadLine(channel, &len) == NULL);
+  YTEST_EXPECT_EQ(len, 0);
+  YchannelRelease(channel);
+
+  /* Static header is scanned in place */
+  channel = YchannelInitByteArray("a,b,c", 5);
+  line = YchannelReadUntil(channel, ',', &len);
+  YTEST_EXPECT_EQ(len, 2);
+  YTEST_EXPECT_MEMEQ(line, "a,", 2);
+  YTEST_EXPECT_EQ(YchannelPush(channel, "x,", 2), 2);
+  line = YchannelReadUntil(channel, ',', &len);
+  YTEST_EXPECT_EQ(len, 2);
+  YTEST_EXPECT_MEMEQ(line, "x,", 2);
+  line = YchannelReadUntil(channel, ',', &len);
+  YTEST_EXPECT_MEMEQ(line, "b,", 2);
+  line = YchannelReadUntil(channel, ',', &len);
+  YTEST_EXPECT_EQ(len, 1);
+  YTEST_EXPECT_MEMEQ(line, "c", 1);
+  YchannelResetBuffer(channel);
+  YchannelRelease(channel);
+
+  /* Records longer than internal buffer are returned in pieces */
+  longinput = (char*) Ymem_malloc(40000);
+  YTEST_ASSERT_TRUE(longinput != NULL);
+  memset(longinput, 'z', 40000);
+  longinput[39999] = '\n';
+  engine.data = longinput;
+  engine.length = 40000;
+  engine.pos = 0;
+  engine.step = 5000;
+  channel = YchannelInitGeneric("slow", &engine, testSlowRead, NULL, NULL, NULL);
+  YTEST_ASSERT_TRUE(channel != NULL);
+  i = 0;
+  while ((line = YchannelReadLine(channel, &len)) != NULL) {
+    YTEST_EXPECT_TRUE(len > 0);
+    i += len;
+    if (line[len - 1] == '\n') {
+      break;
+    }
+  }
+  YTEST_EXPECT_EQ(i, 40000);
+  YchannelRelease(channel);
+  Ymem_free(longinput);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ychannel_push()
+{
+  const char *input = "0123456789abcdefghijklmnopqrstuvwxyz";
+  const char *chunk;
+  const char *rechunk;
+  char data[64];
+  Ychannel *channel;
+  FILE *file;
+  size_t len;
+  int i;
+
+  printf("Test yosal::ychannel push\n");
+
+  file = tmpfile();
+  YTEST_ASSERT_TRUE(file != NULL);
+  fwrite(input, 1, strlen(input), file);
+  rewind(file);
+
+  channel = YchannelInitFile(file, 0);
+  YTEST_ASSERT_TRUE(channel != NULL);
+
+  /* Pushing back what was just fetched rewinds the read buffer */
+  chunk = YchannelFetch(channel, 4, &len);
+  YTEST_EXPECT_EQ(len, 4);
+  YTEST_EXPECT_EQ(YchannelPush(channel, chunk, 4), 4);
+  rechunk = YchannelFetch(channel, 4, &len);
+  YTEST_EXPECT_EQ(len, 4);
+  YTEST_EXPECT_TRUE(rechunk == chunk);
+  YTEST_EXPECT_MEMEQ(rechunk, "0123", 4);
+
+  /* Pushing foreign data goes to push-back buffer */
+  YTEST_EXPECT_EQ(YchannelPush(channel, "XY", 2), 2);
+  YTEST_EXPECT_EQ(YchannelPush(channel, "W", 1), 1);
+  chunk = YchannelFetch(channel, 2, &len);
+  YTEST_EXPECT_EQ(len, 2);
+  YTEST_EXPECT_MEMEQ(chunk, "WX", 2);
+  /* ...and rewinds into it too */
+  YTEST_EXPECT_EQ(YchannelPush(channel, chunk + 1, 1), 1);
+  YTEST_EXPECT_EQ(YchannelRead(channel, data, 6), 6);
+  YTEST_EXPECT_MEMEQ(data, "XY4567", 6);
+
+  /* Many pushes, growing push-back buffer */
+  for (i = 0; i < 200; i++) {
+    data[0] = 'A' + (i % 26);
+    YTEST_EXPECT_EQ(YchannelPush(channel, data, 1), 1);
+  }
+  for (i = 199; i >= 0; i--) {
+    chunk = YchannelFetch(channel, 1, &len);
+    YTEST_EXPECT_EQ(len, 1);
+    YTEST_EXPECT_EQ(chunk[0], 'A' + (i % 26));
+  }
+  YTEST_EXPECT_EQ(YchannelRead(channel, data, 4), 4);
+  YTEST_EXPECT_MEMEQ(data, "89ab", 4);
+
+  YchannelSetAutoRelease(channel, 1);
+  YchannelRelease(channel);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ychannel_nonblocking()
+{
+  YchannelPollEntry entries[2];
+  Ychannel *reader;
+  Ychannel *writer;
+  const char *line;
+  char *buf;
+  int fds[2];
+  int total;
+  size_t len;
+  int n;
+
+  printf("Test yosal::ychannel non-blocking\n");
+
+  YTEST_ASSERT_EQ(pipe(fds), 0);
+  reader = YchannelInitFd(fds[0], 0);
+  writer = YchannelInitFd(fds[1], 1);
+  YTEST_ASSERT_TRUE(reader != NULL && writer != NULL);
+  YchannelSetAutoRelease(reader, 1);
+  YchannelSetAutoRelease(writer, 1);
+  YTEST_EXPECT_EQ(YchannelGetFd(reader), fds[0]);
+  YTEST_EXPECT_EQ(YchannelGetFd(writer), fds[1]);
+  YTEST_EXPECT_EQ(YchannelSetNonBlocking(reader, YTRUE), YOSAL_OK);
+  YTEST_EXPECT_EQ(YchannelSetNonBlocking(writer, YTRUE), YOSAL_OK);
+
+  /* Empty pipe would block, and is not at end of input */
+  YTEST_EXPECT_TRUE(YchannelFetch(reader, 10, &len) == NULL);
+  YTEST_EXPECT_TRUE(YchannelWouldBlock(reader));
+  YTEST_EXPECT_FALSE(YchannelEof(reader));
+
+  entries[0].channel = reader;
+  entries[0].events = YCHANNEL_POLLIN;
+  entries[1].channel = writer;
+  entries[1].events = YCHANNEL_POLLOUT;
+  YTEST_EXPECT_EQ(YchannelPoll(entries, 2, 0), 1);
+  YTEST_EXPECT_EQ(entries[0].revents, 0);
+  YTEST_EXPECT_EQ(entries[1].revents, YCHANNEL_POLLOUT);
+
+  /* Incomplete line stays buffered */
+  YTEST_EXPECT_EQ(YchannelWrite(writer, "abc", 3), 3);
+  YTEST_EXPECT_EQ(YchannelPoll(entries, 1, 1000), 1);
+  YTEST_EXPECT_EQ(entries[0].revents, YCHANNEL_POLLIN);
+  YTEST_EXPECT_TRUE(YchannelReadLine(reader, &len) == NULL);
+  YTEST_EXPECT_TRUE(YchannelWouldBlock(reader));
+  /* Buffered input is ready without polling descriptor */
+  YTEST_EXPECT_EQ(YchannelPoll(entries, 1, -1), 1);
+  YTEST_EXPECT_EQ(YchannelWrite(writer, "def\n", 4), 4);
+  line = YchannelReadLine(reader, &len);
+  YTEST_EXPECT_EQ(len, 7);
+  YTEST_EXPECT_MEMEQ(line, "abcdef\n", 7);
+
+  /* Writing more than pipe capacity makes partial progress */
+  buf = (char*) Ymem_malloc(1024 * 1024);
+  YTEST_ASSERT_TRUE(buf != NULL);
+  memset(buf, 'x', 1024 * 1024);
+  total = YchannelWrite(writer, buf, 1024 * 1024);
+  YTEST_EXPECT_TRUE(total > 0 && total < 1024 * 1024);
+  YTEST_EXPECT_TRUE(YchannelWouldBlock(writer));
+  YTEST_EXPECT_EQ(YchannelPoll(entries + 1, 1, 0), 0);
+
+  n = YchannelRead(reader, buf, 1024 * 1024);
+  YTEST_EXPECT_EQ(n, total);
+  YTEST_EXPECT_TRUE(YchannelWouldBlock(reader));
+  YTEST_EXPECT_FALSE(YchannelEof(reader));
+  Ymem_free(buf);
+
+  /* Hang up is readable, and then reported as end of input */
+  YchannelRelease(writer);
+  /* Hang up alone doesn't count for an entry only waiting for output */
+  entries[1].channel = YchannelInitFd(fds[0], 1);
+  YTEST_ASSERT_TRUE(entries[1].channel != NULL);
+  YTEST_EXPECT_EQ(YchannelPoll(entries + 1, 1, 0), 0);
+  YTEST_EXPECT_EQ(entries[1].revents, 0);
+  YchannelRelease(entries[1].channel);
+  YTEST_EXPECT_EQ(YchannelPoll(entries, 1, 1000), 1);
+  YTEST_EXPECT_EQ(entries[0].revents, YCHANNEL_POLLIN);
+  YTEST_EXPECT_TRUE(YchannelFetch(reader, 10, &len) == NULL);
+  YTEST_EXPECT_FALSE(YchannelWouldBlock(reader));
+  YTEST_EXPECT_TRUE(YchannelEof(reader));
+  YchannelRelease(reader);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+#define TEST_SHARED_THREADS 8
+#define TEST_SHARED_RECORDS 2000
+
+typedef struct {
+  Ychannel *channel;
+  int id;
+} TestSharedWriter;
+
+static void*
+testSharedWriter(void *arg)
+{
+  TestSharedWriter *writer = (TestSharedWriter*) arg;
+  char record[32];
+  int len;
+  int i;
+
+  for (i = 0; i < TEST_SHARED_RECORDS; i++) {
+    len = snprintf(record, sizeof(record), "t%d-%06d\n", writer->id, i);
+    if (YchannelWrite(writer->channel, record, len) != len) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+typedef struct {
+  Ychannel *reader;
+  char *data;
+  int size;
+  int length;
+} TestSharedPipe;
+
+/* Read from a non-blocking pipe until end of input */
+static void*
+testSharedPipeReader(void *arg)
+{
+  TestSharedPipe *t = (TestSharedPipe*) arg;
+  YchannelPollEntry entry;
+  int n;
+
+  entry.channel = t->reader;
+  entry.events = YCHANNEL_POLLIN;
+  while (t->length < t->size) {
+    n = (int) YchannelRead(t->reader, t->data + t->length, t->size - t->length);
+    t->length += n;
+    if (n == 0) {
+      if (!YchannelWouldBlock(t->reader)) {
+        break;
+      }
+      YchannelPoll(&entry, 1, -1);
+    }
+  }
+
+  return NULL;
+}
+
+static int
+test_ychannel_shared()
+{
+  pthread_t threads[TEST_SHARED_THREADS];
+  TestSharedWriter writers[TEST_SHARED_THREADS];
+  int next[TEST_SHARED_THREADS];
+  TestSharedPipe piped;
+  YchannelStats stats;
+  pthread_t tid;
+  Ychannel *memory;
+  Ychannel *shared;
+  Ychannel *reader;
+  Ychannel *writer;
+  const char *line;
+  char *large;
+  char *data;
+  int count;
+  size_t len;
+  int id;
+  int i;
+
+  printf("Test yosal::ychannel shared\n");
+
+  memory = YchannelInitMemoryWriter();
+  YTEST_ASSERT_TRUE(memory != NULL);
+  shared = YchannelInitShared(memory);
+  YTEST_ASSERT_TRUE(shared != NULL);
+
+  /* Counters are only available on the underlying channel */
+  YTEST_EXPECT_EQ(YchannelEnableStats(shared, YTRUE), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(YchannelEnableStats(memory, YTRUE), YOSAL_OK);
+
+  for (i = 0; i < TEST_SHARED_THREADS; i++) {
+    writers[i].channel = shared;
+    writers[i].id = i;
+    YTEST_ASSERT_EQ(pthread_create(&threads[i], NULL, testSharedWriter, &writers[i]), 0);
+  }
+  for (i = 0; i < TEST_SHARED_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  YTEST_EXPECT_EQ(YchannelFlush(shared), YOSAL_OK);
+  YchannelRelease(shared);
+  YTEST_EXPECT_EQ(YchannelGetStats(memory, &stats), YOSAL_OK);
+  YTEST_EXPECT_EQ(stats.written, TEST_SHARED_THREADS * TEST_SHARED_RECORDS * 10);
+
+  /* Every record is intact, and in order for each writer */
+  data = YchannelDetach(memory, &len);
+  YTEST_ASSERT_TRUE(data != NULL);
+  YTEST_EXPECT_EQ(len, TEST_SHARED_THREADS * TEST_SHARED_RECORDS * 10);
+  memset(next, 0, sizeof(next));
+  count = 0;
+  reader = YchannelInitByteArray(data, len);
+  while ((line = YchannelReadLine(reader, &len)) != NULL) {
+    YTEST_EXPECT_EQ(len, 10);
+    YTEST_EXPECT_TRUE(line[0] == 't' && line[2] == '-' && line[9] == '\n');
+    id = line[1] - '0';
+    YTEST_ASSERT_TRUE(id >= 0 && id < TEST_SHARED_THREADS);
+    YTEST_EXPECT_EQ(atoi(line + 3), next[id]);
+    next[id]++;
+    count++;
+  }
+  YTEST_EXPECT_EQ(count, TEST_SHARED_THREADS * TEST_SHARED_RECORDS);
+  YchannelResetBuffer(reader);
+  YchannelRelease(reader);
+  Ymem_free(data);
+
+  /* Bytes a non-blocking channel doesn't take are written later */
+  YTEST_ASSERT_EQ(YchannelInitPipe(16, YTRUE, &reader, &writer), YOSAL_OK);
+  shared = YchannelInitShared(writer);
+  YTEST_ASSERT_TRUE(shared != NULL);
+  YchannelSetAutoRelease(shared, 1);
+  YTEST_EXPECT_EQ(YchannelWrite(shared, "0123456789", 10), 10);
+  YTEST_EXPECT_EQ(YchannelWrite(shared, "abcdefghij", 10), 10);
+  piped.data = (char*) Ymem_malloc(200000);
+  YTEST_ASSERT_TRUE(piped.data != NULL);
+  YTEST_EXPECT_EQ(YchannelRead(reader, piped.data, 100), 16);
+  YTEST_EXPECT_MEMEQ(piped.data, "0123456789abcdef", 16);
+  YTEST_EXPECT_EQ(YchannelWrite(shared, "klmno", 5), 5);
+  YTEST_EXPECT_EQ(YchannelRead(reader, piped.data, 100), 9);
+  YTEST_EXPECT_MEMEQ(piped.data, "ghijklmno", 9);
+
+  /* Flush and release wait until everything is written */
+  large = (char*) Ymem_malloc(100000);
+  YTEST_ASSERT_TRUE(large != NULL);
+  for (i = 0; i < 100000; i++) {
+    large[i] = (char) (i * 13);
+  }
+  piped.reader = reader;
+  piped.size = 200000;
+  piped.length = 0;
+  YTEST_ASSERT_EQ(pthread_create(&tid, NULL, testSharedPipeReader, &piped), 0);
+  YTEST_EXPECT_EQ(YchannelWrite(shared, "pqrst", 5), 5);
+  YTEST_EXPECT_EQ(YchannelWrite(shared, large, 100000), 100000);
+  YTEST_EXPECT_EQ(YchannelFlush(shared), YOSAL_OK);
+  YTEST_EXPECT_EQ(YchannelWrite(shared, "uvwxyz", 6), 6);
+  YchannelRelease(shared);
+  pthread_join(tid, NULL);
+  YTEST_EXPECT_EQ(piped.length, 100011);
+  YTEST_EXPECT_MEMEQ(piped.data, "pqrst", 5);
+  YTEST_EXPECT_MEMEQ(piped.data + 5, large, 100000);
+  YTEST_EXPECT_MEMEQ(piped.data + 100005, "uvwxyz", 6);
+  YchannelRelease(reader);
+  Ymem_free(large);
+  Ymem_free(piped.data);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+#define TEST_PIPE_BYTES (1024 * 1024)
+
+/* Byte at a given offset of piped stream */
+#define TEST_PIPE_BYTE(i) ((char) (((i) * 7 + ((i) >> 10)) & 0xff))
+
+static void*
+testPipeWriter(void *arg)
+{
+  Ychannel *writer = (Ychannel*) arg;
+  char buf[5000];
+  int pos = 0;
+  int len;
+  int i;
+
+  /* Chunks of varying size, both smaller and larger than ring */
+  for (len = 1; pos < TEST_PIPE_BYTES; len = (len * 3 + 1) % sizeof(buf)) {
+    if (len > TEST_PIPE_BYTES - pos) {
+      len = TEST_PIPE_BYTES - pos;
+    }
+    for (i = 0; i < len; i++) {
+      buf[i] = TEST_PIPE_BYTE(pos + i);
+    }
+    if (YchannelWrite(writer, buf, len) != len) {
+      break;
+    }
+    pos += len;
+  }
+  YchannelRelease(writer);
+
+  return NULL;
+}
+
+/* Write a single byte once reader is likely polling */
+static void*
+testPipeLateWriter(void *arg)
+{
+  Ychannel *writer = (Ychannel*) arg;
+
+  usleep(20000);
+  YchannelWrite(writer, "z", 1);
+
+  return NULL;
+}
+
+static int
+test_ychannel_pipe()
+{
+  pthread_t tid;
+  YchannelPollEntry entry;
+  Ychannel *reader;
+  Ychannel *writer;
+  char buf[3000];
+  int errors;
+  int pos;
+  int n;
+  int i;
+
+  printf("Test yosal::ychannel pipe\n");
+
+  /* Reader gets whole stream, then end of input */
+  YTEST_ASSERT_EQ(YchannelInitPipe(4096, YFALSE, &reader, &writer), YOSAL_OK);
+  YTEST_ASSERT_EQ(pthread_create(&tid, NULL, testPipeWriter, writer), 0);
+  pos = 0;
+  errors = 0;
+  while ((n = (int) YchannelRead(reader, buf, 1 + pos % sizeof(buf))) > 0) {
+    for (i = 0; i < n; i++) {
+      if (buf[i] != TEST_PIPE_BYTE(pos + i)) {
+        errors++;
+      }
+    }
+    pos += n;
+  }
+  pthread_join(tid, NULL);
+  YTEST_EXPECT_EQ(pos, TEST_PIPE_BYTES);
+  YTEST_EXPECT_EQ(errors, 0);
+  YTEST_EXPECT_EQ(YchannelRead(reader, buf, sizeof(buf)), 0);
+  YTEST_EXPECT_TRUE(YchannelEof(reader));
+  YchannelRelease(reader);
+
+  /* Remaining data then end of input, once writer is released */
+  YTEST_ASSERT_EQ(YchannelInitPipe(16, YTRUE, &reader, &writer), YOSAL_OK);
+  YTEST_EXPECT_EQ(YchannelWrite(writer, "abc", 3), 3);
+  YchannelRelease(writer);
+  YTEST_EXPECT_TRUE(!YchannelEof(reader));
+  YTEST_EXPECT_EQ(YchannelRead(reader, buf, 3), 3);
+  YTEST_EXPECT_MEMEQ(buf, "abc", 3);
+  YTEST_EXPECT_EQ(YchannelRead(reader, buf, sizeof(buf)), 0);
+  YTEST_EXPECT_TRUE(YchannelEof(reader));
+  YTEST_EXPECT_TRUE(!YchannelWouldBlock(reader));
+  entry.channel = reader;
+  entry.events = YCHANNEL_POLLIN;
+  YTEST_EXPECT_EQ(YchannelPoll(&entry, 1, 0), 1);
+  YTEST_EXPECT_EQ(entry.revents, YCHANNEL_POLLIN);
+  YchannelRelease(reader);
+
+  /* Non-blocking ends return what they can */
+  YTEST_ASSERT_EQ(YchannelInitPipe(16, YTRUE, &reader, &writer), YOSAL_OK);
+  YTEST_EXPECT_EQ(YchannelRead(reader, buf, sizeof(buf)), 0);
+  YTEST_EXPECT_TRUE(YchannelWouldBlock(reader));
+  memset(buf, 'x', sizeof(buf));
+  YTEST_EXPECT_EQ(YchannelWrite(writer, buf, 100), 16);
+  YTEST_EXPECT_TRUE(YchannelWouldBlock(writer));
+  YTEST_EXPECT_EQ(YchannelRead(reader, buf, 10), 10);
+  YTEST_EXPECT_EQ(YchannelWrite(writer, buf, 100), 10);
+
+  /* Polling waits until the other end makes progress */
+  entry.channel = writer;
+  entry.events = YCHANNEL_POLLOUT;
+  YTEST_EXPECT_EQ(YchannelPoll(&entry, 1, 50), 0);
+  YTEST_EXPECT_EQ(entry.revents, 0);
+  YTEST_EXPECT_EQ(YchannelRead(reader, buf, 16), 16);
+  YTEST_EXPECT_EQ(YchannelPoll(&entry, 1, 50), 1);
+  YTEST_EXPECT_EQ(entry.revents, YCHANNEL_POLLOUT);
+  entry.channel = reader;
+  entry.events = YCHANNEL_POLLIN;
+  YTEST_EXPECT_EQ(YchannelPoll(&entry, 1, 50), 0);
+  YTEST_EXPECT_EQ(entry.revents, 0);
+  YTEST_ASSERT_EQ(pthread_create(&tid, NULL, testPipeLateWriter, writer), 0);
+  YTEST_EXPECT_EQ(YchannelPoll(&entry, 1, -1), 1);
+  YTEST_EXPECT_EQ(entry.revents, YCHANNEL_POLLIN);
+  pthread_join(tid, NULL);
+  YTEST_EXPECT_EQ(YchannelRead(reader, buf, 16), 1);
+  YTEST_EXPECT_EQ(YchannelPoll(&entry, 1, 0), 0);
+
+  /* Writing fails once reader is gone */
+  YchannelRelease(reader);
+  YTEST_EXPECT_EQ(YchannelWrite(writer, buf, 100), 0);
+  YTEST_EXPECT_TRUE(!YchannelWouldBlock(writer));
+  YchannelRelease(writer);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+typedef struct {
+  uint64_t length;
+  uint64_t pos;
+} TestVirtualEngine;
+
+/* Engine producing undefined content, to cover large offsets quickly */
+static int
+testVirtualRead(Ychannel *channel, void *readbuf, int nbytes)
+{
+  TestVirtualEngine *engine = (TestVirtualEngine*) YchannelGetEngine(channel);
+  uint64_t n = engine->length - engine->pos;
+
+  if (n <= 0) {
+    return -1;
+  }
+  if (n > nbytes) {
+    n = nbytes;
+  }
+  engine->pos += n;
+
+  return (int) n;
+}
+
+static int
+test_ychannel_large()
+{
+  const uint64_t giga = 1024 * 1024 * 1024;
+  TestVirtualEngine engine;
+  Ychannel *channel;
+
+  printf("Test yosal::ychannel large offsets\n");
+
+  engine.length = 6 * giga;
+  engine.pos = 0;
+  channel = YchannelInitGeneric("virtual", &engine, testVirtualRead, NULL, NULL, NULL);
+  YTEST_ASSERT_TRUE(channel != NULL);
+
+  YchannelSetLength(channel, 5 * giga + 3);
+  YTEST_EXPECT_TRUE(YchannelGetLength(channel) == 5 * giga + 3);
+
+  /* Skip beyond 32 bits offsets, then get clamped to channel length */
+  YTEST_EXPECT_TRUE(YchannelSkip(channel, 4 * giga + 1) == 4 * giga + 1);
+  YTEST_EXPECT_TRUE(YchannelSkip(channel, 2 * giga) == giga + 2);
+  YTEST_EXPECT_TRUE(YchannelSkip(channel, 1) == 0);
+  YchannelRelease(channel);
+
+  /* Without length, skip stops at end of input */
+  engine.pos = 0;
+  channel = YchannelInitGeneric("virtual", &engine, testVirtualRead, NULL, NULL, NULL);
+  YTEST_ASSERT_TRUE(channel != NULL);
+  YTEST_EXPECT_TRUE(YchannelSkip(channel, 8 * giga) == 6 * giga);
+  YTEST_EXPECT_TRUE(YchannelEof(channel));
+  YchannelRelease(channel);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+static int
+test_ychannel_stats()
+{
+  const char *input = "0123456789abcdefghij";
+  YchannelStats before;
+  YchannelStats after;
+  YchannelStats stats;
+  TestSlowEngine engine;
+  Ychannel *channel;
+  char data[16];
+  size_t len;
+
+  printf("Test yosal::ychannel stats\n");
+
+  engine.data = input;
+  engine.length = strlen(input);
+  engine.pos = 0;
+  engine.step = 8;
+  channel = YchannelInitGeneric("slow", &engine, testSlowRead, NULL, NULL, NULL);
+  YTEST_ASSERT_TRUE(channel != NULL);
+  YTEST_EXPECT_EQ(YchannelGetStats(channel, &stats), YOSAL_ERROR);
+  YTEST_EXPECT_EQ(YchannelEnableStats(channel, YTRUE), YOSAL_OK);
+
+  /* Served from read buffer without copy */
+  YTEST_EXPECT_TRUE(YchannelFetch(channel, 4, &len) != NULL);
+  /* 4 bytes copied from read buffer, then 2 read directly */
+  YTEST_EXPECT_EQ(YchannelRead(channel, data, 6), 6);
+  /* Push-back of data not coming from channel needs a buffer */
+  YTEST_EXPECT_EQ(YchannelPush(channel, "XY", 2), 2);
+  YTEST_EXPECT_TRUE(YchannelSkip(channel, 100) == 12);
+
+  YTEST_EXPECT_EQ(YchannelGetStats(channel, &stats), YOSAL_OK);
+  YTEST_EXPECT_TRUE(stats.fetched == 22);
+  YTEST_EXPECT_TRUE(stats.zerocopy == 4);
+  YTEST_EXPECT_TRUE(stats.copied == 6);
+  YTEST_EXPECT_TRUE(stats.direct == 2);
+  YTEST_EXPECT_TRUE(stats.pushallocs == 1);
+  YTEST_EXPECT_TRUE(stats.readcalls == 5);
+  YTEST_EXPECT_TRUE(stats.readtime >= 0);
+  YTEST_EXPECT_TRUE(stats.written == 0 && stats.writecalls == 0);
+
+  /* Aggregated into global counters on release */
+  YchannelGetGlobalStats(&before);
+  YchannelRelease(channel);
+  YchannelGetGlobalStats(&after);
+  YTEST_EXPECT_TRUE(after.fetched - before.fetched == 22);
+  YTEST_EXPECT_TRUE(after.readcalls - before.readcalls == 5);
+
+  channel = YchannelInitMemoryWriter();
+  YTEST_ASSERT_TRUE(channel != NULL);
+  YchannelEnableStats(channel, YTRUE);
+  YTEST_EXPECT_EQ(YchannelWrite(channel, "hello ", 6), 6);
+  YTEST_EXPECT_EQ(YchannelWrite(channel, "world", 5), 5);
+  YchannelGetStats(channel, &stats);
+  YTEST_EXPECT_TRUE(stats.written == 11);
+  YTEST_EXPECT_TRUE(stats.writecalls == 2);
+  YchannelRelease(channel);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
+/* Minimal JNI environment, emulating java.nio objects without a JVM */
+#define TEST_JNI_CLASS   1
+#define TEST_JNI_BUFFER  2
+#define TEST_JNI_CHANNEL 3
+
+typedef struct {
+  int kind;
+  char *address;
+  jlong capacity;
+  jint position;
+  jint limit;
+} TestJniBuffer;
+
+typedef struct {
+  int kind;
+  const char *data;
+  int length;
+  int pos;
+  int step;
+  char out[64];
+  int outlength;
+  int closed;
+} TestJniChannel;
+
+static int gTestJniClass = TEST_JNI_CLASS;
+static int gTestJniLocalBuffers = 0;
+static char gTestJniMethods[5];
+
+static jclass
+testJniFindClass(JNIEnv *env, const char *name)
+{
+  return (jclass) &gTestJniClass;
+}
+
+static jmethodID
+testJniGetMethodID(JNIEnv *env, jclass clazz, const char *name, const char *sig)
+{
+  static const char *names[] = { "read", "write", "close", "position", "limit" };
+  int i;
+
+  for (i = 0; i < 5; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      return (jmethodID) &gTestJniMethods[i];
+    }
+  }
+
+  return NULL;
+}
+
+static jobject
+testJniNewGlobalRef(JNIEnv *env, jobject obj)
+{
+  return obj;
+}
+
+static void
+testJniDeleteRef(JNIEnv *env, jobject obj)
+{
+  if (obj != NULL && *((int*) obj) == TEST_JNI_BUFFER) {
+    gTestJniLocalBuffers--;
+    free(obj);
+  }
+}
+
+static jboolean
+testJniExceptionCheck(JNIEnv *env)
+{
+  return JNI_FALSE;
+}
+
+static void
+testJniExceptionClear(JNIEnv *env)
+{
+}
+
+static jobject
+testJniNewDirectByteBuffer(JNIEnv *env, void *address, jlong capacity)
+{
+  TestJniBuffer *buffer = (TestJniBuffer*) malloc(sizeof(TestJniBuffer));
+
+  buffer->kind = TEST_JNI_BUFFER;
+  buffer->address = (char*) address;
+  buffer->capacity = capacity;
+  buffer->position = 0;
+  buffer->limit = (jint) capacity;
+  gTestJniLocalBuffers++;
+
+  return (jobject) buffer;
+}
+
+static void*
+testJniGetDirectBufferAddress(JNIEnv *env, jobject obj)
+{
+  return ((TestJniBuffer*) obj)->address;
+}
+
+static jlong
+testJniGetDirectBufferCapacity(JNIEnv *env, jobject obj)
+{
+  return ((TestJniBuffer*) obj)->capacity;
+}
+
+static jint
+testJniCallIntMethod(JNIEnv *env, jobject obj, jmethodID methodID, ...)
+{
+  TestJniChannel *channel = (TestJniChannel*) obj;
+  TestJniBuffer *buffer;
+  va_list args;
+  int n = -1;
+
+  if (methodID == (jmethodID) &gTestJniMethods[3]) {
+    return ((TestJniBuffer*) obj)->position;
+  }
+  if (methodID == (jmethodID) &gTestJniMethods[4]) {
+    return ((TestJniBuffer*) obj)->limit;
+  }
+
+  va_start(args, methodID);
+  buffer = (TestJniBuffer*) va_arg(args, jobject);
+  va_end(args);
+
+  if (methodID == (jmethodID) &gTestJniMethods[0]) {
+    n = channel->length - channel->pos;
+    if (n <= 0) {
+      return -1;
+    }
+    if (n > buffer->capacity) {
+      n = (int) buffer->capacity;
+    }
+    memcpy(buffer->address, channel->data + channel->pos, n);
+    channel->pos += n;
+  } else if (methodID == (jmethodID) &gTestJniMethods[1]) {
+    /* Accept partial writes */
+    n = (int) buffer->capacity;
+    if (n > channel->step) {
+      n = channel->step;
+    }
+    if (n > sizeof(channel->out) - channel->outlength) {
+      n = sizeof(channel->out) - channel->outlength;
+    }
+    memcpy(channel->out + channel->outlength, buffer->address, n);
+    channel->outlength += n;
+  }
+
+  return n;
+}
+
+static void
+testJniCallVoidMethod(JNIEnv *env, jobject obj, jmethodID methodID, ...)
+{
+  if (methodID == (jmethodID) &gTestJniMethods[2]) {
+    ((TestJniChannel*) obj)->closed = 1;
+  }
+}
+
+static int
+test_ychannel_javanio()
+{
+  const char *input = "direct buffers avoid Java arrays";
+  struct JNINativeInterface iface;
+  JNIEnv env = &iface;
+  TestJniChannel jchannel;
+  TestJniBuffer jbuffer;
+  Ychannel *channel;
+  const char *chunk;
+  char data[64];
+  size_t len;
+
+  printf("Test yosal::ychannel java nio\n");
+
+  memset(&iface, 0, sizeof(iface));
+  iface.FindClass = testJniFindClass;
+  iface.GetMethodID = testJniGetMethodID;
+  iface.NewGlobalRef = testJniNewGlobalRef;
+  iface.DeleteGlobalRef = testJniDeleteRef;
+  iface.DeleteLocalRef = testJniDeleteRef;
+  iface.ExceptionCheck = testJniExceptionCheck;
+  iface.ExceptionClear = testJniExceptionClear;
+  iface.NewDirectByteBuffer = testJniNewDirectByteBuffer;
+  iface.GetDirectBufferAddress = testJniGetDirectBufferAddress;
+  iface.GetDirectBufferCapacity = testJniGetDirectBufferCapacity;
+  iface.CallIntMethod = testJniCallIntMethod;
+  iface.CallVoidMethod = testJniCallVoidMethod;
+
+  /* Remaining of direct ByteBuffer is read in place */
+  jbuffer.kind = TEST_JNI_BUFFER + 100;
+  jbuffer.address = (char*) input;
+  jbuffer.capacity = strlen(input);
+  jbuffer.position = 7;
+  jbuffer.limit = 14;
+  channel = YchannelInitJavaByteBuffer(&env, (jobject) &jbuffer);
+  YTEST_ASSERT_TRUE(channel != NULL);
+  chunk = YchannelFetch(channel, 100, &len);
+  YTEST_EXPECT_TRUE(chunk == input + 7);
+  YTEST_EXPECT_EQ(len, 7);
+  YTEST_EXPECT_TRUE(YchannelFetch(channel, 100, &len) == NULL);
+  YchannelRelease(channel);
+
+  /* ReadableByteChannel fills native memory */
+  memset(&jchannel, 0, sizeof(jchannel));
+  jchannel.kind = TEST_JNI_CHANNEL;
+  jchannel.data = input;
+  jchannel.length = strlen(input);
+  channel = YchannelInitJavaByteChannel(&env, (jobject) &jchannel, 0);
+  YTEST_ASSERT_TRUE(channel != NULL);
+  YchannelSetAutoRelease(channel, 1);
+  YTEST_EXPECT_EQ(YchannelRead(channel, data, sizeof(data)), strlen(input));
+  YTEST_EXPECT_MEMEQ(data, input, strlen(input));
+  YchannelRelease(channel);
+  YTEST_EXPECT_EQ(jchannel.closed, 1);
+
+  /* WritableByteChannel, with partial writes */
+  memset(&jchannel, 0, sizeof(jchannel));
+  jchannel.kind = TEST_JNI_CHANNEL;
+  jchannel.step = 5;
+  channel = YchannelInitJavaByteChannel(&env, (jobject) &jchannel, 1);
+  YTEST_ASSERT_TRUE(channel != NULL);
+  YTEST_EXPECT_EQ(YchannelWrite(channel, input, strlen(input)), strlen(input));
+  YTEST_EXPECT_EQ(jchannel.outlength, strlen(input));
+  YTEST_EXPECT_MEMEQ(jchannel.out, input, strlen(input));
+  YchannelRelease(channel);
+  YTEST_EXPECT_EQ(jchannel.closed, 0);
+
+  YTEST_EXPECT_EQ(gTestJniLocalBuffers, 0);
+
+  printf("Test passed\n");
+
+  return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -345,6 +3036,8 @@ main(int argc, char *argv[])
     return 0;
   }
 
+  /* Test allocator backend, first of all */
+  test_ymem_backend();
   /* Test hashmap */
   test_hashmap();
   /* Test digest */
@@ -359,6 +3052,58 @@ main(int argc, char *argv[])
   test_yobject();
   /* Test random */
   test_yrandom();
+  /* Test allocator */
+  test_ymem();
+  /* Test memory accounting */
+  test_ymem_stats();
+  /* Test large allocations */
+  test_ymem_large();
+  /* Test arena */
+  test_yarena();
+  /* Test object pool */
+  test_ypool();
+  /* Test queue */
+  test_yqueue();
+  /* Test priority queue */
+  test_yheap();
+  /* Test timer wheel */
+  test_ytimerwheel();
+  /* Test concurrent queue */
+  test_yqueue_concurrent();
+  /* Test single producer, single consumer rings */
+  test_yring();
+  /* Test thread pool */
+  test_ythreadpool();
+  /* Test sorting */
+  test_ysort();
+  /* Test dynamic buffers */
+  test_ybuffer();
+  /* Test buffer formatting */
+  test_ybuffer_format();
+  /* Test buffer reuse */
+  test_ybuffer_reuse();
+  /* Test digest channel */
+  test_ychannel_digest();
+  /* Test in-memory channel */
+  test_ychannel_memory();
+  /* Test push-back */
+  test_ychannel_push();
+  /* Test peek */
+  test_ychannel_peek();
+  /* Test record scanning */
+  test_ychannel_readline();
+  /* Test non-blocking channels */
+  test_ychannel_nonblocking();
+  /* Test channel shared by many threads */
+  test_ychannel_shared();
+  /* Test in-process pipe */
+  test_ychannel_pipe();
+  /* Test 64 bits lengths and offsets */
+  test_ychannel_large();
+  /* Test I/O counters */
+  test_ychannel_stats();
+  /* Test Java NIO engines */
+  test_ychannel_javanio();
 
   fclose(stdin);
   fclose(stdout);